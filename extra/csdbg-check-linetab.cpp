@@ -0,0 +1,427 @@
+#include "../include/linetab.hpp"
+#include "../include/string.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file extra/csdbg-check-linetab.cpp
+
+	@brief Line number table check (csdbg-check-linetab)
+
+	Compares the source file and line that csdbg::linetab resolves with the line
+	number table of a module, as decoded by binutils readelf (that must be in the
+	PATH). By default the module is this program, that is built with debug
+	information by 'make check'. The first and the last address of each row are
+	looked up, along with the end address of each sequence, that must be left
+	unresolved unless another sequence spans it. Only the base name of the
+	source files is compared. The sequences outside the .text section (of
+	discarded code) and the addresses where sequences overlap are skipped. Any
+	difference is reported and the program fails. This program must not be
+	compiled with -finstrument-functions
+*/
+
+using namespace csdbg;
+
+/**
+	@brief An address range
+*/
+struct range {
+	mem_addr_t start;									/**< @brief Range start address */
+
+	mem_addr_t end;										/**< @brief Range end address (exclusive) */
+};
+
+
+/* Check state */
+
+static const i8 *g_path = NULL;
+
+static range g_text = { 0, 0 };
+
+static range *g_seqs = NULL;
+
+static u32 g_seq_cnt = 0;
+
+static u32 g_seq_cap = 0;
+
+static range *g_overlaps = NULL;
+
+static u32 g_overlap_cnt = 0;
+
+static u32 g_overlap_cap = 0;
+
+static u64 g_rows = 0;
+
+static u64 g_checked = 0;
+
+static u64 g_skipped = 0;
+
+static u64 g_diffs = 0;
+
+
+/**
+ * @brief Show the usage message and exit
+ *
+ * @param[in] name the program name
+ */
+static void usage(const i8 *name)
+{
+	std::cerr << "libcsdbg line number table check\r\n"
+						<< "Usage: " << name << " [-h] [file]\r\n\r\n"
+						<< "'" << name << "' compares the source file and line "
+						<< "that csdbg::linetab resolves\r\nfor the rows of the line "
+						<< "number table of file (this program by default) with\r\n"
+						<< "the output of readelf\r\n\r\n"
+						<< "-h  Show this message\r\n";
+
+	exit(EXIT_FAILURE);
+}
+
+
+/**
+ * @brief Append an address range to an array
+ *
+ * @param[in,out] arr the array
+ *
+ * @param[in,out] cnt the range count
+ *
+ * @param[in,out] cap the array capacity
+ *
+ * @param[in] start the range start address
+ *
+ * @param[in] end the range end address
+ *
+ * @throws std::bad_alloc
+ */
+static void append(range *&arr, u32 &cnt, u32 &cap, mem_addr_t start,
+									 mem_addr_t end)
+{
+	if ( unlikely(cnt == cap) ) {
+		u32 sz = (cap == 0) ? 256 : cap * 2;
+		range *tmp = new range[sz];
+		if ( likely(cnt > 0) )
+			memcpy(tmp, arr, cnt * sizeof(range));
+
+		delete[] arr;
+		arr = tmp;
+		cap = sz;
+	}
+
+	arr[cnt].start = start;
+	arr[cnt++].end = end;
+}
+
+
+/**
+ * @brief Compare two address ranges by start address (for qsort)
+ *
+ * @param[in] a the first range
+ *
+ * @param[in] b the second range
+ *
+ * @returns -1, 0 or 1 if a starts before, at or after b
+ */
+static i32 compare(const void *a, const void *b)
+{
+	const range *r1 = static_cast<const range*> (a);
+	const range *r2 = static_cast<const range*> (b);
+	if (r1->start != r2->start)
+		return (r1->start < r2->start) ? -1 : 1;
+
+	return 0;
+}
+
+
+/**
+ * @brief Check if an address is in any of the ranges of an array
+ *
+ * @param[in] arr the array
+ *
+ * @param[in] cnt the range count
+ *
+ * @param[in] addr the address
+ *
+ * @returns true if it is, false otherwise
+ */
+static bool contains(const range *arr, u32 cnt, mem_addr_t addr)
+{
+	for (u32 i = 0; likely(i < cnt); i++)
+		if ( unlikely(arr[i].start <= addr && addr < arr[i].end) )
+			return true;
+
+	return false;
+}
+
+
+/**
+ * @brief Get the address range of the .text section of the module
+ *
+ * @throws csdbg::exception
+ */
+static void text_bounds()
+{
+	bfd *fd = bfd_openr(g_path, NULL);
+	if ( unlikely(fd == NULL) ) {
+		bfd_error bfd_errno = bfd_get_error();
+		throw exception("failed to open '%s' (bfd errno %d - %s)", g_path,
+										bfd_errno, bfd_errmsg(bfd_errno));
+	}
+
+	if ( unlikely(!bfd_check_format(fd, bfd_object)) ) {
+		bfd_error bfd_errno = bfd_get_error();
+		bfd_close(fd);
+		throw exception("'%s' is not an object file (bfd errno %d - %s)", g_path,
+										bfd_errno, bfd_errmsg(bfd_errno));
+	}
+
+	asection *sec = bfd_get_section_by_name(fd, ".text");
+	if ( unlikely(sec == NULL) ) {
+		bfd_close(fd);
+		throw exception("'%s' has no .text section", g_path);
+	}
+
+	g_text.start = bfd_get_section_vma(fd, sec);
+	g_text.end = g_text.start + bfd_get_section_size(sec);
+	bfd_close(fd);
+}
+
+
+/**
+ * @brief Parse a row of the readelf output
+ *
+ * @param[in] ln the output line (it is modified)
+ *
+ * @param[out] file the source file base name
+ *
+ * @param[out] line the line number (-1 if the row ends a sequence)
+ *
+ * @param[out] addr the row address
+ *
+ * @returns true if the output line is a row, false otherwise
+ */
+static bool parse(i8 *ln, const i8 *&file, i64 &line, mem_addr_t &addr)
+{
+	i8 *save = NULL;
+	i8 *nm = strtok_r(ln, " \t\r\n", &save);
+	i8 *ln_no = strtok_r(NULL, " \t\r\n", &save);
+	i8 *start = strtok_r(NULL, " \t\r\n", &save);
+	if (nm == NULL || ln_no == NULL || start == NULL ||
+			strncmp(start, "0x", 2) != 0)
+		return false;
+
+	file = strrchr(nm, '/');
+	file = (file != NULL) ? file + 1 : nm;
+	line = (strcmp(ln_no, "-") == 0) ? -1 : strtoll(ln_no, NULL, 10);
+	addr = strtoull(start, NULL, 16);
+	return true;
+}
+
+
+/**
+ * @brief Compare the resolved source file and line of an address
+ *
+ * @param[in] tbl the line number table
+ *
+ * @param[in] addr the address
+ *
+ * @param[in] file the expected source file (NULL if it must be unresolved)
+ *
+ * @param[in] line the expected line number (0 if it must be unresolved)
+ */
+static void expect(const linetab &tbl, mem_addr_t addr, const i8 *file,
+									 i64 line)
+{
+	if ( unlikely(contains(g_overlaps, g_overlap_cnt, addr)) ) {
+		g_skipped++;
+		return;
+	}
+
+	g_checked++;
+	u32 our_line = 0;
+	const i8 *our_file = tbl.lookup(addr, our_line);
+
+	/* Rows with line 0 are stored unresolved */
+	if (file == NULL || line <= 0) {
+		if ( likely(our_file == NULL) )
+			return;
+
+		file = "??";
+		line = 0;
+	}
+	else if ( likely(our_file != NULL && our_line == line &&
+									 strcmp(our_file, file) == 0) )
+		return;
+
+	if (g_diffs++ < 10)
+		fprintf(stderr, "[w] 0x%lx: linetab %s:%u, readelf %s:%ld\r\n",
+						static_cast<unsigned long> (addr),
+						(our_file != NULL) ? our_file : "??", our_line, file,
+						static_cast<long> (line));
+}
+
+
+/**
+ * @brief Decode the line number table of the module with readelf
+ *
+ * @param[in] tbl
+ *	the line number table to check, or NULL to collect the sequence ranges
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	Each row is checked when the next one is read, as a row spans up to the
+ *	next one. Of multiple rows with the same address, the last one applies
+ */
+static void scan(const linetab *tbl)
+{
+	string cmd("readelf -W --debug-dump=decodedline '%s'", g_path);
+	FILE *fp = popen(cmd.cstr(), "r");
+	if ( unlikely(fp == NULL) )
+		throw exception("failed to run readelf (errno %d - %s)", errno,
+										strerror(errno));
+
+	try {
+		i8 ln[PATH_MAX + 128], prev_file[PATH_MAX];
+		mem_addr_t seq = 0, prev_addr = 0;
+		i64 prev_line = 0;
+		bool fresh = true, pending = false;
+
+		while ( likely(fgets(ln, sizeof(ln), fp) != NULL) ) {
+			const i8 *file;
+			i64 line;
+			mem_addr_t addr;
+			if ( unlikely(!parse(ln, file, line, addr)) )
+				continue;
+
+			if ( unlikely(fresh) ) {
+				seq = addr;
+				fresh = false;
+			}
+
+			fresh = (line < 0);
+			/* Skip the sequences of discarded code */
+			if ( unlikely(seq < g_text.start || seq >= g_text.end) )
+				continue;
+
+			if (tbl == NULL) {
+				if ( unlikely(fresh && addr > seq) )
+					append(g_seqs, g_seq_cnt, g_seq_cap, seq, addr);
+
+				continue;
+			}
+
+			g_rows++;
+			if ( likely(pending && addr > prev_addr) ) {
+				expect(*tbl, prev_addr, prev_file, prev_line);
+				expect(*tbl, addr - 1, prev_file, prev_line);
+			}
+
+			/* The end of a sequence is unresolved, unless another one spans it */
+			pending = !fresh;
+			if ( unlikely(fresh) ) {
+				if ( likely(!contains(g_seqs, g_seq_cnt, addr)) )
+					expect(*tbl, addr, NULL, 0);
+
+				continue;
+			}
+
+			snprintf(prev_file, sizeof(prev_file), "%s", file);
+			prev_addr = addr;
+			prev_line = line;
+		}
+	}
+
+	catch (...) {
+		pclose(fp);
+		throw;
+	}
+
+	i32 status = pclose(fp);
+	if ( unlikely(status != 0) )
+		throw exception("readelf failed (status %d)", status);
+}
+
+
+/**
+ * @brief Find the addresses where the sequences overlap
+ *
+ * @throws std::bad_alloc
+ */
+static void overlaps()
+{
+	qsort(g_seqs, g_seq_cnt, sizeof(range), compare);
+
+	mem_addr_t end = 0;
+	for (u32 i = 0; likely(i < g_seq_cnt); i++) {
+		if ( unlikely(i > 0 && g_seqs[i].start < end) )
+			append(g_overlaps, g_overlap_cnt, g_overlap_cap, g_seqs[i].start,
+						 (g_seqs[i].end < end) ? g_seqs[i].end : end);
+
+		if (g_seqs[i].end > end)
+			end = g_seqs[i].end;
+	}
+}
+
+
+/**
+ * @brief Program entry point
+ *
+ * @param[in] argc the argument count
+ *
+ * @param[in] argv the arguments
+ *
+ * @returns EXIT_SUCCESS if linetab agrees with readelf, else EXIT_FAILURE
+ */
+i32 main(i32 argc, i8 **argv)
+{
+	i32 opt;
+	while ( likely((opt = getopt(argc, argv, "h")) != -1) )
+		usage(argv[0]);
+
+	if ( unlikely(optind < argc - 1) )
+		usage(argv[0]);
+
+	i32 retval = EXIT_FAILURE;
+	const i8 *self = NULL;
+	linetab *tbl = NULL;
+	try {
+		if (optind == argc - 1)
+			g_path = argv[optind];
+		else
+			g_path = self = util::exec_path();
+
+		tbl = new linetab(g_path);
+		if ( unlikely(tbl->size() == 0) )
+			throw exception("'%s' has no (supported) line number table", g_path);
+
+		text_bounds();
+		scan(NULL);
+		overlaps();
+		scan(tbl);
+
+		printf("%s: %lu rows, %lu addresses checked, %lu skipped, "
+					 "%lu different\r\n", g_path,
+					 static_cast<unsigned long> (g_rows),
+					 static_cast<unsigned long> (g_checked),
+					 static_cast<unsigned long> (g_skipped),
+					 static_cast<unsigned long> (g_diffs));
+
+		if ( likely(g_checked > 0 && g_diffs == 0) )
+			retval = EXIT_SUCCESS;
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	delete tbl;
+	delete[] self;
+	delete[] g_seqs;
+	delete[] g_overlaps;
+	return retval;
+}
+
@@ -0,0 +1,358 @@
+#include "../include/matcher.hpp"
+#include "../include/string.hpp"
+
+/**
+	@file extra/csdbg-check-matcher.cpp
+
+	@brief Instrumentation filter matcher check (csdbg-check-matcher)
+
+	Builds random sets of instrumentation filters (module and symbol filters,
+	case sensitive or not, plain literals with optional anchors and escaped
+	special characters, and expressions with regular expression operators) and
+	matches random texts against them with csdbg::matcher. The result must be
+	the first filter of the set (of the matched type) whose expression matches
+	the text with regexec, compiled independently. Half of the texts embed the
+	text of a filter of the set, with random case changes, so most of them
+	match. The random generator is seeded (-s), a difference is reported with
+	the seed, the filter set and the text, so it can be reproduced. This program
+	must not be compiled with -finstrument-functions
+*/
+
+using namespace csdbg;
+
+/* Generator alphabets (the specials are escaped in literal expressions) */
+
+static const i8 g_alphabet[] = "abcABC_:./$^(+\\\xe9";
+
+static const i8 g_special[] = ".[]()*+?{}|^$\\";
+
+static const i8 *g_operators[] = {
+	".", "[ab]", "[^c]", "a*", "b+", "c?", "(ab|c)", ".*", "[[:upper:]]"
+};
+
+
+/* Check state */
+
+static u32 g_seed = 1;
+
+static u32 g_state = 1;
+
+static u64 g_count = 120000;
+
+static u64 g_sets = 0;
+
+static u64 g_texts = 0;
+
+static u64 g_matched = 0;
+
+static u64 g_diffs = 0;
+
+
+/**
+ * @brief Show the usage message and exit
+ *
+ * @param[in] name the program name
+ */
+static void usage(const i8 *name)
+{
+	std::cerr << "libcsdbg instrumentation filter matcher check\r\n"
+						<< "Usage: " << name << " [-n count] [-s seed] [-h]\r\n\r\n"
+						<< "'" << name << "' matches count random texts (120000 by "
+						<< "default) against random\r\nfilter sets with "
+						<< "csdbg::matcher and compares the results with regexec\r\n\r\n"
+						<< "-n  Match count texts\r\n"
+						<< "-s  Seed the random generator (1 by default)\r\n"
+						<< "-h  Show this message\r\n";
+
+	exit(EXIT_FAILURE);
+}
+
+
+/**
+ * @brief Get a pseudo-random number (xorshift32)
+ *
+ * @param[in] n the range of the number
+ *
+ * @returns a number in [0, n)
+ */
+static u32 rnd(u32 n)
+{
+	g_state ^= g_state << 13;
+	g_state ^= g_state >> 17;
+	g_state ^= g_state << 5;
+	return g_state % n;
+}
+
+
+/**
+ * @brief Append a random text to a string
+ *
+ * @param[in,out] str the string
+ *
+ * @param[in] max the maximum text length
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void scribble(string &str, u32 max)
+{
+	u32 len = rnd(max + 1);
+	for (u32 i = 0; likely(i < len); i++)
+		str.append("%c", g_alphabet[rnd(sizeof(g_alphabet) - 1)]);
+}
+
+
+/**
+ * @brief Generate a random filter expression
+ *
+ * @param[out] expr the expression
+ *
+ * @param[out] text a text the expression matches (without its anchors)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void generate(string &expr, string &text)
+{
+	expr.clear();
+	text.clear();
+	if (rnd(3) == 0)
+		expr.append("^");
+
+	/* A literal, with an operator appended to some of them */
+	u32 len = rnd(5) + 1;
+	for (u32 i = 0; likely(i < len); i++) {
+		i8 ch = g_alphabet[rnd(sizeof(g_alphabet) - 1)];
+		if ( unlikely(strchr(g_special, ch) != NULL) )
+			expr.append("\\");
+
+		expr.append("%c", ch);
+		text.append("%c", ch);
+	}
+
+	if (rnd(3) == 0) {
+		u32 i = rnd(sizeof(g_operators) / sizeof(g_operators[0]));
+		expr.append("%s", g_operators[i]);
+	}
+
+	if (rnd(3) == 0)
+		expr.append("$");
+}
+
+
+/**
+ * @brief Report a difference
+ *
+ * @param[in] filters the filter set
+ *
+ * @param[in] mode the matched filter type
+ *
+ * @param[in] text the text
+ *
+ * @param[in] got the matcher result
+ *
+ * @param[in] expected the regexec result
+ */
+static void report(const chain<filter> *filters, bool mode, const i8 *text,
+									 i32 got, i32 expected)
+{
+	if (g_diffs++ >= 10)
+		return;
+
+	std::cerr << std::dec << "[w] seed " << g_seed << ", set " << g_sets
+						<< ", mode " << mode << ": text '" << text << "' matched filter "
+						<< got << ", regexec " << expected << "\r\n";
+
+	chain<filter>::iterator it = filters->head();
+	for (; likely(it.valid()); it.next()) {
+		const filter *filt = it.data();
+		std::cerr << "    " << it.index() << ": '" << filt->expr() << "' (mode "
+							<< filt->mode() << ", icase " << filt->icase() << ")\r\n";
+	}
+}
+
+
+/**
+ * @brief Match random texts against a random filter set
+ *
+ * @param[in] cnt the text count
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void check(u32 cnt)
+{
+	chain<filter> *filters = new chain<filter>;
+	chain<string> *texts = NULL;
+	regex_t *exprs = NULL;
+	matcher *matchers[2] = { NULL, NULL };
+	u32 sz = 0;
+
+	try {
+		texts = new chain<string>;
+		u32 filter_cnt = rnd(8) + 1;
+		exprs = new regex_t[filter_cnt];
+
+		string expr, text;
+		while (sz < filter_cnt) {
+			generate(expr, text);
+			bool icase = (rnd(3) == 0), mode = (rnd(2) == 0);
+
+			i32 flags = REG_EXTENDED | REG_NOSUB;
+			if (icase)
+				flags |= REG_ICASE;
+
+			if ( unlikely(regcomp(&exprs[sz], expr.cstr(), flags) != 0) )
+				continue;
+
+			filter *filt = NULL;
+			try {
+				filt = new filter(expr.cstr(), icase, mode);
+				filters->append(filt);
+				texts->append(text.clone());
+			}
+
+			catch (...) {
+				regfree(&exprs[sz]);
+				if (filters->size() > sz)
+					filters->remove(sz);
+				else
+					delete filt;
+
+				throw;
+			}
+
+			sz++;
+		}
+
+		matchers[0] = new matcher(filters, false);
+		matchers[1] = new matcher(filters, true);
+
+		for (u32 i = 0; likely(i < cnt); i++) {
+			/* Embed the text of a filter, changing the case of some characters */
+			text.clear();
+			scribble(text, 8);
+			if (rnd(2) == 0) {
+				const i8 *str = texts->at(rnd(sz))->cstr();
+				for (u32 j = 0; likely(str[j] != '\0'); j++) {
+					i8 ch = str[j];
+					if (rnd(4) == 0)
+						ch = isupper(static_cast<u8> (ch)) ? tolower(ch) : toupper(ch);
+
+					text.append("%c", ch);
+				}
+
+				scribble(text, 8);
+			}
+
+			for (u32 m = 0; likely(m < 2); m++) {
+				i32 expected = -1;
+				chain<filter>::iterator it = filters->head();
+				for (; likely(it.valid()); it.next())
+					if (it.data()->mode() == (m == 1) &&
+							regexec(&exprs[it.index()], text.cstr(), 0, NULL, 0) == 0) {
+						expected = it.index();
+						break;
+					}
+
+				i32 got = matchers[m]->match(text.cstr());
+				if ( unlikely(got != expected) )
+					report(filters, m == 1, text.cstr(), got, expected);
+
+				g_matched += (expected >= 0);
+			}
+
+			g_texts++;
+		}
+	}
+
+	catch (...) {
+		delete matchers[0];
+		delete matchers[1];
+		for (u32 i = 0; likely(i < sz); i++)
+			regfree(&exprs[i]);
+
+		delete[] exprs;
+		delete texts;
+		delete filters;
+		throw;
+	}
+
+	delete matchers[0];
+	delete matchers[1];
+	for (u32 i = 0; likely(i < sz); i++)
+		regfree(&exprs[i]);
+
+	delete[] exprs;
+	delete texts;
+	delete filters;
+	g_sets++;
+}
+
+
+/**
+ * @brief Program entry point
+ *
+ * @param[in] argc the argument count
+ *
+ * @param[in] argv the arguments
+ *
+ * @returns EXIT_SUCCESS if the matcher agrees with regexec, else EXIT_FAILURE
+ */
+i32 main(i32 argc, i8 **argv)
+{
+	i32 opt;
+	while ( likely((opt = getopt(argc, argv, "n:s:h")) != -1) ) {
+		switch (opt) {
+		case 'n':
+			g_count = strtoull(optarg, NULL, 10);
+			if ( unlikely(g_count == 0) )
+				usage(argv[0]);
+
+			break;
+
+		case 's':
+			g_seed = strtoul(optarg, NULL, 10);
+			if ( unlikely(g_seed == 0) )
+				usage(argv[0]);
+
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ( unlikely(optind < argc) )
+		usage(argv[0]);
+
+	i32 retval = EXIT_FAILURE;
+	try {
+		g_state = g_seed;
+		while (g_texts < g_count) {
+			u64 left = g_count - g_texts;
+			check((left < 200) ? left : 200);
+		}
+
+		printf("seed %u: %lu filter sets, %lu texts, %lu matches, "
+					 "%lu different\r\n", g_seed,
+					 static_cast<unsigned long> (g_sets),
+					 static_cast<unsigned long> (g_texts),
+					 static_cast<unsigned long> (g_matched),
+					 static_cast<unsigned long> (g_diffs));
+
+		if ( likely(g_diffs == 0) )
+			retval = EXIT_SUCCESS;
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	return retval;
+}
+
@@ -0,0 +1,382 @@
+#include "../include/ring.hpp"
+#include "../include/util.hpp"
+#include <signal.h>
+
+/**
+	@file extra/csdbg-check-ring.cpp
+
+	@brief Event ring buffer check (csdbg-check-ring)
+
+	Pushes numbered events to a csdbg::ring while draining it with random pauses
+	and random batch sizes, so the ring fills up and (in overwrite mode) wraps
+	around while it is copied. The events are pushed either by a producer thread
+	or by a signal handler that an interval timer runs in the middle of the
+	drains, so the copies are written over even on a uniprocessor. The check is
+	repeated for a few ring capacities, in both modes. Each event encodes its
+	sequence number in all its fields, so an event that is written over while it
+	is copied (torn) is detected. The drained sequence numbers must be strictly
+	increasing, the gaps between them must add up to the lost events that the
+	ring reports and each event must be either drained or lost. In overwrite
+	mode, the events lost before each drained block must be reported by the
+	same drain and the newest event is never lost. The random generator is
+	seeded (-s), but the interleaving of the producer and the consumer is not
+	reproducible. This program must not be compiled with -finstrument-functions
+*/
+
+using namespace csdbg;
+
+/**
+	@brief A producer run
+*/
+struct run {
+	ring *buffer;											/**< @brief The ring */
+
+	u64 count;												/**< @brief Events to push */
+
+	u64 next;													/**< @brief Next event to push */
+
+	u64 pushed;												/**< @brief Accepted events */
+
+	bool finished;										/**< @brief All events were pushed */
+
+	u32 seed;													/**< @brief Random generator state */
+};
+
+
+/* Check state */
+
+static const u32 g_capacities[] = { 4, 64, 4096, 65536 };
+
+static u32 g_seed = 1;
+
+static u64 g_count = 1000000;
+
+static u64 g_failures = 0;
+
+static run *g_run = NULL;
+
+
+/**
+ * @brief Show the usage message and exit
+ *
+ * @param[in] name the program name
+ */
+static void usage(const i8 *name)
+{
+	std::cerr << "libcsdbg event ring buffer check\r\n"
+						<< "Usage: " << name << " [-n count] [-s seed] [-h]\r\n\r\n"
+						<< "'" << name << "' pushes count events (1000000 by default) "
+						<< "to rings of a few\r\ncapacities, in both modes, while "
+						<< "draining them concurrently, and checks\r\nthat each "
+						<< "event is drained intact, in order, or reported lost\r\n\r\n"
+						<< "-n  Push count events to each ring\r\n"
+						<< "-s  Seed the random generator (1 by default)\r\n"
+						<< "-h  Show this message\r\n";
+
+	exit(EXIT_FAILURE);
+}
+
+
+/**
+ * @brief Get a pseudo-random number (xorshift32)
+ *
+ * @param[in,out] state the generator state
+ *
+ * @param[in] n the range of the number
+ *
+ * @returns a number in [0, n)
+ */
+static u32 rnd(u32 &state, u32 n)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state % n;
+}
+
+
+/**
+ * @brief Stall for a random while
+ *
+ * @param[in,out] state the generator state
+ */
+static void stall(u32 &state)
+{
+	switch (rnd(state, 16)) {
+	case 0:
+		sched_yield();
+		break;
+
+	case 1:
+	case 2:
+		for (volatile u32 i = rnd(state, 20000); i > 0; i--);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/**
+ * @brief Check that an event is intact
+ *
+ * @param[in] ev the event
+ *
+ * @returns true if all its fields encode the same sequence number
+ */
+static bool intact(const traceevent_t &ev)
+{
+	u64 seq = ev.time;
+	return ev.fn == seq * 0x9e3779b97f4a7c15ULL && ev.site == ~seq &&
+				 ev.type == (seq & 1) && ev.reserved == 0;
+}
+
+
+/**
+ * @brief Push a burst of events
+ *
+ * @param[in] rn the producer run
+ *
+ * @param[in] cnt the burst length
+ */
+static void burst(run *rn, u32 cnt)
+{
+	for (; likely(cnt > 0 && rn->next <= rn->count); cnt--) {
+		u64 seq = rn->next++;
+		if ( likely(rn->buffer->push(seq, seq * 0x9e3779b97f4a7c15ULL, ~seq,
+																 seq & 1)) )
+			rn->pushed++;
+	}
+
+	if ( unlikely(rn->next > rn->count) )
+		store_release(rn->finished, true);
+}
+
+
+/**
+ * @brief Producer thread entry point
+ *
+ * @param[in] arg the producer run
+ *
+ * @returns NULL
+ */
+static void* produce(void *arg)
+{
+	run *rn = static_cast<run*> (arg);
+	while ( likely(!rn->finished) ) {
+		burst(rn, rnd(rn->seed, 1024) + 1);
+		stall(rn->seed);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * @brief Interval timer signal handler, the producer of interrupted drains
+ *
+ * @param[in] signo the signal number
+ */
+static void interrupt(i32)
+{
+	if ( likely(!g_run->finished) )
+		burst(g_run, rnd(g_run->seed, g_run->buffer->capacity() * 2 + 1024) + 1);
+}
+
+
+/**
+ * @brief Check a ring of a capacity and mode
+ *
+ * @param[in] cap the ring capacity
+ *
+ * @param[in] overwrite the ring mode
+ *
+ * @param[in] timed true to push the events from a signal handler
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void check(u32 cap, bool overwrite, bool timed)
+{
+	u32 state = g_seed * 2654435761U + cap * 4 + overwrite * 2 + timed;
+	state |= (state == 0);
+
+	run rn;
+	rn.count = g_count;
+	rn.next = 1;
+	rn.pushed = 0;
+	rn.finished = false;
+	rn.seed = ~state;
+	rn.seed |= (rn.seed == 0);
+	rn.buffer = new ring(&rn, cap, overwrite);
+
+	traceevent_t *events = NULL;
+	try {
+		events = new traceevent_t[cap * 2];
+	}
+
+	catch (...) {
+		delete rn.buffer;
+		throw;
+	}
+
+	pthread_t producer = 0;
+	i32 err = 0;
+	if (timed) {
+		g_run = &rn;
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = interrupt;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+
+		struct itimerval tv;
+		tv.it_interval.tv_sec = tv.it_value.tv_sec = 0;
+		tv.it_interval.tv_usec = tv.it_value.tv_usec = 50;
+		if ( unlikely(sigaction(SIGALRM, &sa, NULL) != 0 ||
+									setitimer(ITIMER_REAL, &tv, NULL) != 0) )
+			err = errno;
+	}
+	else
+		err = pthread_create(&producer, NULL, produce, &rn);
+
+	if ( unlikely(err != 0) ) {
+		delete[] events;
+		delete rn.buffer;
+		throw exception("failed to start the producer (errno %d - %s)", err,
+										strerror(err));
+	}
+
+	u64 drained = 0, lost = 0, gaps = 0, last = 0, pending = 0;
+	u64 torn = 0, disordered = 0, unreported = 0;
+	while (true) {
+		/* Once the producer has finished, drain the ring until it is empty */
+		bool finished = load_acquire(rn.finished);
+		u64 cnt_lost = 0;
+		u32 cnt = rn.buffer->drain(events, rnd(state, cap * 2) + 1, cnt_lost);
+		lost += cnt_lost;
+		pending += cnt_lost;
+
+		for (u32 i = 0; likely(i < cnt); i++) {
+			const traceevent_t &ev = events[i];
+			if ( unlikely(!intact(ev)) ) {
+				torn++;
+				continue;
+			}
+
+			if ( unlikely(ev.time <= last) ) {
+				disordered++;
+				continue;
+			}
+
+			/* The events lost before a block are reported by its drain */
+			u64 gap = ev.time - last - 1;
+			if ( unlikely(overwrite && i == 0 && gap != pending) )
+				unreported++;
+
+			gaps += gap;
+			last = ev.time;
+			drained++;
+		}
+
+		if (cnt > 0)
+			pending = 0;
+		else if (finished)
+			break;
+
+		if ( likely(!finished) )
+			stall(state);
+	}
+
+	if (timed) {
+		struct itimerval tv;
+		memset(&tv, 0, sizeof(tv));
+		setitimer(ITIMER_REAL, &tv, NULL);
+		signal(SIGALRM, SIG_DFL);
+		g_run = NULL;
+	}
+	else
+		pthread_join(producer, NULL);
+
+	/* The events dropped at the end of the run were never drained */
+	gaps += g_count - last;
+
+	bool failed = (torn > 0 || disordered > 0 || unreported > 0 ||
+								 drained + lost != g_count || gaps != lost ||
+								 (!overwrite && drained != rn.pushed) ||
+								 (overwrite && last != g_count));
+
+	printf("capacity %u, %s, %s: %lu pushed, %lu drained, %lu lost, %lu torn, "
+				 "%lu out of order, %lu unreported%s\r\n", cap,
+				 (overwrite) ? "overwrite" : "drop", (timed) ? "timer" : "thread",
+				 static_cast<unsigned long> (g_count),
+				 static_cast<unsigned long> (drained),
+				 static_cast<unsigned long> (lost),
+				 static_cast<unsigned long> (torn),
+				 static_cast<unsigned long> (disordered),
+				 static_cast<unsigned long> (unreported),
+				 (failed) ? " (FAILED)" : "");
+
+	g_failures += failed;
+	delete[] events;
+	delete rn.buffer;
+}
+
+
+/**
+ * @brief Program entry point
+ *
+ * @param[in] argc the argument count
+ *
+ * @param[in] argv the arguments
+ *
+ * @returns EXIT_SUCCESS if all the checks pass, else EXIT_FAILURE
+ */
+i32 main(i32 argc, i8 **argv)
+{
+	i32 opt;
+	while ( likely((opt = getopt(argc, argv, "n:s:h")) != -1) ) {
+		switch (opt) {
+		case 'n':
+			g_count = strtoull(optarg, NULL, 10);
+			if ( unlikely(g_count == 0) )
+				usage(argv[0]);
+
+			break;
+
+		case 's':
+			g_seed = strtoul(optarg, NULL, 10);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ( unlikely(optind < argc) )
+		usage(argv[0]);
+
+	i32 retval = EXIT_FAILURE;
+	try {
+		u32 cnt = sizeof(g_capacities) / sizeof(g_capacities[0]);
+		for (u32 i = 0; likely(i < cnt); i++) {
+			for (u32 j = 0; likely(j < 4); j++)
+				check(g_capacities[i], j & 1, j & 2);
+		}
+
+		if ( likely(g_failures == 0) )
+			retval = EXIT_SUCCESS;
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	return retval;
+}
+
@@ -0,0 +1,693 @@
+#include "../include/process.hpp"
+#include "../include/util.hpp"
+#ifdef CSDBG_WITH_TIMELINE
+#include "../include/filebuf.hpp"
+#include "../include/timeline.hpp"
+#endif
+
+/**
+	@file extra/csdbg-decode.cpp
+
+	@brief Binary event trace decoder (csdbg-decode)
+
+	Reads a binary event trace recorded by libcsdbg (see csdbg::recorder) and
+	symbolizes it offline, using the module load map recorded in the trace. By
+	default, the simulated call stack of each traced thread, as it was when the
+	recording stopped, is printed in the format of tracer::trace. With -t, each
+	event is printed instead, with its timestamp and call depth. With -p, the
+	module paths are looked up under a directory prefix (a sysroot), so that a
+	trace recorded on another host can be decoded. Modules whose build id does
+	not match the recorded one are not used for symbolization. With -j (if
+	libcsdbg is built with CSDBG_WITH_TIMELINE), the trace is converted to a
+	Chrome trace event timeline (see csdbg::timeline). A crash dump (see
+	csdbg::crashdump) is decoded the same way, the signal and the dumped call
+	stack of each thread are printed, using the function names recorded in the
+	dump for the addresses that can't be resolved. This program must not be
+	compiled with -finstrument-functions
+*/
+
+using namespace csdbg;
+
+/**
+	@brief The replayed simulated call stack of a traced thread
+*/
+struct track {
+	u64 id;											/**< @brief Thread id */
+
+	u64 *fns;										/**< @brief Called function addresses */
+
+	u64 *sites;									/**< @brief Call sites */
+
+	u32 depth;									/**< @brief Call depth */
+
+	u32 capacity;								/**< @brief Stack capacity */
+
+	u64 events;									/**< @brief Replayed events */
+
+	u64 lost;										/**< @brief Lost events */
+};
+
+
+/* Decoder state */
+
+static process *g_proc = NULL;
+
+static track *g_tracks = NULL;
+
+static u32 g_track_cnt = 0;
+
+static u64 g_clock = 0;
+
+static bool g_timeline = false;
+
+static const i8 *g_sysroot = "";
+
+#ifdef CSDBG_WITH_TIMELINE
+static const i8 *g_json_path = NULL;
+
+static timeline *g_json = NULL;
+#endif
+
+
+/**
+ * @brief Show the usage message and exit
+ *
+ * @param[in] name the program name
+ */
+static void usage(const i8 *name)
+{
+	std::cerr << "libcsdbg binary event trace decoder\r\n"
+#ifdef CSDBG_WITH_TIMELINE
+						<< "Usage: " << name << " [-t] [-j json] [-p prefix] [-h] file"
+						<< "\r\n\r\n"
+#else
+						<< "Usage: " << name << " [-t] [-p prefix] [-h] file\r\n\r\n"
+#endif
+						<< "'" << name << "' prints the call stack of each thread of a "
+						<< "trace recorded with\r\nCSDBG_TRACE, as it was when the "
+						<< "recording stopped, or of a crash dump\r\nwritten to "
+						<< "CSDBG_CRASHDUMP. The following options change the "
+						<< "default\r\nbehaviour:\r\n\r\n"
+						<< "-t  Print each recorded event (call or return)\r\n"
+#ifdef CSDBG_WITH_TIMELINE
+						<< "-j  Convert the trace to a Chrome trace event timeline\r\n"
+#endif
+						<< "-p  Look up the recorded modules under a directory prefix\r\n"
+						<< "-h  Show this message\r\n";
+
+	exit(EXIT_FAILURE);
+}
+
+
+/**
+ * @brief Print a warning message
+ *
+ * @param[in] fmt a printf-style format string
+ *
+ * @param[in] ... the format arguments
+ */
+static void warn(const i8 *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "[w] ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\r\n");
+	va_end(args);
+}
+
+
+/**
+ * @brief Read a number of bytes from the trace file
+ *
+ * @param[in] fp the trace file
+ *
+ * @param[out] dst the destination buffer
+ *
+ * @param[in] sz the number of bytes to read
+ *
+ * @returns true on success, false on a clean end of file
+ *
+ * @throws csdbg::exception
+ */
+static bool read(FILE *fp, void *dst, u32 sz)
+{
+	u32 cnt = fread(dst, 1, sz, fp);
+	if ( likely(cnt == sz) )
+		return true;
+
+	if ( unlikely(ferror(fp)) )
+		throw exception("failed to read the trace file (errno %d - %s)",
+										errno, strerror(errno));
+
+	if ( unlikely(cnt > 0) )
+		throw exception("truncated trace file");
+
+	return false;
+}
+
+
+/**
+ * @brief Get the replayed call stack of a thread, create it if it's new
+ *
+ * @param[in] id the thread id
+ *
+ * @returns the track of the thread
+ *
+ * @throws std::bad_alloc
+ */
+static track* get_track(u64 id)
+{
+	for (u32 i = 0; likely(i < g_track_cnt); i++)
+		if ( likely(g_tracks[i].id == id) )
+			return &g_tracks[i];
+
+	track *tracks = new track[g_track_cnt + 1];
+	if ( likely(g_tracks != NULL) )
+		memcpy(tracks, g_tracks, g_track_cnt * sizeof(track));
+
+	delete[] g_tracks;
+	g_tracks = tracks;
+
+	track *trk = &g_tracks[g_track_cnt++];
+	util::memset(trk, 0, sizeof(track));
+	trk->id = id;
+	return trk;
+}
+
+
+/**
+ * @brief Append the symbol of an address to a string
+ *
+ * @param[in] dst the destination string
+ *
+ * @param[in] fn the function address
+ *
+ * @param[in] site the call site (0 to omit the source file and line)
+ *
+ * @param[in] alt
+ *	the name printed if the address can't be resolved (NULL to print the
+ *	address)
+ */
+static void describe(string &dst, u64 fn, u64 site, const i8 *alt = NULL)
+{
+	const i8 *nm = g_proc->lookup(fn);
+	if ( likely(nm != NULL) )
+		dst.append("%s", nm);
+	else if ( likely(alt != NULL) )
+		dst.append("%s", alt);
+	else
+		dst.append("0x%lx", static_cast<mem_addr_t> (fn));
+
+	if ( unlikely(site == 0) )
+		return;
+
+	u32 line = 0;
+	const i8 *file = g_proc->addr2line(site, line);
+	if ( likely(file != NULL) )
+		dst.append(" (%s:%d)", file, line);
+}
+
+
+/**
+ * @brief Load the module records of a module block
+ *
+ * @param[in] fp the trace file
+ *
+ * @param[in] cnt the record count
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	A module that can't be loaded, or whose build id doesn't match, is skipped
+ *	with a warning. Its addresses are printed unresolved
+ */
+static void load_modules(FILE *fp, u32 cnt)
+{
+	for (u32 i = 0; likely(i < cnt); i++) {
+		tracemod_t mod;
+		if ( unlikely(!read(fp, &mod, sizeof(tracemod_t))) )
+			throw exception("truncated trace file");
+
+		u32 sz = (mod.path_sz + mod.id_sz + sizeof(tracemod_t) + 7) & ~7U;
+		sz -= sizeof(tracemod_t);
+		if ( unlikely(mod.path_sz == 0 || mod.id_sz > g_build_id_sz) )
+			throw exception("invalid module record");
+
+		u8 *rec = new u8[sz];
+		string path;
+		u8 id[g_build_id_sz];
+		u32 id_sz = 0;
+		try {
+			if ( unlikely(!read(fp, rec, sz)) )
+				throw exception("truncated trace file");
+
+			rec[mod.path_sz - 1] = '\0';
+			path.append("%s%s", g_sysroot, reinterpret_cast<const i8*> (rec));
+			id_sz = util::build_id(path.cstr(), id, g_build_id_sz);
+		}
+
+		catch (...) {
+			delete[] rec;
+			throw;
+		}
+
+		/* Virtual modules (e.g linux-vdso.so.1) have no file */
+		bool valid = (rec[0] == '/');
+		if ( unlikely(valid && access(path.cstr(), R_OK) != 0) ) {
+			warn("'%s' not found", path.cstr());
+			valid = false;
+		}
+		else if ( likely(valid) && unlikely(id_sz != mod.id_sz ||
+				memcmp(id, rec + mod.path_sz, id_sz) != 0) ) {
+			warn("build id mismatch, '%s' is not used", path.cstr());
+			valid = false;
+		}
+
+		delete[] rec;
+		if ( unlikely(!valid) )
+			continue;
+
+		try {
+			g_proc->add_module(path.cstr(), mod.base);
+		}
+
+		catch (exception &x) {
+			warn("failed to load '%s' (%s)", path.cstr(), x.msg());
+		}
+	}
+}
+
+
+/**
+ * @brief Print the crash record of a crash block
+ *
+ * @param[in] fp the trace file
+ *
+ * @param[in] blk the block header
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void print_crash(FILE *fp, const traceblock_t &blk)
+{
+	tracecrash_t rec;
+	if ( unlikely(blk.count != 1) )
+		throw exception("invalid crash block");
+
+	if ( unlikely(!read(fp, &rec, sizeof(tracecrash_t))) )
+		throw exception("truncated trace file");
+
+	string buf;
+	buf.append("crash: signal %d (%s), code %d, address 0x%lx, thread 0x%lx\r\n",
+						 rec.signo, strsignal(rec.signo), rec.code,
+						 static_cast<mem_addr_t> (rec.addr),
+						 static_cast<mem_addr_t> (blk.thread));
+
+	std::cout << buf;
+}
+
+
+/**
+ * @brief Print the dumped call stack of a stack block
+ *
+ * @param[in] fp the trace file
+ *
+ * @param[in] blk the block header
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void print_stack(FILE *fp, const traceblock_t &blk)
+{
+	if ( unlikely(blk.count == 0) )
+		throw exception("invalid stack block");
+
+	string buf;
+	for (u32 i = 0; likely(i < blk.count); i++) {
+		traceframe_t rec;
+		if ( unlikely(!read(fp, &rec, sizeof(traceframe_t))) )
+			throw exception("truncated trace file");
+
+		if ( unlikely(rec.name_sz > USHRT_MAX) )
+			throw exception("invalid call stack record");
+
+		/* The name is padded to a multiple of 8 bytes */
+		u32 sz = (rec.name_sz + 7) & ~7U;
+		i8 *nm = NULL;
+		try {
+			if ( likely(sz > 0) ) {
+				nm = new i8[sz];
+				if ( unlikely(!read(fp, nm, sz)) )
+					throw exception("truncated trace file");
+
+				nm[rec.name_sz - 1] = '\0';
+			}
+
+			/* The first record names the thread */
+			if ( unlikely(i == 0) ) {
+				buf.append("at %s thread (0x%lx) {\r\n",
+									 (nm != NULL) ? nm : "anonymous",
+									 static_cast<mem_addr_t> (blk.thread));
+			}
+			else {
+				buf.append("  at ");
+				describe(buf, rec.fn, (i > 1) ? rec.site : 0, nm);
+				buf.append("\r\n");
+			}
+		}
+
+		catch (...) {
+			delete[] nm;
+			throw;
+		}
+
+		delete[] nm;
+	}
+
+	buf.append("}\r\n");
+	std::cout << buf;
+}
+
+
+/**
+ * @brief Print an event, indented by its call depth
+ *
+ * @param[in] trk the thread track
+ *
+ * @param[in] ev the event
+ *
+ * @param[in] depth the call depth of the event
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void print_event(const track *trk, const traceevent_t &ev, u32 depth)
+{
+	string buf;
+	u64 t = (ev.time > g_clock) ? (ev.time - g_clock) / 1000 : 0;
+	buf.append("%6llu.%06llu (0x%lx) ", t / 1000000, t % 1000000,
+						 static_cast<mem_addr_t> (trk->id));
+
+	for (u32 i = 0; likely(i < depth); i++)
+		buf.append("  ");
+
+	if ( likely(ev.type == g_event_call) ) {
+		buf.append("at ");
+		describe(buf, ev.fn, (depth > 0) ? ev.site : 0);
+	}
+	else {
+		buf.append("ret ");
+		describe(buf, ev.fn, 0);
+	}
+
+	buf.append("\r\n");
+	std::cout << buf;
+}
+
+
+/**
+ * @brief Replay an event on the call stack of its thread
+ *
+ * @param[in] trk the thread track
+ *
+ * @param[in] ev the event
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	A return pops the frames down to the returning function. A return from a
+ *	function that is not on the stack (its call was lost) is ignored. If a
+ *	timeline is exported, a return event is written for each popped frame
+ */
+static void replay(track *trk, const traceevent_t &ev)
+{
+	trk->events++;
+
+	u32 depth = trk->depth;
+	if ( likely(ev.type == g_event_call) ) {
+		if ( unlikely(trk->depth == trk->capacity) ) {
+			u32 cap = (trk->capacity == 0) ? 64 : trk->capacity * 2;
+			u64 *fns = new u64[cap];
+			u64 *sites = NULL;
+			try {
+				sites = new u64[cap];
+			}
+
+			catch (...) {
+				delete[] fns;
+				throw;
+			}
+
+			if ( likely(trk->depth > 0) ) {
+				memcpy(fns, trk->fns, trk->depth * sizeof(u64));
+				memcpy(sites, trk->sites, trk->depth * sizeof(u64));
+			}
+
+			delete[] trk->fns;
+			delete[] trk->sites;
+			trk->fns = fns;
+			trk->sites = sites;
+			trk->capacity = cap;
+		}
+
+		trk->fns[trk->depth] = ev.fn;
+		trk->sites[trk->depth++] = ev.site;
+
+#ifdef CSDBG_WITH_TIMELINE
+		if ( unlikely(g_json != NULL) ) {
+			string nm;
+			describe(nm, ev.fn, 0);
+			g_json->enter(trk->id, NULL, nm.cstr(), ev.time);
+		}
+#endif
+	}
+	else {
+		u32 i = trk->depth;
+		while ( likely(i > 0 && trk->fns[i - 1] != ev.fn) )
+			i--;
+
+		if ( unlikely(i == 0) )
+			return;
+
+#ifdef CSDBG_WITH_TIMELINE
+		if ( unlikely(g_json != NULL) )
+			for (u32 j = trk->depth; likely(j >= i); j--)
+				g_json->leave(trk->id, NULL, ev.time);
+#endif
+
+		depth = trk->depth = i - 1;
+	}
+
+	if ( unlikely(g_timeline) )
+		print_event(trk, ev, depth);
+}
+
+
+/**
+ * @brief Print the replayed call stack of each thread
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void print_stacks()
+{
+	for (u32 i = 0; likely(i < g_track_cnt); i++) {
+		const track *trk = &g_tracks[i];
+
+		string buf;
+		buf.append("at anonymous thread (0x%lx) {\r\n",
+							 static_cast<mem_addr_t> (trk->id));
+
+		for (u32 j = 0; likely(j < trk->depth); j++) {
+			buf.append("  at ");
+			describe(buf, trk->fns[j], (j > 0) ? trk->sites[j] : 0);
+			buf.append("\r\n");
+		}
+
+		buf.append("}\r\n");
+		std::cout << buf;
+
+		if ( unlikely(trk->lost > 0) )
+			warn("thread 0x%lx: %llu of %llu events lost",
+					 static_cast<mem_addr_t> (trk->id), trk->lost,
+					 trk->lost + trk->events);
+	}
+}
+
+
+/**
+ * @brief Decode a binary event trace file
+ *
+ * @param[in] fp the trace file
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+static void decode(FILE *fp)
+{
+	tracehdr_t hdr;
+	if ( unlikely(!read(fp, &hdr, sizeof(tracehdr_t)) ||
+			memcmp(hdr.magic, g_trace_magic, sizeof(hdr.magic)) != 0) )
+		throw exception("not a libcsdbg event trace file");
+
+	if ( unlikely(hdr.version != g_trace_version) )
+		throw exception("unsupported trace file version %d", hdr.version);
+
+	g_clock = hdr.clock;
+
+#ifdef CSDBG_WITH_TIMELINE
+	if ( unlikely(g_json_path != NULL) ) {
+		filebuf *buf = new filebuf(g_json_path);
+		try {
+			buf->open(O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			g_json = new timeline(buf, hdr.clock, hdr.pid);
+		}
+
+		catch (...) {
+			delete buf;
+			throw;
+		}
+	}
+#endif
+
+	traceevent_t *events = new traceevent_t[g_ring_sz];
+	try {
+		traceblock_t blk;
+		while ( likely(read(fp, &blk, sizeof(traceblock_t))) ) {
+			if ( unlikely(blk.type == g_block_modules) ) {
+				load_modules(fp, blk.count);
+				continue;
+			}
+
+			if ( unlikely(blk.type == g_block_crash) ) {
+				print_crash(fp, blk);
+				continue;
+			}
+
+			if ( unlikely(blk.type == g_block_stack) ) {
+				print_stack(fp, blk);
+				continue;
+			}
+
+			if ( unlikely(blk.type != g_block_events) )
+				throw exception("invalid block type %d", blk.type);
+
+			track *trk = get_track(blk.thread);
+			trk->lost += blk.dropped;
+			if ( unlikely(g_timeline && blk.dropped > 0) )
+				std::cout << "-- (0x" << std::hex << blk.thread << std::dec << ") "
+									<< blk.dropped << " events lost --\r\n";
+
+			for (u32 left = blk.count; likely(left > 0); ) {
+				u32 cnt = (left < g_ring_sz) ? left : g_ring_sz;
+				if ( unlikely(!read(fp, events, cnt * sizeof(traceevent_t))) )
+					throw exception("truncated trace file");
+
+				for (u32 i = 0; likely(i < cnt); i++)
+					replay(trk, events[i]);
+
+				left -= cnt;
+			}
+		}
+	}
+
+	catch (...) {
+		delete[] events;
+		throw;
+	}
+
+	delete[] events;
+
+#ifdef CSDBG_WITH_TIMELINE
+	if ( unlikely(g_json != NULL) ) {
+		g_json->close();
+		return;
+	}
+#endif
+
+	if ( likely(!g_timeline) )
+		print_stacks();
+}
+
+
+/**
+ * @brief Program entry point
+ *
+ * @param[in] argc the argument count
+ *
+ * @param[in] argv the argument list
+ *
+ * @returns EXIT_SUCCESS or EXIT_FAILURE
+ */
+i32 main(i32 argc, i8 **argv)
+{
+	i32 opt;
+#ifdef CSDBG_WITH_TIMELINE
+	const i8 *opts = "tj:p:h";
+#else
+	const i8 *opts = "tp:h";
+#endif
+
+	while ( likely((opt = getopt(argc, argv, opts)) != -1) ) {
+		switch (opt) {
+		case 't':
+			g_timeline = true;
+			break;
+
+#ifdef CSDBG_WITH_TIMELINE
+		case 'j':
+			g_json_path = optarg;
+			break;
+#endif
+
+		case 'p':
+			g_sysroot = optarg;
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ( unlikely(optind != argc - 1) )
+		usage(argv[0]);
+
+	FILE *fp = fopen(argv[optind], "rb");
+	if ( unlikely(fp == NULL) ) {
+		warn("failed to open '%s' (errno %d - %s)", argv[optind], errno,
+				 strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	i32 retval = EXIT_FAILURE;
+	try {
+		g_proc = new process;
+		decode(fp);
+		retval = EXIT_SUCCESS;
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	fclose(fp);
+	for (u32 i = 0; i < g_track_cnt; i++) {
+		delete[] g_tracks[i].fns;
+		delete[] g_tracks[i].sites;
+	}
+
+	delete[] g_tracks;
+#ifdef CSDBG_WITH_TIMELINE
+	delete g_json;
+#endif
+	delete g_proc;
+	return retval;
+}
+
@@ -0,0 +1,410 @@
+#ifndef _CSDBG_CACHE
+#define _CSDBG_CACHE 1
+
+/**
+	@file include/cache.hpp
+
+	@brief Class csdbg::cache definition and method implementation
+*/
+
+#include "./object.hpp"
+#include "./exception.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Fixed-capacity, open-addressing hash table keyed by address
+
+	The table maps non-zero addresses to small, trivially copyable values (T must
+	be copyable with an assignment and must not own any resources). The slots
+	are probed linearly, for at most g_cache_probes slots. When the probe window
+	of a key is full, a victim is chosen with a CLOCK (second chance) policy: a
+	lookup hit marks the slot as referenced and an insertion replaces the first
+	slot of the window that has not been referenced since it was last scanned.
+	Slots are never emptied, only replaced, so an empty slot always terminates a
+	probe sequence. Each slot is protected by a sequence counter, thus lookups
+	don't need any lock and can run concurrently with a single writer. Callers
+	must serialize the writers (cache::add, cache::clear, the copy operations)
+
+	@see process::lookup
+*/
+template <class T>
+class cache: virtual public object
+{
+protected:
+
+	/**
+		@brief A cache slot
+	*/
+	struct slot {
+		u32 m_seq;										/**< @brief Sequence counter (odd while written) */
+
+		u32 m_ref;										/**< @brief Referenced since the last scan */
+
+		mem_addr_t m_key;							/**< @brief Key (0 if the slot is empty) */
+
+		T m_value;										/**< @brief Value */
+	};
+
+
+	/* Protected variables */
+
+	slot *m_slots;									/**< @brief Slot array */
+
+	u32 m_capacity;									/**< @brief Slot count (a power of 2) */
+
+	u32 m_size;											/**< @brief Occupied slot count */
+
+
+	/* Protected generic methods */
+
+	virtual u32 hash(mem_addr_t) const;
+
+	virtual bool read(u32, mem_addr_t&, T&) const;
+
+	virtual void write(u32, mem_addr_t, const T&);
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	explicit cache(u32 = g_cache_sz);
+
+	cache(const cache&);
+
+	virtual	~cache();
+
+	virtual cache* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual u32 capacity() const;
+
+	virtual u32 size() const;
+
+
+	/* Operator overloading methods */
+
+	virtual cache& operator=(const cache&);
+
+
+	/* Generic methods */
+
+	virtual bool lookup(mem_addr_t, T&);
+
+	virtual cache& add(mem_addr_t, const T&);
+
+	virtual cache& clear();
+};
+
+
+/**
+ * @brief Get the home slot of a key
+ *
+ * @param[in] key the key
+ *
+ * @returns the slot index
+ */
+template <class T>
+inline u32 cache<T>::hash(mem_addr_t key) const
+{
+	/* Fibonacci hashing, the high product bits are the best mixed */
+	u64 h = static_cast<u64> (key) * 11400714819323198485ULL;
+	return static_cast<u32> (h >> 32) & (m_capacity - 1);
+}
+
+
+/**
+ * @brief Read a slot consistently, without locking
+ *
+ * @param[in] i the slot index
+ *
+ * @param[out] key the slot key
+ *
+ * @param[out] val the slot value
+ *
+ * @returns true if a consistent copy of the slot was read, false if the slot
+ * was being modified throughout the read attempts
+ */
+template <class T>
+bool cache<T>::read(u32 i, mem_addr_t &key, T &val) const
+{
+	slot &s = m_slots[i];
+	for (u32 retries = 0; likely(retries < g_snapshot_retries); retries++) {
+		u32 seq = load_acquire(s.m_seq);
+		if ( unlikely(seq & 1) )
+			continue;
+
+		key = s.m_key;
+		val = s.m_value;
+		fence_acquire();
+
+		if ( likely(load_acquire(s.m_seq) == seq) )
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * @brief Write a slot, concurrent readers will retry until the write is over
+ *
+ * @param[in] i the slot index
+ *
+ * @param[in] key the slot key
+ *
+ * @param[in] val the slot value
+ */
+template <class T>
+void cache<T>::write(u32 i, mem_addr_t key, const T &val)
+{
+	slot &s = m_slots[i];
+	store_release(s.m_seq, s.m_seq + 1);
+	fence_release();
+
+	s.m_key = key;
+	s.m_value = val;
+	s.m_ref = 0;
+
+	store_release(s.m_seq, s.m_seq + 1);
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] cap the slot count (a power of 2)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+template <class T>
+cache<T>::cache(u32 cap):
+m_slots(NULL),
+m_capacity(cap),
+m_size(0)
+{
+	if ( unlikely(cap == 0 || (cap & (cap - 1)) != 0) )
+		throw exception("invalid cache capacity (%d is not a power of 2)", cap);
+
+	m_slots = new slot[cap];
+	for (u32 i = 0; likely(i < cap); i++) {
+		m_slots[i].m_seq = 0;
+		m_slots[i].m_ref = 0;
+		m_slots[i].m_key = 0;
+	}
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+template <class T>
+inline cache<T>::cache(const cache &src):
+m_slots(NULL),
+m_capacity(0),
+m_size(0)
+{
+	*this = src;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+template <class T>
+inline cache<T>::~cache()
+{
+	delete[] m_slots;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+template <class T>
+inline cache<T>* cache<T>::clone() const
+{
+	return new cache(*this);
+}
+
+
+/**
+ * @brief Get the cache capacity
+ *
+ * @returns this->m_capacity
+ */
+template <class T>
+inline u32 cache<T>::capacity() const
+{
+	return m_capacity;
+}
+
+
+/**
+ * @brief Get the number of occupied slots
+ *
+ * @returns this->m_size
+ */
+template <class T>
+inline u32 cache<T>::size() const
+{
+	return m_size;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+template <class T>
+cache<T>& cache<T>::operator=(const cache &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	if (m_capacity != rval.m_capacity) {
+		slot *slots = new slot[rval.m_capacity];
+		delete[] m_slots;
+		m_slots = slots;
+		m_capacity = rval.m_capacity;
+	}
+
+	for (u32 i = 0; likely(i < m_capacity); i++) {
+		m_slots[i] = rval.m_slots[i];
+		m_slots[i].m_seq = 0;
+	}
+
+	m_size = rval.m_size;
+	return *this;
+}
+
+
+/**
+ * @brief Lookup a key in the cache
+ *
+ * @param[in] key the key
+ *
+ * @param[out] val the cached value, if the key is found
+ *
+ * @returns true if the key was found, false otherwise
+ *
+ * @note This method is lock-free and it can run concurrently with a writer
+ */
+template <class T>
+bool cache<T>::lookup(mem_addr_t key, T &val)
+{
+	if ( unlikely(key == 0) )
+		return false;
+
+	u32 mask = m_capacity - 1;
+	for (u32 i = hash(key), j = 0; likely(j < g_cache_probes); j++) {
+		mem_addr_t k;
+		T v;
+		if ( unlikely(!read(i, k, v)) )
+			break;
+
+		if (likely(k == key)) {
+			if ( unlikely(m_slots[i].m_ref == 0) )
+				m_slots[i].m_ref = 1;
+
+			val = v;
+			return true;
+		}
+
+		if (k == 0)
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	return false;
+}
+
+
+/**
+ * @brief Add an entry to the cache (or update the value of an existing key)
+ *
+ * If the probe window of the key is full, the first slot in it that was not
+ * referenced since it was last scanned is replaced (the scanned slots lose
+ * their referenced mark). If all the slots were referenced, the home slot of
+ * the key is replaced
+ *
+ * @param[in] key the key (must not be 0)
+ *
+ * @param[in] val the value
+ *
+ * @returns *this
+ *
+ * @attention Calls to this method must be serialized by the caller
+ */
+template <class T>
+cache<T>& cache<T>::add(mem_addr_t key, const T &val)
+{
+	__D_ASSERT(key != 0);
+	if ( unlikely(key == 0) )
+		return *this;
+
+	u32 mask = m_capacity - 1, home = hash(key), victim = m_capacity;
+	for (u32 i = home, j = 0; likely(j < g_cache_probes); j++) {
+		slot &s = m_slots[i];
+		if (s.m_key == key || s.m_key == 0) {
+			if (s.m_key == 0)
+				m_size++;
+
+			write(i, key, val);
+			return *this;
+		}
+
+		if (victim == m_capacity) {
+			if (s.m_ref == 0)
+				victim = i;
+			else
+				s.m_ref = 0;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	write((victim == m_capacity) ? home : victim, key, val);
+	return *this;
+}
+
+
+/**
+ * @brief Remove all the entries from the cache
+ *
+ * @returns *this
+ *
+ * @attention Calls to this method must be serialized by the caller
+ */
+template <class T>
+cache<T>& cache<T>::clear()
+{
+	for (u32 i = 0; likely(i < m_capacity); i++)
+		if (m_slots[i].m_key != 0)
+			write(i, 0, T());
+
+	m_size = 0;
+	return *this;
+}
+
+}
+
+#endif
+
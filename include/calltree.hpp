@@ -0,0 +1,120 @@
+#ifndef _CSDBG_CALLTREE
+#define _CSDBG_CALLTREE 1
+
+/**
+	@file include/calltree.hpp
+
+	@brief Class csdbg::calltree definition
+*/
+
+#include "./string.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Call path statistics of the instrumented code (a prefix tree)
+
+	A calltree object aggregates call stacks by their path. Each node stands for
+	a distinct call path (a function called from its parent node path) and
+	holds a weight, that is either a number of stack samples (see
+	tracer::sample) or the exclusive time spent in the path (see
+	thread::called and thread::returned). Identical stacks share their nodes, so
+	the tree size depends only on the number of distinct paths and not on how
+	many times they were seen.
+
+	The nodes are kept in an array (in creation order) indexed by an open
+	addressing hash table on the parent node and the function address. A node
+	id is its offset in the array plus 1 (id 0 stands for the tree root), so a
+	node is always created after its parent and the id of a node never changes.
+	Like in csdbg::profile, each thread updates its own tree without locking and
+	the old array is released under the global lock when the array grows, so
+	readers holding the lock can merge the tree of a running thread.
+
+	The tree is reported in the folded stack format ("a;b;c weight") read by the
+	flame graph tools (e.g flamegraph.pl, speedscope, inferno)
+
+	@see tracer::flamegraph
+*/
+class calltree: virtual public object
+{
+protected:
+
+	/**
+		@brief A call path node
+	*/
+	struct vertex {
+		mem_addr_t m_addr;							/**< @brief Function address */
+
+		u32 m_parent;										/**< @brief Parent node id */
+
+		u32 m_depth;										/**< @brief Path length */
+
+		u64 m_weight;										/**< @brief Sample count or time (nsec) */
+	};
+
+
+	/* Protected variables */
+
+	vertex *m_nodes;									/**< @brief Call path nodes */
+
+	u32 m_size;												/**< @brief Node count */
+
+	u32 m_capacity;										/**< @brief Node array capacity */
+
+	u32 *m_index;											/**< @brief Hash index (node id or 0) */
+
+	u32 m_index_sz;										/**< @brief Hash index size */
+
+
+	/* Protected static methods */
+
+	static u32 hash(u32, mem_addr_t);
+
+
+	/* Protected generic methods */
+
+	virtual calltree& grow();
+
+	virtual calltree& rehash(u32);
+
+	virtual u32 add(u32, mem_addr_t);
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	calltree();
+
+	calltree(const calltree&);
+
+	virtual ~calltree();
+
+	virtual calltree* clone() const;
+
+
+	/* Operator overloading methods */
+
+	virtual calltree& operator=(const calltree&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual u32 find(u32, mem_addr_t) const;
+
+	virtual u32 child(u32, mem_addr_t);
+
+	virtual calltree& charge(u32, u64);
+
+	virtual calltree& merge(const calltree&);
+
+	virtual calltree& clear();
+
+	virtual string& fold(string&, const i8* (*)(mem_addr_t, void*), void*) const;
+};
+
+}
+
+#endif
+
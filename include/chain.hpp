@@ -21,13 +21,21 @@ namespace csdbg {
 	of memory (per node) as a singly-linked list. The chain supports shared data
 	(multiple chains can point to the same data) but it's not thread safe, callers
 	should synchronize thread access. This implementation does not allow a node
-	with a NULL or a duplicate data pointer. A node can be detached (dispose the
-	node without deleting its data) or removed (dispose both node and data). A
-	chain can be traversed using simple callbacks	and method chain::foreach
+	with a NULL or a duplicate data pointer. Method chain::add enforces this with
+	a scan of the whole chain, callers that own freshly allocated data pointers
+	should use method chain::append instead, which adds a node in constant time.
+	Whole chains can be spliced in constant time, so bulk loads can be built in a
+	temporary chain and appended when complete. A node can be detached (dispose
+	the node without deleting its data) or removed (dispose both node and data).
+	A chain can be traversed using simple callbacks	and method chain::foreach, or
+	with a chain::iterator, in both directions. Offset access (chain::at) caches
+	the last accessed node (a cursor), so sequential access with offsets costs
+	amortized constant time per node. As the cursor is updated even by constant
+	methods, concurrent offset access must be synchronized too. Iterators keep
+	their own state, so concurrent traversals of a chain that is not modified are
+	safe
 
 	@see csdbg::node
-
-	@todo Implement cached pointers
 */
 template <class T>
 class chain: virtual public object
@@ -42,6 +50,17 @@ protected:
 
 	u32 m_size;												/**< @brief Node count */
 
+	mutable node<T> *m_cursor;				/**< @brief Last accessed node */
+
+	mutable node<T> *m_cursor_prev;		/**< @brief Node preceding the cursor */
+
+	mutable u32 m_cursor_pos;					/**< @brief Cursor offset */
+
+
+	/* Protected static methods */
+
+	static i32 compare(const void*, const void*);
+
 
 	/* Protected generic methods */
 
@@ -53,6 +72,49 @@ protected:
 
 public:
 
+	/**
+		@brief Bidirectional chain iterator
+
+		An iterator references a chain node and its predecessor, so it can step to
+		both directions in constant time. An iterator is invalidated when the node
+		it references is detached or removed
+	*/
+	class iterator
+	{
+	protected:
+
+		/* Protected variables */
+
+		node<T> *m_cur;									/**< @brief Current node */
+
+		node<T> *m_prev;								/**< @brief Preceding node */
+
+		u32 m_index;										/**< @brief Current node offset */
+
+	public:
+
+		/* Constructors */
+
+		iterator(node<T>* = NULL, node<T>* = NULL, u32 = 0);
+
+
+		/* Accessor methods */
+
+		bool valid() const;
+
+		u32 index() const;
+
+		T* data() const;
+
+
+		/* Generic methods */
+
+		iterator& next();
+
+		iterator& prev();
+	};
+
+
 	/* Constructors, copy constructors and destructor */
 
 	chain();
@@ -80,6 +142,10 @@ public:
 
 	virtual chain& add(T*);
 
+	virtual chain& append(T*);
+
+	virtual chain& append(chain&);
+
 	virtual chain& remove(u32);
 
 	virtual chain& clear();
@@ -88,10 +154,34 @@ public:
 
 	virtual T* detach(u32);
 
+	virtual iterator head() const;
+
+	virtual iterator tail() const;
+
 	virtual chain& foreach(void (*)(u32, T*)) const;
 };
 
 
+/**
+ * @brief Compare two data pointers by address
+ *
+ * @param[in] a the first data pointer
+ *
+ * @param[in] b the second data pointer
+ *
+ * @returns
+ *	less than, equal to or greater than 0 if a is lower than, equal to or
+ *	greater than b (qsort and bsearch callback)
+ */
+template <class T>
+i32 chain<T>::compare(const void *a, const void *b)
+{
+	mem_addr_t x = reinterpret_cast<mem_addr_t> (*static_cast<T* const*> (a));
+	mem_addr_t y = reinterpret_cast<mem_addr_t> (*static_cast<T* const*> (b));
+	return (x < y) ? -1 : (x > y);
+}
+
+
 /**
  * @brief Get the node at a chain offset
  *
@@ -107,21 +197,45 @@ node<T>* chain<T>::node_at(u32 i) const
 	if ( unlikely(i >= m_size) )
 		throw exception("offset out of chain bounds (%d >= %d)", i, m_size);
 
-	/* Select traversal direction */
-	node<T> *cur = m_head;
-	i32 j = i, mid = m_size / 2;
-	if (j >= mid) {
-		j = m_size - i - 1;
+	/*
+	 * Select the nearest starting node (head, tail or cursor) and the traversal
+	 * direction. When traversing backwards, prev is the following node
+	 */
+	node<T> *cur = m_head, *prev = NULL, *next;
+	u32 dist = i;
+	bool fwd = true;
+	if (m_size - i - 1 < dist) {
+		dist = m_size - i - 1;
 		cur = m_tail;
+		fwd = false;
+	}
+
+	if ( likely(m_cursor != NULL) ) {
+		if (i >= m_cursor_pos && i - m_cursor_pos < dist) {
+			dist = i - m_cursor_pos;
+			cur = m_cursor;
+			prev = m_cursor_prev;
+			fwd = true;
+		}
+
+		else if (i < m_cursor_pos && m_cursor_pos - i < dist) {
+			dist = m_cursor_pos - i;
+			cur = m_cursor;
+			prev = m_cursor->link(m_cursor_prev);
+			fwd = false;
+		}
 	}
 
-	node<T> *prev = NULL, *next;
-	while ( likely(j-- > 0) ) {
+	while ( likely(dist-- > 0) ) {
 		next = cur->link(prev);
 		prev = cur;
 		cur = next;
 	}
 
+	/* Cache the accessed node */
+	m_cursor = cur;
+	m_cursor_prev = (fwd) ? prev : cur->link(prev);
+	m_cursor_pos = i;
 	return cur;
 }
 
@@ -166,17 +280,9 @@ node<T>* chain<T>::node_with(const T *d) const
 template <class T>
 node<T>* chain<T>::detach_node(u32 i)
 {
-	if ( unlikely(i >= m_size) )
-		throw exception("offset out of chain bounds (%d >= %d)", i, m_size);
-
-	node<T> *cur = m_head, *prev = NULL, *next;
-	while ( likely(i-- > 0) ) {
-		next = cur->link(prev);
-		prev = cur;
-		cur = next;
-	}
-
-	next = cur->link(prev);
+	/* Locate the node and its predecessor, then invalidate the cursor */
+	node<T> *cur = node_at(i), *prev = m_cursor_prev, *next = cur->link(prev);
+	m_cursor = m_cursor_prev = NULL;
 
 	/* If it's the first in the chain */
 	if ( unlikely(cur == m_head) ) {
@@ -216,7 +322,10 @@ template <class T>
 inline chain<T>::chain():
 m_head(NULL),
 m_tail(NULL),
-m_size(0)
+m_size(0),
+m_cursor(NULL),
+m_cursor_prev(NULL),
+m_cursor_pos(0)
 {
 }
 
@@ -233,7 +342,10 @@ inline chain<T>::chain(const chain &src)
 try:
 m_head(NULL),
 m_tail(NULL),
-m_size(0)
+m_size(0),
+m_cursor(NULL),
+m_cursor_prev(NULL),
+m_cursor_pos(0)
 {
 	*this = src;
 }
@@ -290,7 +402,8 @@ inline u32 chain<T>::size() const
  *
  * @note
  *	Automatically resolves collisions when the chains overlap (when they have
- *	nodes with the same data pointer)
+ *	nodes with the same data pointer). The data pointers of rval are sorted to
+ *	find the shared ones, so the copy costs O((n + m) log m) instead of O(n * m)
  */
 template <class T>
 chain<T>& chain<T>::operator=(const chain &rval)
@@ -299,14 +412,29 @@ chain<T>& chain<T>::operator=(const chain &rval)
 		return *this;
 
 	/* Check if the chains overlap and detach shared data pointers */
-	node<T> *cur = m_head, *prev = NULL, *next;
-	while ( likely(cur != NULL) ) {
-		if ( unlikely(rval.node_with(cur->m_data) != NULL) )
-			cur->detach();
+	node<T> *cur, *prev, *next;
+	if ( likely(m_size > 0 && rval.m_size > 0) ) {
+		T **shared = new T*[rval.m_size];
+		u32 i = 0;
+		for (cur = rval.m_head, prev = NULL; likely(cur != NULL); i++) {
+			shared[i] = cur->m_data;
+			next = cur->link(prev);
+			prev = cur;
+			cur = next;
+		}
 
-		next = cur->link(prev);
-		prev = cur;
-		cur = next;
+		qsort(shared, rval.m_size, sizeof(T*), compare);
+		for (cur = m_head, prev = NULL; likely(cur != NULL); ) {
+			if ( unlikely(bsearch(&cur->m_data, shared, rval.m_size, sizeof(T*),
+														compare) != NULL) )
+				cur->detach();
+
+			next = cur->link(prev);
+			prev = cur;
+			cur = next;
+		}
+
+		delete[] shared;
 	}
 
 	clear();
@@ -316,7 +444,7 @@ chain<T>& chain<T>::operator=(const chain &rval)
 		T *copy = NULL;
 		try {
 			copy = new T(*cur->m_data);
-			add(copy);
+			append(copy);
 		}
 
 		catch (...) {
@@ -369,6 +497,30 @@ chain<T>& chain<T>::add(T *d)
 	if ( unlikely(node_with(d) != NULL) )
 		throw exception("chain @ %p already has a node with data @ %p", this, d);
 
+	return append(d);
+}
+
+
+/**
+ * @brief Add a node to the chain, without checking for duplicate data pointers
+ *
+ * @param[in] d the new node data pointer
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @attention
+ *	This method runs in constant time, the caller must guarantee that d is not
+ *	already in the chain (e.g. it is freshly allocated)
+ */
+template <class T>
+chain<T>& chain<T>::append(T *d)
+{
+	if ( unlikely(d == NULL) )
+		throw exception("invalid argument: d (=%p)", d);
+
 	node<T> *n = new node<T>(d);
 
 	/* Add the node to the chain tail */
@@ -387,6 +539,40 @@ chain<T>& chain<T>::add(T *d)
 }
 
 
+/**
+ * @brief Move all the nodes of another chain to the tail of this chain
+ *
+ * @param[in,out] src the source chain (it is left empty)
+ *
+ * @returns *this
+ *
+ * @attention
+ *	This method runs in constant time, the caller must guarantee that the chains
+ *	don't overlap (they have no nodes with the same data pointer)
+ */
+template <class T>
+chain<T>& chain<T>::append(chain &src)
+{
+	if ( unlikely(this == &src || src.m_head == NULL) )
+		return *this;
+
+	/* Link the tail of this chain with the head of the source chain */
+	if ( likely(m_head != NULL) ) {
+		m_tail->link_to(src.m_head);
+		src.m_head->link_to(m_tail);
+	}
+	else
+		m_head = src.m_head;
+
+	m_tail = src.m_tail;
+	m_size += src.m_size;
+
+	src.m_head = src.m_tail = src.m_cursor = src.m_cursor_prev = NULL;
+	src.m_size = 0;
+	return *this;
+}
+
+
 /**
  * @brief Dispose the node (and its data) at a chain offset
  *
@@ -421,7 +607,7 @@ chain<T>& chain<T>::clear()
 		cur = next;
 	}
 
-	m_head = m_tail = NULL;
+	m_head = m_tail = m_cursor = m_cursor_prev = NULL;
 	m_size = 0;
 	return *this;
 }
@@ -489,6 +675,126 @@ chain<T>& chain<T>::foreach(void (*pfunc)(u32, T*)) const
 	return const_cast<chain<T>&> (*this);
 }
 
+
+/**
+ * @brief Get an iterator to the chain head
+ *
+ * @returns the iterator (invalid if the chain is empty)
+ */
+template <class T>
+inline typename chain<T>::iterator chain<T>::head() const
+{
+	return iterator(m_head, NULL, 0);
+}
+
+
+/**
+ * @brief Get an iterator to the chain tail
+ *
+ * @returns the iterator (invalid if the chain is empty)
+ */
+template <class T>
+inline typename chain<T>::iterator chain<T>::tail() const
+{
+	if ( unlikely(m_tail == NULL) )
+		return iterator();
+
+	return iterator(m_tail, m_tail->link(), m_size - 1);
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] cur the current node
+ *
+ * @param[in] prev the node preceding cur
+ *
+ * @param[in] i the offset of cur
+ */
+template <class T>
+inline chain<T>::iterator::iterator(node<T> *cur, node<T> *prev, u32 i):
+m_cur(cur),
+m_prev(prev),
+m_index(i)
+{
+}
+
+
+/**
+ * @brief Check if the iterator references a node
+ *
+ * @returns true if the iterator references a node, false if the traversal is
+ * over
+ */
+template <class T>
+inline bool chain<T>::iterator::valid() const
+{
+	return m_cur != NULL;
+}
+
+
+/**
+ * @brief Get the offset of the current node
+ *
+ * @returns this->m_index
+ */
+template <class T>
+inline u32 chain<T>::iterator::index() const
+{
+	return m_index;
+}
+
+
+/**
+ * @brief Get the data pointer of the current node
+ *
+ * @returns the current node data pointer or NULL if the iterator is invalid
+ */
+template <class T>
+inline T* chain<T>::iterator::data() const
+{
+	return likely(m_cur != NULL) ? m_cur->m_data : NULL;
+}
+
+
+/**
+ * @brief Step to the following node
+ *
+ * @returns *this
+ */
+template <class T>
+inline typename chain<T>::iterator& chain<T>::iterator::next()
+{
+	if ( likely(m_cur != NULL) ) {
+		node<T> *next = m_cur->link(m_prev);
+		m_prev = m_cur;
+		m_cur = next;
+		m_index++;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Step to the preceding node
+ *
+ * @returns *this
+ */
+template <class T>
+inline typename chain<T>::iterator& chain<T>::iterator::prev()
+{
+	if ( likely(m_cur != NULL) ) {
+		node<T> *prev = (likely(m_prev != NULL)) ? m_prev->link(m_cur) : NULL;
+		m_cur = m_prev;
+		m_prev = prev;
+		m_index--;
+	}
+
+	return *this;
+}
+
 }
 
 #endif
@@ -22,6 +22,7 @@
 #include <cstdio>
 #include <cerrno>
 #include <cctype>
+#include <ctime>
 
 
 #ifdef __cplusplus
@@ -35,6 +36,7 @@ extern "C" {
 #include <link.h>
 #include <bfd.h>
 #include <sys/stat.h>
+#include <sys/auxv.h>
 
 #ifdef CSDBG_WITH_STREAMBUF
 #include <sys/time.h>
@@ -55,6 +57,18 @@ extern "C" {
 #include <sys/mman.h>
 #endif
 
+#if defined CSDBG_WITH_SAMPLER || defined CSDBG_WITH_CRASHDUMP
+#include <signal.h>
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+#include <sys/syscall.h>
+#endif
+
+#ifdef CSDBG_WITH_CRASHDUMP
+#include <fcntl.h>
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -111,6 +125,11 @@ typedef unsigned int				u32;
 */
 typedef unsigned long long	u64;
 
+/**
+	@brief Double precision floating point number
+*/
+typedef double							f64;
+
 /**
 	@brief File metadata
 */
@@ -156,6 +175,112 @@ typedef struct sockaddr			ip_addr_t;
 */
 typedef void (*							modsym_t)(void*, void*);
 
+/**
+	@brief
+		Instrumentation event, as passed to batched plugin callbacks. A batched
+		callback (mod_enter_batch) is a modsym_t, called with the address of the
+		first event of an array and the address past its last event
+*/
+typedef struct {
+	u64 time;										/**< @brief Timestamp (nsec, monotonic clock) */
+
+	void *fn;										/**< @brief Called (or returning) function */
+
+	void *site;									/**< @brief Call site (or return address) */
+
+	u32 type;										/**< @brief Event type (g_event_*) */
+} modevent_t;
+
+#endif
+
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+
+/**
+	@brief
+		Binary event trace file header. A trace file starts with a header followed
+		by blocks of records, each block is a traceblock_t header followed by the
+		block records (all fields are in host byte order)
+*/
+typedef struct {
+	i8 magic[8];								/**< @brief File signature (g_trace_magic) */
+
+	u32 version;								/**< @brief File format version */
+
+	u32 pid;										/**< @brief Traced process id */
+
+	u64 clock;									/**< @brief Monotonic clock at start (nsec) */
+
+	u64 epoch;									/**< @brief Real time clock at start (nsec) */
+} tracehdr_t;
+
+/**
+	@brief Binary event trace block header
+*/
+typedef struct {
+	u32 type;										/**< @brief Block type (g_block_*) */
+
+	u32 count;									/**< @brief Record count */
+
+	u64 thread;									/**< @brief Recording thread id */
+
+	u64 dropped;								/**< @brief Events lost before the block */
+} traceblock_t;
+
+/**
+	@brief Binary event trace record
+*/
+typedef struct {
+	u64 time;										/**< @brief Timestamp (nsec, monotonic clock) */
+
+	u64 fn;											/**< @brief Called (or returning) function */
+
+	u64 site;										/**< @brief Call site (or return address) */
+
+	u32 type;										/**< @brief Event type (g_event_*) */
+
+	u32 reserved;								/**< @brief Reserved (0) */
+} traceevent_t;
+
+/**
+	@brief
+		Binary event trace module record (module load map). It is followed by the
+		module path (path_sz bytes, including the terminating null) and build id
+		(id_sz bytes), and padded with zeros to a multiple of 8 bytes
+*/
+typedef struct {
+	u64 base;										/**< @brief Load base address */
+
+	u32 path_sz;								/**< @brief Path size (bytes) */
+
+	u32 id_sz;									/**< @brief Build id size (bytes) */
+} tracemod_t;
+
+/**
+	@brief Binary event trace crash record (see csdbg::crashdump)
+*/
+typedef struct {
+	u32 signo;									/**< @brief Signal number */
+	i32 code;										/**< @brief Signal code (si_code) */
+	u64 addr;										/**< @brief Fault address (si_addr) */
+	u64 time;										/**< @brief Timestamp (nsec, monotonic clock) */
+} tracecrash_t;
+
+/**
+	@brief
+		Binary event trace call stack record (see csdbg::crashdump). It is followed
+		by the function name (name_sz bytes, including the terminating null, 0 if
+		the name was not resolved) and padded with zeros to a multiple of 8 bytes.
+		The first record of a block names the thread (fn and site are 0), the
+		rest are its calls, the stack bottom first
+*/
+typedef struct {
+	u64 fn;											/**< @brief Called function */
+	u64 site;										/**< @brief Call site */
+	u32 name_sz;								/**< @brief Name size (bytes) */
+	u32 reserved;								/**< @brief Reserved (0) */
+} traceframe_t;
+
 #endif
 
 
@@ -189,6 +314,73 @@ static const i8 g_prefix[] = "/usr/local";
 */
 static const i8 g_libs_env[] = "CSDBG_LIBS";
 
+#ifdef CSDBG_WITH_PROFILER
+/**
+	@brief Profile report file shell variable
+
+	@see tracer::on_lib_unload
+*/
+static const i8 g_profile_env[] = "CSDBG_PROFILE";
+#endif
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+/**
+	@brief Folded stack (flame graph) report file shell variable
+
+	@see tracer::on_lib_unload
+*/
+static const i8 g_flamegraph_env[] = "CSDBG_FLAMEGRAPH";
+#endif
+
+#ifdef CSDBG_WITH_CRASHDUMP
+/**
+	@brief Crash dump file shell variable
+
+	@see tracer::on_lib_load
+*/
+static const i8 g_crashdump_env[] = "CSDBG_CRASHDUMP";
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+/**
+	@brief
+		Sampling profiler shell variable. If it is set, the instrumented threads
+		are sampled, with the period (usec of thread CPU time) it is set to or
+		the default period (g_sample_period) if it is not a positive number
+
+	@see tracer::on_lib_load
+*/
+static const i8 g_sampler_env[] = "CSDBG_SAMPLER";
+#endif
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+/**
+	@brief Binary event trace file shell variable
+
+	@see tracer::on_lib_load
+*/
+static const i8 g_trace_env[] = "CSDBG_TRACE";
+
+/**
+	@brief
+		Binary event trace drop policy shell variable. If it is set to 'oldest',
+		the oldest events are overwritten when a ring buffer is full, otherwise
+		the newest events are dropped
+
+	@see csdbg::ring
+*/
+static const i8 g_trace_drop_env[] = "CSDBG_TRACE_DROP";
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+/**
+	@brief Chrome trace event (JSON) timeline file shell variable
+
+	@see tracer::on_lib_load
+*/
+static const i8 g_timeline_env[] = "CSDBG_TIMELINE";
+#endif
+
 /**
 	@brief Library version major
 */
@@ -206,6 +398,281 @@ static const u16 g_minor = 28;
 */
 static const u16 g_memblock_sz = 64;
 
+/**
+	@brief Per-thread symbol lookup memo size (must be a power of 2)
+
+	@see thread::recall
+*/
+static const u32 g_memo_sz = 256;
+
+/**
+	@brief Initial capacity (in frames) of a simulated call stack
+
+	@see thread::called
+*/
+static const u32 g_frames_sz = 64;
+
+/**
+	@brief Maximum attempts to copy a concurrently modified simulated call stack
+
+	@see thread::snapshot
+*/
+static const u32 g_snapshot_retries = 1024;
+
+/**
+	@brief Maximum number of exited thread objects kept for reuse
+
+	@see process::release_thread
+*/
+static const u32 g_thread_pool_sz = 64;
+
+/**
+	@brief Process symbol lookup cache capacity (must be a power of 2)
+
+	@see csdbg::cache
+*/
+static const u32 g_cache_sz = 4096;
+
+/**
+	@brief Maximum length of a cache probe sequence
+
+	@see csdbg::cache
+*/
+static const u32 g_cache_probes = 8;
+
+
+#ifdef CSDBG_WITH_PROFILER
+
+/**
+	@brief Initial capacity (in functions) of a profile
+
+	@see csdbg::profile
+*/
+static const u32 g_profile_sz = 256;
+
+#ifdef CSDBG_WITH_HISTOGRAM
+/**
+	@brief
+		Latency histogram sub-bucket bits. Each power of 2 range of latencies is
+		split in 2^g_hist_bits buckets, for a relative precision of 1/16
+
+	@see profile::bucket
+*/
+static const u32 g_hist_bits = 4;
+
+/**
+	@brief
+		Latency histogram range (in bits). Longer latencies (about 68 seconds)
+		are recorded in the last bucket
+
+	@see profile::bucket
+*/
+static const u32 g_hist_range = 36;
+
+/**
+	@brief Latency histogram size (in buckets)
+
+	@see profile::bucket
+*/
+static const u32 g_hist_sz = (g_hist_range - g_hist_bits + 1) << g_hist_bits;
+#endif
+
+#endif
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+/**
+	@brief Initial capacity (in call paths) of a call path tree
+
+	@see csdbg::calltree
+*/
+static const u32 g_calltree_sz = 256;
+
+/**
+	@brief Maximum sampled call depth (deeper frames are not sampled)
+
+	@see tracer::sample
+*/
+static const u32 g_sample_depth = 256;
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+/**
+	@brief
+		Default sampling period (usec of thread CPU time). The thread CPU time
+		timers expire on scheduler ticks, so shorter periods than a tick are
+		effectively rounded up to it
+
+	@see csdbg::sampler
+*/
+static const u32 g_sample_period = 10000;
+
+/**
+	@brief
+		Per-thread sample buffer size (in words, must be a power of 2). A sample
+		takes a word for its depth and a word per sampled frame
+
+	@see csdbg::sampler
+*/
+static const u32 g_sample_buf = 4096;
+
+/**
+	@brief Sample aggregation period (usec)
+
+	@see sampler::aggregator
+*/
+static const u32 g_sampler_drain = 100000;
+#endif
+
+#ifdef CSDBG_WITH_CRASHDUMP
+/**
+	@brief The fatal signals that trigger a crash dump
+
+	@see csdbg::crashdump
+*/
+static const i32 g_crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+/**
+	@brief The number of the fatal signals that trigger a crash dump
+
+	@see csdbg::crashdump
+*/
+static const u32 g_crash_signal_cnt = sizeof(g_crash_signals) / sizeof(i32);
+
+/**
+	@brief Maximum number of threads in a crash dump
+
+	@see csdbg::crashdump
+*/
+static const u32 g_crash_threads = 256;
+
+/**
+	@brief Maximum call depth dumped per thread (deeper frames are not dumped)
+
+	@see csdbg::crashdump
+*/
+static const u32 g_crash_depth = 1024;
+
+/**
+	@brief Crash dump output buffer size (in bytes)
+
+	@see csdbg::crashdump
+*/
+static const u32 g_crash_buf = 4096;
+#endif
+
+
+#ifdef CSDBG_WITH_PLUGIN
+
+/**
+	@brief Per-thread capacity (in events) of the batched plugin event buffer
+
+	@see tracer::call_plugins
+*/
+static const u32 g_events_sz = 1024;
+
+#endif
+
+
+#if defined CSDBG_WITH_PLUGIN || defined CSDBG_WITH_EVENT_TRACE
+
+/**
+	@brief Function call event type
+
+	@see modevent_t
+*/
+static const u32 g_event_call = 0;
+
+/**
+	@brief Function return event type
+
+	@see modevent_t
+*/
+static const u32 g_event_return = 1;
+
+#endif
+
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+
+/**
+	@brief Per-thread capacity (in events) of a binary event trace ring buffer
+
+	@see csdbg::ring
+*/
+static const u32 g_ring_sz = 8192;
+
+/**
+	@brief Binary event trace writer polling period (usec)
+
+	@see recorder::writer
+*/
+static const u32 g_trace_period = 10000;
+
+/**
+	@brief Binary event trace file signature
+
+	@see tracehdr_t
+*/
+static const i8 g_trace_magic[] = "CSDBGEVT";
+
+/**
+	@brief Binary event trace file format version
+
+	@see tracehdr_t
+*/
+static const u32 g_trace_version = 1;
+
+/**
+	@brief Binary event trace block of traceevent_t records
+
+	@see traceblock_t
+*/
+static const u32 g_block_events = 0;
+
+/**
+	@brief Binary event trace block of tracemod_t records
+
+	@see traceblock_t
+*/
+static const u32 g_block_modules = 1;
+
+/**
+	@brief Binary event trace block of a tracecrash_t record
+
+	@see traceblock_t
+*/
+static const u32 g_block_crash = 2;
+
+/**
+	@brief Binary event trace block of traceframe_t records (a thread call stack)
+
+	@see traceblock_t
+*/
+static const u32 g_block_stack = 3;
+
+/**
+	@brief Maximum size (in bytes) of a recorded module build id
+
+	@see util::build_id
+*/
+static const u32 g_build_id_sz = 64;
+
+#endif
+
+
+#ifdef CSDBG_WITH_TIMELINE
+
+/**
+	@brief
+		Buffered size (in bytes) of a timeline stream, beyond which the buffer is
+		flushed
+
+	@see timeline::commit
+*/
+static const u32 g_timeline_flush = 65536;
+
+#endif
+
 
 #ifdef CSDBG_WITH_STREAMBUF_TCP
 
@@ -363,6 +830,42 @@ if (!(x)) { 																								\
 */
 #define precache_w(addr)		__builtin_prefetch((addr), 1, 3)
 
+/**
+	@brief Load a variable with acquire semantics (no read-modify-write)
+*/
+#define load_acquire(var)		__atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+
+/**
+	@brief Store to a variable with release semantics (no read-modify-write)
+*/
+#define store_release(var, val)	__atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+
+/**
+	@brief Order all prior stores before any subsequent store
+*/
+#define fence_release()			__atomic_thread_fence(__ATOMIC_RELEASE)
+
+/**
+	@brief Order all prior loads before any subsequent load
+*/
+#define fence_acquire()			__atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+/**
+	@brief Order all prior loads and stores before any subsequent load or store
+*/
+#define fence_full()				__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/**
+	@brief Atomically increment a statistics counter (no ordering guarantees)
+*/
+#define count_relaxed(var)	__atomic_add_fetch(&(var), 1, __ATOMIC_RELAXED)
+
+/**
+	@brief Atomically replace the value of a variable and return the old one
+*/
+#define exchange_acq_rel(var, val)	\
+	__atomic_exchange_n(&(var), (val), __ATOMIC_ACQ_REL)
+
 #else
 
 #define likely(expr)				(expr)
@@ -373,6 +876,20 @@ if (!(x)) { 																								\
 
 #define precache_w(addr)
 
+#define load_acquire(var)		(var)
+
+#define store_release(var, val)	((var) = (val))
+
+#define fence_release()
+
+#define fence_acquire()
+
+#define fence_full()
+
+#define count_relaxed(var)	(++(var))
+
+#define exchange_acq_rel(var, val)	__sync_lock_test_and_set(&(var), (val))
+
 #endif
 
 #endif
@@ -0,0 +1,128 @@
+#ifndef _CSDBG_CRASHDUMP
+#define _CSDBG_CRASHDUMP 1
+
+/**
+	@file include/crashdump.hpp
+
+	@brief Class csdbg::crashdump definition
+*/
+
+#include "./process.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Async-signal-safe crash dumper
+
+	A crashdump object handles the fatal signals (g_crash_signals) and, when one
+	is delivered, dumps the simulated call stack of every instrumented thread to
+	a file, before the signal takes its course. Producing a stack trace (e.g
+	with tracer::dump) allocates memory, takes locks and resolves symbols, none
+	of which is safe in a signal handler, so the dump holds only the raw frames
+	(function addresses and call sites) and the function names already resolved.
+	The file is opened when the object is created, and the file header and the
+	module load map are written beforehand, so the handler only copies the
+	stacks to a preallocated buffer and writes it with write(2). The dump is in
+	the binary event trace format (a g_block_crash block followed by a
+	g_block_stack block per thread, see traceframe_t), it is symbolized offline
+	by csdbg-decode (see extra/csdbg-decode.cpp).
+
+	The crashing thread dumps the stacks, any other thread that crashes
+	meanwhile waits for it. The replaced signal actions are restored before the
+	handler returns, so the fault recurs and is handled as it would without the
+	dumper (e.g a core is dumped)
+
+	@see tracer::on_lib_load
+*/
+class crashdump: virtual public object
+{
+protected:
+
+	/* Protected static variables */
+
+	static crashdump *m_active;				/**< @brief The armed dumper */
+
+	static bool m_dumping;						/**< @brief A dump is in progress */
+
+
+	/* Protected variables */
+
+	process *m_proc;									/**< @brief Dumped process */
+
+	i8 *m_path;												/**< @brief Dump file path */
+
+	i32 m_fd;													/**< @brief Dump file descriptor */
+
+	frame *m_frames;									/**< @brief Call stack buffer */
+
+	const thread **m_threads;					/**< @brief Thread buffer */
+
+	u8 *m_buffer;											/**< @brief Output buffer */
+
+	u32 m_length;											/**< @brief Buffered bytes */
+
+	bool m_armed;											/**< @brief The handler is installed */
+
+	/** @brief Replaced signal actions */
+	struct sigaction m_actions[g_crash_signal_cnt];
+
+
+	/* Protected static methods */
+
+	static void handler(i32, siginfo_t*, void*);
+
+	static bool put(i32, const void*, u32);
+
+
+	/* Protected generic methods */
+
+	virtual crashdump& destroy();
+
+	virtual crashdump& append(const void*, u32);
+
+	virtual crashdump& append_frame(mem_addr_t, mem_addr_t, const i8*);
+
+	virtual crashdump& flush();
+
+	virtual crashdump& dump_thread(const thread*);
+
+	virtual crashdump& dump(i32, const siginfo_t*);
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	crashdump(process*, const i8*);
+
+	crashdump(const crashdump&);
+
+	virtual ~crashdump();
+
+	virtual crashdump* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual const i8* path() const;
+
+	virtual bool is_armed() const;
+
+
+	/* Operator overloading methods */
+
+	virtual crashdump& operator=(const crashdump&);
+
+
+	/* Generic methods */
+
+	virtual crashdump& add_module(const i8*, mem_addr_t, const u8*, u32);
+
+	virtual crashdump& arm();
+
+	virtual crashdump& disarm();
+};
+
+}
+
+#endif
+
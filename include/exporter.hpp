@@ -0,0 +1,95 @@
+#ifndef _CSDBG_EXPORTER
+#define _CSDBG_EXPORTER 1
+
+/**
+	@file include/exporter.hpp
+
+	@brief Class csdbg::exporter definition
+*/
+
+#include "./recorder.hpp"
+#include "./timeline.hpp"
+#include "./process.hpp"
+#include "./string.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Chrome trace event (JSON) timeline recorder
+
+	An exporter object is an event trace recorder that writes a Chrome trace
+	event timeline (see csdbg::timeline) instead of a binary trace. The events
+	are buffered exactly as by csdbg::recorder, each instrumented thread appends
+	them to its own ring without any locking, and the background writer thread
+	resolves their function symbols and formats them. A thread may exit before
+	its events are formatted, so its name is copied when it records its first
+	event and whenever it changes. Like the simulated call stack, the timeline
+	includes only the functions with a resolved symbol. If a ring fills up
+	before it is drained, events are dropped and the timeline may miss the
+	beginning or the end of some durations
+
+	@see tracer::export_event
+*/
+class exporter: public recorder
+{
+protected:
+
+	/* Protected static variables */
+
+	static __thread u32 m_named;				/**< @brief Copied name hash (TLS) */
+
+
+	/* Protected variables */
+
+	process *m_proc;									/**< @brief Traced process */
+
+	timeline *m_timeline;							/**< @brief Timeline formatter */
+
+	const i8 **m_symbols;							/**< @brief Resolved block symbols */
+
+	chain<string> *m_names;						/**< @brief Copied thread names */
+
+	u64 *m_tids;											/**< @brief Named thread ids */
+
+	u32 m_tid_cnt;										/**< @brief Named thread count */
+
+
+	/* Protected generic methods */
+
+	virtual exporter& name_thread(u64, const i8*);
+
+	virtual exporter& open();
+
+	virtual exporter& write(const traceblock_t&, const traceevent_t*);
+
+	virtual exporter& destroy();
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	exporter(process*, const i8*, bool = false, u32 = g_ring_sz);
+
+	exporter(const exporter&);
+
+	virtual ~exporter();
+
+	virtual exporter* clone() const;
+
+
+	/* Operator overloading methods */
+
+	virtual exporter& operator=(const exporter&);
+
+
+	/* Generic methods */
+
+	virtual exporter& record(mem_addr_t, mem_addr_t, u32);
+
+	virtual exporter& add_module(const i8*, mem_addr_t, const u8*, u32);
+};
+
+}
+
+#endif
+
@@ -67,6 +67,8 @@ public:
 
 	virtual filebuf& flush();
 
+	virtual filebuf& write(const void*, u32);
+
 	virtual filebuf& sync() const;
 
 	virtual filebuf& sync(bool) const;
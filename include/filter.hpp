@@ -28,6 +28,10 @@ protected:
 
 	regex_t m_expr;										/**< @brief Filter expression */
 
+	i8 *m_text;												/**< @brief Filter expression source */
+
+	bool m_icase;											/**< @brief Case insensitivity switch */
+
 	bool m_mode;											/**< @brief Filter type switch */
 
 
@@ -62,6 +66,10 @@ public:
 
 	virtual bool mode() const;
 
+	virtual const i8* expr() const;
+
+	virtual bool icase() const;
+
 	virtual filter& set_expr(const i8*, bool);
 
 	virtual filter& set_mode(bool);
@@ -0,0 +1,239 @@
+#ifndef _CSDBG_FRAME
+#define _CSDBG_FRAME 1
+
+/**
+	@file include/frame.hpp
+
+	@brief Class csdbg::frame definition and method implementation
+*/
+
+#include "./object.hpp"
+
+namespace csdbg {
+
+/**
+	@brief This class represents a frame of a simulated call stack
+
+	A frame records a function call (the function address, the call site address
+	and a reference to the function name) in a fixed size record. The simulated
+	call stack of each thread is a contiguous, growable array of frames, so that
+	pushing and popping a call requires no memory allocation and any frame can
+	be accessed in constant time. The name is not copied, it is owned by the
+	process namespace (see csdbg::process). Unlike most library classes, frame
+	is not a csdbg::object descendant and has no virtual methods, so that frame
+	arrays can be copied and relocated as plain memory. If the built-in profiler
+	is enabled (CSDBG_WITH_PROFILER), a frame also records the call timestamp
+	and the time spent in the callees of the call and, with
+	CSDBG_WITH_FLAMEGRAPH, the call path node of the call
+
+	@see csdbg::thread
+*/
+class frame
+{
+protected:
+
+	/* Protected variables */
+
+	mem_addr_t m_addr;						/**< @brief Function address */
+
+	mem_addr_t m_site;						/**< @brief Call site address */
+
+	const i8 *m_name;							/**< @brief
+																 Function name (NULL until resolved, see
+																 CSDBG_WITH_LAZY_SYMBOLS) */
+
+#ifdef CSDBG_WITH_PROFILER
+	u64 m_start;									/**< @brief Call timestamp (nsec) */
+
+	u64 m_callees;								/**< @brief Time spent in callees (nsec) */
+
+	u32 m_entry;									/**< @brief Profile statistics offset */
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	u32 m_path;										/**< @brief Call path node id */
+#endif
+
+public:
+
+	/* Accessor methods */
+
+	mem_addr_t addr() const;
+
+	mem_addr_t site() const;
+
+	const i8* name() const;
+
+	frame& set(mem_addr_t, mem_addr_t, const i8*);
+
+#ifdef CSDBG_WITH_PROFILER
+	u64 start() const;
+
+	u64 callees() const;
+
+	u32 entry() const;
+
+	frame& set_timing(u32, u64);
+
+	frame& charge(u64);
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	u32 path() const;
+
+	frame& set_path(u32);
+#endif
+};
+
+
+/**
+ * @brief Get the function address
+ *
+ * @returns this->m_addr
+ */
+inline mem_addr_t frame::addr() const
+{
+	return m_addr;
+}
+
+
+/**
+ * @brief Get the call site address
+ *
+ * @returns this->m_site
+ */
+inline mem_addr_t frame::site() const
+{
+	return m_site;
+}
+
+
+/**
+ * @brief Get the function name
+ *
+ * @returns this->m_name
+ */
+inline const i8* frame::name() const
+{
+	return m_name;
+}
+
+
+/**
+ * @brief Set the frame data
+ *
+ * @param[in] addr the function address
+ *
+ * @param[in] site the call site address
+ *
+ * @param[in] nm the function name (it is not copied, it can be NULL)
+ *
+ * @returns *this
+ */
+inline frame& frame::set(mem_addr_t addr, mem_addr_t site, const i8 *nm)
+{
+	m_addr = addr;
+	m_site = site;
+	m_name = nm;
+	return *this;
+}
+
+
+
+#ifdef CSDBG_WITH_PROFILER
+/**
+ * @brief Get the call timestamp
+ *
+ * @returns this->m_start
+ */
+inline u64 frame::start() const
+{
+	return m_start;
+}
+
+
+/**
+ * @brief Get the time spent in the callees of the call
+ *
+ * @returns this->m_callees
+ */
+inline u64 frame::callees() const
+{
+	return m_callees;
+}
+
+
+/**
+ * @brief Get the offset of the function statistics in the thread profile
+ *
+ * @returns this->m_entry
+ */
+inline u32 frame::entry() const
+{
+	return m_entry;
+}
+
+
+/**
+ * @brief Set the profiling data of the call
+ *
+ * @param[in] entry the offset of the function statistics in the thread profile
+ *
+ * @param[in] start the call timestamp (nsec)
+ *
+ * @returns *this
+ */
+inline frame& frame::set_timing(u32 entry, u64 start)
+{
+	m_entry = entry;
+	m_start = start;
+	m_callees = 0;
+	return *this;
+}
+
+
+/**
+ * @brief Charge the time of a returned callee to the call
+ *
+ * @param[in] t the inclusive time of the callee (nsec)
+ *
+ * @returns *this
+ */
+inline frame& frame::charge(u64 t)
+{
+	m_callees += t;
+	return *this;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+/**
+ * @brief Get the id of the call path node of the call
+ *
+ * @returns this->m_path
+ */
+inline u32 frame::path() const
+{
+	return m_path;
+}
+
+
+/**
+ * @brief Set the id of the call path node of the call
+ *
+ * @param[in] id the node id in the thread call path tree
+ *
+ * @returns *this
+ */
+inline frame& frame::set_path(u32 id)
+{
+	m_path = id;
+	return *this;
+}
+#endif
+
+}
+
+#endif
+
@@ -0,0 +1,130 @@
+#ifndef _CSDBG_LINETAB
+#define _CSDBG_LINETAB 1
+
+/**
+	@file include/linetab.hpp
+
+	@brief Class csdbg::linetab definition
+*/
+
+#include "./object.hpp"
+
+namespace csdbg {
+
+/**
+	@brief This class represents the line number table of a program/library
+
+	A linetab object parses the DWARF line number programs (the .debug_line
+	section, versions 2 to 5) of an objective code module once and keeps the
+	resulting rows sorted by address in contiguous arrays. The source file and
+	line of an address are then resolved in-process with a binary search, so no
+	external program (such as binutils addr2line) is needed. Only the base names
+	of the source files are kept, in a string pool. Line number information is
+	optional: if the module can't be read or has no (or unsupported, e.g. a
+	compressed) .debug_line section, the table is left empty. The access to a
+	linetab is not thread safe, callers must implement thread synchronization
+
+	@see process::addr2line
+*/
+class linetab: virtual public object
+{
+protected:
+
+	/**
+		@brief A loaded debug section
+	*/
+	struct section {
+		const u8 *m_data;								/**< @brief Section contents */
+
+		u32 m_size;											/**< @brief Section size (bytes) */
+	};
+
+
+	/* Protected variables */
+
+	i8 *m_path;												/**< @brief Objective code file path */
+
+	mem_addr_t *m_addrs;							/**< @brief Row addresses (sorted) */
+
+	u32 *m_lines;											/**< @brief Row lines (0 ends a sequence) */
+
+	u32 *m_files;											/**< @brief Row file name offsets */
+
+	i8 *m_strings;										/**< @brief File name string pool */
+
+	u32 m_size;												/**< @brief Row count */
+
+	u32 m_capacity;										/**< @brief Row table capacity */
+
+	u32 m_strings_sz;									/**< @brief String pool size (bytes) */
+
+	u32 m_pool_sz;										/**< @brief String pool capacity (bytes) */
+
+
+	/* Protected static methods */
+
+	static u8* load(bfd*, const i8*, u32&);
+
+	static u64 read(const u8*&, const u8*, u32);
+
+	static u64 uleb128(const u8*&, const u8*);
+
+	static i64 sleb128(const u8*&, const u8*);
+
+	static const i8* cstr(const u8*&, const u8*);
+
+	static const i8* form(const u8*&, const u8*, u64, u32, const section&,
+												const section&);
+
+
+	/* Protected generic methods */
+
+	virtual linetab& add(mem_addr_t, u32, u32);
+
+	virtual u32 intern(const i8*);
+
+	virtual const u8* parse(const u8*, const u8*, const section&,
+													const section&);
+
+	virtual linetab& swap(u32, u32);
+
+	virtual linetab& sift(u32, u32);
+
+	virtual linetab& sort();
+
+	virtual i32 find(mem_addr_t) const;
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	explicit linetab(const i8*);
+
+	linetab(const linetab&);
+
+	virtual ~linetab();
+
+	virtual linetab* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual const i8* path() const;
+
+
+	/* Operator overloading methods */
+
+	virtual linetab& operator=(const linetab&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual const i8* lookup(mem_addr_t, u32&) const;
+};
+
+}
+
+#endif
+
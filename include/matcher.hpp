@@ -0,0 +1,130 @@
+#ifndef _CSDBG_MATCHER
+#define _CSDBG_MATCHER 1
+
+/**
+	@file include/matcher.hpp
+
+	@brief Class csdbg::matcher definition
+*/
+
+#include "./chain.hpp"
+#include "./filter.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Combined matcher for a set of instrumentation filters
+
+	A matcher object compiles all the filters of a type (module or symbol filters)
+	into a single matcher that checks a text against the whole set in one pass and
+	reports the first matching filter, in registration order. The expressions that
+	are plain literals (optionally anchored with ^ and/or $, with escaped special
+	characters) are merged into an Aho-Corasick automaton. The automaton is stored
+	as a dense transition table over byte classes (the distinct bytes of all the
+	literals, case folded), so each character of the text costs a table lookup.
+	The expressions that use regular expression operators are kept as a fallback
+	and only the ones registered before the first literal match are applied. A
+	matcher refers to the filters it was built from, it must be rebuilt whenever
+	the filter set changes
+
+	@see tracer::apply_filters
+*/
+class matcher: virtual public object
+{
+protected:
+
+	/**
+		@brief A literal pattern
+	*/
+	struct pattern {
+		u32 m_index;										/**< @brief Filter registration index */
+
+		u32 m_offset;										/**< @brief Literal offset in the pool */
+
+		u32 m_length;										/**< @brief Literal length */
+
+		u32 m_next;											/**< @brief Next pattern of the state */
+
+		u8 m_flags;											/**< @brief Anchor and case flags */
+	};
+
+
+	/**
+		@brief A regular expression filter
+	*/
+	struct fallback {
+		const filter *m_filter;					/**< @brief Filter */
+
+		u32 m_index;										/**< @brief Filter registration index */
+	};
+
+
+	/* Protected variables */
+
+	pattern *m_patterns;							/**< @brief Literal patterns */
+
+	u32 m_size;												/**< @brief Literal pattern count */
+
+	i8 *m_strings;										/**< @brief Literal string pool */
+
+	u32 m_strings_sz;									/**< @brief String pool size (bytes) */
+
+	fallback *m_regexes;							/**< @brief Regular expression filters */
+
+	u32 m_regexes_sz;									/**< @brief Regular expression count */
+
+	u32 *m_delta;											/**< @brief Transitions (state x class) */
+
+	u32 *m_out;												/**< @brief First pattern of each state */
+
+	u32 *m_link;											/**< @brief Output links (suffix states) */
+
+	u32 m_states;											/**< @brief Automaton state count */
+
+	u32 m_width;											/**< @brief Byte class count */
+
+	u8 m_classes[256];								/**< @brief Byte class map */
+
+
+	/* Protected static methods */
+
+	static i8* literal(const i8*, u8&);
+
+
+	/* Protected generic methods */
+
+	virtual matcher& build();
+
+	virtual matcher& release();
+
+	virtual bool verify(const pattern&, const i8*, u32) const;
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	matcher(const chain<filter>*, bool);
+
+	matcher(const matcher&);
+
+	virtual ~matcher();
+
+	virtual matcher* clone() const;
+
+
+	/* Operator overloading methods */
+
+	virtual matcher& operator=(const matcher&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual i32 match(const i8*) const;
+};
+
+}
+
+#endif
+
@@ -34,7 +34,21 @@ namespace csdbg {
 	<b>mod_exit</b>, take two <b>void*</b> arguments and return <b>void</b> for
 	the plugin object to resolve them correctly. All plugin functions (as all
 	libcsdbg functions) must <b>NOT</b> be instrumented by libcsdbg, as this will
-	result in a recurse and a stack overflow
+	result in a recurse and a stack overflow.
+
+	A plugin may instead implement the <b>batched ABI</b>, a single callback named
+	<b>mod_enter_batch</b> with the same signature. The calls and returns are then
+	recorded in a per-thread buffer and the callback receives them in batches, as
+	an array of modevent_t structures (the first argument points to the first
+	event and the second past the last one). If a module exports the batched
+	callback, mod_enter and mod_exit are not resolved.
+
+	A plugin may request a <b>per-thread context</b> of a given size. The library
+	allocates it (zero filled) before the first callback of each thread and the
+	callbacks get it with tracer::plugin_context, so per-thread data needs no
+	synchronization. When a thread exits, the optional <b>mod_thread_exit</b>
+	callback is passed the context (and the pthread handle of the thread) before
+	the context is released
 
 	@see tracer::register_plugin, tracer::unregister_plugin
 	@see <a href="index.html#sec5_6"><b>5.6 Using the instrumentation plugin API</b></a>
@@ -49,11 +63,26 @@ protected:
 
 	modsym_t m_end;						/**< @brief Instrumentation ending callback */
 
+	modsym_t m_batch;					/**< @brief Batched instrumentation callback */
+
+	modsym_t m_exit;					/**< @brief Thread exit callback */
+
+	u32 m_ctxsz;							/**< @brief Per-thread context size (bytes) */
+
+	u32 m_slot;								/**< @brief Context slot (set by the tracer) */
+
+	u64 m_id;									/**< @brief Unique plugin identifier */
+
 	i8 *m_path;								/**< @brief Module file path */
 
 	void *m_handle;						/**< @brief DSO handle (as provided by dlopen) */
 
 
+	/* Protected static variables */
+
+	static u64 m_ids;					/**< @brief Plugin identifier counter */
+
+
 	/* Protected generic methods */
 
 	virtual plugin& destroy();
@@ -62,9 +91,9 @@ public:
 
 	/* Constructors, copy constructors and destructor */
 
-	explicit plugin(const i8*, const i8* = NULL);
+	explicit plugin(const i8*, const i8* = NULL, u32 = 0);
 
-	plugin(modsym_t, modsym_t);
+	plugin(modsym_t, modsym_t, modsym_t = NULL, u32 = 0, modsym_t = NULL);
 
 	plugin(const plugin&);
 
@@ -77,6 +106,16 @@ public:
 
 	virtual const i8* path() const;
 
+	virtual bool batched() const;
+
+	virtual u32 context_size() const;
+
+	virtual u32 slot() const;
+
+	virtual plugin& set_slot(u32);
+
+	virtual u64 id() const;
+
 
 	/* Operator overloading methods */
 
@@ -90,6 +129,10 @@ public:
 	virtual plugin& begin(void*, void*) const;
 
 	virtual plugin& end(void*, void*) const;
+
+	virtual plugin& batch(const modevent_t*, u32) const;
+
+	virtual plugin& thread_exit(void*) const;
 };
 
 }
@@ -7,8 +7,14 @@
 	@brief Class csdbg::process definition
 */
 
+#include "./chain.hpp"
 #include "./thread.hpp"
-#include "./symtab.hpp"
+#include "./segtab.hpp"
+#include "./cache.hpp"
+#include "./linetab.hpp"
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+#include "./calltree.hpp"
+#endif
 
 namespace csdbg {
 
@@ -20,9 +26,17 @@ namespace csdbg {
 	threads and their stacks. The namespace consists of a number of symbol tables,
 	one for each objective code module (executable and selected DSO libraries). A
 	process object offers methods to perform batch symbol lookups, inverse lookups
-	(given a resolved symbol find the module that defines it) and thread handling.
-	A lookup cache is used internally to optimize symbol resolving. Access to the
-	process object <b>is thread safe</b>
+	(given an address find the module that maps it, using a sorted index of the
+	module segments), filter application (each symbol table keeps the filter
+	verdict of its functions) and thread handling. A bounded, lock-free hash
+	cache is used internally to optimize symbol resolving. The line number table
+	of a module is loaded when it is first needed, to resolve source files and
+	lines in-process. Access to the process object <b>is thread safe</b>. The
+	thread object of the currently executing thread is kept in thread local
+	storage, so once a thread has been registered, retrieving it requires no
+	synchronization. When an instrumented thread exits, its object is released
+	automatically (through a pthread key destructor) and kept in a pool, to be
+	reused by threads created later
 
 	@todo Create an object mutex
 */
@@ -30,22 +44,63 @@ class process: virtual public object
 {
 protected:
 
+	/* Protected static variables */
+
+	static __thread thread *m_current;	/**< @brief Current thread (TLS) */
+
+
 	/* Protected variables */
 
 	pid_t m_pid;												/**< @brief Process ID */
 
 	chain<thread> *m_threads;						/**< @brief Instrumented thread list */
 
+	chain<thread> *m_pool;							/**< @brief Exited thread objects */
+
+	pthread_key_t m_key;								/**< @brief Thread exit notification key */
+
 	chain<symtab> *m_modules;						/**< @brief Symbol table list */
 
-	chain<symbol> *m_symcache;					/**< @brief Lookup cache */
+	chain<symtab> *m_retired;						/**< @brief Replaced symbol tables */
 
+	bool (*m_filter)(const i8*, bool, void*);	/**< @brief Filter callback */
 
-	/* Protected generic methods */
+	void *m_filter_arg;									/**< @brief Filter callback data */
+
+	segtab *m_segments;									/**< @brief Module segment index */
+
+	chain<segtab> *m_stale;							/**< @brief Replaced segment indices */
+
+	cache<const i8*> *m_symcache;				/**< @brief Lookup cache */
+
+	u64 m_hits;													/**< @brief
+																					 Lookup cache hits of exited and not
+																					 instrumented threads */
+
+	u64 m_misses;												/**< @brief Lookup cache misses */
+
+	chain<linetab> *m_lines;						/**< @brief Line number tables */
+
+#ifdef CSDBG_WITH_PROFILER
+	profile *m_profile;									/**< @brief Exited thread statistics */
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	calltree *m_calltree;								/**< @brief Exited thread call paths */
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	calltree *m_samples;								/**< @brief Sampled call paths */
+#endif
+
+
+	/* Protected static methods */
+
+	static void thread_exit(void*);
 
-	virtual process& cache_add(mem_addr_t, const i8*);
 
-	virtual const symbol* cache_lookup(mem_addr_t) const;
+	/* Protected generic methods */
+
+	virtual process& release_thread(u32);
 
 public:
 
@@ -64,6 +119,10 @@ public:
 
 	virtual pid_t pid() const;
 
+	virtual u64 cache_hits() const;
+
+	virtual u64 cache_misses() const;
+
 
 	/* Operator overloading methods */
 
@@ -78,12 +137,22 @@ public:
 
 	virtual u32 module_count() const;
 
-	virtual process& add_module(const i8*, mem_addr_t);
+	virtual process& add_module(const i8*, mem_addr_t, const dl_phdr_info* = NULL);
 
 	virtual const i8* lookup(mem_addr_t);
 
+	virtual const i8* lookup(mem_addr_t, mem_addr_t&) const;
+
+	virtual u32 lookup(frame*, u32);
+
 	virtual const i8* ilookup(mem_addr_t, mem_addr_t&) const;
 
+	virtual const i8* addr2line(mem_addr_t, u32&);
+
+	virtual bool traced(mem_addr_t) const;
+
+	virtual process& mark(bool (*)(const i8*, bool, void*), void*);
+
 
 	/* Thread handling methods */
 
@@ -91,6 +160,14 @@ public:
 
 	virtual thread* current_thread();
 
+#if defined CSDBG_WITH_SAMPLER || defined CSDBG_WITH_CRASHDUMP
+	static const thread* peek_thread();
+#endif
+
+#ifdef CSDBG_WITH_CRASHDUMP
+	virtual u32 peek_threads(const thread**, u32) const;
+#endif
+
 	virtual thread* get_thread(pthread_t) const;
 
 	virtual thread* get_thread(const i8*) const;
@@ -98,6 +175,22 @@ public:
 	virtual thread* get_thread(u32) const;
 
 	virtual process& cleanup_thread(pthread_t);
+
+	virtual bool quiescent(u64) const;
+
+#ifdef CSDBG_WITH_PROFILER
+	virtual profile* collect_profile() const;
+#endif
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	virtual calltree* collect_calltree(bool = false) const;
+
+	virtual process& sample();
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+	virtual process& add_sample(const mem_addr_t*, u32);
+#endif
 };
 
 }
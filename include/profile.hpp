@@ -0,0 +1,152 @@
+#ifndef _CSDBG_PROFILE
+#define _CSDBG_PROFILE 1
+
+/**
+	@file include/profile.hpp
+
+	@brief Class csdbg::profile definition
+*/
+
+#include "./string.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Per-function call statistics of the instrumented code
+
+	A profile object accumulates, for each instrumented function, the number of
+	calls and the inclusive (with callees) and exclusive (without callees) time
+	spent in it. Each thread records its calls in its own profile (see
+	thread::called and thread::returned) without any locking, the profiles are
+	merged when a report is produced. The inclusive time of recursive calls is
+	accounted once, when the outermost call returns.
+
+	The statistics are kept in an array (in first call order) indexed by an open
+	addressing hash table on the function address, so the offset of a function
+	in the array never changes and the simulated call stack frames can refer to
+	it. When the array grows, the old one is released under the global lock, so
+	readers holding the lock (see profile::merge) can safely access the profile
+	of a running thread, although the copied statistics may be slightly stale.
+
+	If CSDBG_WITH_HISTOGRAM is defined, a log-linear (HDR style) latency
+	histogram is also kept for each function. The latencies of each power of 2
+	range are counted in 2^g_hist_bits buckets, so the percentiles have a fixed
+	relative precision. The histogram is allocated when the function is first
+	called, recording a latency costs a bucket index computation and requires
+	no memory allocation
+
+	@see tracer::report
+*/
+class profile: virtual public object
+{
+protected:
+
+	/**
+		@brief The statistics of a function
+	*/
+	struct entry {
+		mem_addr_t m_addr;							/**< @brief Function address */
+
+		const i8 *m_name;								/**< @brief Function name (can be NULL) */
+
+		u64 m_calls;										/**< @brief Call count */
+
+		u64 m_incl;											/**< @brief Inclusive time (nsec) */
+
+		u64 m_excl;											/**< @brief Exclusive time (nsec) */
+
+		u32 m_active;										/**< @brief Active (recursive) calls */
+
+		u64 m_key;											/**< @brief Sort key */
+
+#ifdef CSDBG_WITH_HISTOGRAM
+		u32 *m_hist;										/**< @brief Latency histogram */
+
+		u64 m_max;											/**< @brief Maximum latency (nsec) */
+#endif
+	};
+
+
+	/* Protected variables */
+
+	entry *m_entries;									/**< @brief Function statistics */
+
+	u32 m_size;												/**< @brief Function count */
+
+	u32 m_capacity;										/**< @brief Statistics array capacity */
+
+	u32 *m_index;											/**< @brief Hash index (offset + 1 or 0) */
+
+	u32 m_index_sz;										/**< @brief Hash index size */
+
+
+	/* Protected static methods */
+
+	static i32 compare(const void*, const void*);
+
+#ifdef CSDBG_WITH_HISTOGRAM
+	static u32 bucket(u64);
+
+	static u64 bucket_value(u32);
+#endif
+
+
+	/* Protected generic methods */
+
+	virtual profile& grow();
+
+	virtual profile& rehash(u32);
+
+	virtual u32 add(mem_addr_t, const i8*);
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	profile();
+
+	profile(const profile&);
+
+	virtual ~profile();
+
+	virtual profile* clone() const;
+
+
+	/* Operator overloading methods */
+
+	virtual profile& operator=(const profile&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual i32 find(mem_addr_t) const;
+
+	virtual i32 find(const i8*) const;
+
+	virtual u32 enter(mem_addr_t, const i8*);
+
+	virtual profile& leave(u32, u64, u64);
+
+	virtual profile& merge(const profile&);
+
+	virtual profile& resolve(const i8* (*)(mem_addr_t, void*), void*);
+
+	virtual profile& sort(bool = false);
+
+	virtual profile& clear();
+
+	virtual string& report(string&, u32 = 0) const;
+
+#ifdef CSDBG_WITH_HISTOGRAM
+	virtual u64 percentile(u32, f64) const;
+
+	virtual string& latencies(string&, u32 = 0) const;
+#endif
+};
+
+}
+
+#endif
+
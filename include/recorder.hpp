@@ -0,0 +1,134 @@
+#ifndef _CSDBG_RECORDER
+#define _CSDBG_RECORDER 1
+
+/**
+	@file include/recorder.hpp
+
+	@brief Class csdbg::recorder definition
+*/
+
+#include "./chain.hpp"
+#include "./ring.hpp"
+#include "./filebuf.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Binary event trace recorder
+
+	A recorder object writes a binary trace of the instrumentation events (each
+	function call and return, with a timestamp, the function address and the
+	call site) to a file. Each instrumented thread appends its events to its own
+	csdbg::ring, without any locking, and a background writer thread drains the
+	rings periodically and writes them to the file in blocks (see tracehdr_t and
+	traceblock_t). The instrumented threads never wait for the file I/O, if a
+	ring fills up before it is drained, events are dropped (the newest or the
+	oldest ones, as selected) and the lost events are recorded in the next block
+	of the thread. The ring of an instrumented thread is created upon its first
+	recorded event, and released after the thread exits and its events have
+	been written. The file is not created (or truncated) until the first event
+	is recorded. A module block (the path, load address and build id of each
+	loaded module, see tracemod_t) precedes the event blocks, so that the trace
+	can be symbolized offline, even on another host (see extra/csdbg-decode.cpp)
+
+	@see tracer::on_lib_load
+*/
+class recorder: virtual public object
+{
+protected:
+
+	/* Protected static variables */
+
+	static __thread ring *m_ring;				/**< @brief Current thread ring (TLS) */
+
+
+	/* Protected variables */
+
+	filebuf *m_stream;								/**< @brief Output file */
+
+	chain<ring> *m_rings;							/**< @brief Thread rings */
+
+	traceevent_t *m_buffer;						/**< @brief Writer buffer */
+
+	u8 *m_modules;										/**< @brief Pending module records */
+
+	u32 m_modules_sz;									/**< @brief Module records size */
+
+	u32 m_module_cnt;									/**< @brief Module record count */
+
+	u32 m_ring_sz;										/**< @brief Ring capacity (in events) */
+
+	bool m_overwrite;									/**< @brief Drop the oldest events */
+
+	bool m_stop;											/**< @brief Writer stop request */
+
+	bool m_running;										/**< @brief Writer thread started */
+
+	bool m_failed;										/**< @brief Writer failed to start */
+
+	pthread_t m_writer;								/**< @brief Writer thread */
+
+	pthread_key_t m_key;							/**< @brief Thread exit key */
+
+
+	/* Protected static methods */
+
+	static void* writer(void*);
+
+	static void thread_exit(void*);
+
+
+	/* Protected generic methods */
+
+	virtual recorder& open();
+
+	virtual recorder& write(const traceblock_t&, const traceevent_t*);
+
+	virtual recorder& start();
+
+	virtual recorder& stop();
+
+	virtual recorder& destroy();
+
+	virtual ring* attach();
+
+	virtual recorder& collect();
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	explicit recorder(const i8*, bool = false, u32 = g_ring_sz);
+
+	recorder(const recorder&);
+
+	virtual ~recorder();
+
+	virtual recorder* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual const i8* path() const;
+
+	virtual u32 ring_size() const;
+
+	virtual bool is_overwriting() const;
+
+
+	/* Operator overloading methods */
+
+	virtual recorder& operator=(const recorder&);
+
+
+	/* Generic methods */
+
+	virtual recorder& record(mem_addr_t, mem_addr_t, u32);
+
+	virtual recorder& add_module(const i8*, mem_addr_t, const u8*, u32);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,104 @@
+#ifndef _CSDBG_RING
+#define _CSDBG_RING 1
+
+/**
+	@file include/ring.hpp
+
+	@brief Class csdbg::ring definition
+*/
+
+#include "./object.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Lock-free, single-producer/single-consumer binary event ring buffer
+
+	A ring object buffers the binary trace events (see traceevent_t) of a single
+	thread until a single consumer (the writer thread of a csdbg::recorder)
+	drains them. The producer and the consumer each advance their own monotonic
+	counter, so neither ever waits for the other. When the ring is full, either
+	the newest events are dropped (the default) or the producer keeps writing
+	over the oldest ones. In the second mode, the producer claims a slot before
+	it writes it and the consumer discards any event that may have been written
+	over while it was copied. In both modes the lost events are counted and
+	reported by ring::drain
+
+	@see recorder::record
+*/
+class ring: virtual public object
+{
+protected:
+
+	/* Protected variables */
+
+	traceevent_t *m_events;						/**< @brief Event slots */
+
+	u32 m_capacity;										/**< @brief Slot count (a power of 2) */
+
+	bool m_overwrite;									/**< @brief Drop the oldest events */
+
+	bool m_retired;										/**< @brief The producer has exited */
+
+	const void *m_owner;							/**< @brief Owner (recorder) */
+
+	u64 m_thread;											/**< @brief Producer thread id */
+
+	u64 m_head;												/**< @brief Published events */
+
+	u64 m_claim;											/**< @brief Claimed slots */
+
+	u64 m_tail;												/**< @brief Drained events */
+
+	u64 m_dropped;										/**< @brief Lost events */
+
+	u64 m_reported;										/**< @brief Reported lost events */
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	ring(const void*, u32 = g_ring_sz, bool = false);
+
+	ring(const ring&);
+
+	virtual ~ring();
+
+	virtual ring* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual const void* owner() const;
+
+	virtual u64 thread() const;
+
+	virtual u32 capacity() const;
+
+	virtual bool is_overwriting() const;
+
+	virtual bool is_retired() const;
+
+
+	/* Operator overloading methods */
+
+	virtual ring& operator=(const ring&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual u64 dropped() const;
+
+	virtual bool push(u64, mem_addr_t, mem_addr_t, u32);
+
+	virtual u32 drain(traceevent_t*, u32, u64&);
+
+	virtual ring& retire();
+};
+
+}
+
+#endif
+
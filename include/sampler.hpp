@@ -0,0 +1,165 @@
+#ifndef _CSDBG_SAMPLER
+#define _CSDBG_SAMPLER 1
+
+/**
+	@file include/sampler.hpp
+
+	@brief Class csdbg::sampler definition
+*/
+
+#include "./process.hpp"
+
+namespace csdbg {
+
+/**
+	@brief SIGPROF driven sampling profiler
+
+	A sampler object samples the simulated call stacks of the instrumented
+	threads periodically, to profile them statistically at a fixed cost instead
+	of timing every call. Each instrumented thread arms its own timer, that
+	measures the CPU time of the thread and delivers a SIGPROF to it (and not to
+	an arbitrary thread of the process) whenever a sampling period is consumed,
+	so idle threads are not sampled and busy threads are sampled in proportion
+	to their CPU usage. The signal handler copies the function addresses of the
+	simulated call stack of the interrupted thread to a buffer owned by the
+	thread, without any locking, memory allocation or symbol lookup, as only
+	async-signal-safe operations are allowed in a signal handler. A background
+	aggregator thread drains the buffers periodically and counts the samples in
+	the sampled call path tree of the process (see process::add_sample). If a
+	buffer fills up before it is drained, samples are dropped and counted.
+
+	The timer and the buffer of a thread are created upon its first
+	instrumented call, and released after the thread exits. The samples are
+	reported with tracer::flamegraph
+
+	@see tracer::on_lib_load
+*/
+class sampler: virtual public object
+{
+protected:
+
+	/**
+		@brief The sample buffer and timer of a thread
+	*/
+	struct slot {
+		mem_addr_t *m_words;						/**< @brief Sample buffer */
+
+		u32 m_mask;											/**< @brief Buffer size - 1 */
+
+		u64 m_head;											/**< @brief Published words */
+
+		u64 m_tail;											/**< @brief Drained words */
+
+		u64 m_dropped;									/**< @brief Dropped samples */
+
+		u64 m_reported;									/**< @brief Counted dropped samples */
+
+		const sampler *m_owner;					/**< @brief Owner sampler */
+
+		timer_t m_timer;								/**< @brief Thread CPU time timer */
+
+		bool m_armed;										/**< @brief The timer exists */
+
+		bool m_retired;									/**< @brief The thread has exited */
+
+		slot *m_next;										/**< @brief Next slot in the list */
+
+		mem_addr_t m_scratch[g_sample_depth];		/**< @brief Handler buffer */
+	};
+
+
+	/* Protected static variables */
+
+	static __thread slot *m_slot;			/**< @brief Current thread slot (TLS) */
+
+	static bool m_live;								/**< @brief The handler is active */
+
+
+	/* Protected variables */
+
+	process *m_proc;									/**< @brief Sampled process */
+
+	slot *m_slots;										/**< @brief Thread slots */
+
+	mem_addr_t *m_buffer;							/**< @brief Aggregator buffer */
+
+	u32 m_period;											/**< @brief Sampling period (usec) */
+
+	u32 m_buffer_sz;									/**< @brief Slot buffer size (words) */
+
+	u64 m_dropped;										/**< @brief Dropped samples */
+
+	bool m_stop;											/**< @brief Aggregator stop request */
+
+	bool m_running;										/**< @brief Sampling started */
+
+	bool m_failed;										/**< @brief Sampling failed to start */
+
+	bool m_halted;										/**< @brief Sampling stopped */
+
+	pthread_t m_aggregator;						/**< @brief Aggregator thread */
+
+	pthread_key_t m_key;							/**< @brief Thread exit key */
+
+	struct sigaction m_action;				/**< @brief Replaced SIGPROF action */
+
+
+	/* Protected static methods */
+
+	static void handler(i32, siginfo_t*, void*);
+
+	static void* aggregator(void*);
+
+	static void thread_exit(void*);
+
+
+	/* Protected generic methods */
+
+	virtual sampler& start();
+
+	virtual sampler& destroy();
+
+	virtual sampler& arm(slot*);
+
+	virtual sampler& drain(slot*);
+
+	virtual sampler& collect();
+
+	virtual sampler& release(slot*);
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	explicit sampler(process*, u32 = g_sample_period, u32 = g_sample_buf);
+
+	sampler(const sampler&);
+
+	virtual ~sampler();
+
+	virtual sampler* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual u32 period() const;
+
+	virtual u64 dropped() const;
+
+
+	/* Operator overloading methods */
+
+	virtual sampler& operator=(const sampler&);
+
+
+	/* Generic methods */
+
+	virtual sampler& attach();
+
+	virtual sampler& stop();
+};
+
+}
+
+#endif
+
@@ -0,0 +1,74 @@
+#ifndef _CSDBG_SEGTAB
+#define _CSDBG_SEGTAB 1
+
+/**
+	@file include/segtab.hpp
+
+	@brief Class csdbg::segtab definition
+*/
+
+#include "./symtab.hpp"
+
+namespace csdbg {
+
+/**
+	@brief This class represents the segment table of a process namespace
+
+	A segtab object maps the address ranges of the loaded segments of objective
+	code modules (executable and DSO libraries) to the symbol tables of the
+	modules. The segment ranges are kept sorted by address in contiguous arrays,
+	so the module that maps an address is found with a binary search. A segtab
+	does not own the symbol tables it references. The access to a segtab is not
+	thread safe, callers must implement thread synchronization
+
+	@see process::ilookup
+*/
+class segtab: virtual public object
+{
+protected:
+
+	/* Protected variables */
+
+	mem_addr_t *m_starts;						/**< @brief Segment start addresses (sorted) */
+
+	mem_addr_t *m_ends;							/**< @brief Segment end addresses */
+
+	const symtab **m_owners;				/**< @brief Segment modules */
+
+	u32 m_size;											/**< @brief Segment count */
+
+	u32 m_capacity;									/**< @brief Segment table capacity */
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	segtab();
+
+	segtab(const segtab&);
+
+	virtual ~segtab();
+
+	virtual segtab* clone() const;
+
+
+	/* Operator overloading methods */
+
+	virtual segtab& operator=(const segtab&);
+
+
+	/* Generic methods */
+
+	virtual u32 size() const;
+
+	virtual segtab& add(const symtab*, mem_addr_t, mem_addr_t);
+
+	virtual segtab& rebind(const symtab*, const symtab*);
+
+	virtual const symtab* lookup(mem_addr_t) const;
+};
+
+}
+
+#endif
+
@@ -75,6 +75,8 @@ public:
 
 	virtual streambuf& flush() = 0;						/**< @brief To be implemented */
 
+	virtual streambuf& write(const void*, u32);
+
 	virtual streambuf& sync() const = 0;			/**< @brief To be implemented */
 
 	virtual streambuf& lock() const;
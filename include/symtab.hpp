@@ -7,7 +7,6 @@
 	@brief Class csdbg::symtab definition
 */
 
-#include "./chain.hpp"
 #include "./symbol.hpp"
 
 namespace csdbg {
@@ -20,9 +19,16 @@ namespace csdbg {
 	by the libbfd backends on the host (target) machine (elf, coff, ecoff e.t.c).
 	To optimize lookups the symbol table (as structured in libbfd) is parsed, the
 	non-function symbols are discarded and function symbols are demangled once and
-	stored in simpler data structures. A symtab can be traversed using callbacks
-	and method symtab::foreach. The access to a symtab is not thread safe, callers
-	must implement thread synchronization
+	stored in simpler data structures. The function addresses are kept sorted in
+	a contiguous array, along with the function sizes and the offsets of their
+	names in a string pool, so an address is resolved with a binary search, either
+	as an exact function address or as an address contained in a function (a
+	return address or a sampled program counter). Each function also has a trace
+	flag, set when the instrumentation filters are applied to the whole table
+	(see symtab::mark), so filtered calls are identified with the address lookup
+	alone. A symtab can be traversed using callbacks and method symtab::foreach.
+	The access to a symtab is not thread safe, callers must implement thread
+	synchronization
 */
 class symtab: virtual public object
 {
@@ -34,7 +40,30 @@ protected:
 
 	mem_addr_t m_base;							/**< @brief Load base address */
 
-	chain<symbol> *m_table;					/**< @brief Function symbol table */
+	mem_addr_t *m_addrs;						/**< @brief Function addresses (sorted) */
+
+	u32 *m_sizes;										/**< @brief Function sizes */
+
+	u32 *m_names;										/**< @brief Function name offsets */
+
+	i8 *m_strings;									/**< @brief Function name string pool */
+
+	bool *m_traced;									/**< @brief Function trace flags */
+
+	u32 m_size;											/**< @brief Function symbol count */
+
+	u32 m_strings_sz;								/**< @brief String pool size (bytes) */
+
+
+	/* Protected generic methods */
+
+	virtual symtab& swap(u32, u32);
+
+	virtual symtab& sift(u32, u32);
+
+	virtual symtab& sort();
+
+	virtual i32 find(mem_addr_t) const;
 
 public:
 
@@ -67,8 +96,16 @@ public:
 
 	virtual const i8* lookup(mem_addr_t) const;
 
+	virtual const i8* lookup(mem_addr_t, mem_addr_t&) const;
+
 	virtual bool exists(mem_addr_t) const;
 
+	virtual bool bounds(mem_addr_t&, mem_addr_t&) const;
+
+	virtual bool traced(mem_addr_t) const;
+
+	virtual symtab& mark(bool (*)(const i8*, bool, void*), void*);
+
 	virtual symtab& foreach(void (*)(u32, symbol*)) const;
 };
 
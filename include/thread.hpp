@@ -7,8 +7,13 @@
 	@brief Class csdbg::thread definition
 */
 
-#include "./stack.hpp"
-#include "./call.hpp"
+#include "./frame.hpp"
+#ifdef CSDBG_WITH_PROFILER
+#include "./profile.hpp"
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+#include "./calltree.hpp"
+#endif
 
 namespace csdbg {
 
@@ -19,8 +24,22 @@ namespace csdbg {
 	stores the simulated call stack and other thread specific data and it is used
 	to track a thread execution. The simulated call stack can be traversed using
 	simple callbacks and method thread::foreach. Currently only POSIX threads are
-
-	supported
+	supported.
+
+	The simulated call stack is a contiguous array of frames (see csdbg::frame),
+	so recording a call or a return is a constant time operation that requires
+	no memory allocation, unless the array must grow. The stack is modified only
+	by the thread it tracks, without any locking. Each modification is bracketed
+	by a sequence counter, with only plain (non read-modify-write) stores, so
+	that other threads can obtain a consistent copy of the stack with method
+	thread::snapshot. When the array grows, the old one is released under the
+	global lock, that concurrent readers hold while copying the stack.
+
+	If the built-in profiler is enabled (CSDBG_WITH_PROFILER), each thread also
+	accumulates the call count and the inclusive and exclusive time of the
+	functions it calls in its own profile (see csdbg::profile). With
+	CSDBG_WITH_FLAMEGRAPH, the exclusive time of each call is also accumulated
+	per call path, in the call path tree of the thread (see csdbg::calltree)
 
 	@todo Use std::thread (C++11) class for portability
 */
@@ -34,13 +53,48 @@ protected:
 
 	pthread_t m_handle;					/**< @brief Thread handle */
 
-	stack<call> *m_stack;				/**< @brief Simulated call stack */
+	frame *m_frames;						/**< @brief Simulated call stack */
+
+	u32 m_depth;								/**< @brief Simulated call stack depth */
+
+	u32 m_capacity;							/**< @brief Simulated call stack capacity */
 
 	i32 m_lag;									/**< @brief
 																	 The number of calls that must be popped off
 																	 the simulated stack for it to match the real
 																	 one */
 
+	u32 m_seq;									/**< @brief
+																	 Modification sequence counter (odd while the
+																	 simulated stack is being modified) */
+
+	u64 m_epoch;								/**< @brief
+																	 Registry epoch of the active read-side
+																	 section (0 if the thread is quiescent) */
+
+	u64 m_hits;									/**< @brief Lookup cache hits */
+
+	mem_addr_t m_memo_addr[g_memo_sz];	/**< @brief Memoized lookup addresses */
+
+	const i8 *m_memo_name[g_memo_sz];		/**< @brief Memoized lookup symbols */
+
+#ifdef CSDBG_WITH_PROFILER
+	profile *m_profile;					/**< @brief Function call statistics */
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	calltree *m_calltree;				/**< @brief Call path statistics */
+#endif
+
+
+	/* Protected generic methods */
+
+	virtual thread& grow();
+
+#ifdef CSDBG_WITH_PROFILER
+	virtual thread& account(u64);
+#endif
+
 public:
 
 	/* Constructors, copy constructors and destructor */
@@ -62,8 +116,24 @@ public:
 
 	virtual i32 lag() const;
 
+	virtual u64 epoch() const;
+
+	virtual u64 cache_hits() const;
+
+#ifdef CSDBG_WITH_PROFILER
+	virtual const profile* get_profile() const;
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	virtual const calltree* get_calltree() const;
+#endif
+
 	virtual thread& set_name(const i8*);
 
+	virtual thread& set_epoch(u64);
+
+	virtual thread& reset(const i8* = NULL);
+
 
 	/* Operator overloading methods */
 
@@ -76,15 +146,27 @@ public:
 
 	virtual u32 call_depth() const;
 
-	virtual const call* backtrace(u32) const;
+	virtual const frame* backtrace(u32) const;
 
 	virtual thread& called(mem_addr_t, mem_addr_t, const i8*);
 
-	virtual thread& returned();
+	virtual thread& returned(mem_addr_t, mem_addr_t);
 
 	virtual thread& unwind();
 
-	virtual thread& foreach(void (*)(u32, call*)) const;
+	virtual u32 snapshot(frame*, u32) const;
+
+#ifdef CSDBG_WITH_SAMPLER
+	virtual u32 sample(mem_addr_t*, u32) const;
+#endif
+
+	virtual const i8* recall(mem_addr_t) const;
+
+	virtual thread& memorize(mem_addr_t, const i8*);
+
+	virtual thread& count_hit();
+
+	virtual thread& foreach(void (*)(u32, const frame*)) const;
 };
 
 }
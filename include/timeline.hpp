@@ -0,0 +1,105 @@
+#ifndef _CSDBG_TIMELINE
+#define _CSDBG_TIMELINE 1
+
+/**
+	@file include/timeline.hpp
+
+	@brief Class csdbg::timeline definition
+*/
+
+#include "./streambuf.hpp"
+
+namespace csdbg {
+
+/**
+	@brief Chrome trace event (JSON) timeline exporter
+
+	A timeline object writes function calls and returns as the "B" and "E"
+	duration events of the Chrome trace event format (the JSON array variant),
+	that can be loaded to chrome://tracing or the Perfetto UI. The events are
+	formatted in the buffer of a csdbg::streambuf, which is flushed to its
+	stream whenever it grows beyond g_timeline_flush bytes, so the memory
+	footprint stays constant however long the timeline gets. The name of each
+	thread is written (as a "M" metadata event) before its first event, and
+	again whenever it changes. The closing bracket of the array is optional in
+	this format, so a timeline that is cut short (e.g by a crash) still loads
+
+	@see tracer::export_event
+*/
+class timeline: virtual public object
+{
+protected:
+
+	/* Protected variables */
+
+	streambuf *m_stream;							/**< @brief Output stream */
+
+	u64 *m_threads;										/**< @brief Named thread ids */
+
+	u32 *m_names;											/**< @brief Thread name hashes */
+
+	u32 m_thread_cnt;									/**< @brief Named thread count */
+
+	u32 m_last;												/**< @brief Last used thread index */
+
+	u32 m_pid;												/**< @brief Traced process id */
+
+	u64 m_origin;											/**< @brief Time origin (nsec) */
+
+	u64 m_events;											/**< @brief Written event count */
+
+	bool m_closed;										/**< @brief The array is closed */
+
+
+	/* Protected generic methods */
+
+	virtual timeline& escape(const i8*);
+
+	virtual timeline& record(u64, u64, const i8*);
+
+	virtual timeline& name_thread(u64, const i8*);
+
+	virtual timeline& commit();
+
+public:
+
+	/* Constructors, copy constructors and destructor */
+
+	explicit timeline(streambuf*, u64 = 0, u32 = 0);
+
+	timeline(const timeline&);
+
+	virtual ~timeline();
+
+	virtual timeline* clone() const;
+
+
+	/* Accessor methods */
+
+	virtual const streambuf* stream() const;
+
+	virtual u64 event_count() const;
+
+	virtual bool is_closed() const;
+
+
+	/* Operator overloading methods */
+
+	virtual timeline& operator=(const timeline&);
+
+
+	/* Generic methods */
+
+	virtual timeline& enter(u64, const i8*, const i8*, u64);
+
+	virtual timeline& leave(u64, const i8*, u64);
+
+	virtual timeline& flush();
+
+	virtual timeline& close();
+};
+
+}
+
+#endif
+
@@ -14,6 +14,19 @@
 #endif
 #ifdef CSDBG_WITH_FILTER
 #include "./filter.hpp"
+#include "./matcher.hpp"
+#endif
+#ifdef CSDBG_WITH_EVENT_TRACE
+#include "./recorder.hpp"
+#endif
+#ifdef CSDBG_WITH_TIMELINE
+#include "./exporter.hpp"
+#endif
+#ifdef CSDBG_WITH_SAMPLER
+#include "./sampler.hpp"
+#endif
+#ifdef CSDBG_WITH_CRASHDUMP
+#include "./crashdump.hpp"
 #endif
 
 namespace csdbg {
@@ -35,10 +48,54 @@ class tracer: virtual public object
 {
 protected:
 
+#ifdef CSDBG_WITH_PLUGIN
+	/**
+		@brief An immutable plugin array, published to the instrumentation functions
+	*/
+	struct plugin_set {
+		const plugin **m_plugins;				/**< @brief Plugins (registration order) */
+
+		u32 m_size;											/**< @brief Plugin count */
+
+		const plugin **m_batches;				/**< @brief Batched plugins */
+
+		u32 m_batches_sz;								/**< @brief Batched plugin count */
+
+		u64 m_epoch;										/**< @brief Retirement epoch */
+
+		chain<plugin> *m_released;			/**< @brief Plugins released with it */
+
+		plugin_set *m_next;							/**< @brief Next retired array */
+	};
+
+
+	/**
+		@brief A per-thread plugin context
+	*/
+	struct context {
+		u64 m_owner;										/**< @brief Owner plugin identifier */
+
+		u8 *m_data;											/**< @brief Context data */
+	};
+#endif
+
+
 	/* Protected static variables */
 
 	static tracer *m_iface;							/**< @brief Interface object */
 
+#ifdef CSDBG_WITH_PLUGIN
+	static __thread modevent_t *m_events;	/**< @brief Event buffer (TLS) */
+
+	static __thread u32 m_events_cnt;	/**< @brief Buffered events (TLS) */
+
+	static __thread context *m_contexts;	/**< @brief Plugin contexts (TLS) */
+
+	static __thread u32 m_contexts_sz;	/**< @brief Context slots (TLS) */
+
+	static __thread void *m_context;		/**< @brief Called plugin context (TLS) */
+#endif
+
 
 	/* Protected variables */
 
@@ -46,9 +103,41 @@ protected:
 
 #ifdef CSDBG_WITH_PLUGIN
 	chain<plugin> *m_plugins;						/**< @brief Instrumentation plugins */
+
+	plugin_set *m_active;								/**< @brief Published plugin array */
+
+	u32 m_active_sz;										/**< @brief Published plugin count */
+
+	plugin_set *m_retired;							/**< @brief Retired plugin arrays */
+
+	u64 m_epoch;												/**< @brief Plugin registry epoch */
+
+	pthread_key_t m_key;								/**< @brief Thread exit key */
 #endif
 #ifdef CSDBG_WITH_FILTER
 	chain<filter> *m_filters;						/**< @brief Instrumentation filters */
+
+	matcher *m_modmatch;								/**< @brief Module filter matcher */
+
+	matcher *m_symmatch;								/**< @brief Symbol filter matcher */
+
+	cache<u32> *m_verdicts;							/**< @brief Filter verdict cache */
+
+	u32 m_generation;										/**< @brief Filter set generation */
+
+	u32 m_filters_sz;										/**< @brief Published filter count */
+#endif
+#ifdef CSDBG_WITH_EVENT_TRACE
+	recorder *m_recorder;								/**< @brief Binary event trace recorder */
+#endif
+#ifdef CSDBG_WITH_TIMELINE
+	exporter *m_exporter;								/**< @brief Timeline exporter */
+#endif
+#ifdef CSDBG_WITH_SAMPLER
+	sampler *m_sampler;									/**< @brief Sampling profiler */
+#endif
+#ifdef CSDBG_WITH_CRASHDUMP
+	crashdump *m_crashdump;							/**< @brief Crash dumper */
 #endif
 
 
@@ -60,7 +149,23 @@ protected:
 
 	static i32 on_dso_load(dl_phdr_info*, size_t, void*);
 
-	static string& addr2line(string&, const i8*, mem_addr_t);
+#ifdef CSDBG_WITH_EVENT_TRACE
+	static void map_module(const i8*, const dl_phdr_info*);
+#endif
+
+#ifdef CSDBG_WITH_PLUGIN
+	static void release(plugin_set*);
+
+	static void thread_exit(void*);
+#endif
+
+#ifdef CSDBG_WITH_FILTER
+	static bool apply_filters(const i8*, bool, void*);
+#endif
+
+#if defined CSDBG_WITH_PROFILER || defined CSDBG_WITH_SAMPLER
+	static const i8* symbol_name(mem_addr_t, void*);
+#endif
 
 
 	/* Protected constructors, copy constructors and destructor */
@@ -83,6 +188,30 @@ protected:
 
 	virtual tracer& destroy();
 
+	virtual const tracer& render(string&, frame*, u32, u32) const;
+
+	virtual string& addr2line(string&, mem_addr_t) const;
+
+#ifdef CSDBG_WITH_PLUGIN
+	virtual plugin_set* snapshot(i32 = -1) const;
+
+	virtual tracer& publish(plugin_set*, chain<plugin>* = NULL);
+
+	virtual tracer& reclaim();
+
+	virtual tracer& drain(const plugin_set*);
+
+	virtual u32 alloc_slot() const;
+
+	virtual void* bind(const plugin*);
+
+	virtual tracer& exit_thread();
+#endif
+
+#ifdef CSDBG_WITH_FILTER
+	virtual tracer& compile_filters();
+#endif
+
 public:
 
 	/* Friend classes and functions */
@@ -96,6 +225,10 @@ public:
 
 	static tracer* interface();
 
+#ifdef CSDBG_WITH_PLUGIN
+	static void* plugin_context();
+#endif
+
 
 	/* Generic methods */
 
@@ -115,9 +248,10 @@ public:
 #ifdef CSDBG_WITH_PLUGIN
 	virtual u32 plugin_count() const;
 
-	virtual const plugin* add_plugin(const i8*, const i8* = NULL);
+	virtual const plugin* add_plugin(const i8*, const i8* = NULL, u32 = 0);
 
-	virtual const plugin* add_plugin(modsym_t, modsym_t);
+	virtual const plugin* add_plugin(modsym_t, modsym_t, modsym_t = NULL,
+																	 u32 = 0, modsym_t = NULL);
 
 	virtual tracer& remove_plugin(const i8*);
 
@@ -126,6 +260,10 @@ public:
 	virtual const plugin* get_plugin(const i8*) const;
 
 	virtual const plugin* get_plugin(u32) const;
+
+	virtual tracer& call_plugins(void*, void*, bool);
+
+	virtual tracer& flush_plugins();
 #endif
 
 
@@ -134,11 +272,51 @@ public:
 #ifdef CSDBG_WITH_FILTER
 	virtual u32 filter_count() const;
 
-	virtual filter* add_filter(const i8*, bool, bool = true);
+	virtual const filter* add_filter(const i8*, bool, bool = true);
 
 	virtual tracer& remove_filter(u32);
 
-	virtual filter* get_filter(u32) const;
+	virtual const filter* get_filter(u32) const;
+
+	virtual bool apply_filters(const i8*, bool) const;
+
+	virtual bool filtered(mem_addr_t);
+#endif
+
+
+	/* Event trace methods */
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+	virtual tracer& record_event(void*, void*, bool);
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+	virtual tracer& export_event(void*, bool);
+#endif
+
+
+	/* Profiling methods */
+
+#ifdef CSDBG_WITH_PROFILER
+	virtual const tracer& report(string&, u32 = 0) const;
+#endif
+
+#ifdef CSDBG_WITH_HISTOGRAM
+	virtual u64 percentile(mem_addr_t, f64) const;
+
+	virtual u64 percentile(const i8*, f64) const;
+
+	virtual const tracer& latencies(string&, u32 = 0) const;
+#endif
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	virtual const tracer& flamegraph(string&, bool = false) const;
+
+	virtual tracer& sample();
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+	virtual tracer& sample_thread();
 #endif
 };
 
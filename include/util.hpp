@@ -34,6 +34,10 @@ protected:
 
 	static void on_lib_unload()	__attribute((destructor));
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+	static u32 note_build_id(const u8*, u32, u8*, u32);
+#endif
+
 public:
 
 	/* Generic methods */
@@ -71,6 +75,8 @@ public:
 
 	static void unlock();
 
+	static u64 timestamp();
+
 	static bool is_regular(const fileinfo_t&);
 
 	static bool is_chardev(const fileinfo_t&);
@@ -79,6 +85,12 @@ public:
 
 	static bool is_writable(const fileinfo_t&);
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+	static u32 build_id(const dl_phdr_info*, u8*, u32);
+
+	static u32 build_id(const i8*, u8*, u32);
+#endif
+
 
 	/* Output and debug methods */
 
@@ -0,0 +1,11 @@
+#include "../include/cache.hpp"
+
+/**
+	@file src/cache.cpp
+
+	@brief Class csdbg::cache dummy implementation file
+
+	Template classes must have their class declaration and method implementation
+	all in the same file according to ISO
+*/
+
@@ -0,0 +1,422 @@
+#include "../include/calltree.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/calltree.cpp
+
+	@brief Class csdbg::calltree method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Hash a call path node key
+ *
+ * @param[in] parent the parent node id
+ *
+ * @param[in] addr the function address
+ *
+ * @returns the hash value
+ */
+u32 calltree::hash(u32 parent, mem_addr_t addr)
+{
+	u64 h = static_cast<u64> (addr) ^ (static_cast<u64> (parent) << 40);
+	return static_cast<u32> ((h * 11400714819323198485ULL) >> 32);
+}
+
+
+/**
+ * @brief
+ *	Double the capacity of the node array. The old array is released under the
+ *	global lock, to exclude concurrent readers (see calltree::merge)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+calltree& calltree::grow()
+{
+	u32 cap = m_capacity << 1;
+	if ( unlikely(cap == 0) )
+		cap = g_calltree_sz;
+
+	vertex *nodes = new vertex[cap];
+	vertex *old = m_nodes;
+	if ( likely(old != NULL) )
+		memcpy(nodes, old, m_size * sizeof(vertex));
+
+	store_release(m_nodes, nodes);
+	m_capacity = cap;
+
+	util::lock();
+	delete[] old;
+	util::unlock();
+	return *this;
+}
+
+
+/**
+ * @brief Rebuild the hash index
+ *
+ * @param[in] sz the new index size (a power of 2)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+calltree& calltree::rehash(u32 sz)
+{
+	u32 *index = new u32[sz];
+	util::memset(index, 0, sz * sizeof(u32));
+
+	u32 mask = sz - 1;
+	for (u32 i = 0; likely(i < m_size); i++) {
+		u32 j = hash(m_nodes[i].m_parent, m_nodes[i].m_addr) & mask;
+		while (index[j] != 0)
+			j = (j + 1) & mask;
+
+		index[j] = i + 1;
+	}
+
+	delete[] m_index;
+	m_index = index;
+	m_index_sz = sz;
+	return *this;
+}
+
+
+/**
+ * @brief Add a call path node
+ *
+ * @param[in] parent the parent node id
+ *
+ * @param[in] addr the function address
+ *
+ * @returns the node id
+ *
+ * @throws std::bad_alloc
+ *
+ * @note The node must not already exist
+ */
+u32 calltree::add(u32 parent, mem_addr_t addr)
+{
+	/* Keep the load factor of the index at most 1/2 */
+	if ( unlikely((m_size + 1) << 1 > m_index_sz) )
+		rehash((m_index_sz == 0) ? g_calltree_sz << 1 : m_index_sz << 1);
+
+	if ( unlikely(m_size == m_capacity) )
+		grow();
+
+	vertex &n = m_nodes[m_size];
+	n.m_addr = addr;
+	n.m_parent = parent;
+	n.m_depth = (likely(parent > 0)) ? m_nodes[parent - 1].m_depth + 1 : 1;
+	n.m_weight = 0;
+
+	u32 mask = m_index_sz - 1;
+	u32 j = hash(parent, addr) & mask;
+	while (m_index[j] != 0)
+		j = (j + 1) & mask;
+
+	m_index[j] = m_size + 1;
+
+	/* The new node is visible to readers after it is initialized */
+	store_release(m_size, m_size + 1);
+	return m_size;
+}
+
+
+/**
+ * @brief Object default constructor
+ */
+calltree::calltree():
+m_nodes(NULL),
+m_size(0),
+m_capacity(0),
+m_index(NULL),
+m_index_sz(0)
+{
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+calltree::calltree(const calltree &src)
+try:
+m_nodes(NULL),
+m_size(0),
+m_capacity(0),
+m_index(NULL),
+m_index_sz(0)
+{
+	*this = src;
+}
+
+catch (...) {
+	delete[] m_nodes;
+	delete[] m_index;
+	m_nodes = NULL;
+	m_index = NULL;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+calltree::~calltree()
+{
+	delete[] m_nodes;
+	delete[] m_index;
+	m_nodes = NULL;
+	m_index = NULL;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline calltree* calltree::clone() const
+{
+	return new calltree(*this);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+calltree& calltree::operator=(const calltree &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	clear();
+	return merge(rval);
+}
+
+
+/**
+ * @brief Get the number of call path nodes
+ *
+ * @returns this->m_size
+ */
+inline u32 calltree::size() const
+{
+	return m_size;
+}
+
+
+/**
+ * @brief Find a call path node
+ *
+ * @param[in] parent the parent node id (0 for the tree root)
+ *
+ * @param[in] addr the function address
+ *
+ * @returns the node id or 0 if the path was never seen
+ */
+u32 calltree::find(u32 parent, mem_addr_t addr) const
+{
+	if ( unlikely(m_index_sz == 0) )
+		return 0;
+
+	u32 mask = m_index_sz - 1;
+	for (u32 j = hash(parent, addr) & mask; ; j = (j + 1) & mask) {
+		u32 i = m_index[j];
+		if ( likely(i == 0) )
+			return 0;
+
+		const vertex &n = m_nodes[i - 1];
+		if ( likely(n.m_addr == addr && n.m_parent == parent) )
+			return i;
+	}
+}
+
+
+/**
+ * @brief Get a call path node, create it if the path is new
+ *
+ * @param[in] parent the parent node id (0 for the tree root)
+ *
+ * @param[in] addr the function address
+ *
+ * @returns the node id
+ *
+ * @throws std::bad_alloc
+ */
+u32 calltree::child(u32 parent, mem_addr_t addr)
+{
+	__D_ASSERT(parent <= m_size);
+	u32 retval = find(parent, addr);
+	return (likely(retval > 0)) ? retval : add(parent, addr);
+}
+
+
+/**
+ * @brief Add to the weight of a call path node
+ *
+ * @param[in] id the node id
+ *
+ * @param[in] w the added weight (a sample count or a time in nsec)
+ *
+ * @returns *this
+ */
+calltree& calltree::charge(u32 id, u64 w)
+{
+	__D_ASSERT(id > 0 && id <= m_size);
+	if ( likely(id > 0 && id <= m_size) )
+		m_nodes[id - 1].m_weight += w;
+
+	return *this;
+}
+
+
+/**
+ * @brief Add the call paths of another tree to this one
+ *
+ * @param[in] src the source tree
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @attention
+ *	To merge the tree of a running thread, the caller must hold the global lock
+ *	(see util::lock), otherwise the node array may be released by the thread
+ *	while it is read
+ */
+calltree& calltree::merge(const calltree &src)
+{
+	u32 sz = load_acquire(src.m_size);
+	const vertex *nodes = load_acquire(src.m_nodes);
+	if ( unlikely(sz == 0) )
+		return *this;
+
+	/* Map the source node ids to the ids of this tree (parents come first) */
+	u32 *ids = new u32[sz + 1];
+	try {
+		ids[0] = 0;
+		for (u32 i = 0; likely(i < sz); i++) {
+			const vertex &from = nodes[i];
+			u32 id = child(ids[from.m_parent], from.m_addr);
+			m_nodes[id - 1].m_weight += from.m_weight;
+			ids[i + 1] = id;
+		}
+	}
+
+	catch (...) {
+		delete[] ids;
+		throw;
+	}
+
+	delete[] ids;
+	return *this;
+}
+
+
+/**
+ * @brief Clear the tree
+ *
+ * @returns *this
+ *
+ * @note
+ *	The node array is not released, the tree is empty but keeps its capacity
+ */
+calltree& calltree::clear()
+{
+	store_release(m_size, 0);
+	if ( likely(m_index != NULL) )
+		util::memset(m_index, 0, m_index_sz * sizeof(u32));
+
+	return *this;
+}
+
+
+/**
+ * @brief Produce a folded stack report of the tree
+ *
+ * @param[out] dst the destination string
+ *
+ * @param[in] pfunc
+ *	a function that returns the name of a function address (or NULL), passed
+ *	the address and arg
+ *
+ * @param[in] arg an argument passed to pfunc
+ *
+ * @returns its first argument
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	Each call path with a non-zero weight is reported in a line, as the names
+ *	of its functions (outermost first) separated with semicolons, followed by
+ *	a space and the path weight. Unnamed functions are reported by their
+ *	address. The lines end with a plain LF, as the flame graph tools expect
+ */
+string& calltree::fold(string &dst, const i8* (*pfunc)(mem_addr_t, void*),
+											 void *arg) const
+{
+	u32 max = 0;
+	for (u32 i = 0; likely(i < m_size); i++)
+		if ( unlikely(m_nodes[i].m_depth > max) )
+			max = m_nodes[i].m_depth;
+
+	if ( unlikely(max == 0) )
+		return dst;
+
+	const vertex **path = new const vertex*[max];
+	try {
+		for (u32 i = 0; likely(i < m_size); i++) {
+			const vertex *n = &m_nodes[i];
+			if ( likely(n->m_weight == 0) )
+				continue;
+
+			/* Collect the path of the node, innermost first */
+			u32 depth = 0;
+			for (; likely(n != NULL && depth < max); depth++) {
+				path[depth] = n;
+				n = (likely(n->m_parent > 0)) ? &m_nodes[n->m_parent - 1] : NULL;
+			}
+
+			while ( likely(depth-- > 0) ) {
+				mem_addr_t addr = path[depth]->m_addr;
+				const i8 *nm = (likely(pfunc != NULL)) ? pfunc(addr, arg) : NULL;
+				if ( likely(nm != NULL) )
+					dst.append("%s", nm);
+				else
+					dst.append("%p", reinterpret_cast<void*> (addr));
+
+				if ( likely(depth > 0) )
+					dst.append(";");
+			}
+
+			dst.append(" %llu\n",
+								 static_cast<unsigned long long> (m_nodes[i].m_weight));
+		}
+	}
+
+	catch (...) {
+		delete[] path;
+		throw;
+	}
+
+	delete[] path;
+	return dst;
+}
+
+}
+
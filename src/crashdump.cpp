@@ -0,0 +1,612 @@
+#include "../include/crashdump.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/crashdump.cpp
+
+	@brief Class csdbg::crashdump method implementation
+*/
+
+namespace csdbg {
+
+/* Static member variable definition */
+
+crashdump *crashdump::m_active = NULL;
+
+bool crashdump::m_dumping = false;
+
+
+/**
+ * @brief
+ *	The fatal signal handler. The first crashing thread dumps the call stacks
+ *	of all the instrumented threads and restores the replaced signal actions
+ *
+ * @param[in] signo the signal number
+ *
+ * @param[in] info the signal info
+ *
+ * @param[in] ctx the interrupted thread context
+ *
+ * @note
+ *	The handler is async-signal-safe. When it returns, a fault recurs and is
+ *	handled by the restored action. A signal sent by a process (e.g with abort
+ *	or kill) is raised again instead
+ */
+void crashdump::handler(i32 signo, siginfo_t *info, void *ctx)
+{
+	i32 err = errno;
+
+	crashdump *cd = load_acquire(m_active);
+	if ( likely(cd != NULL && !exchange_acq_rel(m_dumping, true)) ) {
+		cd->dump(signo, info);
+		cd->disarm();
+		store_release(m_dumping, false);
+	}
+	else {
+		/* Wait for the dumping thread, it restores the replaced actions */
+		timespec ts = {0, 1000000};
+		while ( unlikely(load_acquire(m_dumping)) )
+			nanosleep(&ts, NULL);
+	}
+
+	errno = err;
+	if ( unlikely(info == NULL || info->si_code <= 0) )
+		raise(signo);
+}
+
+
+/**
+ * @brief Write a buffer to a file descriptor
+ *
+ * @param[in] fd the file descriptor
+ *
+ * @param[in] buf the buffer
+ *
+ * @param[in] sz the buffer size
+ *
+ * @returns true on success, false if the buffer could not be written
+ *
+ * @note This method is async-signal-safe
+ */
+bool crashdump::put(i32 fd, const void *buf, u32 sz)
+{
+	const u8 *ptr = static_cast<const u8*> (buf);
+	while ( likely(sz > 0) ) {
+		ssize_t cnt = write(fd, ptr, sz);
+		if ( unlikely(cnt < 0) ) {
+			if ( likely(errno == EINTR) )
+				continue;
+
+			return false;
+		}
+
+		ptr += cnt;
+		sz -= cnt;
+	}
+
+	return true;
+}
+
+
+/**
+ * @brief Disarm the handler and release the resources
+ *
+ * @returns *this
+ */
+crashdump& crashdump::destroy()
+{
+	disarm();
+
+	if ( likely(m_fd >= 0) )
+		close(m_fd);
+
+	delete[] m_path;
+	delete[] m_frames;
+	delete[] m_threads;
+	delete[] m_buffer;
+	m_fd = -1;
+	m_path = NULL;
+	m_frames = NULL;
+	m_threads = NULL;
+	m_buffer = NULL;
+	return *this;
+}
+
+
+/**
+ * @brief Append data to the output buffer, flush it if it is full
+ *
+ * @param[in] data the data
+ *
+ * @param[in] sz the data size
+ *
+ * @returns *this
+ *
+ * @note This method is async-signal-safe
+ */
+crashdump& crashdump::append(const void *data, u32 sz)
+{
+	const u8 *ptr = static_cast<const u8*> (data);
+	while ( likely(sz > 0) ) {
+		if ( unlikely(m_length == g_crash_buf) )
+			flush();
+
+		u32 cnt = g_crash_buf - m_length;
+		if ( likely(cnt > sz) )
+			cnt = sz;
+
+		memcpy(m_buffer + m_length, ptr, cnt);
+		m_length += cnt;
+		ptr += cnt;
+		sz -= cnt;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Append a call stack record (see traceframe_t) to the output buffer
+ *
+ * @param[in] fn the function address
+ *
+ * @param[in] site the call site
+ *
+ * @param[in] nm the function name (NULL if it's not resolved)
+ *
+ * @returns *this
+ *
+ * @note This method is async-signal-safe
+ */
+crashdump& crashdump::append_frame(mem_addr_t fn, mem_addr_t site,
+																	 const i8 *nm)
+{
+	static const u8 pad[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+	traceframe_t rec;
+	rec.fn = fn;
+	rec.site = site;
+	rec.name_sz = (likely(nm != NULL)) ? strlen(nm) + 1 : 0;
+	rec.reserved = 0;
+	append(&rec, sizeof(traceframe_t));
+
+	if ( likely(nm != NULL) )
+		append(nm, rec.name_sz);
+
+	return append(pad, (8 - (rec.name_sz & 7)) & 7);
+}
+
+
+/**
+ * @brief Write the output buffer to the dump file
+ *
+ * @returns *this
+ *
+ * @note
+ *	This method is async-signal-safe. If the buffer can't be written, it is
+ *	discarded
+ */
+crashdump& crashdump::flush()
+{
+	put(m_fd, m_buffer, m_length);
+	m_length = 0;
+	return *this;
+}
+
+
+/**
+ * @brief Append the call stack of a thread to the output buffer
+ *
+ * @param[in] thr the thread
+ *
+ * @returns *this
+ *
+ * @note
+ *	This method is async-signal-safe. The stack of the current thread can't
+ *	change while it is copied, any other thread may still be running, so its
+ *	stack is copied as in thread::snapshot, without the global lock
+ */
+crashdump& crashdump::dump_thread(const thread *thr)
+{
+	u32 depth;
+	if ( unlikely(thr == process::peek_thread()) ) {
+		/* The crash may have interrupted a call or return, don't wait for it */
+		depth = thr->call_depth();
+		u32 cnt = (depth < g_crash_depth) ? depth : g_crash_depth;
+		for (u32 i = 0; likely(i < cnt); i++)
+			m_frames[i] = *thr->backtrace(depth - i - 1);
+	}
+	else
+		depth = thr->snapshot(m_frames, g_crash_depth);
+
+	if ( unlikely(depth > g_crash_depth) )
+		depth = g_crash_depth;
+
+	traceblock_t blk;
+	blk.type = g_block_stack;
+	blk.count = depth + 1;
+	blk.thread = static_cast<u64> (thr->handle());
+	blk.dropped = 0;
+	append(&blk, sizeof(traceblock_t));
+	append_frame(0, 0, thr->name());
+
+	for (u32 i = 0; likely(i < depth); i++) {
+		const frame &f = m_frames[i];
+		const i8 *nm = f.name();
+		if ( unlikely(nm == NULL) )
+			nm = thr->recall(f.addr());
+
+		append_frame(f.addr(), f.site(), nm);
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Write a crash dump (the crash record and all the thread stacks)
+ *
+ * @param[in] signo the signal number
+ *
+ * @param[in] info the signal info
+ *
+ * @returns *this
+ *
+ * @note This method is async-signal-safe
+ */
+crashdump& crashdump::dump(i32 signo, const siginfo_t *info)
+{
+	traceblock_t blk;
+	blk.type = g_block_crash;
+	blk.count = 1;
+	blk.thread = static_cast<u64> (pthread_self());
+	blk.dropped = 0;
+
+	tracecrash_t rec;
+	rec.signo = signo;
+	rec.code = (likely(info != NULL)) ? info->si_code : 0;
+
+	/* The fault address is set only for signals raised by the kernel */
+	rec.addr = 0;
+	if ( likely(info != NULL && info->si_code > 0) )
+		rec.addr = reinterpret_cast<mem_addr_t> (info->si_addr);
+
+	rec.time = util::timestamp();
+
+	m_length = 0;
+	append(&blk, sizeof(traceblock_t));
+	append(&rec, sizeof(tracecrash_t));
+	flush();
+
+	/*
+	 * Each stack is written as soon as it is copied. If reading the stack of a
+	 * running thread faults, the process is killed but the stacks dumped so far
+	 * are kept
+	 */
+	u32 cnt = m_proc->peek_threads(m_threads, g_crash_threads);
+	for (u32 i = 0; likely(i < cnt); i++)
+		dump_thread(m_threads[i]).flush();
+
+	return *this;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] proc the dumped process
+ *
+ * @param[in] path the dump file path (it is truncated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The dump file is created, the file header is written and the handler is
+ *	armed. Each loaded module must be added to the file (see add_module) for
+ *	the dump to be symbolized
+ */
+crashdump::crashdump(process *proc, const i8 *path)
+try:
+m_proc(proc),
+m_path(NULL),
+m_fd(-1),
+m_frames(NULL),
+m_threads(NULL),
+m_buffer(NULL),
+m_length(0),
+m_armed(false)
+{
+	if ( unlikely(proc == NULL) )
+		throw exception("invalid argument: proc (=%p)", proc);
+
+	if ( unlikely(path == NULL) )
+		throw exception("invalid argument: path (=%p)", path);
+
+	util::memset(m_actions, 0, sizeof(m_actions));
+	m_path = new i8[strlen(path) + 1];
+	strcpy(m_path, path);
+	m_frames = new frame[g_crash_depth];
+	m_threads = new const thread*[g_crash_threads];
+	m_buffer = new u8[g_crash_buf];
+
+	m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if ( unlikely(m_fd < 0) )
+		throw exception("failed to open '%s' (errno %d - %s)", path, errno,
+										strerror(errno));
+
+	tracehdr_t hdr;
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	util::memset(&hdr, 0, sizeof(tracehdr_t));
+	memcpy(hdr.magic, g_trace_magic, sizeof(hdr.magic));
+	hdr.version = g_trace_version;
+	hdr.pid = getpid();
+	hdr.clock = util::timestamp();
+	hdr.epoch = static_cast<u64> (ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+	if ( unlikely(!put(m_fd, &hdr, sizeof(tracehdr_t))) )
+		throw exception("failed to write '%s' (errno %d - %s)", path, errno,
+										strerror(errno));
+
+	arm();
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The copy writes to a duplicate descriptor of the source file. It is not
+ *	armed
+ */
+crashdump::crashdump(const crashdump &src)
+try:
+m_proc(NULL),
+m_path(NULL),
+m_fd(-1),
+m_frames(NULL),
+m_threads(NULL),
+m_buffer(NULL),
+m_length(0),
+m_armed(false)
+{
+	util::memset(m_actions, 0, sizeof(m_actions));
+	m_frames = new frame[g_crash_depth];
+	m_threads = new const thread*[g_crash_threads];
+	m_buffer = new u8[g_crash_buf];
+	*this = src;
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object destructor
+ *
+ * @note The handler is disarmed, the replaced signal actions are restored
+ */
+crashdump::~crashdump()
+{
+	destroy();
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+inline crashdump* crashdump::clone() const
+{
+	return new crashdump(*this);
+}
+
+
+/**
+ * @brief Get the dump file path
+ *
+ * @returns this->m_path
+ */
+inline const i8* crashdump::path() const
+{
+	return m_path;
+}
+
+
+/**
+ * @brief Check if the handler is armed
+ *
+ * @returns this->m_armed
+ */
+inline bool crashdump::is_armed() const
+{
+	return m_armed;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The object writes to a duplicate descriptor of the file of rval. It stays
+ *	armed, if it is
+ *
+ * @attention Assign to an armed object only if no thread can crash meanwhile
+ */
+crashdump& crashdump::operator=(const crashdump &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	i8 *path = new i8[strlen(rval.m_path) + 1];
+	strcpy(path, rval.m_path);
+
+	i32 fd = dup(rval.m_fd);
+	if ( unlikely(fd < 0) ) {
+		delete[] path;
+		throw exception("failed to duplicate fd %d (errno %d - %s)", rval.m_fd,
+										errno, strerror(errno));
+	}
+
+	if ( likely(m_fd >= 0) )
+		close(m_fd);
+
+	m_fd = fd;
+	m_proc = rval.m_proc;
+
+	delete[] m_path;
+	m_path = path;
+	return *this;
+}
+
+
+/**
+ * @brief Add a module to the module load map of the dump file
+ *
+ * @param[in] path the module path
+ *
+ * @param[in] base the module load base address
+ *
+ * @param[in] id the module build id (NULL if it has none)
+ *
+ * @param[in] id_sz the build id size (in bytes)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note The module record is written at once, in a block of its own
+ */
+crashdump& crashdump::add_module(const i8 *path, mem_addr_t base,
+																 const u8 *id, u32 id_sz)
+{
+	if ( unlikely(path == NULL) )
+		throw exception("invalid argument: path (=%p)", path);
+
+	if ( unlikely(id == NULL) )
+		id_sz = 0;
+
+	/* The record is padded to a multiple of 8 bytes */
+	traceblock_t blk = {g_block_modules, 1, 0, 0};
+	tracemod_t mod;
+	mod.base = base;
+	mod.path_sz = strlen(path) + 1;
+	mod.id_sz = id_sz;
+	u32 sz = (sizeof(tracemod_t) + mod.path_sz + id_sz + 7) & ~7U;
+	sz += sizeof(traceblock_t);
+
+	u8 *rec = new u8[sz];
+	util::memset(rec, 0, sz);
+	memcpy(rec, &blk, sizeof(traceblock_t));
+
+	u8 *ptr = rec + sizeof(traceblock_t);
+	memcpy(ptr, &mod, sizeof(tracemod_t));
+	memcpy(ptr + sizeof(tracemod_t), path, mod.path_sz);
+	if (id_sz > 0)
+		memcpy(ptr + sizeof(tracemod_t) + mod.path_sz, id, id_sz);
+
+	/* A single write, so that the block is never split */
+	bool ok = put(m_fd, rec, sz);
+	delete[] rec;
+	if ( unlikely(!ok) )
+		throw exception("failed to write '%s' (errno %d - %s)", m_path, errno,
+										strerror(errno));
+
+	return *this;
+}
+
+
+/**
+ * @brief Install the handler of the fatal signals (g_crash_signals)
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ *
+ * @attention
+ *	A signal has a single handler, so only one crashdump may be armed at a
+ *	time. The handler runs on the alternate signal stack of the thread, if it
+ *	has one (see sigaltstack), otherwise a stack overflow can't be dumped
+ */
+crashdump& crashdump::arm()
+{
+	if ( unlikely(m_armed) )
+		return *this;
+
+	crashdump *cur = load_acquire(m_active);
+	if ( unlikely(cur != NULL) )
+		throw exception("a crash dump handler is already armed (%p)", cur);
+
+	/* The handler finds the object before it is installed */
+	store_release(m_active, this);
+	m_armed = true;
+
+	struct sigaction act;
+	util::memset(&act, 0, sizeof(struct sigaction));
+	act.sa_sigaction = handler;
+	act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&act.sa_mask);
+	for (u32 i = 0; likely(i < g_crash_signal_cnt); i++) {
+		if ( likely(sigaction(g_crash_signals[i], &act, &m_actions[i]) == 0) )
+			continue;
+
+		i32 err = errno, signo = g_crash_signals[i];
+		while ( likely(i-- > 0) )
+			sigaction(g_crash_signals[i], &m_actions[i], NULL);
+
+		m_armed = false;
+		store_release(m_active, static_cast<crashdump*> (NULL));
+		throw exception("failed to install the signal %d handler (errno %d - %s)",
+										signo, err, strerror(err));
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Restore the replaced signal actions
+ *
+ * @returns *this
+ *
+ * @note This method is async-signal-safe
+ */
+crashdump& crashdump::disarm()
+{
+	if ( unlikely(!m_armed) )
+		return *this;
+
+	for (u32 i = 0; likely(i < g_crash_signal_cnt); i++)
+		sigaction(g_crash_signals[i], &m_actions[i], NULL);
+
+	m_armed = false;
+	if ( likely(load_acquire(m_active) == this) )
+		store_release(m_active, static_cast<crashdump*> (NULL));
+
+	return *this;
+}
+
+}
+
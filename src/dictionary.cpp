@@ -249,37 +249,36 @@ dictionary& dictionary::load_file(const i8 *path)
 		);
 	}
 
+	/*
+	 * The words are loaded in a temporary chain, in linear time, and spliced to
+	 * the dictionary when the whole file is parsed
+	 */
+	chain<string> words;
 	string *word = NULL;
-	i32 cnt = 0;
 
 	/* If an exception occurs, unmap/close the file, clean up and rethrow it */
 	try {
-		i32 bytes = sz;
-		i8 *offset, *cur;
+		i8 *offset, *cur, *end;
 		offset = cur = static_cast<i8*> (mmap_base);
+		end = offset + sz;
 
-		/* Load the dictionary words */
-		while ( likely(bytes-- > 0) )
-			if ( unlikely(*cur == '\n') ) {
+		/* Load the dictionary words (the last line may not be terminated) */
+		for (; likely(cur <= end); cur++)
+			if ( unlikely(cur == end || *cur == '\n') ) {
 				if ( likely(cur != offset) ) {
 					word = new string("%.*s", cur - offset, offset);
 					word->trim();
 
 					if ( unlikely(word->length() == 0) )
 						delete word;
-
-					else {
-						cnt++;
-						add(word);
-					}
+					else
+						words.append(word);
 
 					word = NULL;
 				}
 
-				offset = ++cur;
+				offset = cur + 1;
 			}
-			else
-				++cur;
 	}
 
 	catch (...) {
@@ -292,6 +291,9 @@ dictionary& dictionary::load_file(const i8 *path)
 	munmap(mmap_base, sz);
 	close(fd);
 
+	u32 cnt = words.size();
+	append(words);
+
 #if CSDBG_DBG_LEVEL & CSDBG_DBGL_INFO
 	if ( likely(cnt > 0) )
 		util::dbg_info(
@@ -323,8 +325,8 @@ dictionary& dictionary::load_file(const i8 *path)
  */
 const string* dictionary::lookup(const string &exp, bool icase) const
 {
-	for (u32 i = 0; likely(i < m_size); i++) {
-		string *word = at(i);
+	for (iterator it = head(); likely(it.valid()); it.next()) {
+		string *word = it.data();
 		if ( likely(!m_mode) ) {
 			if ( unlikely(exp.cmp(*word, icase) == 0) )
 				return word;
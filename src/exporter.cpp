@@ -0,0 +1,432 @@
+#include "../include/exporter.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/exporter.cpp
+
+	@brief Class csdbg::exporter method implementation
+*/
+
+namespace csdbg {
+
+/* Static member variable definition */
+
+__thread u32 exporter::m_named = 0;
+
+
+/**
+ * @brief Copy the name of a thread, for the writer thread to format
+ *
+ * @param[in] tid the thread id
+ *
+ * @param[in] nm the thread name (NULL if it has none)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+exporter& exporter::name_thread(u64 tid, const i8 *nm)
+{
+	/* If an exception occurs, unlock and rethrow it */
+	util::lock();
+	try {
+		u32 i = 0;
+		for (; likely(i < m_tid_cnt); i++)
+			if ( unlikely(m_tids[i] == tid) )
+				break;
+
+		/* A new thread, grow the id array */
+		if ( unlikely(i == m_tid_cnt) ) {
+			u64 *tids = new u64[m_tid_cnt + 1];
+			string *name = NULL;
+			try {
+				name = new string;
+				m_names->append(name);
+			}
+
+			catch (...) {
+				delete name;
+				delete[] tids;
+				throw;
+			}
+
+			if ( likely(m_tid_cnt > 0) )
+				memcpy(tids, m_tids, m_tid_cnt * sizeof(u64));
+
+			delete[] m_tids;
+			m_tids = tids;
+			m_tids[i] = tid;
+			m_tid_cnt++;
+		}
+
+		if ( likely(nm != NULL) )
+			m_names->at(i)->set("%s", nm);
+		else
+			m_names->at(i)->clear();
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+
+	util::unlock();
+	return *this;
+}
+
+
+/**
+ * @brief Create (or truncate) the file and start the timeline
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The timeline formats the events to a duplicate descriptor of the file, the
+ *	original one is released with the base object
+ */
+exporter& exporter::open()
+{
+	m_stream->open(O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	filebuf *stream = m_stream->clone();
+	try {
+		m_timeline = new timeline(stream);
+	}
+
+	catch (...) {
+		delete stream;
+		throw;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Format a block of events to the timeline
+ *
+ * @param[in] blk the block header
+ *
+ * @param[in] events the block events (blk.count)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The global lock is held once per block, to resolve the function symbols and
+ *	copy the thread name, the events are formatted after it is released
+ */
+exporter& exporter::write(const traceblock_t &blk, const traceevent_t *events)
+{
+	if ( unlikely(m_timeline == NULL || blk.count == 0) )
+		return *this;
+
+	string name;
+	bool named = false;
+
+	/* If an exception occurs, unlock and rethrow it */
+	util::lock();
+	try {
+		for (u32 i = 0; likely(i < m_tid_cnt); i++)
+			if ( unlikely(m_tids[i] == blk.thread) ) {
+				named = (m_names->at(i)->length() > 0);
+				if ( likely(named) )
+					name.set(*m_names->at(i));
+
+				break;
+			}
+
+		for (u32 i = 0; likely(i < blk.count); i++)
+			m_symbols[i] = m_proc->lookup(events[i].fn);
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+
+	util::unlock();
+
+	const i8 *nm = (named) ? name.cstr() : NULL;
+	for (u32 i = 0; likely(i < blk.count); i++) {
+		if ( unlikely(m_symbols[i] == NULL) )
+			continue;
+
+		if (events[i].type == g_event_call)
+			m_timeline->enter(blk.thread, nm, m_symbols[i], events[i].time);
+		else
+			m_timeline->leave(blk.thread, nm, events[i].time);
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Stop exporting, format the buffered events, close the timeline and release
+ *	the resources
+ *
+ * @returns *this
+ */
+exporter& exporter::destroy()
+{
+	/* The events left in the rings are formatted while the timeline is open */
+	recorder::destroy();
+
+	delete m_timeline;
+	delete[] m_symbols;
+	delete m_names;
+	delete[] m_tids;
+	m_timeline = NULL;
+	m_symbols = NULL;
+	m_names = NULL;
+	m_tids = NULL;
+	m_tid_cnt = 0;
+	return *this;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] proc the traced process, it resolves the symbols and thread names
+ *
+ * @param[in] path the timeline file path (it is truncated)
+ *
+ * @param[in] overwrite
+ *	true to drop the oldest events when a ring is full, false to drop the newest
+ *
+ * @param[in] sz the ring capacity (in events, a power of 2)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The file is created and the writer thread is started when the first event
+ *	is recorded
+ */
+exporter::exporter(process *proc, const i8 *path, bool overwrite, u32 sz)
+try:
+recorder(path, overwrite, sz),
+m_proc(proc),
+m_timeline(NULL),
+m_symbols(NULL),
+m_names(NULL),
+m_tids(NULL),
+m_tid_cnt(0)
+{
+	if ( unlikely(proc == NULL) )
+		throw exception("invalid argument: proc (=%p)", proc);
+
+	m_symbols = new const i8*[sz];
+	m_names = new chain<string>;
+}
+
+catch (...) {
+	delete[] m_symbols;
+	delete m_names;
+	m_symbols = NULL;
+	m_names = NULL;
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The copy formats its events to a duplicate descriptor of the source file,
+ *	using its own rings, writer thread and timeline
+ */
+exporter::exporter(const exporter &src)
+try:
+recorder(src.path(), src.m_overwrite, src.m_ring_sz),
+m_proc(NULL),
+m_timeline(NULL),
+m_symbols(NULL),
+m_names(NULL),
+m_tids(NULL),
+m_tid_cnt(0)
+{
+	*this = src;
+}
+
+catch (...) {
+	delete[] m_symbols;
+	delete m_names;
+	delete[] m_tids;
+	m_symbols = NULL;
+	m_names = NULL;
+	m_tids = NULL;
+}
+
+
+/**
+ * @brief Object destructor
+ *
+ * @attention
+ *	The rings are released, the instrumented threads must not record events
+ *	while or after the object is destroyed
+ */
+exporter::~exporter()
+{
+	destroy();
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+inline exporter* exporter::clone() const
+{
+	return new exporter(*this);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The events buffered so far are formatted to the current timeline, the
+ *	following ones to a copy of the timeline of rval (see recorder::operator=),
+ *	along with a copy of its thread names
+ */
+exporter& exporter::operator=(const exporter &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	/* The writer must not use the timeline while it is replaced */
+	stop();
+	if ( likely(m_stream != NULL && m_stream->is_opened()) )
+		collect();
+
+	timeline *tl = NULL;
+	const i8 **symbols = NULL;
+	chain<string> *names = NULL;
+	u64 *tids = NULL;
+	util::lock();
+	try {
+		if ( likely(rval.m_timeline != NULL) )
+			tl = rval.m_timeline->clone();
+
+		symbols = new const i8*[rval.m_ring_sz];
+		names = rval.m_names->clone();
+		tids = new u64[rval.m_tid_cnt];
+	}
+
+	catch (...) {
+		util::unlock();
+		delete tl;
+		delete[] symbols;
+		delete names;
+		throw;
+	}
+
+	if ( likely(rval.m_tid_cnt > 0) )
+		memcpy(tids, rval.m_tids, rval.m_tid_cnt * sizeof(u64));
+
+	delete m_timeline;
+	delete[] m_symbols;
+	delete m_names;
+	delete[] m_tids;
+	m_timeline = tl;
+	m_symbols = symbols;
+	m_names = names;
+	m_tids = tids;
+	m_tid_cnt = rval.m_tid_cnt;
+	m_proc = rval.m_proc;
+	util::unlock();
+
+	recorder::operator=(rval);
+	return *this;
+}
+
+
+/**
+ * @brief Record an instrumentation event of the current thread
+ *
+ * @param[in] fn the called (or returning) function address
+ *
+ * @param[in] site the call site (or return address)
+ *
+ * @param[in] type the event type (g_event_*)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	No lock is held, unless this is the first event of the thread or its name
+ *	has changed since its last event, when the name is copied (see
+ *	recorder::record)
+ */
+exporter& exporter::record(mem_addr_t fn, mem_addr_t site, u32 type)
+{
+	if ( unlikely(load_acquire(m_failed)) )
+		return *this;
+
+	/* FNV-1a hash of the thread name, 0 stands for no name */
+	thread *thr = m_proc->current_thread();
+	const i8 *nm = thr->name();
+	u32 hash = 0;
+	if ( likely(nm != NULL) ) {
+		hash = 2166136261U;
+		for (const i8 *ch = nm; *ch != '\0'; ch++)
+			hash = (hash ^ static_cast<u8> (*ch)) * 16777619U;
+
+		hash |= (hash == 0);
+	}
+
+	/* Copy the name before the event is recorded, for the writer to find it */
+	ring *r = m_ring;
+	if ( unlikely(r == NULL || r->owner() != this || hash != m_named) ) {
+		name_thread(static_cast<u64> (thr->handle()), nm);
+		m_named = hash;
+	}
+
+	recorder::record(fn, site, type);
+	return *this;
+}
+
+
+/**
+ * @brief Add a module to the module load map of the trace
+ *
+ * @returns *this
+ *
+ * @note
+ *	A timeline is symbolized as it is written, it has no module load map, so
+ *	this method does nothing
+ */
+exporter& exporter::add_module(const i8*, mem_addr_t, const u8*, u32)
+{
+	return *this;
+}
+
+}
+
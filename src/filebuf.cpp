@@ -231,6 +231,35 @@ filebuf& filebuf::flush()
 }
 
 
+/**
+ * @brief Write raw (binary) data to the file, bypassing the buffer
+ *
+ * @param[in] data the data
+ *
+ * @param[in] sz the data size (bytes)
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+filebuf& filebuf::write(const void *data, u32 sz)
+{
+	try {
+		streambuf::write(data, sz);
+		return *this;
+	}
+
+	catch (i32 err) {
+		throw exception(
+			"failed to write data to file '%s' (errno %d - %s)",
+			m_path,
+			err,
+			strerror(err)
+		);
+	}
+}
+
+
 /**
  * @brief Commit cached data to the file
  *
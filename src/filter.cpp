@@ -52,9 +52,12 @@ inline filter& filter::operator=(const filter &rval)
  *
  * @param[in] mode true to create a symbol filter, false to filter modules
  *
+ * @throws std::bad_alloc
  * @throws csdbg::exception
  */
 filter::filter(const i8 *expr, bool icase, bool mode):
+m_text(NULL),
+m_icase(icase),
 m_mode(mode)
 {
 	util::memset(&m_expr, 0, sizeof(regex_t));
@@ -68,6 +71,8 @@ m_mode(mode)
 filter::~filter()
 {
 	regfree(&m_expr);
+	delete[] m_text;
+	m_text = NULL;
 }
 
 
@@ -82,6 +87,28 @@ inline bool filter::mode() const
 }
 
 
+/**
+ * @brief Get the filter expression
+ *
+ * @returns this->m_text
+ */
+inline const i8* filter::expr() const
+{
+	return m_text;
+}
+
+
+/**
+ * @brief Check if the filter ignores case
+ *
+ * @returns this->m_icase
+ */
+inline bool filter::icase() const
+{
+	return m_icase;
+}
+
+
 /**
  * @brief Set the filter expression
  *
@@ -91,6 +118,7 @@ inline bool filter::mode() const
  *
  * @returns *this
  *
+ * @throws std::bad_alloc
  * @throws csdbg::exception
  */
 filter& filter::set_expr(const i8 *expr, bool icase)
@@ -103,10 +131,20 @@ filter& filter::set_expr(const i8 *expr, bool icase)
 	if ( unlikely(icase) )
 		flags |= REG_ICASE;
 
+	/* Keep the expression source, the filter matchers analyze it */
+	i8 *text = new i8[strlen(expr) + 1];
+	strcpy(text, expr);
+
 	/* Compile the regular expression */
 	i32 retval = regcomp(&m_expr, expr, flags);
-	if ( likely(retval == 0) )
+	if ( likely(retval == 0) ) {
+		delete[] m_text;
+		m_text = text;
+		m_icase = icase;
 		return *this;
+	}
+
+	delete[] text;
 
 	/* If the expression compilation failed */
 	i32 len = regerror(retval, &m_expr, NULL, 0);
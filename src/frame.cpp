@@ -0,0 +1,11 @@
+#include "../include/frame.hpp"
+
+/**
+	@file src/frame.cpp
+
+	@brief Class csdbg::frame dummy implementation file
+
+	The frame methods are trivial and they are implemented inline, in the class
+	definition file, to be accessible to all the library modules
+*/
+
@@ -0,0 +1,1090 @@
+#include "../include/linetab.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/linetab.cpp
+
+	@brief Class csdbg::linetab method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Load the contents of a section of an objective code file
+ *
+ * @param[in] fd the bfd of the file
+ *
+ * @param[in] nm the section name
+ *
+ * @param[out] sz the section size
+ *
+ * @returns the section contents (heap allocated) or NULL if the file has no
+ * such section (or if it can't be read)
+ *
+ * @throws std::bad_alloc
+ */
+u8* linetab::load(bfd *fd, const i8 *nm, u32 &sz)
+{
+	sz = 0;
+	asection *sec = bfd_get_section_by_name(fd, nm);
+	if ( unlikely(sec == NULL || (sec->flags & SEC_HAS_CONTENTS) == 0) )
+		return NULL;
+
+	u32 len = bfd_get_section_size(sec);
+	if ( unlikely(len == 0) )
+		return NULL;
+
+	u8 *retval = new u8[len];
+	if ( unlikely(!bfd_get_section_contents(fd, sec, retval, 0, len)) ) {
+		delete[] retval;
+		return NULL;
+	}
+
+	sz = len;
+	return retval;
+}
+
+
+/**
+ * @brief Read a fixed size unsigned integer (of host byte order)
+ *
+ * @param[in,out] cur the read position (it is advanced)
+ *
+ * @param[in] end the end of the readable data
+ *
+ * @param[in] sz the integer size (1, 2, 4 or 8 bytes)
+ *
+ * @returns the integer
+ *
+ * @throws csdbg::exception
+ */
+u64 linetab::read(const u8 *&cur, const u8 *end, u32 sz)
+{
+	if ( unlikely(sz > static_cast<u32> (end - cur)) )
+		throw exception("truncated line number program (%d bytes needed)", sz);
+
+	u64 retval = 0;
+	switch (sz) {
+	case 1:
+		retval = *cur;
+		break;
+
+	case 2: {
+		u16 val;
+		memcpy(&val, cur, sizeof(val));
+		retval = val;
+		break;
+	}
+
+	case 4: {
+		u32 val;
+		memcpy(&val, cur, sizeof(val));
+		retval = val;
+		break;
+	}
+
+	case 8:
+		memcpy(&retval, cur, sizeof(retval));
+		break;
+
+	default:
+		throw exception("unsupported integer size (%d bytes)", sz);
+	}
+
+	cur += sz;
+	return retval;
+}
+
+
+/**
+ * @brief Read an unsigned LEB128 encoded integer
+ *
+ * @param[in,out] cur the read position (it is advanced)
+ *
+ * @param[in] end the end of the readable data
+ *
+ * @returns the integer
+ *
+ * @throws csdbg::exception
+ */
+u64 linetab::uleb128(const u8 *&cur, const u8 *end)
+{
+	u64 retval = 0;
+	for (u32 shift = 0; likely(cur < end); shift += 7) {
+		u8 byte = *cur++;
+		if ( likely(shift < 64) )
+			retval |= static_cast<u64> (byte & 0x7f) << shift;
+
+		if ( likely((byte & 0x80) == 0) )
+			return retval;
+	}
+
+	throw exception("truncated line number program (LEB128 overrun)");
+}
+
+
+/**
+ * @brief Read a signed LEB128 encoded integer
+ *
+ * @param[in,out] cur the read position (it is advanced)
+ *
+ * @param[in] end the end of the readable data
+ *
+ * @returns the integer
+ *
+ * @throws csdbg::exception
+ */
+i64 linetab::sleb128(const u8 *&cur, const u8 *end)
+{
+	i64 retval = 0;
+	for (u32 shift = 0; likely(cur < end);) {
+		u8 byte = *cur++;
+		if ( likely(shift < 64) )
+			retval |= static_cast<i64> (byte & 0x7f) << shift;
+
+		shift += 7;
+		if ( likely((byte & 0x80) == 0) ) {
+			/* Sign extend */
+			if ( unlikely(shift < 64 && (byte & 0x40) != 0) )
+				retval |= -(static_cast<i64> (1) << shift);
+
+			return retval;
+		}
+	}
+
+	throw exception("truncated line number program (LEB128 overrun)");
+}
+
+
+/**
+ * @brief Read a null terminated string
+ *
+ * @param[in,out] cur the read position (it is advanced past the terminator)
+ *
+ * @param[in] end the end of the readable data
+ *
+ * @returns the string
+ *
+ * @throws csdbg::exception
+ */
+const i8* linetab::cstr(const u8 *&cur, const u8 *end)
+{
+	const u8 *nul = static_cast<const u8*> (memchr(cur, 0, end - cur));
+	if ( unlikely(nul == NULL) )
+		throw exception("truncated line number program (unterminated string)");
+
+	const i8 *retval = reinterpret_cast<const i8*> (cur);
+	cur = nul + 1;
+	return retval;
+}
+
+
+/**
+ * @brief Read an attribute value of a DWARF 5 directory or file name entry
+ *
+ * @param[in,out] cur the read position (it is advanced)
+ *
+ * @param[in] end the end of the readable data
+ *
+ * @param[in] fmt the attribute form code (DW_FORM_*)
+ *
+ * @param[in] offsz the size of section offsets (4 or 8 bytes)
+ *
+ * @param[in] lstr the .debug_line_str section
+ *
+ * @param[in] str the .debug_str section
+ *
+ * @returns the value if it is a string, NULL otherwise
+ *
+ * @throws csdbg::exception
+ */
+const i8* linetab::form(const u8 *&cur, const u8 *end, u64 fmt, u32 offsz,
+												const section &lstr, const section &str)
+{
+	const section *pool = &str;
+	switch (fmt) {
+	/* DW_FORM_string */
+	case 0x08:
+		return cstr(cur, end);
+
+	/* DW_FORM_line_strp */
+	case 0x1f:
+		pool = &lstr;
+
+		/* Fall through */
+
+	/* DW_FORM_strp */
+	case 0x0e: {
+		u64 offset = read(cur, end, offsz);
+		if ( unlikely(offset >= pool->m_size) )
+			throw exception(
+				"invalid string offset (0x%x)",
+				static_cast<u32> (offset)
+			);
+
+		const u8 *bgn = pool->m_data + offset;
+		return cstr(bgn, pool->m_data + pool->m_size);
+	}
+
+	/* DW_FORM_udata */
+	case 0x0f:
+		uleb128(cur, end);
+		return NULL;
+
+	/* DW_FORM_data1, DW_FORM_data2, DW_FORM_data4, DW_FORM_data8 */
+	case 0x0b:
+		read(cur, end, 1);
+		return NULL;
+
+	case 0x05:
+		read(cur, end, 2);
+		return NULL;
+
+	case 0x06:
+		read(cur, end, 4);
+		return NULL;
+
+	case 0x07:
+		read(cur, end, 8);
+		return NULL;
+
+	/* DW_FORM_data16 (e.g. an MD5 checksum) */
+	case 0x1e:
+		read(cur, end, 8);
+		read(cur, end, 8);
+		return NULL;
+
+	/* DW_FORM_block */
+	case 0x09: {
+		u64 len = uleb128(cur, end);
+		if ( unlikely(len > static_cast<u64> (end - cur)) )
+			throw exception("truncated line number program (block overrun)");
+
+		cur += len;
+		return NULL;
+	}
+
+	default:
+		throw exception(
+			"unsupported attribute form (0x%x)",
+			static_cast<u32> (fmt)
+		);
+	}
+}
+
+
+/**
+ * @brief Append a row to the line number table
+ *
+ * @param[in] addr the row address
+ *
+ * @param[in] file the offset of the file name in the string pool
+ *
+ * @param[in] line the line number (0 if the row ends a sequence)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+linetab& linetab::add(mem_addr_t addr, u32 file, u32 line)
+{
+	/* Grow the row table if required */
+	if ( unlikely(m_size == m_capacity) ) {
+		u32 cap = (m_capacity << 1) + g_memblock_sz;
+		mem_addr_t *addrs = NULL;
+		u32 *lines = NULL, *files = NULL;
+		try {
+			addrs = new mem_addr_t[cap];
+			lines = new u32[cap];
+			files = new u32[cap];
+		}
+
+		catch (...) {
+			delete[] addrs;
+			delete[] lines;
+			throw;
+		}
+
+		if ( likely(m_size > 0) ) {
+			memcpy(addrs, m_addrs, m_size * sizeof(mem_addr_t));
+			memcpy(lines, m_lines, m_size * sizeof(u32));
+			memcpy(files, m_files, m_size * sizeof(u32));
+		}
+
+		delete[] m_addrs;
+		delete[] m_lines;
+		delete[] m_files;
+
+		m_addrs = addrs;
+		m_lines = lines;
+		m_files = files;
+		m_capacity = cap;
+	}
+
+	m_addrs[m_size] = addr;
+	m_lines[m_size] = line;
+	m_files[m_size] = file;
+	m_size++;
+	return *this;
+}
+
+
+/**
+ * @brief Store the base name of a source file in the string pool
+ *
+ * @param[in] path the source file path
+ *
+ * @returns the offset of the base name in the string pool
+ *
+ * @throws std::bad_alloc
+ */
+u32 linetab::intern(const i8 *path)
+{
+	const i8 *nm = strrchr(path, '/');
+	nm = (nm != NULL) ? nm + 1 : path;
+
+	/* Grow the string pool if required */
+	u32 len = strlen(nm) + 1;
+	if ( unlikely(m_strings_sz + len > m_pool_sz) ) {
+		u32 sz = (m_pool_sz << 1) + len + g_memblock_sz;
+		i8 *pool = new i8[sz];
+		if ( likely(m_strings != NULL) )
+			memcpy(pool, m_strings, m_strings_sz);
+
+		delete[] m_strings;
+		m_strings = pool;
+		m_pool_sz = sz;
+	}
+
+	u32 retval = m_strings_sz;
+	memcpy(m_strings + m_strings_sz, nm, len);
+	m_strings_sz += len;
+	return retval;
+}
+
+
+/**
+ * @brief Parse a line number program unit and append its rows to the table
+ *
+ * @param[in] cur the beginning of the unit
+ *
+ * @param[in] end the end of the .debug_line section
+ *
+ * @param[in] lstr the .debug_line_str section
+ *
+ * @param[in] str the .debug_str section
+ *
+ * @returns the beginning of the next unit
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	Sequences that start at address 0 (or at the maximum address) belong to code
+ *	discarded by the linker and they are dropped
+ */
+const u8* linetab::parse(const u8 *cur, const u8 *end, const section &lstr,
+												const section &str)
+{
+	/* Unit header */
+	u32 offsz = 4;
+	u64 len = read(cur, end, 4);
+	if ( unlikely(len == 0xffffffff) ) {
+		offsz = 8;
+		len = read(cur, end, 8);
+	}
+
+	if ( unlikely(len > static_cast<u64> (end - cur)) )
+		throw exception("truncated line number program unit");
+
+	const u8 *unit_end = cur + len;
+	u16 ver = read(cur, unit_end, 2);
+	if ( unlikely(ver < 2 || ver > 5) ) {
+		util::dbg_warn("unsupported line number program version %d", ver);
+		return unit_end;
+	}
+
+	u32 addrsz = sizeof(mem_addr_t);
+	if (ver >= 5) {
+		addrsz = read(cur, unit_end, 1);
+		read(cur, unit_end, 1);
+	}
+
+	u64 hdrsz = read(cur, unit_end, offsz);
+	if ( unlikely(hdrsz > static_cast<u64> (unit_end - cur)) )
+		throw exception("truncated line number program header");
+
+	const u8 *prog = cur + hdrsz;
+	u32 min_len = read(cur, prog, 1);
+	if (ver >= 4)
+		read(cur, prog, 1);
+
+	read(cur, prog, 1);
+	i32 line_base = static_cast<i8> (read(cur, prog, 1));
+	u32 line_range = read(cur, prog, 1);
+	u32 opcode_base = read(cur, prog, 1);
+	if ( unlikely(line_range == 0 || opcode_base == 0) )
+		throw exception("invalid line number program header");
+
+	const u8 *op_lens = cur;
+	if ( unlikely(opcode_base - 1 > static_cast<u32> (prog - cur)) )
+		throw exception("truncated line number program header");
+
+	cur += opcode_base - 1;
+
+	/* The file name table (up to DWARF 4 the file indices start from 1) */
+	const i8 **files = NULL;
+	u32 *offsets = NULL, file_cnt = 0;
+
+	/* If an exception occurs, release resources and rethrow it */
+	try {
+		if (ver < 5) {
+			/* Skip the include directories */
+			while ( likely(cur < prog && *cur != 0) )
+				cstr(cur, prog);
+
+			read(cur, prog, 1);
+
+			/* Count the file names, then read them */
+			const u8 *bgn = cur;
+			for (file_cnt = 1; likely(cur < prog && *cur != 0); file_cnt++) {
+				cstr(cur, prog);
+				uleb128(cur, prog);
+				uleb128(cur, prog);
+				uleb128(cur, prog);
+			}
+
+			files = new const i8*[file_cnt];
+			files[0] = NULL;
+			cur = bgn;
+			for (u32 i = 1; likely(i < file_cnt); i++) {
+				files[i] = cstr(cur, prog);
+				uleb128(cur, prog);
+				uleb128(cur, prog);
+				uleb128(cur, prog);
+			}
+		}
+
+		else {
+			/* Skip the directories, using their entry format */
+			u32 fmt_cnt = read(cur, prog, 1);
+			u64 fmt[2 * 256];
+			for (u32 i = 0; likely(i < fmt_cnt); i++) {
+				fmt[2 * i] = uleb128(cur, prog);
+				fmt[2 * i + 1] = uleb128(cur, prog);
+			}
+
+			u64 cnt = uleb128(cur, prog);
+			for (u64 i = 0; likely(i < cnt); i++)
+				for (u32 j = 0; likely(j < fmt_cnt); j++)
+					form(cur, prog, fmt[2 * j + 1], offsz, lstr, str);
+
+			/* Read the file names (DW_LNCT_path entries) */
+			fmt_cnt = read(cur, prog, 1);
+			for (u32 i = 0; likely(i < fmt_cnt); i++) {
+				fmt[2 * i] = uleb128(cur, prog);
+				fmt[2 * i + 1] = uleb128(cur, prog);
+			}
+
+			cnt = uleb128(cur, prog);
+			if ( unlikely(cnt > static_cast<u64> (prog - cur)) )
+				throw exception("invalid file name count (%d)", static_cast<u32> (cnt));
+
+			file_cnt = cnt;
+			files = new const i8*[file_cnt];
+			for (u32 i = 0; likely(i < file_cnt); i++) {
+				files[i] = NULL;
+				for (u32 j = 0; likely(j < fmt_cnt); j++) {
+					const i8 *val = form(cur, prog, fmt[2 * j + 1], offsz, lstr, str);
+					if (fmt[2 * j] == 1)
+						files[i] = val;
+				}
+			}
+		}
+
+		/* The file names are stored in the string pool when first referenced */
+		offsets = new u32[file_cnt];
+		for (u32 i = 0; likely(i < file_cnt); i++)
+			offsets[i] = UINT_MAX;
+
+		/* Run the line number program state machine */
+		mem_addr_t addr = 0, seq = 0;
+		mem_addr_t max = (addrsz < 8) ? (1ULL << (8 * addrsz)) - 1 : ~0ULL;
+		u32 file = 1, first = m_size;
+		i64 line = 1;
+		bool fresh = true;
+
+		for (cur = prog; likely(cur < unit_end);) {
+			u32 op = *cur++;
+			bool emit = false;
+
+			/* Special opcodes advance the address and the line and append a row */
+			if ( likely(op >= opcode_base) ) {
+				u32 adj = op - opcode_base;
+				addr += (adj / line_range) * min_len;
+				line += line_base + static_cast<i32> (adj % line_range);
+				emit = true;
+			}
+
+			else switch (op) {
+			/* Extended opcodes */
+			case 0: {
+				u64 sz = uleb128(cur, unit_end);
+				if ( unlikely(sz > static_cast<u64> (unit_end - cur)) )
+					throw exception("truncated extended opcode");
+
+				const u8 *next = cur + sz;
+				if ( unlikely(sz == 0) )
+					break;
+
+				switch (*cur++) {
+				/* DW_LNE_end_sequence */
+				case 1:
+					/* Drop the sequences of discarded code */
+					if ( unlikely(seq == 0 || seq >= max - 1) )
+						m_size = first;
+					else {
+						/* A row at the end address is empty, the end replaces it */
+						if ( likely(m_size > first && m_addrs[m_size - 1] == addr) )
+							m_size--;
+
+						add(addr, 0, 0);
+					}
+
+					addr = 0;
+					seq = 0;
+					file = 1;
+					line = 1;
+					fresh = true;
+					first = m_size;
+					break;
+
+				/* DW_LNE_set_address */
+				case 2:
+					addr = read(cur, next, sz - 1);
+
+					/* The sequence base address (discarded code is relocated to 0) */
+					if ( likely(fresh) )
+						seq = addr;
+
+					break;
+
+				default:
+					break;
+				}
+
+				cur = next;
+				break;
+			}
+
+			/* DW_LNS_copy */
+			case 1:
+				emit = true;
+				break;
+
+			/* DW_LNS_advance_pc */
+			case 2:
+				addr += uleb128(cur, unit_end) * min_len;
+				break;
+
+			/* DW_LNS_advance_line */
+			case 3:
+				line += sleb128(cur, unit_end);
+				break;
+
+			/* DW_LNS_set_file */
+			case 4:
+				file = uleb128(cur, unit_end);
+				break;
+
+			/* DW_LNS_const_add_pc */
+			case 8:
+				addr += ((255 - opcode_base) / line_range) * min_len;
+				break;
+
+			/* DW_LNS_fixed_advance_pc */
+			case 9:
+				addr += read(cur, unit_end, 2);
+				break;
+
+			/* DW_LNS_negate_stmt, set_basic_block, set_prologue_end/epilogue_begin */
+			case 6:
+			case 7:
+			case 10:
+			case 11:
+				break;
+
+			/* Other standard opcodes (skip their LEB128 operands) */
+			default:
+				for (u32 i = 0; likely(i < op_lens[op - 1]); i++)
+					uleb128(cur, unit_end);
+
+				break;
+			}
+
+			if ( likely(!emit) )
+				continue;
+
+			if ( unlikely(fresh) )
+				fresh = false;
+
+			/* Of multiple rows of a sequence with the same address, the last applies */
+			else if ( unlikely(m_addrs[m_size - 1] == addr) )
+				m_size--;
+
+			/* Rows with an invalid file index or line are stored as unresolved */
+			if ( unlikely(file >= file_cnt || files[file] == NULL || line <= 0) ) {
+				add(addr, 0, 0);
+				continue;
+			}
+
+			if ( unlikely(offsets[file] == UINT_MAX) )
+				offsets[file] = intern(files[file]);
+
+			add(addr, offsets[file], line);
+		}
+
+		/* Drop an unterminated sequence */
+		m_size = first;
+
+		delete[] files;
+		delete[] offsets;
+		return unit_end;
+	}
+
+	catch (...) {
+		delete[] files;
+		delete[] offsets;
+		throw;
+	}
+}
+
+
+/**
+ * @brief Swap two line number table rows
+ *
+ * @param[in] i the offset of the first row
+ *
+ * @param[in] j the offset of the second row
+ *
+ * @returns *this
+ */
+linetab& linetab::swap(u32 i, u32 j)
+{
+	mem_addr_t addr = m_addrs[i];
+	m_addrs[i] = m_addrs[j];
+	m_addrs[j] = addr;
+
+	u32 tmp = m_lines[i];
+	m_lines[i] = m_lines[j];
+	m_lines[j] = tmp;
+
+	tmp = m_files[i];
+	m_files[i] = m_files[j];
+	m_files[j] = tmp;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Sift a row down a max heap, ordered by address and, on equal addresses, by
+ *	line number (so rows that end a sequence come first)
+ *
+ * @param[in] i the offset of the row
+ *
+ * @param[in] sz the heap size
+ *
+ * @returns *this
+ */
+linetab& linetab::sift(u32 i, u32 sz)
+{
+	while (true) {
+		u32 max = i, child = 2 * i + 1;
+
+		for (u32 j = child; likely(j < sz && j <= child + 1); j++)
+			if (m_addrs[j] > m_addrs[max] ||
+					(m_addrs[j] == m_addrs[max] && m_lines[j] > m_lines[max]))
+				max = j;
+
+		if ( unlikely(max == i) )
+			return *this;
+
+		swap(i, max);
+		i = max;
+	}
+}
+
+
+/**
+ * @brief
+ *	Sort the line number table by address. Of multiple rows with the same
+ *	address, the one with the greatest line number is kept, so a sequence that
+ *	starts where another one ends takes precedence over its end
+ *
+ * @returns *this
+ */
+linetab& linetab::sort()
+{
+	/* Heapsort */
+	for (i32 i = m_size / 2 - 1; likely(i >= 0); i--)
+		sift(i, m_size);
+
+	for (u32 i = m_size; likely(i > 1); i--) {
+		swap(0, i - 1);
+		sift(0, i - 1);
+	}
+
+	/* Discard duplicate addresses */
+	u32 cnt = 0;
+	for (u32 i = 0; likely(i < m_size); i++) {
+		if ( unlikely(cnt > 0 && m_addrs[cnt - 1] == m_addrs[i]) )
+			cnt--;
+
+		m_addrs[cnt] = m_addrs[i];
+		m_lines[cnt] = m_lines[i];
+		m_files[cnt] = m_files[i];
+		cnt++;
+	}
+
+	m_size = cnt;
+	return *this;
+}
+
+
+/**
+ * @brief Binary search the line number table
+ *
+ * @param[in] addr the address
+ *
+ * @returns
+ *	the offset of the last row with address less than or equal to addr, or -1 if
+ *	there's no such row
+ */
+i32 linetab::find(mem_addr_t addr) const
+{
+	i32 lo = 0, hi = m_size - 1, retval = -1;
+	while ( likely(lo <= hi) ) {
+		i32 mid = lo + (hi - lo) / 2;
+
+		if ( unlikely(m_addrs[mid] <= addr) ) {
+			retval = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+
+	return retval;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] path the path of the objective code file
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	If the file can't be read or has no usable line number information, the
+ *	table is left empty (the errors are logged, not thrown)
+ */
+linetab::linetab(const i8 *path):
+m_path(NULL),
+m_addrs(NULL),
+m_lines(NULL),
+m_files(NULL),
+m_strings(NULL),
+m_size(0),
+m_capacity(0),
+m_strings_sz(0),
+m_pool_sz(0)
+{
+	if ( unlikely(path == NULL) )
+		throw exception("invalid argument: path (=%p)", path);
+
+	m_path = new i8[strlen(path) + 1];
+	strcpy(m_path, path);
+
+	bfd *fd = NULL;
+	u8 *lines = NULL, *lstr = NULL, *str = NULL;
+
+	/* If an exception occurs, release resources and rethrow it */
+	try {
+		/* Open the binary file and obtain a descriptor (the bfd) */
+		fd = bfd_openr(m_path, NULL);
+		if ( unlikely(fd == NULL) ) {
+			bfd_error bfd_errno = bfd_get_error();
+			throw exception(
+				"failed to open file '%s' (bfd errno %d - %s)",
+				m_path,
+				bfd_errno,
+				bfd_errmsg(bfd_errno)
+			);
+		}
+
+		/* Verify that the file contains objective code */
+		if ( unlikely(!bfd_check_format(fd, bfd_object)) ) {
+			bfd_error bfd_errno = bfd_get_error();
+			throw exception(
+				"failed to verify file '%s' (bfd errno %d - %s)",
+				m_path,
+				bfd_errno,
+				bfd_errmsg(bfd_errno)
+			);
+		}
+
+		/* Load the line number programs and the string sections they refer to */
+		section ln, ls, s;
+		lines = load(fd, ".debug_line", ln.m_size);
+		if ( unlikely(lines == NULL) )
+			throw exception("file '%s' has no line number information", m_path);
+
+		lstr = load(fd, ".debug_line_str", ls.m_size);
+		str = load(fd, ".debug_str", s.m_size);
+		ln.m_data = lines;
+		ls.m_data = lstr;
+		s.m_data = str;
+
+		/* Parse all the units, stop at the first malformed one */
+		const u8 *cur = ln.m_data, *end = ln.m_data + ln.m_size;
+		while ( likely(cur < end) ) {
+			u32 rows = m_size;
+			try {
+				cur = parse(cur, end, ls, s);
+			}
+
+			catch (exception &x) {
+				m_size = rows;
+				util::dbg_warn("in '%s' .debug_line: %s", m_path, x.msg());
+				break;
+			}
+		}
+
+		sort();
+		delete[] lines;
+		delete[] lstr;
+		delete[] str;
+		bfd_close(fd);
+
+#if CSDBG_DBG_LEVEL & CSDBG_DBGL_INFO
+		util::dbg_info("loaded the line number table of '%s'", m_path);
+		util::dbg_info("  number of rows: %d", m_size);
+#endif
+	}
+
+	catch (exception &x) {
+		delete[] lines;
+		delete[] lstr;
+		delete[] str;
+		m_size = 0;
+
+		if ( likely(fd != NULL) )
+			bfd_close(fd);
+
+		util::dbg_warn("in linetab::%s(): %s", __FUNCTION__, x.msg());
+	}
+
+	catch (...) {
+		delete[] m_path;
+		delete[] lines;
+		delete[] lstr;
+		delete[] str;
+
+		delete[] m_addrs;
+		delete[] m_lines;
+		delete[] m_files;
+		delete[] m_strings;
+
+		m_path = NULL;
+		m_addrs = NULL;
+		m_lines = NULL;
+		m_files = NULL;
+		m_strings = NULL;
+
+		if ( likely(fd != NULL) )
+			bfd_close(fd);
+
+		throw;
+	}
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+linetab::linetab(const linetab &src)
+try:
+m_path(NULL),
+m_addrs(NULL),
+m_lines(NULL),
+m_files(NULL),
+m_strings(NULL),
+m_size(0),
+m_capacity(0),
+m_strings_sz(0),
+m_pool_sz(0)
+{
+	*this = src;
+}
+
+catch (...) {
+	delete[] m_path;
+	delete[] m_addrs;
+	delete[] m_lines;
+	delete[] m_files;
+	delete[] m_strings;
+
+	m_path = NULL;
+	m_addrs = NULL;
+	m_lines = NULL;
+	m_files = NULL;
+	m_strings = NULL;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+linetab::~linetab()
+{
+	delete[] m_path;
+	delete[] m_addrs;
+	delete[] m_lines;
+	delete[] m_files;
+	delete[] m_strings;
+
+	m_path = NULL;
+	m_addrs = NULL;
+	m_lines = NULL;
+	m_files = NULL;
+	m_strings = NULL;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline linetab* linetab::clone() const
+{
+	return new linetab(*this);
+}
+
+
+/**
+ * @brief Get the objective code file path
+ *
+ * @returns this->m_path
+ */
+inline const i8* linetab::path() const
+{
+	return m_path;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+linetab& linetab::operator=(const linetab &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	u32 len = strlen(rval.m_path);
+	if (m_path == NULL || len > strlen(m_path)) {
+		delete[] m_path;
+		m_path = NULL;
+		m_path = new i8[len + 1];
+	}
+
+	/* Allocate the new tables before releasing the old ones */
+	u32 sz = rval.m_size;
+	mem_addr_t *addrs = NULL;
+	u32 *lines = NULL, *files = NULL;
+	i8 *strings = NULL;
+	try {
+		addrs = new mem_addr_t[sz];
+		lines = new u32[sz];
+		files = new u32[sz];
+		strings = new i8[rval.m_strings_sz];
+	}
+
+	catch (...) {
+		delete[] addrs;
+		delete[] lines;
+		delete[] files;
+		throw;
+	}
+
+	memcpy(addrs, rval.m_addrs, sz * sizeof(mem_addr_t));
+	memcpy(lines, rval.m_lines, sz * sizeof(u32));
+	memcpy(files, rval.m_files, sz * sizeof(u32));
+	memcpy(strings, rval.m_strings, rval.m_strings_sz);
+
+	delete[] m_addrs;
+	delete[] m_lines;
+	delete[] m_files;
+	delete[] m_strings;
+
+	m_addrs = addrs;
+	m_lines = lines;
+	m_files = files;
+	m_strings = strings;
+	m_size = m_capacity = sz;
+	m_strings_sz = m_pool_sz = rval.m_strings_sz;
+
+	strcpy(m_path, rval.m_path);
+	return *this;
+}
+
+
+/**
+ * @brief Get the number of rows
+ *
+ * @returns this->m_size
+ */
+inline u32 linetab::size() const
+{
+	return m_size;
+}
+
+
+/**
+ * @brief Resolve the source file and line of an address
+ *
+ * @param[in] addr the address (relative to the module load base address)
+ *
+ * @param[out] line the line number
+ *
+ * @returns the source file base name or NULL if the address is unresolved
+ */
+const i8* linetab::lookup(mem_addr_t addr, u32 &line) const
+{
+	i32 i = find(addr);
+	if ( unlikely(i < 0 || m_lines[i] == 0) ) {
+		line = 0;
+		return NULL;
+	}
+
+	line = m_lines[i];
+	return m_strings + m_files[i];
+}
+
+}
+
@@ -0,0 +1,484 @@
+#include "../include/matcher.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/matcher.cpp
+
+	@brief Class csdbg::matcher method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief
+ *	Convert a POSIX extended regular expression to the literal text it matches,
+ *	if it uses no regular expression operators. A leading ^ and a trailing $ are
+ *	accepted as anchors and special characters may be escaped with a backslash
+ *
+ * @param[in] expr the expression
+ *
+ * @param[out] flags the anchors of the literal (0x1 for ^, 0x2 for $)
+ *
+ * @returns the literal (heap allocated) or NULL if the expression is not a
+ * (non-empty) literal
+ *
+ * @throws std::bad_alloc
+ */
+i8* matcher::literal(const i8 *expr, u8 &flags)
+{
+	static const i8 special[] = ".[]()*+?{}|^$\\";
+
+	flags = 0;
+	u32 len = strlen(expr);
+	if (len > 0 && expr[0] == '^') {
+		flags |= 0x1;
+		expr++;
+		len--;
+	}
+
+	/* A trailing $ is an anchor, unless it is escaped */
+	if (len > 0 && expr[len - 1] == '$') {
+		u32 cnt = 0;
+		for (i32 i = len - 2; i >= 0 && expr[i] == '\\'; i--)
+			cnt++;
+
+		if ( likely((cnt & 1) == 0) ) {
+			flags |= 0x2;
+			len--;
+		}
+	}
+
+	i8 *retval = new i8[len + 1];
+	u32 sz = 0;
+	for (u32 i = 0; likely(i < len); i++) {
+		i8 ch = expr[i];
+		if ( unlikely(ch == '\\') ) {
+			/* Only the special characters can be escaped in a literal */
+			if ( unlikely(i + 1 == len || strchr(special, expr[i + 1]) == NULL) )
+				break;
+
+			ch = expr[++i];
+		}
+		else if ( unlikely(strchr(special, ch) != NULL) )
+			break;
+
+		retval[sz++] = ch;
+		if ( unlikely(i + 1 == len) ) {
+			retval[sz] = '\0';
+			return retval;
+		}
+	}
+
+	delete[] retval;
+	return NULL;
+}
+
+
+/**
+ * @brief
+ *	Build the automaton of the literal patterns. The patterns are inserted in a
+ *	trie and the failure transitions are resolved breadth first, so that every
+ *	state has a transition for every byte class
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+matcher& matcher::build()
+{
+	static const u32 none = UINT_MAX;
+
+	/* Map each distinct (case folded) byte of the literals to a class */
+	util::memset(m_classes, 0, sizeof(m_classes));
+	m_width = 1;
+	m_states = 1;
+	for (u32 i = 0; likely(i < m_size); i++) {
+		const u8 *str = reinterpret_cast<const u8*> (m_strings);
+		str += m_patterns[i].m_offset;
+
+		for (u32 j = 0; likely(j < m_patterns[i].m_length); j++) {
+			u8 ch = tolower(str[j]);
+			if ( unlikely(m_classes[ch] == 0) )
+				m_classes[ch] = m_width++;
+		}
+
+		m_states += m_patterns[i].m_length;
+	}
+
+	/* Bytes that differ only in case share a class */
+	for (u32 i = 0; likely(i < 256); i++)
+		m_classes[i] = m_classes[tolower(i)];
+
+	u32 *fail = NULL, *queue = NULL;
+	try {
+		m_delta = new u32[m_states * m_width];
+		m_out = new u32[m_states];
+		m_link = new u32[m_states];
+		fail = new u32[m_states];
+		queue = new u32[m_states];
+
+		for (u32 i = 0; likely(i < m_states * m_width); i++)
+			m_delta[i] = none;
+
+		for (u32 i = 0; likely(i < m_states); i++)
+			m_out[i] = m_link[i] = fail[i] = 0;
+
+		/* Insert the patterns in the trie (the state 0 is the root) */
+		u32 cnt = 1;
+		for (u32 i = 0; likely(i < m_size); i++) {
+			pattern &pat = m_patterns[i];
+			const u8 *str = reinterpret_cast<const u8*> (m_strings + pat.m_offset);
+
+			u32 st = 0;
+			for (u32 j = 0; likely(j < pat.m_length); j++) {
+				u32 &next = m_delta[st * m_width + m_classes[str[j]]];
+				if ( unlikely(next == none) )
+					next = cnt++;
+
+				st = next;
+			}
+
+			/* The patterns of a state are chained, 0 ends a chain */
+			pat.m_next = m_out[st];
+			m_out[st] = i + 1;
+		}
+
+		/* Resolve the failure transitions, breadth first */
+		u32 head = 0, tail = 0;
+		for (u32 c = 0; likely(c < m_width); c++) {
+			u32 &next = m_delta[c];
+			if ( likely(next == none) )
+				next = 0;
+			else
+				queue[tail++] = next;
+		}
+
+		while ( likely(head < tail) ) {
+			u32 st = queue[head++];
+
+			/* Link to the longest proper suffix state that has patterns */
+			u32 f = fail[st];
+			m_link[st] = (m_out[f] != 0) ? f : m_link[f];
+
+			for (u32 c = 0; likely(c < m_width); c++) {
+				u32 &next = m_delta[st * m_width + c];
+				u32 alt = m_delta[f * m_width + c];
+				if ( likely(next == none) ) {
+					next = alt;
+					continue;
+				}
+
+				fail[next] = alt;
+				queue[tail++] = next;
+			}
+		}
+
+		delete[] fail;
+		delete[] queue;
+		return *this;
+	}
+
+	catch (...) {
+		delete[] fail;
+		delete[] queue;
+		throw;
+	}
+}
+
+
+/**
+ * @brief Release the matcher tables
+ *
+ * @returns *this
+ */
+matcher& matcher::release()
+{
+	delete[] m_patterns;
+	delete[] m_strings;
+	delete[] m_regexes;
+	delete[] m_delta;
+	delete[] m_out;
+	delete[] m_link;
+
+	m_patterns = NULL;
+	m_strings = NULL;
+	m_regexes = NULL;
+	m_delta = NULL;
+	m_out = NULL;
+	m_link = NULL;
+	m_size = m_strings_sz = m_regexes_sz = m_states = m_width = 0;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Verify a match of the automaton (it matched the case folded text) against
+ *	the anchors and the case of a pattern
+ *
+ * @param[in] pat the pattern
+ *
+ * @param[in] text the matched text
+ *
+ * @param[in] end the offset of the last matched character
+ *
+ * @returns true if the pattern matches, false otherwise
+ */
+bool matcher::verify(const pattern &pat, const i8 *text, u32 end) const
+{
+	u32 start = end + 1 - pat.m_length;
+	if ( unlikely((pat.m_flags & 0x1) && start != 0) )
+		return false;
+
+	if ( unlikely((pat.m_flags & 0x2) && text[end + 1] != '\0') )
+		return false;
+
+	if (pat.m_flags & 0x4)
+		return true;
+
+	return memcmp(text + start, m_strings + pat.m_offset, pat.m_length) == 0;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] filters the filter set
+ *
+ * @param[in] mode true to compile the symbol filters, false for module filters
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+matcher::matcher(const chain<filter> *filters, bool mode):
+m_patterns(NULL),
+m_size(0),
+m_strings(NULL),
+m_strings_sz(0),
+m_regexes(NULL),
+m_regexes_sz(0),
+m_delta(NULL),
+m_out(NULL),
+m_link(NULL),
+m_states(0),
+m_width(0)
+{
+	if ( unlikely(filters == NULL) )
+		throw exception("invalid argument: filters (=%p)", filters);
+
+	/* If an exception occurs, release resources and rethrow it */
+	i8 *lit = NULL;
+	try {
+		u32 sz = filters->size(), pool_sz = 0;
+		chain<filter>::iterator it = filters->head();
+		for (; likely(it.valid()); it.next())
+			pool_sz += strlen(it.data()->expr()) + 1;
+
+		m_patterns = new pattern[sz];
+		m_regexes = new fallback[sz];
+		m_strings = new i8[pool_sz];
+
+		/* Split the filters of the requested type to literals and expressions */
+		for (it = filters->head(); likely(it.valid()); it.next()) {
+			const filter *filt = it.data();
+			if (filt->mode() != mode)
+				continue;
+
+			u8 flags;
+			lit = literal(filt->expr(), flags);
+			if ( unlikely(lit == NULL) ) {
+				fallback &fb = m_regexes[m_regexes_sz++];
+				fb.m_filter = filt;
+				fb.m_index = it.index();
+				continue;
+			}
+
+			if ( unlikely(filt->icase()) )
+				flags |= 0x4;
+
+			pattern &pat = m_patterns[m_size++];
+			pat.m_index = it.index();
+			pat.m_offset = m_strings_sz;
+			pat.m_length = strlen(lit);
+			pat.m_next = 0;
+			pat.m_flags = flags;
+
+			memcpy(m_strings + m_strings_sz, lit, pat.m_length + 1);
+			m_strings_sz += pat.m_length + 1;
+			delete[] lit;
+			lit = NULL;
+		}
+
+		build();
+	}
+
+	catch (...) {
+		delete[] lit;
+		release();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+matcher::matcher(const matcher &src)
+try:
+m_patterns(NULL),
+m_size(0),
+m_strings(NULL),
+m_strings_sz(0),
+m_regexes(NULL),
+m_regexes_sz(0),
+m_delta(NULL),
+m_out(NULL),
+m_link(NULL),
+m_states(0),
+m_width(0)
+{
+	*this = src;
+}
+
+catch (...) {
+	release();
+}
+
+
+/**
+ * @brief Object destructor
+ */
+matcher::~matcher()
+{
+	release();
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline matcher* matcher::clone() const
+{
+	return new matcher(*this);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note The copy refers to the same filter objects
+ */
+matcher& matcher::operator=(const matcher &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	release();
+	try {
+		m_patterns = new pattern[rval.m_size];
+		m_strings = new i8[rval.m_strings_sz];
+		m_regexes = new fallback[rval.m_regexes_sz];
+		m_delta = new u32[rval.m_states * rval.m_width];
+		m_out = new u32[rval.m_states];
+		m_link = new u32[rval.m_states];
+	}
+
+	catch (...) {
+		release();
+		throw;
+	}
+
+	m_size = rval.m_size;
+	m_strings_sz = rval.m_strings_sz;
+	m_regexes_sz = rval.m_regexes_sz;
+	m_states = rval.m_states;
+	m_width = rval.m_width;
+
+	memcpy(m_patterns, rval.m_patterns, m_size * sizeof(pattern));
+	memcpy(m_strings, rval.m_strings, m_strings_sz);
+	memcpy(m_regexes, rval.m_regexes, m_regexes_sz * sizeof(fallback));
+	memcpy(m_delta, rval.m_delta, m_states * m_width * sizeof(u32));
+	memcpy(m_out, rval.m_out, m_states * sizeof(u32));
+	memcpy(m_link, rval.m_link, m_states * sizeof(u32));
+	memcpy(m_classes, rval.m_classes, sizeof(m_classes));
+	return *this;
+}
+
+
+/**
+ * @brief Get the number of compiled filters
+ *
+ * @returns the literal pattern count plus the regular expression count
+ */
+inline u32 matcher::size() const
+{
+	return m_size + m_regexes_sz;
+}
+
+
+/**
+ * @brief Match a text against all the compiled filters
+ *
+ * @param[in] text a module path or a symbol
+ *
+ * @returns
+ *	the registration index of the first filter that matches the text or -1 if
+ *	no filter matches
+ *
+ * @note
+ *	The text is scanned once by the automaton. Then, only the regular expression
+ *	filters registered before the best literal match are applied, in order
+ */
+i32 matcher::match(const i8 *text) const
+{
+	__D_ASSERT(text != NULL);
+	if ( unlikely(text == NULL) )
+		return -1;
+
+	u32 best = UINT_MAX;
+	if ( likely(m_size > 0) ) {
+		const u8 *str = reinterpret_cast<const u8*> (text);
+
+		for (u32 i = 0, st = 0; likely(str[i] != '\0'); i++) {
+			st = m_delta[st * m_width + m_classes[str[i]]];
+
+			/* Check all the patterns that end at this character */
+			u32 out = (m_out[st] != 0) ? st : m_link[st];
+			for (; unlikely(out != 0); out = m_link[out])
+				for (u32 p = m_out[out]; p != 0; p = m_patterns[p - 1].m_next) {
+					const pattern &pat = m_patterns[p - 1];
+					if (pat.m_index < best && verify(pat, text, i))
+						best = pat.m_index;
+				}
+		}
+	}
+
+	/* The expressions are in registration order, the first match is the best */
+	for (u32 i = 0; likely(i < m_regexes_sz); i++) {
+		const fallback &fb = m_regexes[i];
+		if ( unlikely(fb.m_index >= best) )
+			break;
+
+		if ( unlikely(fb.m_filter->apply(text)) )
+			return fb.m_index;
+	}
+
+	return (best == UINT_MAX) ? -1 : static_cast<i32> (best);
+}
+
+}
+
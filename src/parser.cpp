@@ -341,10 +341,11 @@ parser& parser::remove_dictionary(const i8 *nm)
 	if ( unlikely(nm == NULL) )
 		return *this;
 
-	for (u32 i = 0, sz = m_dictionaries->size(); likely(i < sz); i++) {
-		dictionary *dict = m_dictionaries->at(i);
+	chain<dictionary>::iterator it = m_dictionaries->head();
+	for (; likely(it.valid()); it.next()) {
+		dictionary *dict = it.data();
 		if ( unlikely(strcmp(dict->name(), nm) == 0) ) {
-			m_dictionaries->remove(i);
+			m_dictionaries->remove(it.index());
 			break;
 		}
 	}
@@ -378,8 +379,9 @@ dictionary* parser::get_dictionary(const i8 *nm) const
 	if ( unlikely(nm == NULL) )
 		return NULL;
 
-	for (u32 i = 0, sz = m_dictionaries->size(); likely(i < sz); i++) {
-		dictionary *dict = m_dictionaries->at(i);
+	chain<dictionary>::iterator it = m_dictionaries->head();
+	for (; likely(it.valid()); it.next()) {
+		dictionary *dict = it.data();
 		if ( unlikely(strcmp(dict->name(), nm) == 0) )
 			return dict;
 	}
@@ -401,9 +403,10 @@ chain<string>* parser::get_dictionary_names() const
 	string *nm = NULL;
 
 	try {
-		for (u32 i = 0, sz = m_dictionaries->size(); likely(i < sz); i++) {
-			nm = new string(m_dictionaries->at(i)->name());
-			retval->add(nm);
+		chain<dictionary>::iterator it = m_dictionaries->head();
+		for (; likely(it.valid()); it.next()) {
+			nm = new string(it.data()->name());
+			retval->append(nm);
 			nm = NULL;
 		}
 
@@ -480,10 +483,11 @@ parser& parser::remove_style(const i8 *nm)
 	if ( unlikely(nm == NULL) )
 		return *this;
 
-	for (u32 i = 0, sz = m_styles->size(); likely(i < sz); i++) {
-		style *stl = m_styles->at(i);
+	chain<style>::iterator it = m_styles->head();
+	for (; likely(it.valid()); it.next()) {
+		style *stl = it.data();
 		if ( unlikely(strcmp(stl->name(), nm) == 0) ) {
-			m_styles->remove(i);
+			m_styles->remove(it.index());
 			break;
 		}
 	}
@@ -517,8 +521,9 @@ style* parser::get_style(const i8 *nm) const
 	if ( unlikely(nm == NULL) )
 		return m_fallback;
 
-	for (u32 i = 0, sz = m_styles->size(); likely(i < sz); i++) {
-		style *stl = m_styles->at(i);
+	chain<style>::iterator it = m_styles->head();
+	for (; likely(it.valid()); it.next()) {
+		style *stl = it.data();
 		if ( unlikely(strcmp(stl->name(), nm) == 0) )
 			return stl;
 	}
@@ -540,9 +545,10 @@ chain<string>* parser::get_style_names() const
 	string *nm = NULL;
 
 	try {
-		for (u32 i = 0, sz = m_styles->size(); likely(i < sz); i++) {
-			nm = new string(m_styles->at(i)->name());
-			retval->add(nm);
+		chain<style>::iterator it = m_styles->head();
+		for (; likely(it.valid()); it.next()) {
+			nm = new string(it.data()->name());
+			retval->append(nm);
 			nm = NULL;
 		}
 
@@ -693,8 +699,9 @@ inline bool parser::lookup(const string &exp, const i8 *nm, bool icase) const
  */
 const i8* parser::lookup(const string &exp, bool icase) const
 {
-	for (u32 i = 0, sz = m_dictionaries->size(); likely(i < sz); i++) {
-		dictionary *dict = m_dictionaries->at(i);
+	chain<dictionary>::iterator it = m_dictionaries->head();
+	for (; likely(it.valid()); it.next()) {
+		dictionary *dict = it.data();
 		if ( unlikely(dict->lookup(exp, icase) != NULL) )
 			return dict->name();
 	}
@@ -10,6 +10,11 @@
 
 namespace csdbg {
 
+/* Static member variable definition */
+
+u64 plugin::m_ids = 0;
+
+
 /**
  * @brief Object deconstruction
  *
@@ -23,7 +28,7 @@ plugin& plugin::destroy()
 	delete[] m_path;
 	m_path = NULL;
 	m_handle = NULL;
-	m_begin = m_end = NULL;
+	m_begin = m_end = m_batch = m_exit = NULL;
 
 	return *this;
 }
@@ -36,15 +41,22 @@ plugin& plugin::destroy()
  *
  * @param[in] scope the full scope of the callbacks (namespace and/or class)
  *
+ * @param[in] ctxsz the size of the per-thread context (0 for none)
+ *
  * @throws std::bad_alloc
  * @throws csdbg::exception
  *
  * @note If scope is NULL, the <b>C ABI</b> is used to resolve the symbols
  */
-plugin::plugin(const i8 *path, const i8 *scope)
+plugin::plugin(const i8 *path, const i8 *scope, u32 ctxsz)
 try:
 m_begin(NULL),
 m_end(NULL),
+m_batch(NULL),
+m_exit(NULL),
+m_ctxsz(ctxsz),
+m_slot(0),
+m_id(count_relaxed(m_ids)),
 m_path(NULL),
 m_handle(NULL)
 {
@@ -72,9 +84,29 @@ m_handle(NULL)
 		util::dbg_info("plugin '%s' linked", m_path);
 #endif
 
-	/* Resolve the instrumentation functions */
-	m_begin = resolve("mod_enter", scope);
-	m_end = resolve("mod_exit", scope);
+	/* Resolve the batched instrumentation function, if it is exported */
+	try {
+		m_batch = resolve("mod_enter_batch", scope);
+	}
+
+	catch (exception &x) {
+		m_batch = NULL;
+	}
+
+	/* Otherwise, resolve the instrumentation functions */
+	if ( likely(m_batch == NULL) ) {
+		m_begin = resolve("mod_enter", scope);
+		m_end = resolve("mod_exit", scope);
+	}
+
+	/* Resolve the thread exit function, if it is exported */
+	try {
+		m_exit = resolve("mod_thread_exit", scope);
+	}
+
+	catch (exception &x) {
+		m_exit = NULL;
+	}
 }
 
 catch (...) {
@@ -88,10 +120,24 @@ catch (...) {
  * @param[in] bgn instrumentation starting function
  *
  * @param[in] end instrumentation ending function
+ *
+ * @param[in] batch
+ *	batched instrumentation function. If not NULL, the other two functions are
+ *	ignored
+ *
+ * @param[in] ctxsz the size of the per-thread context (0 for none)
+ *
+ * @param[in] exit the thread exit function (it can be NULL)
  */
-plugin::plugin(modsym_t bgn, modsym_t end):
-m_begin(bgn),
-m_end(end),
+plugin::plugin(modsym_t bgn, modsym_t end, modsym_t batch, u32 ctxsz,
+							 modsym_t exit):
+m_begin((batch == NULL) ? bgn : NULL),
+m_end((batch == NULL) ? end : NULL),
+m_batch(batch),
+m_exit(exit),
+m_ctxsz(ctxsz),
+m_slot(0),
+m_id(count_relaxed(m_ids)),
 m_path(NULL),
 m_handle(NULL)
 {
@@ -110,6 +156,11 @@ plugin::plugin(const plugin &src)
 try:
 m_begin(NULL),
 m_end(NULL),
+m_batch(NULL),
+m_exit(NULL),
+m_ctxsz(0),
+m_slot(0),
+m_id(0),
 m_path(NULL),
 m_handle(NULL)
 {
@@ -159,6 +210,69 @@ inline const i8* plugin::path() const
 }
 
 
+/**
+ * @brief Check if the plugin implements the batched ABI
+ *
+ * @returns true if the plugin has a batched instrumentation callback
+ */
+inline bool plugin::batched() const
+{
+	return m_batch != NULL;
+}
+
+
+/**
+ * @brief Get the size of the per-thread context
+ *
+ * @returns this->m_ctxsz
+ */
+inline u32 plugin::context_size() const
+{
+	return m_ctxsz;
+}
+
+
+/**
+ * @brief Get the per-thread context slot
+ *
+ * @returns this->m_slot
+ */
+inline u32 plugin::slot() const
+{
+	return m_slot;
+}
+
+
+/**
+ * @brief Set the per-thread context slot
+ *
+ * @param[in] slot the slot index
+ *
+ * @returns *this
+ *
+ * @note The slots are assigned by the tracer when the plugin is registered
+ */
+inline plugin& plugin::set_slot(u32 slot)
+{
+	m_slot = slot;
+	return *this;
+}
+
+
+/**
+ * @brief Get the unique plugin identifier
+ *
+ * @returns this->m_id
+ *
+ * @note A plugin copy has the identifier of its source, so it owns the same
+ *	per-thread contexts
+ */
+inline u64 plugin::id() const
+{
+	return m_id;
+}
+
+
 /**
  * @brief Assignment operator
  *
@@ -176,6 +290,11 @@ plugin& plugin::operator=(const plugin &rval)
 
 	m_begin = rval.m_begin;
 	m_end = rval.m_end;
+	m_batch = rval.m_batch;
+	m_exit = rval.m_exit;
+	m_ctxsz = rval.m_ctxsz;
+	m_slot = rval.m_slot;
+	m_id = rval.m_id;
 
 	/* If this object has called dlopen and holds a handle, close it */
 	if ( likely(m_handle != NULL) ) {
@@ -243,8 +362,9 @@ modsym_t plugin::resolve(const i8 *nm, const i8 *scope) const
 			mangled = new string("_ZN");
 			parts = tmp.split("::");
 
-			for (u32 i = 0, sz = parts->size(); likely(i < sz); i++) {
-				string *token = parts->at(i);
+			chain<string>::iterator it = parts->head();
+			for (; likely(it.valid()); it.next()) {
+				string *token = it.data();
 				mangled->append("%d%s", token->length(), token->cstr());
 			}
 
@@ -322,5 +442,42 @@ inline plugin& plugin::end(void *this_fn, void *call_site) const
 	return const_cast<plugin&> (*this);
 }
 
+
+/**
+ * @brief Pass a batch of instrumentation events to the plugin
+ *
+ * @param[in] events the event array
+ *
+ * @param[in] cnt the event count
+ *
+ * @returns *this
+ */
+inline plugin& plugin::batch(const modevent_t *events, u32 cnt) const
+{
+	__D_ASSERT(m_batch != NULL);
+	if ( likely(m_batch != NULL && cnt > 0) ) {
+		void *first = const_cast<modevent_t*> (events);
+		m_batch(first, const_cast<modevent_t*> (events + cnt));
+	}
+
+	return const_cast<plugin&> (*this);
+}
+
+
+/**
+ * @brief Notify the plugin that the current thread exits
+ *
+ * @param[in] ctx the per-thread context of the plugin
+ *
+ * @returns *this
+ */
+inline plugin& plugin::thread_exit(void *ctx) const
+{
+	if ( likely(m_exit != NULL) )
+		m_exit(ctx, reinterpret_cast<void*> (pthread_self()));
+
+	return const_cast<plugin&> (*this);
+}
+
 }
 
@@ -9,59 +9,107 @@
 
 namespace csdbg {
 
+/* Static member variable definition */
+
+__thread thread *process::m_current = NULL;
+
+
 /**
- * @brief Add a symbol to the lookup cache
- *
- * @param[in] addr the symbol address
+ * @brief
+ *	Thread exit notification callback. Upon the exit of an instrumented thread,
+ *	release its thread object
  *
- * @param[in] nm the symbol name (NULL if the address is unresolved)
+ * @param[in] arg the process object that tracks the exiting thread
  *
- * @returns *this
+ * @note
+ *	This is a pthread key destructor, it is executed by the exiting thread
  */
-process& process::cache_add(mem_addr_t addr, const i8 *nm)
+void process::thread_exit(void *arg)
 {
+	process *proc = static_cast<process*> (arg);
+	thread *thr = m_current;
+
+	__D_ASSERT(proc != NULL);
+	if ( unlikely(proc == NULL || thr == NULL) )
+		return;
+
+	/* Forget the object first, a signal handler may look it up meanwhile */
 	util::lock();
-	symbol *sym = NULL;
+	m_current = NULL;
 	try {
-		sym = new symbol(addr, nm);
-		m_symcache->add(sym);
+		chain<thread>::iterator it = proc->m_threads->head();
+		for (; likely(it.valid()); it.next())
+			if ( unlikely(it.data() == thr) ) {
+				proc->release_thread(it.index());
+				break;
+			}
+	}
+
+	catch (exception &x) {
+		util::dbg_error("in process::%s(): %s", __FUNCTION__, x.msg());
 	}
 
 	catch (std::exception &x) {
-		delete sym;
 		util::dbg_error("in process::%s(): %s", __FUNCTION__, x.what());
 	}
 
 	util::unlock();
-	return *this;
 }
 
 
 /**
- * @brief Perform a cache lookup
+ * @brief
+ *	Remove a thread object from the instrumented thread list. If the pool is not
+ *	full the object is emptied and kept for reuse, otherwise it is disposed
+ *
+ * @param[in] i the offset of the thread in the thread list
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
  *
- * @param[in] addr the address to lookup
+ * @note The caller must hold the global lock
  *
- * @returns the cached symbol or NULL if no such lookup is cached
+ * @note
+ *	If the built-in profiler is enabled, the statistics of the thread are kept
+ *	in the profile (and the call path tree) of the exited threads
  */
-const symbol* process::cache_lookup(mem_addr_t addr) const
+process& process::release_thread(u32 i)
 {
-	util::lock();
+	thread *thr = m_threads->detach(i);
+	m_hits += thr->cache_hits();
 
-	/*
-	 * Search the cache starting from the last entry (the latest added) to exploit
-	 * locality of reference
-	 */
-	for (i32 i = m_symcache->size() - 1; likely(i >= 0); i--) {
-		symbol *sym = m_symcache->at(i);
-		if ( unlikely(sym->addr() == addr) ) {
-			util::unlock();
-			return sym;
-		}
+#ifdef CSDBG_WITH_PROFILER
+	/* Keep the statistics of the thread */
+	try {
+		m_profile->merge(*thr->get_profile());
+#ifdef CSDBG_WITH_FLAMEGRAPH
+		m_calltree->merge(*thr->get_calltree());
+#endif
 	}
 
-	util::unlock();
-	return NULL;
+	catch (...) {
+		delete thr;
+		throw;
+	}
+#endif
+
+	if ( unlikely(m_pool->size() >= g_thread_pool_sz) ) {
+		delete thr;
+		return *this;
+	}
+
+	try {
+		thr->reset();
+		m_pool->append(thr);
+		return *this;
+	}
+
+	catch (...) {
+		delete thr;
+		throw;
+	}
 }
 
 
@@ -74,19 +122,80 @@ process::process()
 try:
 m_pid(getpid()),
 m_threads(NULL),
+m_pool(NULL),
 m_modules(NULL),
-m_symcache(NULL)
+m_retired(NULL),
+m_filter(NULL),
+m_filter_arg(NULL),
+m_segments(NULL),
+m_stale(NULL),
+m_symcache(NULL),
+m_hits(0),
+m_misses(0),
+m_lines(NULL)
+#ifdef CSDBG_WITH_PROFILER
+,m_profile(NULL)
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+,m_calltree(NULL)
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+,m_samples(NULL)
+#endif
 {
 	m_threads = new chain<thread>;
+	m_pool = new chain<thread>;
 	m_modules = new chain<symtab>;
-	m_symcache = new chain<symbol>;
+	m_retired = new chain<symtab>;
+	m_segments = new segtab;
+	m_stale = new chain<segtab>;
+	m_symcache = new cache<const i8*>;
+	m_lines = new chain<linetab>;
+#ifdef CSDBG_WITH_PROFILER
+	m_profile = new profile;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree = new calltree;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	m_samples = new calltree;
+#endif
+
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
 }
 
 catch (...) {
 	delete m_threads;
+	delete m_pool;
 	delete m_modules;
+	delete m_retired;
+	delete m_segments;
+	delete m_stale;
+	delete m_symcache;
+	delete m_lines;
 	m_threads = NULL;
+	m_pool = NULL;
 	m_modules = NULL;
+	m_retired = NULL;
+	m_segments = NULL;
+	m_stale = NULL;
+	m_symcache = NULL;
+	m_lines = NULL;
+#ifdef CSDBG_WITH_PROFILER
+	delete m_profile;
+	m_profile = NULL;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	delete m_calltree;
+	m_calltree = NULL;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	delete m_samples;
+	m_samples = NULL;
+#endif
 }
 
 
@@ -101,21 +210,93 @@ process::process(const process &src)
 try:
 m_pid(src.m_pid),
 m_threads(NULL),
+m_pool(NULL),
 m_modules(NULL),
-m_symcache(NULL)
+m_retired(NULL),
+m_filter(src.m_filter),
+m_filter_arg(src.m_filter_arg),
+m_segments(NULL),
+m_stale(NULL),
+m_symcache(NULL),
+m_hits(0),
+m_misses(0),
+m_lines(NULL)
+#ifdef CSDBG_WITH_PROFILER
+,m_profile(NULL)
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+,m_calltree(NULL)
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+,m_samples(NULL)
+#endif
 {
 	util::lock();
 	m_threads = src.m_threads->clone();
+	m_pool = new chain<thread>;
 	m_modules = src.m_modules->clone();
-	m_symcache = src.m_symcache->clone();
+	m_retired = new chain<symtab>;
+	m_segments = src.m_segments->clone();
+	m_stale = new chain<segtab>;
+	m_lines = src.m_lines->clone();
+#ifdef CSDBG_WITH_PROFILER
+	m_profile = src.m_profile->clone();
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree = src.m_calltree->clone();
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	m_samples = src.m_samples->clone();
+#endif
+
+	/*
+	 * The cached names point to the symbol tables of the source object, so the
+	 * lookup cache is not copied
+	 */
+	m_symcache = new cache<const i8*>;
+
+	/* Make the segment index refer to the copied symbol tables */
+	chain<symtab>::iterator from = src.m_modules->head(), to = m_modules->head();
+	for (; likely(to.valid()); from.next(), to.next())
+		m_segments->rebind(from.data(), to.data());
+
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+
 	util::unlock();
 }
 
 catch (...) {
 	delete m_threads;
+	delete m_pool;
 	delete m_modules;
+	delete m_retired;
+	delete m_segments;
+	delete m_stale;
+	delete m_symcache;
+	delete m_lines;
 	m_threads = NULL;
+	m_pool = NULL;
 	m_modules = NULL;
+	m_retired = NULL;
+	m_segments = NULL;
+	m_stale = NULL;
+	m_symcache = NULL;
+	m_lines = NULL;
+#ifdef CSDBG_WITH_PROFILER
+	delete m_profile;
+	m_profile = NULL;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	delete m_calltree;
+	m_calltree = NULL;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	delete m_samples;
+	m_samples = NULL;
+#endif
 	util::unlock();
 }
 
@@ -126,13 +307,42 @@ catch (...) {
 process::~process()
 {
 	util::lock();
+	pthread_key_delete(m_key);
 	delete m_threads;
+	delete m_pool;
 	delete m_modules;
+	delete m_retired;
+	delete m_segments;
+	delete m_stale;
 	delete m_symcache;
+	delete m_lines;
+#ifdef CSDBG_WITH_PROFILER
+	delete m_profile;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	delete m_calltree;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	delete m_samples;
+#endif
 
 	m_threads = NULL;
+	m_pool = NULL;
 	m_modules = NULL;
+	m_retired = NULL;
+	m_segments = NULL;
+	m_stale = NULL;
 	m_symcache = NULL;
+	m_lines = NULL;
+#ifdef CSDBG_WITH_PROFILER
+	m_profile = NULL;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree = NULL;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+	m_samples = NULL;
+#endif
 	util::unlock();
 }
 
@@ -161,6 +371,39 @@ inline pid_t process::pid() const
 }
 
 
+/**
+ * @brief Get the number of symbol lookups served by the lookup cache
+ *
+ * @returns the cache hit count
+ *
+ * @note
+ *	Each instrumented thread counts its own hits (see thread::count_hit), the
+ *	counters are summed on read
+ */
+u64 process::cache_hits() const
+{
+	util::lock();
+	u64 retval = m_hits;
+	chain<thread>::iterator it = m_threads->head();
+	for (; likely(it.valid()); it.next())
+		retval += it.data()->cache_hits();
+
+	util::unlock();
+	return retval;
+}
+
+
+/**
+ * @brief Get the number of symbol lookups that missed the lookup cache
+ *
+ * @returns the cache miss count
+ */
+inline u64 process::cache_misses() const
+{
+	return load_acquire(m_misses);
+}
+
+
 /**
  * @brief Assignment operator
  *
@@ -169,6 +412,16 @@ inline pid_t process::pid() const
  * @returns *this
  *
  * @throws std::bad_alloc
+ *
+ * @note
+ *	The instrumented thread list is not copied. Its objects are registered in
+ *	the thread local storage of the threads they track (see current_thread), so
+ *	they are kept, along with their simulated stacks
+ *
+ * @note
+ *	The names recorded by the tracked threads (simulated stacks, lookup memos
+ *	and profiles) point to the symbol tables of this object, so the replaced
+ *	tables are retired and released with the object, not upon assignment
  */
 process& process::operator=(const process &rval)
 {
@@ -176,17 +429,42 @@ process& process::operator=(const process &rval)
 		return *this;
 
 	util::lock();
+	segtab *map = NULL;
 	try {
 		m_pid = rval.m_pid;
-		*m_threads = *rval.m_threads;
-		*m_modules = *rval.m_modules;
-		*m_symcache = *rval.m_symcache;
+		m_filter = rval.m_filter;
+		m_filter_arg = rval.m_filter_arg;
+		while (m_modules->size() > 0)
+			m_retired->add(m_modules->detach(0));
 
+		*m_modules = *rval.m_modules;
+		*m_lines = *rval.m_lines;
+		m_symcache->clear();
+#ifdef CSDBG_WITH_PROFILER
+		*m_profile = *rval.m_profile;
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+		*m_calltree = *rval.m_calltree;
+#endif
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+		*m_samples = *rval.m_samples;
+#endif
+
+		/* Make the segment index refer to the copied symbol tables */
+		map = rval.m_segments->clone();
+		chain<symtab>::iterator from = rval.m_modules->head();
+		chain<symtab>::iterator to = m_modules->head();
+		for (; likely(to.valid()); from.next(), to.next())
+			map->rebind(from.data(), to.data());
+
+		m_stale->add(m_segments);
+		store_release(m_segments, map);
 		util::unlock();
 		return *this;
 	}
 
 	catch (...) {
+		delete map;
 		util::unlock();
 		throw;
 	}
@@ -201,8 +479,9 @@ process& process::operator=(const process &rval)
 u32 process::symbol_count() const
 {
 	u32 cnt = 0;
-	for (i32 i = m_modules->size() - 1; likely(i >= 0); i--)
-		cnt += m_modules->at(i)->size();
+	chain<symtab>::iterator it = m_modules->head();
+	for (; likely(it.valid()); it.next())
+		cnt += it.data()->size();
 
 	return cnt;
 }
@@ -228,24 +507,69 @@ inline u32 process::module_count() const
  *
  * @param[in] base the load base address
  *
+ * @param[in] info
+ *	the program headers of the loaded module (libdl). The loadable segments are
+ *	added to the segment index. If NULL, the address range spanned by the module
+ *	functions is indexed
+ *
  * @returns *this
  *
  * @throws std::bad_alloc
  * @throws csdbg::exception
+ *
+ * @note
+ *	The segment index is never modified in place. An updated copy replaces it,
+ *	so that it can be searched without locking (see process::ilookup). The
+ *	replaced index is released with the process object
  */
-process& process::add_module(const i8 *path, mem_addr_t base)
+process& process::add_module(const i8 *path, mem_addr_t base,
+														const dl_phdr_info *info)
 {
 	util::lock();
 	symtab *tbl = NULL;
+	segtab *map = NULL;
+	bool added = false;
 	try {
 		tbl = new symtab(path, base);
+		map = m_segments->clone();
+
+		/* Apply the filters last applied to the other tables (see mark) */
+		if ( unlikely(m_filter != NULL) )
+			tbl->mark(m_filter, m_filter_arg);
+
+		/* Index the module segments */
+		if ( likely(info != NULL) ) {
+			for (u32 i = 0; likely(i < info->dlpi_phnum); i++) {
+				const ElfW(Phdr) *seg = &info->dlpi_phdr[i];
+				if ( likely(seg->p_type != PT_LOAD || seg->p_memsz == 0) )
+					continue;
+
+				mem_addr_t start = info->dlpi_addr + seg->p_vaddr;
+				map->add(tbl, start, start + seg->p_memsz);
+			}
+		}
+		else {
+			mem_addr_t start, end;
+			if ( likely(tbl->bounds(start, end)) )
+				map->add(tbl, start, end);
+		}
+
 		m_modules->add(tbl);
+		added = true;
+
+		/* Publish the updated index */
+		m_stale->add(m_segments);
+		store_release(m_segments, map);
 		util::unlock();
 		return *this;
 	}
 
 	catch (...) {
+		if ( unlikely(added) )
+			m_modules->detach(m_modules->size() - 1);
+
 		delete tbl;
+		delete map;
 		util::unlock();
 		throw;
 	}
@@ -265,47 +589,150 @@ process& process::add_module(const i8 *path, mem_addr_t base)
  */
 const i8* process::lookup(mem_addr_t addr)
 {
-	const symbol *sym = cache_lookup(addr);
-	if ( likely(sym != NULL) )
-		return sym->name();
+	/*
+	 * The cache is probed without locking, repeated lookups cost O(1). The hits
+	 * are counted by the calling thread, the misses on the locked slow path
+	 */
+	const i8 *retval = NULL;
+	if ( likely(m_symcache->lookup(addr, retval)) ) {
+		thread *thr = m_current;
+		if ( likely(thr != NULL) ) {
+			thr->count_hit();
+			return retval;
+		}
 
-	for (u32 i = 0, sz = m_modules->size(); likely(i < sz); i++) {
-		const	i8 *retval = m_modules->at(i)->lookup(addr);
+		util::lock();
+		m_hits++;
+		util::unlock();
+		return retval;
+	}
 
-		if ( unlikely(retval != NULL) ) {
-			cache_add(addr, retval);
-			return retval;
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+		store_release(m_misses, m_misses + 1);
+
+		/* Find the module that maps the address and lookup its symbol table */
+		const symtab *tbl = m_segments->lookup(addr);
+		if ( likely(tbl != NULL) )
+			retval = tbl->lookup(addr);
+
+		/*
+		 * Cache the lookup, even if the address was not resolved. The cache has a
+		 * fixed capacity, so negative entries can't grow it without bounds
+		 */
+		m_symcache->add(addr, retval);
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Lookup an address to resolve the function symbol that contains it
+ *
+ * @param[in] addr the address (e.g. a return address or a program counter)
+ *
+ * @param[out] start the address of the function that contains addr
+ *
+ * @returns the demangled symbol or NULL if the address is unresolved
+ *
+ * @note The lookup cache is not used, as addr is not a function address
+ */
+const i8* process::lookup(mem_addr_t addr, mem_addr_t &start) const
+{
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+		const symtab *tbl = m_segments->lookup(addr);
+		const i8 *retval = NULL;
+		if ( likely(tbl != NULL) )
+			retval = tbl->lookup(addr, start);
+		else
+			start = 0;
+
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Batch lookup, resolve the function symbols of an array of frames
+ *
+ * @param[in,out] frames the frame array
+ *
+ * @param[in] cnt the frame count
+ *
+ * @returns the number of frames with a resolved function symbol
+ *
+ * @note
+ *	Frames that already reference a symbol are not looked up again. The global
+ *	lock is acquired once for the whole batch
+ */
+u32 process::lookup(frame *frames, u32 cnt)
+{
+	__D_ASSERT(frames != NULL);
+	if ( unlikely(frames == NULL) )
+		return 0;
+
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+
+		u32 retval = 0;
+		for (u32 i = 0; likely(i < cnt); i++) {
+			frame &f = frames[i];
+			if ( likely(f.name() == NULL) )
+				f.set(f.addr(), f.site(), lookup(f.addr()));
+
+			if ( likely(f.name() != NULL) )
+				retval++;
 		}
+
+		util::unlock();
+		return retval;
 	}
 
-	/* The address was not resolved */
-	cache_add(addr, NULL);
-	return NULL;
+	catch (...) {
+		util::unlock();
+		throw;
+	}
 }
 
 
 /**
  * @brief
- *	Inverse lookup. Find the module (executable or DSO library) that defines a
- *	symbol and return its path and load base address
+ *	Inverse lookup. Find the module (executable or DSO library) that maps an
+ *	address and return its path and load base address
  *
- * @param[in] addr the symbol address
+ * @param[in] addr the address
  *
  * @param[out] base the load base address of the module
  *
  * @returns the path of the module or NULL if the address is unresolved
  *
- * @see tracer::addr2line
+ * @note
+ *	The segment index is searched without locking, this method is called by the
+ *	instrumentation functions when filters are registered
  */
 const i8* process::ilookup(mem_addr_t addr, mem_addr_t &base) const
 {
-	for (u32 i = 0, sz = m_modules->size(); likely(i < sz); i++) {
-		const symtab *tbl = m_modules->at(i);
-
-		if ( unlikely(tbl->exists(addr)) ) {
-			base = tbl->base();
-			return tbl->path();
-		}
+	const segtab *map = load_acquire(m_segments);
+	const symtab *tbl = map->lookup(addr);
+	if ( likely(tbl != NULL) ) {
+		base = tbl->base();
+		return tbl->path();
 	}
 
 	base = 0;
@@ -313,6 +740,123 @@ const i8* process::ilookup(mem_addr_t addr, mem_addr_t &base) const
 }
 
 
+/**
+ * @brief Resolve the source file and line of an address
+ *
+ * @param[in] addr the address (e.g. a call site)
+ *
+ * @param[out] line the line number
+ *
+ * @returns the source file base name or NULL if the address is unresolved
+ *
+ * @note
+ *	The line number table of a module is loaded when an address it maps is first
+ *	resolved. If the module has no line number information, the empty table is
+ *	kept, so the module is not parsed again
+ */
+const i8* process::addr2line(mem_addr_t addr, u32 &line)
+{
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+		line = 0;
+
+		const symtab *mod = m_segments->lookup(addr);
+		if ( unlikely(mod == NULL) ) {
+			util::unlock();
+			return NULL;
+		}
+
+		linetab *tbl = NULL;
+		chain<linetab>::iterator it = m_lines->head();
+		for (; likely(it.valid()); it.next())
+			if ( likely(strcmp(it.data()->path(), mod->path()) == 0) ) {
+				tbl = it.data();
+				break;
+			}
+
+		if ( unlikely(tbl == NULL) ) {
+			tbl = new linetab(mod->path());
+			try {
+				m_lines->append(tbl);
+			}
+
+			catch (...) {
+				delete tbl;
+				throw;
+			}
+		}
+
+		const i8 *retval = tbl->lookup(addr - mod->base(), line);
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Check if a function is traced
+ *
+ * @param[in] addr the function address
+ *
+ * @returns
+ *	false if the function is excluded by the filters last applied with
+ *	process::mark, true otherwise (even if the address is unresolved)
+ */
+bool process::traced(mem_addr_t addr) const
+{
+	util::lock();
+	const symtab *tbl = m_segments->lookup(addr);
+	bool retval = (tbl == NULL || tbl->traced(addr));
+	util::unlock();
+	return retval;
+}
+
+
+/**
+ * @brief
+ *	Apply a set of filters to all the loaded symbol tables and store the verdict
+ *	for each function
+ *
+ * @param[in] pfunc the filter callback (see symtab::mark)
+ *
+ * @param[in] arg the user data passed to the callback
+ *
+ * @returns *this
+ *
+ * @note
+ *	This is called whenever the filter set changes. Its cost is proportional to
+ *	the number of loaded symbols, but afterwards checking if a function is
+ *	filtered out costs only a lookup. The callback is kept and applied to the
+ *	symbol tables added later (see add_module)
+ */
+process& process::mark(bool (*pfunc)(const i8*, bool, void*), void *arg)
+{
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+		m_filter = pfunc;
+		m_filter_arg = arg;
+		chain<symtab>::iterator it = m_modules->head();
+		for (; likely(it.valid()); it.next())
+			it.data()->mark(pfunc, arg);
+
+		util::unlock();
+		return *this;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
 /**
  * @brief Get the active thread count
  *
@@ -334,24 +878,41 @@ inline u32 process::thread_count() const
  * @note
  *	When an actual thread is created the m_threads chain is populated with an
  *	entry for the equivalent csdbg::thread object when the thread executes its
- *	first <b>instrumented</b> function
+ *	first <b>instrumented</b> function. The object is then registered in thread
+ *	local storage, so every subsequent call costs a single TLS load. As only
+ *	this method adds threads to m_threads, and only on behalf of the calling
+ *	thread, a thread with no TLS registration is not tracked yet and the chain
+ *	need not be searched. When the thread exits, the object is released by
+ *	process::thread_exit
  */
 thread* process::current_thread()
 {
+	thread *retval = m_current;
+	if ( likely(retval != NULL) )
+		return retval;
+
 	util::lock();
-	for (u32 i = 0, sz = m_threads->size(); likely(i < sz); i++) {
-		thread *thr = m_threads->at(i);
+	try {
+		/* Reuse the object of an exited thread, if one is available */
+		u32 sz = m_pool->size();
+		if ( likely(sz > 0) ) {
+			retval = m_pool->detach(sz - 1);
+			retval->reset();
+		}
+		else
+			retval = new thread;
 
-		if ( unlikely(thr->is_current()) ) {
-			util::unlock();
-			return thr;
+		m_threads->append(retval);
+
+		/* Register for exit notification */
+		i32 err = pthread_setspecific(m_key, this);
+		if ( unlikely(err != 0) ) {
+			m_threads->detach(m_threads->size() - 1);
+			throw exception("failed to set pthread key (errno %d - %s)",
+											err, strerror(err));
 		}
-	}
 
-	thread *retval = NULL;
-	try {
-		retval = new thread;
-		m_threads->add(retval);
+		m_current = retval;
 		util::unlock();
 		return retval;
 	}
@@ -364,6 +925,55 @@ thread* process::current_thread()
 }
 
 
+#if defined CSDBG_WITH_SAMPLER || defined CSDBG_WITH_CRASHDUMP
+/**
+ * @brief Get the currently executing thread, if it is already tracked
+ *
+ * @returns
+ *	the csdbg::thread object that tracks the actual current thread or NULL if
+ *	the thread is not tracked (yet or anymore)
+ *
+ * @note
+ *	Unlike process::current_thread, this method never locks or allocates, it
+ *	is async-signal-safe
+ */
+const thread* process::peek_thread()
+{
+	return m_current;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_CRASHDUMP
+/**
+ * @brief Get the instrumented threads, without locking
+ *
+ * @param[out] dst the destination array
+ *
+ * @param[in] sz the destination array size
+ *
+ * @returns the number of threads copied to dst (at most sz)
+ *
+ * @note
+ *	This method never locks or allocates, it is async-signal-safe. It is meant
+ *	for a crash handler, where a thread that holds the global lock may never
+ *	release it. If a thread is concurrently registered or released, the list
+ *	may be read inconsistently
+ *
+ * @see csdbg::crashdump
+ */
+u32 process::peek_threads(const thread **dst, u32 sz) const
+{
+	u32 retval = 0;
+	chain<thread>::iterator it = m_threads->head();
+	for (; likely(it.valid() && retval < sz); it.next())
+		dst[retval++] = it.data();
+
+	return retval;
+}
+#endif
+
+
 /**
  * @brief Get a thread by ID
  *
@@ -376,10 +986,11 @@ thread* process::current_thread()
 thread* process::get_thread(pthread_t id) const
 {
 	util::lock();
-	for (u32 i = 0, sz = m_threads->size(); likely(i < sz); i++) {
-		thread *thr = m_threads->at(i);
+	chain<thread>::iterator it = m_threads->head();
+	for (; likely(it.valid()); it.next()) {
+		thread *thr = it.data();
 
-		if ( unlikely(thr->is_current()) ) {
+		if ( unlikely(pthread_equal(thr->handle(), id) != 0) ) {
 			util::unlock();
 			return thr;
 		}
@@ -406,10 +1017,12 @@ thread* process::get_thread(const i8 *nm) const
 		return NULL;
 
 	util::lock();
-	for (u32 i = 0, sz = m_threads->size(); likely(i < sz); i++) {
-		thread *thr = m_threads->at(i);
+	chain<thread>::iterator it = m_threads->head();
+	for (; likely(it.valid()); it.next()) {
+		thread *thr = it.data();
+		const i8 *cur = thr->name();
 
-		if ( unlikely(strcmp(thr->name(), nm) == 0) ) {
+		if ( unlikely(cur != NULL && strcmp(cur, nm) == 0) ) {
 			util::unlock();
 			return thr;
 		}
@@ -452,30 +1065,254 @@ thread* process::get_thread(u32 i) const
  *
  * @returns *this
  *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	Thread resources are released automatically when a thread exits (see
+ *	process::thread_exit). This method releases them earlier, for example from
+ *	a thread cancellation handler
+ *
  * @attention
- *	This method should be called from thread cancellation handlers to release
- *	resources. If you don't cleanup the thread handle though it becomes useless
- *	when the actual thread has exited, it continues to occupy memory and will
- *	also inject junk, empty traces in dumps or in explicit trace requests
+ *	The thread handle is registered in the thread local storage of the thread
+ *	it tracks, so only the calling thread can be cleaned up. If id is the ID of
+ *	any other instrumented thread, an exception is thrown
  *
  * @see man pthread_cleanup_push, pthread_cleanup_pop
  */
 process& process::cleanup_thread(pthread_t id)
 {
 	util::lock();
-	for (u32 i = 0, sz = m_threads->size(); likely(i < sz); i++) {
-		thread *thr = m_threads->at(i);
+	try {
+		chain<thread>::iterator it = m_threads->head();
+		for (; likely(it.valid()); it.next()) {
+			thread *thr = it.data();
+			if ( likely(pthread_equal(thr->handle(), id) == 0) )
+				continue;
+
+			if ( unlikely(thr != m_current) )
+				throw exception("thread 0x%lx is not the calling thread", id);
+
+			pthread_setspecific(m_key, NULL);
+			m_current = NULL;
+			release_thread(it.index());
+			break;
+		}
+
+		util::unlock();
+		return *this;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief
+ *	Check if all the instrumented threads are done with the shared registry
+ *	data retired at an epoch. A thread that entered a read-side section before
+ *	the epoch may still use the retired data
+ *
+ * @param[in] epoch the retirement epoch
+ *
+ * @returns true if the data retired at epoch can be released, false otherwise
+ *
+ * @see thread::set_epoch
+ */
+bool process::quiescent(u64 epoch) const
+{
+	util::lock();
+	fence_full();
 
-		if ( unlikely(thr->is_current()) ) {
-			m_threads->remove(i);
+	chain<thread>::iterator it = m_threads->head();
+	for (; likely(it.valid()); it.next()) {
+		u64 cur = it.data()->epoch();
+
+		if ( unlikely(cur != 0 && cur < epoch) ) {
 			util::unlock();
-			break;
+			return false;
+		}
+	}
+
+	util::unlock();
+	return true;
+}
+
+
+#ifdef CSDBG_WITH_PROFILER
+/**
+ * @brief
+ *	Merge the profiles of the instrumented threads with the profile of the
+ *	exited threads
+ *
+ * @returns the merged profile (heap allocated)
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The profiles of the running threads are modified without locking, so their
+ *	statistics may be slightly stale
+ */
+profile* process::collect_profile() const
+{
+	profile *retval = NULL;
+	try {
+		util::lock();
+		retval = m_profile->clone();
+
+		chain<thread>::iterator it = m_threads->head();
+		for (; likely(it.valid()); it.next())
+			retval->merge(*it.data()->get_profile());
+
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		delete retval;
+		util::unlock();
+		throw;
+	}
+}
+#endif
+
+
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+/**
+ * @brief Collect the call path statistics of the instrumented threads
+ *
+ * @param[in] sampled
+ *	true to get the sampled call paths (see process::sample), false to get the
+ *	exclusive time per call path of the running and exited threads
+ *
+ * @returns the merged call path tree (heap allocated)
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The trees of the running threads are modified without locking, so their
+ *	statistics may be slightly stale. Without CSDBG_WITH_FLAMEGRAPH, only the
+ *	sampled call paths are kept and sampled is ignored
+ */
+calltree* process::collect_calltree(bool sampled) const
+{
+	calltree *retval = NULL;
+	try {
+		util::lock();
+#ifdef CSDBG_WITH_FLAMEGRAPH
+		if ( likely(!sampled) ) {
+			retval = m_calltree->clone();
+
+			chain<thread>::iterator it = m_threads->head();
+			for (; likely(it.valid()); it.next())
+				retval->merge(*it.data()->get_calltree());
+
+			util::unlock();
+			return retval;
+		}
+#endif
+
+		retval = m_samples->clone();
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		delete retval;
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief
+ *	Take a sample of the simulated call stack of each instrumented thread and
+ *	count it in the sampled call path tree
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	Idle threads (with an empty call stack) are not counted. Only the
+ *	g_sample_depth bottommost calls of deeper stacks are sampled
+ */
+process& process::sample()
+{
+	frame *buf = new frame[g_sample_depth];
+	try {
+		util::lock();
+		chain<thread>::iterator it = m_threads->head();
+		for (; likely(it.valid()); it.next()) {
+			u32 depth = it.data()->snapshot(buf, g_sample_depth);
+			if ( unlikely(depth > g_sample_depth) )
+				depth = g_sample_depth;
+
+			u32 path = 0;
+			for (u32 i = 0; likely(i < depth); i++)
+				path = m_samples->child(path, buf[i].addr());
+
+			if ( likely(path > 0) )
+				m_samples->charge(path, 1);
 		}
+
+		util::unlock();
+		delete[] buf;
+		return *this;
+	}
+
+	catch (...) {
+		util::unlock();
+		delete[] buf;
+		throw;
+	}
+}
+
+
+#ifdef CSDBG_WITH_SAMPLER
+/**
+ * @brief Count a call stack sample in the sampled call path tree
+ *
+ * @param[in] path the sampled function addresses (the stack bottom first)
+ *
+ * @param[in] depth the sampled call depth
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @see csdbg::sampler
+ */
+process& process::add_sample(const mem_addr_t *path, u32 depth)
+{
+	__D_ASSERT(path != NULL || depth == 0);
+	if ( unlikely(depth == 0) )
+		return *this;
+
+	util::lock();
+	try {
+		u32 id = 0;
+		for (u32 i = 0; likely(i < depth); i++)
+			id = m_samples->child(id, path[i]);
+
+		m_samples->charge(id, 1);
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
 	}
 
 	util::unlock();
 	return *this;
 }
+#endif
+#endif
 
 }
 
@@ -0,0 +1,696 @@
+#include "../include/profile.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/profile.cpp
+
+	@brief Class csdbg::profile method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Compare the statistics of two functions by sort key
+ *
+ * @param[in] a the first function statistics
+ *
+ * @param[in] b the second function statistics
+ *
+ * @returns
+ *	less than, equal to or greater than 0 if a should be reported before, with
+ *	or after b (qsort callback)
+ *
+ * @see profile::sort
+ */
+i32 profile::compare(const void *a, const void *b)
+{
+	const entry *x = static_cast<const entry*> (a);
+	const entry *y = static_cast<const entry*> (b);
+
+	if (x->m_key != y->m_key)
+		return (x->m_key > y->m_key) ? -1 : 1;
+
+	if (x->m_calls != y->m_calls)
+		return (x->m_calls > y->m_calls) ? -1 : 1;
+
+	return (x->m_addr < y->m_addr) ? -1 : (x->m_addr > y->m_addr);
+}
+
+
+#ifdef CSDBG_WITH_HISTOGRAM
+/**
+ * @brief Get the latency histogram bucket of a latency
+ *
+ * @param[in] t the latency (nsec)
+ *
+ * @returns the bucket index
+ *
+ * @note
+ *	Latencies less than 2^(g_hist_bits + 1) nsec have a bucket each. Above, the
+ *	range [2^n, 2^(n + 1)) is split in 2^g_hist_bits buckets of equal width
+ */
+u32 profile::bucket(u64 t)
+{
+	const u64 max = (1ULL << g_hist_range) - 1;
+	if ( unlikely(t > max) )
+		t = max;
+
+	if ( unlikely(t < (2ULL << g_hist_bits)) )
+		return t;
+
+#ifdef __GNUC__
+	u32 msb = 63 - __builtin_clzll(t);
+#else
+	u32 msb = g_hist_bits;
+	while ((t >> (msb + 1)) != 0)
+		msb++;
+#endif
+
+	u32 shift = msb - g_hist_bits;
+	return (shift << g_hist_bits) + static_cast<u32> (t >> shift);
+}
+
+
+/**
+ * @brief Get the highest latency recorded in a latency histogram bucket
+ *
+ * @param[in] i the bucket index
+ *
+ * @returns the latency (nsec)
+ */
+u64 profile::bucket_value(u32 i)
+{
+	if ( unlikely(i < (2U << g_hist_bits)) )
+		return i;
+
+	u32 shift = (i >> g_hist_bits) - 1;
+	u64 sub = (i & ((1U << g_hist_bits) - 1)) + (1U << g_hist_bits);
+	return ((sub + 1) << shift) - 1;
+}
+#endif
+
+
+/**
+ * @brief
+ *	Double the capacity of the statistics array. The old array is released
+ *	under the global lock, to exclude concurrent readers (see profile::merge)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+profile& profile::grow()
+{
+	u32 cap = m_capacity << 1;
+	if ( unlikely(cap == 0) )
+		cap = g_profile_sz;
+
+	entry *entries = new entry[cap];
+	entry *old = m_entries;
+	if ( likely(old != NULL) )
+		memcpy(entries, old, m_size * sizeof(entry));
+
+	store_release(m_entries, entries);
+	m_capacity = cap;
+
+	util::lock();
+	delete[] old;
+	util::unlock();
+	return *this;
+}
+
+
+/**
+ * @brief Rebuild the hash index
+ *
+ * @param[in] sz the new index size (a power of 2)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+profile& profile::rehash(u32 sz)
+{
+	u32 *index = new u32[sz];
+	util::memset(index, 0, sz * sizeof(u32));
+
+	u32 mask = sz - 1;
+	for (u32 i = 0; likely(i < m_size); i++) {
+		u64 h = static_cast<u64> (m_entries[i].m_addr) * 11400714819323198485ULL;
+		u32 j = static_cast<u32> (h >> 32) & mask;
+		while (index[j] != 0)
+			j = (j + 1) & mask;
+
+		index[j] = i + 1;
+	}
+
+	delete[] m_index;
+	m_index = index;
+	m_index_sz = sz;
+	return *this;
+}
+
+
+/**
+ * @brief Add a function to the profile
+ *
+ * @param[in] addr the function address
+ *
+ * @param[in] nm the function name (it is not copied, it can be NULL)
+ *
+ * @returns the offset of the function statistics
+ *
+ * @throws std::bad_alloc
+ *
+ * @note The function must not be already profiled
+ */
+u32 profile::add(mem_addr_t addr, const i8 *nm)
+{
+#ifdef CSDBG_WITH_HISTOGRAM
+	/* The histogram is allocated here, so recording a latency never allocates */
+	u32 *hist = new u32[g_hist_sz];
+	util::memset(hist, 0, g_hist_sz * sizeof(u32));
+	try {
+#endif
+		/* Keep the load factor of the index at most 1/2 */
+		if ( unlikely((m_size + 1) << 1 > m_index_sz) )
+			rehash((m_index_sz == 0) ? g_profile_sz << 1 : m_index_sz << 1);
+
+		if ( unlikely(m_size == m_capacity) )
+			grow();
+#ifdef CSDBG_WITH_HISTOGRAM
+	}
+
+	catch (...) {
+		delete[] hist;
+		throw;
+	}
+#endif
+
+	entry &e = m_entries[m_size];
+	e.m_addr = addr;
+	e.m_name = nm;
+	e.m_calls = 0;
+	e.m_incl = 0;
+	e.m_excl = 0;
+	e.m_active = 0;
+	e.m_key = 0;
+#ifdef CSDBG_WITH_HISTOGRAM
+	e.m_hist = hist;
+	e.m_max = 0;
+#endif
+
+	u32 mask = m_index_sz - 1;
+	u64 h = static_cast<u64> (addr) * 11400714819323198485ULL;
+	u32 j = static_cast<u32> (h >> 32) & mask;
+	while (m_index[j] != 0)
+		j = (j + 1) & mask;
+
+	m_index[j] = m_size + 1;
+
+	/* The new entry is visible to readers after it is initialized */
+	store_release(m_size, m_size + 1);
+	return m_size - 1;
+}
+
+
+/**
+ * @brief Find a function in the profile
+ *
+ * @param[in] addr the function address
+ *
+ * @returns the offset of the function statistics or -1 if it is not profiled
+ */
+i32 profile::find(mem_addr_t addr) const
+{
+	if ( unlikely(m_index_sz == 0) )
+		return -1;
+
+	u32 mask = m_index_sz - 1;
+	u64 h = static_cast<u64> (addr) * 11400714819323198485ULL;
+	for (u32 j = static_cast<u32> (h >> 32) & mask; ; j = (j + 1) & mask) {
+		u32 i = m_index[j];
+		if ( likely(i == 0) )
+			return -1;
+
+		if ( likely(m_entries[i - 1].m_addr == addr) )
+			return i - 1;
+	}
+}
+
+
+/**
+ * @brief Find a function in the profile by name
+ *
+ * @param[in] nm the function name
+ *
+ * @returns the offset of the function statistics or -1 if it is not profiled
+ *
+ * @note
+ *	The profile is searched linearly. Functions recorded without a name are
+ *	not found, unless they are named first (see profile::resolve)
+ */
+i32 profile::find(const i8 *nm) const
+{
+	__D_ASSERT(nm != NULL);
+	if ( unlikely(nm == NULL) )
+		return -1;
+
+	for (u32 i = 0; likely(i < m_size); i++) {
+		const i8 *cur = m_entries[i].m_name;
+		if ( unlikely(cur != NULL && strcmp(cur, nm) == 0) )
+			return i;
+	}
+
+	return -1;
+}
+
+
+/**
+ * @brief Object default constructor
+ */
+profile::profile():
+m_entries(NULL),
+m_size(0),
+m_capacity(0),
+m_index(NULL),
+m_index_sz(0)
+{
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+profile::profile(const profile &src)
+try:
+m_entries(NULL),
+m_size(0),
+m_capacity(0),
+m_index(NULL),
+m_index_sz(0)
+{
+	*this = src;
+}
+
+catch (...) {
+#ifdef CSDBG_WITH_HISTOGRAM
+	for (u32 i = 0; likely(i < m_size); i++)
+		delete[] m_entries[i].m_hist;
+#endif
+
+	delete[] m_entries;
+	delete[] m_index;
+	m_entries = NULL;
+	m_index = NULL;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+profile::~profile()
+{
+#ifdef CSDBG_WITH_HISTOGRAM
+	for (u32 i = 0; likely(i < m_size); i++)
+		delete[] m_entries[i].m_hist;
+#endif
+
+	delete[] m_entries;
+	delete[] m_index;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline profile* profile::clone() const
+{
+	return new profile(*this);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+profile& profile::operator=(const profile &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	clear();
+	return merge(rval);
+}
+
+
+/**
+ * @brief Get the number of profiled functions
+ *
+ * @returns this->m_size
+ */
+inline u32 profile::size() const
+{
+	return m_size;
+}
+
+
+/**
+ * @brief Record a function call
+ *
+ * @param[in] addr the function address
+ *
+ * @param[in] nm the function name (it is not copied, it can be NULL)
+ *
+ * @returns the offset of the function statistics (see profile::leave)
+ *
+ * @throws std::bad_alloc
+ */
+u32 profile::enter(mem_addr_t addr, const i8 *nm)
+{
+	i32 i = find(addr);
+	u32 retval = (likely(i >= 0)) ? i : add(addr, nm);
+
+	entry &e = m_entries[retval];
+	if ( unlikely(e.m_name == NULL) )
+		e.m_name = nm;
+
+	e.m_calls++;
+	e.m_active++;
+	return retval;
+}
+
+
+/**
+ * @brief Record a function return
+ *
+ * @param[in] i the offset of the function statistics (see profile::enter)
+ *
+ * @param[in] incl the time spent in the call (nsec)
+ *
+ * @param[in] excl the time spent in the call, excluding its callees (nsec)
+ *
+ * @returns *this
+ */
+profile& profile::leave(u32 i, u64 incl, u64 excl)
+{
+	__D_ASSERT(i < m_size);
+	if ( unlikely(i >= m_size) )
+		return *this;
+
+	entry &e = m_entries[i];
+	e.m_excl += excl;
+
+#ifdef CSDBG_WITH_HISTOGRAM
+	e.m_hist[bucket(incl)]++;
+	if ( unlikely(incl > e.m_max) )
+		e.m_max = incl;
+#endif
+
+	/* The inclusive time of a recursion is the time of its outermost call */
+	if ( likely(e.m_active > 0) )
+		e.m_active--;
+
+	if ( likely(e.m_active == 0) )
+		e.m_incl += incl;
+
+	return *this;
+}
+
+
+/**
+ * @brief Add the statistics of another profile to this one
+ *
+ * @param[in] src the source profile
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @attention
+ *	To merge the profile of a running thread, the caller must hold the global
+ *	lock (see util::lock), otherwise the statistics array may be released by
+ *	the thread while it is read
+ */
+profile& profile::merge(const profile &src)
+{
+	u32 sz = load_acquire(src.m_size);
+	const entry *entries = load_acquire(src.m_entries);
+	for (u32 i = 0; likely(i < sz); i++) {
+		const entry &from = entries[i];
+		i32 j = find(from.m_addr);
+		if ( unlikely(j < 0) )
+			j = add(from.m_addr, NULL);
+
+		entry &to = m_entries[j];
+
+		if ( unlikely(to.m_name == NULL) )
+			to.m_name = from.m_name;
+
+		to.m_calls += from.m_calls;
+		to.m_incl += from.m_incl;
+		to.m_excl += from.m_excl;
+
+#ifdef CSDBG_WITH_HISTOGRAM
+		for (u32 k = 0; likely(k < g_hist_sz); k++)
+			to.m_hist[k] += from.m_hist[k];
+
+		if ( unlikely(from.m_max > to.m_max) )
+			to.m_max = from.m_max;
+#endif
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Name the profiled functions that were recorded without a name
+ *
+ * @param[in] pfunc
+ *	a function that returns the name of a function address (or NULL), passed
+ *	the address and arg
+ *
+ * @param[in] arg an argument passed to pfunc
+ *
+ * @returns *this
+ */
+profile& profile::resolve(const i8* (*pfunc)(mem_addr_t, void*), void *arg)
+{
+	__D_ASSERT(pfunc != NULL);
+	if ( unlikely(pfunc == NULL) )
+		return *this;
+
+	for (u32 i = 0; likely(i < m_size); i++) {
+		entry &e = m_entries[i];
+		if ( unlikely(e.m_name == NULL) )
+			e.m_name = pfunc(e.m_addr, arg);
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Sort the profiled functions (descending)
+ *
+ * @param[in] tail
+ *	true to sort by 99th percentile latency, false to sort by exclusive time.
+ *	Ignored if the latency histograms are disabled
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The function offsets change, so the profile of a thread must not be sorted
+ *	while calls are recorded
+ */
+profile& profile::sort(bool tail)
+{
+	if ( unlikely(m_size < 2) )
+		return *this;
+
+	for (u32 i = 0; likely(i < m_size); i++) {
+#ifdef CSDBG_WITH_HISTOGRAM
+		if ( unlikely(tail) ) {
+			m_entries[i].m_key = percentile(i, 99);
+			continue;
+		}
+#endif
+
+		m_entries[i].m_key = m_entries[i].m_excl;
+	}
+
+	qsort(m_entries, m_size, sizeof(entry), compare);
+	return rehash(m_index_sz);
+}
+
+
+/**
+ * @brief Clear the profile
+ *
+ * @returns *this
+ *
+ * @note
+ *	The statistics array is not released, the profile is empty but keeps its
+ *	capacity
+ */
+profile& profile::clear()
+{
+#ifdef CSDBG_WITH_HISTOGRAM
+	for (u32 i = 0; likely(i < m_size); i++)
+		delete[] m_entries[i].m_hist;
+#endif
+
+	store_release(m_size, 0);
+	if ( likely(m_index != NULL) )
+		util::memset(m_index, 0, m_index_sz * sizeof(u32));
+
+	return *this;
+}
+
+
+/**
+ * @brief Produce a report of the profile
+ *
+ * @param[out] dst the destination string
+ *
+ * @param[in] max the maximum number of reported functions (0 for all)
+ *
+ * @returns its first argument
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The functions are reported in their profile order, call profile::sort for
+ *	a report sorted by exclusive time. Unnamed functions are reported by their
+ *	address
+ */
+string& profile::report(string &dst, u32 max) const
+{
+	u32 sz = (max > 0 && max < m_size) ? max : m_size;
+
+	dst.append("%12s %14s %14s  %s\r\n",
+						 "calls", "incl (usec)", "excl (usec)", "function");
+
+	for (u32 i = 0; likely(i < sz); i++) {
+		const entry &e = m_entries[i];
+		dst.append("%12llu %14.3f %14.3f  ",
+							 static_cast<unsigned long long> (e.m_calls),
+							 e.m_incl / 1000.0,
+							 e.m_excl / 1000.0);
+
+		if ( likely(e.m_name != NULL) )
+			dst.append("%s\r\n", e.m_name);
+		else
+			dst.append("%p\r\n", reinterpret_cast<void*> (e.m_addr));
+	}
+
+	return dst;
+}
+
+
+#ifdef CSDBG_WITH_HISTOGRAM
+/**
+ * @brief Get a latency percentile of a function
+ *
+ * @param[in] i the offset of the function statistics
+ *
+ * @param[in] p the percentile (0 to 100, e.g 99.9)
+ *
+ * @returns
+ *	the latency (nsec) that p percent of the calls did not exceed, at the
+ *	histogram precision, or 0 if no call has returned
+ */
+u64 profile::percentile(u32 i, f64 p) const
+{
+	__D_ASSERT(i < m_size);
+	if ( unlikely(i >= m_size) )
+		return 0;
+
+	const entry &e = m_entries[i];
+	u64 total = 0;
+	for (u32 k = 0; likely(k < g_hist_sz); k++)
+		total += e.m_hist[k];
+
+	if ( unlikely(total == 0) )
+		return 0;
+
+	/* The rank of the percentile sample (1 to total) */
+	f64 pos = ((p < 0) ? 0 : (p > 100) ? 100 : p) * total / 100;
+	u64 rank = static_cast<u64> (pos);
+	if (rank < pos || rank == 0)
+		rank++;
+
+	u64 cnt = 0;
+	for (u32 k = 0; likely(k < g_hist_sz); k++) {
+		cnt += e.m_hist[k];
+		if ( unlikely(cnt >= rank) ) {
+			u64 retval = bucket_value(k);
+			return (retval < e.m_max) ? retval : e.m_max;
+		}
+	}
+
+	return e.m_max;
+}
+
+
+/**
+ * @brief Produce a latency report of the profile
+ *
+ * @param[out] dst the destination string
+ *
+ * @param[in] max the maximum number of reported functions (0 for all)
+ *
+ * @returns its first argument
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The functions are reported in their profile order, call profile::sort for
+ *	a report sorted by tail latency. Unnamed functions are reported by their
+ *	address
+ */
+string& profile::latencies(string &dst, u32 max) const
+{
+	u32 sz = (max > 0 && max < m_size) ? max : m_size;
+
+	dst.append("%12s %12s %12s %12s %12s  %s\r\n",
+						 "calls", "p50 (usec)", "p99 (usec)", "p99.9 (usec)", "max (usec)",
+						 "function");
+
+	for (u32 i = 0; likely(i < sz); i++) {
+		const entry &e = m_entries[i];
+		dst.append("%12llu %12.3f %12.3f %12.3f %12.3f  ",
+							 static_cast<unsigned long long> (e.m_calls),
+							 percentile(i, 50) / 1000.0,
+							 percentile(i, 99) / 1000.0,
+							 percentile(i, 99.9) / 1000.0,
+							 e.m_max / 1000.0);
+
+		if ( likely(e.m_name != NULL) )
+			dst.append("%s\r\n", e.m_name);
+		else
+			dst.append("%p\r\n", reinterpret_cast<void*> (e.m_addr));
+	}
+
+	return dst;
+}
+#endif
+
+}
+
@@ -0,0 +1,654 @@
+#include "../include/recorder.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/recorder.cpp
+
+	@brief Class csdbg::recorder method implementation
+*/
+
+namespace csdbg {
+
+/* Static member variable definition */
+
+__thread ring *recorder::m_ring = NULL;
+
+
+/**
+ * @brief
+ *	The writer thread routine. It drains the rings of the instrumented threads
+ *	and writes their events, every g_trace_period usec, until it is stopped
+ *
+ * @param[in] arg the recorder object
+ *
+ * @returns NULL
+ *
+ * @note If the file can't be written, the error is reported and writing stops
+ */
+void* recorder::writer(void *arg)
+{
+	recorder *rec = static_cast<recorder*> (arg);
+
+	__D_ASSERT(rec != NULL);
+	while ( likely(!load_acquire(rec->m_stop)) ) {
+		try {
+			rec->collect();
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+			break;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+			break;
+		}
+
+		usleep(g_trace_period);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * @brief Retire the ring of an exiting thread
+ *
+ * @param[in] arg the ring of the thread
+ *
+ * @note
+ *	This is a pthread key destructor, it is executed by the exiting thread. The
+ *	ring is released by the writer thread, once its last events are written
+ */
+void recorder::thread_exit(void *arg)
+{
+	ring *r = static_cast<ring*> (arg);
+
+	__D_ASSERT(r != NULL);
+	if ( unlikely(r == NULL) )
+		return;
+
+	if ( likely(m_ring == r) )
+		m_ring = NULL;
+
+	r->retire();
+}
+
+
+/**
+ * @brief Create (or truncate) the file and write the file header
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+recorder& recorder::open()
+{
+	m_stream->open(O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	tracehdr_t hdr;
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	util::memset(&hdr, 0, sizeof(tracehdr_t));
+	memcpy(hdr.magic, g_trace_magic, sizeof(hdr.magic));
+	hdr.version = g_trace_version;
+	hdr.pid = getpid();
+	hdr.clock = util::timestamp();
+	hdr.epoch = static_cast<u64> (ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+	m_stream->write(&hdr, sizeof(tracehdr_t));
+	return *this;
+}
+
+
+/**
+ * @brief Write a block of events to the file
+ *
+ * @param[in] blk the block header
+ *
+ * @param[in] events the block events (blk.count)
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+recorder& recorder::write(const traceblock_t &blk, const traceevent_t *events)
+{
+	m_stream->write(&blk, sizeof(traceblock_t));
+	m_stream->write(events, blk.count * sizeof(traceevent_t));
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Start the writer thread. Unless the file is already open, it is created (or
+ *	truncated) and the file header is written first
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+recorder& recorder::start()
+{
+	if ( unlikely(m_running) )
+		return *this;
+
+	if ( likely(!m_stream->is_opened()) )
+		open();
+
+	store_release(m_stop, false);
+	i32 err = pthread_create(&m_writer, NULL, writer, this);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create the trace writer thread (errno %d - %s)",
+										err, strerror(err));
+
+	m_running = true;
+	return *this;
+}
+
+
+/**
+ * @brief Stop the writer thread and wait for it to exit
+ *
+ * @returns *this
+ */
+recorder& recorder::stop()
+{
+	if ( likely(m_running) ) {
+		store_release(m_stop, true);
+		pthread_join(m_writer, NULL);
+		m_running = false;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Stop recording, write the buffered events and release the resources
+ *
+ * @returns *this
+ */
+recorder& recorder::destroy()
+{
+	stop();
+
+	if ( likely(m_stream != NULL && m_rings != NULL) ) {
+		try {
+			/* If no event was recorded, the file was never created */
+			if ( likely(m_stream->is_opened()) )
+				collect();
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+		}
+	}
+
+	/* The key is created before the ring chain is allocated */
+	if ( likely(m_rings != NULL) )
+		pthread_key_delete(m_key);
+
+	delete m_rings;
+	delete[] m_buffer;
+	delete[] m_modules;
+	delete m_stream;
+	m_rings = NULL;
+	m_buffer = NULL;
+	m_modules = NULL;
+	m_modules_sz = m_module_cnt = 0;
+	m_stream = NULL;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Create and register the ring of the current thread. Upon the first recorded
+ *	event (of any thread), the writer thread is started
+ *
+ * @returns the ring, NULL if the writer thread failed to start
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note If the writer thread fails to start, the error is reported once
+ */
+ring* recorder::attach()
+{
+	ring *r = new ring(this, m_ring_sz, m_overwrite);
+
+	util::lock();
+	try {
+		if ( unlikely(!m_running && !m_failed) ) {
+			try {
+				start();
+			}
+
+			catch (exception &x) {
+				std::cerr << x;
+				store_release(m_failed, true);
+			}
+		}
+
+		if ( unlikely(m_failed) ) {
+			util::unlock();
+			delete r;
+			return NULL;
+		}
+
+		m_rings->append(r);
+	}
+
+	catch (...) {
+		util::unlock();
+		delete r;
+		throw;
+	}
+
+	util::unlock();
+
+	/* Retire the ring when the thread exits */
+	pthread_setspecific(m_key, r);
+	m_ring = r;
+	return r;
+}
+
+
+/**
+ * @brief
+ *	Drain the rings of the instrumented threads and write their events to the
+ *	file, a block per ring. The rings of the exited threads are released
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The global lock is held only to access the ring chain, not while the rings
+ *	are drained or the file is written. Only one thread at a time (the writer
+ *	thread, or the destroying thread once the writer has exited) may collect
+ */
+recorder& recorder::collect()
+{
+	/* Write the module records added since the last collection first */
+	util::lock();
+	u8 *mods = m_modules;
+	traceblock_t blk = {g_block_modules, m_module_cnt, 0, 0};
+	u32 sz = m_modules_sz;
+	m_modules = NULL;
+	m_modules_sz = m_module_cnt = 0;
+	util::unlock();
+
+	if ( unlikely(mods != NULL) ) {
+		try {
+			m_stream->write(&blk, sizeof(traceblock_t));
+			m_stream->write(mods, sz);
+		}
+
+		catch (...) {
+			delete[] mods;
+			throw;
+		}
+
+		delete[] mods;
+	}
+
+	for (u32 i = 0; ; ) {
+		util::lock();
+		ring *r = (likely(i < m_rings->size())) ? m_rings->at(i) : NULL;
+		util::unlock();
+
+		if ( unlikely(r == NULL) )
+			break;
+
+		/* Check before draining, so the last events of an exited thread are kept */
+		bool retired = r->is_retired();
+
+		/* The ring of an exited thread is drained until it is empty */
+		do {
+			blk.count = r->drain(m_buffer, m_ring_sz, blk.dropped);
+			if ( unlikely(blk.count == 0 && blk.dropped == 0) )
+				break;
+
+			blk.type = g_block_events;
+			blk.thread = r->thread();
+			write(blk, m_buffer);
+		}
+		while ( unlikely(retired && blk.count > 0) );
+
+		if ( unlikely(retired) ) {
+			util::lock();
+			m_rings->remove(i);
+			util::unlock();
+			continue;
+		}
+
+		i++;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] path the trace file path (it is truncated)
+ *
+ * @param[in] overwrite
+ *	true to drop the oldest events when a ring is full, false to drop the newest
+ *
+ * @param[in] sz the ring capacity (in events, a power of 2)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The file is created and the writer thread is started when the first event
+ *	is recorded, so a process that records no events leaves no trace behind
+ */
+recorder::recorder(const i8 *path, bool overwrite, u32 sz)
+try:
+m_stream(NULL),
+m_rings(NULL),
+m_buffer(NULL),
+m_modules(NULL),
+m_modules_sz(0),
+m_module_cnt(0),
+m_ring_sz(sz),
+m_overwrite(overwrite),
+m_stop(false),
+m_running(false),
+m_failed(false)
+{
+	if ( unlikely(sz == 0 || (sz & (sz - 1)) != 0) )
+		throw exception("invalid ring capacity (%d is not a power of 2)", sz);
+
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+
+	m_rings = new chain<ring>;
+	m_buffer = new traceevent_t[sz];
+	m_stream = new filebuf(path);
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The copy writes to a duplicate descriptor of the source file, using its own
+ *	rings and writer thread
+ */
+recorder::recorder(const recorder &src)
+try:
+m_stream(NULL),
+m_rings(NULL),
+m_buffer(NULL),
+m_modules(NULL),
+m_modules_sz(0),
+m_module_cnt(0),
+m_ring_sz(0),
+m_overwrite(false),
+m_stop(false),
+m_running(false),
+m_failed(false)
+{
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+
+	m_rings = new chain<ring>;
+	*this = src;
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object destructor
+ *
+ * @attention
+ *	The rings are released, the instrumented threads must not record events
+ *	while or after the object is destroyed
+ */
+recorder::~recorder()
+{
+	destroy();
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+inline recorder* recorder::clone() const
+{
+	return new recorder(*this);
+}
+
+
+/**
+ * @brief Get the trace file path
+ *
+ * @returns the file path
+ */
+inline const i8* recorder::path() const
+{
+	return m_stream->path();
+}
+
+
+/**
+ * @brief Get the capacity of the thread rings
+ *
+ * @returns this->m_ring_sz
+ */
+inline u32 recorder::ring_size() const
+{
+	return m_ring_sz;
+}
+
+
+/**
+ * @brief Check if the oldest events are dropped when a ring is full
+ *
+ * @returns this->m_overwrite
+ */
+inline bool recorder::is_overwriting() const
+{
+	return m_overwrite;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The events buffered so far are written to the current file, the following
+ *	ones to a duplicate descriptor of the file of rval (or to the same path, if
+ *	rval has not created it yet, along with the module records of rval). The
+ *	rings of the threads that have already recorded events keep their capacity
+ *	and drop policy
+ */
+recorder& recorder::operator=(const recorder &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	stop();
+	if ( likely(m_stream != NULL && m_stream->is_opened()) )
+		collect();
+
+	filebuf *stream = rval.m_stream->clone();
+	traceevent_t *buffer = NULL;
+	u8 *mods = NULL;
+	try {
+		buffer = new traceevent_t[rval.m_ring_sz];
+
+		/* If rval has created the file, it writes its own module records */
+		if ( unlikely(!stream->is_opened() && rval.m_modules != NULL) ) {
+			mods = new u8[rval.m_modules_sz];
+			memcpy(mods, rval.m_modules, rval.m_modules_sz);
+		}
+	}
+
+	catch (...) {
+		delete stream;
+		delete[] buffer;
+		throw;
+	}
+
+	delete m_stream;
+	delete[] m_buffer;
+	delete[] m_modules;
+	m_stream = stream;
+	m_buffer = buffer;
+	m_modules = mods;
+	m_modules_sz = (mods != NULL) ? rval.m_modules_sz : 0;
+	m_module_cnt = (mods != NULL) ? rval.m_module_cnt : 0;
+	m_ring_sz = rval.m_ring_sz;
+	m_overwrite = rval.m_overwrite;
+	m_failed = false;
+
+	/* Unless the file is already open, the writer starts with the first event */
+	if ( likely(m_stream->is_opened()) )
+		start();
+
+	return *this;
+}
+
+
+/**
+ * @brief Record an instrumentation event of the current thread
+ *
+ * @param[in] fn the called (or returning) function address
+ *
+ * @param[in] site the call site (or return address)
+ *
+ * @param[in] type the event type (g_event_*)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	No lock is held and no I/O is performed, unless this is the first event of
+ *	the thread and its ring is created. If the writer thread has failed to
+ *	start, the event is discarded
+ */
+recorder& recorder::record(mem_addr_t fn, mem_addr_t site, u32 type)
+{
+	ring *r = m_ring;
+	if ( unlikely(r == NULL || r->owner() != this) ) {
+		if ( unlikely(load_acquire(m_failed)) )
+			return *this;
+
+		r = attach();
+		if ( unlikely(r == NULL) )
+			return *this;
+	}
+
+	r->push(util::timestamp(), fn, site, type);
+	return *this;
+}
+
+
+/**
+ * @brief Add a module to the module load map of the trace
+ *
+ * @param[in] path the module path
+ *
+ * @param[in] base the module load base address
+ *
+ * @param[in] id the module build id (NULL if it has none)
+ *
+ * @param[in] id_sz the build id size (in bytes)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The module record is written with the next collection, before any event
+ *	recorded after this method returns
+ */
+recorder& recorder::add_module(const i8 *path, mem_addr_t base, const u8 *id,
+															 u32 id_sz)
+{
+	if ( unlikely(path == NULL) )
+		throw exception("invalid argument: path (=%p)", path);
+
+	if ( unlikely(id == NULL) )
+		id_sz = 0;
+
+	/* The record is padded to a multiple of 8 bytes */
+	tracemod_t mod;
+	mod.base = base;
+	mod.path_sz = strlen(path) + 1;
+	mod.id_sz = id_sz;
+	u32 sz = (sizeof(tracemod_t) + mod.path_sz + id_sz + 7) & ~7U;
+
+	util::lock();
+	try {
+		u8 *mods = new u8[m_modules_sz + sz];
+		if (m_modules != NULL)
+			memcpy(mods, m_modules, m_modules_sz);
+
+		u8 *rec = mods + m_modules_sz;
+		util::memset(rec, 0, sz);
+		memcpy(rec, &mod, sizeof(tracemod_t));
+		memcpy(rec + sizeof(tracemod_t), path, mod.path_sz);
+		if (id_sz > 0)
+			memcpy(rec + sizeof(tracemod_t) + mod.path_sz, id, id_sz);
+
+		delete[] m_modules;
+		m_modules = mods;
+		m_modules_sz += sz;
+		m_module_cnt++;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+
+	util::unlock();
+	return *this;
+}
+
+}
+
@@ -0,0 +1,332 @@
+#include "../include/ring.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/ring.cpp
+
+	@brief Class csdbg::ring method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] owner the object that drains the ring (the consumer)
+ *
+ * @param[in] cap the slot count (a power of 2)
+ *
+ * @param[in] overwrite true to drop the oldest events when the ring is full
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note The calling thread is the producer
+ */
+ring::ring(const void *owner, u32 cap, bool overwrite):
+m_events(NULL),
+m_capacity(cap),
+m_overwrite(overwrite),
+m_retired(false),
+m_owner(owner),
+m_thread(static_cast<u64> (pthread_self())),
+m_head(0),
+m_claim(0),
+m_tail(0),
+m_dropped(0),
+m_reported(0)
+{
+	if ( unlikely(cap == 0 || (cap & (cap - 1)) != 0) )
+		throw exception("invalid ring capacity (%d is not a power of 2)", cap);
+
+	m_events = new traceevent_t[cap];
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+ring::ring(const ring &src):
+m_events(NULL),
+m_capacity(0),
+m_overwrite(false),
+m_retired(false),
+m_owner(NULL),
+m_thread(0),
+m_head(0),
+m_claim(0),
+m_tail(0),
+m_dropped(0),
+m_reported(0)
+{
+	*this = src;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+ring::~ring()
+{
+	delete[] m_events;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline ring* ring::clone() const
+{
+	return new ring(*this);
+}
+
+
+/**
+ * @brief Get the ring owner
+ *
+ * @returns this->m_owner
+ */
+inline const void* ring::owner() const
+{
+	return m_owner;
+}
+
+
+/**
+ * @brief Get the producer thread id
+ *
+ * @returns this->m_thread
+ */
+inline u64 ring::thread() const
+{
+	return m_thread;
+}
+
+
+/**
+ * @brief Get the ring capacity
+ *
+ * @returns this->m_capacity
+ */
+inline u32 ring::capacity() const
+{
+	return m_capacity;
+}
+
+
+/**
+ * @brief Check if the oldest events are dropped when the ring is full
+ *
+ * @returns this->m_overwrite
+ */
+inline bool ring::is_overwriting() const
+{
+	return m_overwrite;
+}
+
+
+/**
+ * @brief Check if the producer has exited
+ *
+ * @returns this->m_retired
+ */
+inline bool ring::is_retired() const
+{
+	return load_acquire(m_retired);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @attention
+ *	The events are copied as they are, the assigned ring must not be written or
+ *	drained concurrently
+ */
+ring& ring::operator=(const ring &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	traceevent_t *events = new traceevent_t[rval.m_capacity];
+	memcpy(events, rval.m_events, rval.m_capacity * sizeof(traceevent_t));
+
+	delete[] m_events;
+	m_events = events;
+	m_capacity = rval.m_capacity;
+	m_overwrite = rval.m_overwrite;
+	m_retired = rval.m_retired;
+	m_owner = rval.m_owner;
+	m_thread = rval.m_thread;
+	m_head = rval.m_head;
+	m_claim = rval.m_claim;
+	m_tail = rval.m_tail;
+	m_dropped = rval.m_dropped;
+	m_reported = rval.m_reported;
+	return *this;
+}
+
+
+/**
+ * @brief Get the number of buffered events
+ *
+ * @returns the event count (approximate, if the ring is written concurrently)
+ */
+u32 ring::size() const
+{
+	u64 sz = load_acquire(m_head) - load_acquire(m_tail);
+	return (sz > m_capacity) ? m_capacity : sz;
+}
+
+
+/**
+ * @brief Get the number of lost events
+ *
+ * @returns the count of the events dropped since the ring was created
+ *
+ * @note
+ *	If the ring drops the oldest events, they are counted when the ring is
+ *	drained
+ */
+u64 ring::dropped() const
+{
+	return load_acquire(m_dropped);
+}
+
+
+/**
+ * @brief Buffer an event (producer side)
+ *
+ * @param[in] time the event timestamp (nsec)
+ *
+ * @param[in] fn the called (or returning) function address
+ *
+ * @param[in] site the call site (or return address)
+ *
+ * @param[in] type the event type (g_event_*)
+ *
+ * @returns true if the event was buffered, false if it was dropped
+ *
+ * @attention Only the producer thread may call this method
+ */
+bool ring::push(u64 time, mem_addr_t fn, mem_addr_t site, u32 type)
+{
+	u64 head = m_head;
+	if ( likely(!m_overwrite) ) {
+		if ( unlikely(head - load_acquire(m_tail) >= m_capacity) ) {
+			store_release(m_dropped, m_dropped + 1);
+			return false;
+		}
+	}
+
+	/* Let the consumer discard the event that this one is written over */
+	else {
+		store_release(m_claim, head + 1);
+		fence_release();
+	}
+
+	traceevent_t &ev = m_events[head & (m_capacity - 1)];
+	ev.time = time;
+	ev.fn = fn;
+	ev.site = site;
+	ev.type = type;
+	ev.reserved = 0;
+
+	store_release(m_head, head + 1);
+	return true;
+}
+
+
+/**
+ * @brief Copy the buffered events to an array (consumer side)
+ *
+ * @param[out] dst the destination array
+ *
+ * @param[in] sz the destination array capacity
+ *
+ * @param[out] lost the count of the events lost since the last drain
+ *
+ * @returns the count of the copied events (oldest first)
+ *
+ * @attention Only a single consumer may drain the ring at any time
+ */
+u32 ring::drain(traceevent_t *dst, u32 sz, u64 &lost)
+{
+	__D_ASSERT(dst != NULL);
+
+	u64 head = load_acquire(m_head);
+	u64 tail = m_tail;
+
+	/* The events older than a full ring have been written over */
+	if ( unlikely(m_overwrite && head - tail > m_capacity) ) {
+		store_release(m_dropped, m_dropped + (head - m_capacity - tail));
+		tail = head - m_capacity;
+	}
+
+	u64 cnt = head - tail;
+	if (cnt > sz)
+		cnt = sz;
+
+	/* Copy the events, in up to two parts if the ring wraps around */
+	u32 mask = m_capacity - 1;
+	u32 bgn = tail & mask;
+	u32 part = (cnt < m_capacity - bgn) ? cnt : m_capacity - bgn;
+	memcpy(dst, m_events + bgn, part * sizeof(traceevent_t));
+	memcpy(dst + part, m_events, (cnt - part) * sizeof(traceevent_t));
+
+	if ( unlikely(m_overwrite) ) {
+		/* Discard the copied events that may have been written over meanwhile */
+		fence_acquire();
+		u64 claim = load_acquire(m_claim);
+		if ( unlikely(claim > m_capacity && claim - m_capacity > tail) ) {
+			u64 skip = claim - m_capacity - tail;
+			if (skip > cnt)
+				skip = cnt;
+
+			memmove(dst, dst + skip, (cnt - skip) * sizeof(traceevent_t));
+			store_release(m_dropped, m_dropped + skip);
+			tail += skip;
+			cnt -= skip;
+		}
+	}
+
+	store_release(m_tail, tail + cnt);
+
+	u64 total = load_acquire(m_dropped);
+	lost = total - m_reported;
+	m_reported = total;
+	return cnt;
+}
+
+
+/**
+ * @brief Mark the producer as exited
+ *
+ * @returns *this
+ *
+ * @note
+ *	A retired ring is released by its consumer, once it is drained for the
+ *	last time
+ */
+ring& ring::retire()
+{
+	store_release(m_retired, true);
+	return *this;
+}
+
+}
+
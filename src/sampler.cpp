@@ -0,0 +1,649 @@
+#include "../include/sampler.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/sampler.cpp
+
+	@brief Class csdbg::sampler method implementation
+*/
+
+/* Older C libraries do not name the thread id field of struct sigevent */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace csdbg {
+
+/* Static member variable definition */
+
+__thread sampler::slot *sampler::m_slot = NULL;
+
+bool sampler::m_live = false;
+
+
+/**
+ * @brief
+ *	The SIGPROF handler. It copies the simulated call stack of the interrupted
+ *	thread to the sample buffer of the thread
+ *
+ * @param[in] signo the signal number
+ *
+ * @param[in] info the signal info
+ *
+ * @param[in] ctx the interrupted thread context
+ *
+ * @note
+ *	The handler is async-signal-safe, it only reads the call stack of its own
+ *	thread and writes to a preallocated buffer. Idle threads (with an empty
+ *	call stack) are not sampled. If the buffer is full, the sample is dropped
+ */
+void sampler::handler(i32 signo, siginfo_t *info, void *ctx)
+{
+	slot *s = m_slot;
+	if ( unlikely(s == NULL || !load_acquire(m_live)) )
+		return;
+
+	const thread *thr = process::peek_thread();
+	if ( unlikely(thr == NULL) )
+		return;
+
+	u32 depth = thr->sample(s->m_scratch, g_sample_depth);
+	if ( unlikely(depth == 0) )
+		return;
+
+	/* A sample takes a word for its depth and a word per frame */
+	u64 head = s->m_head;
+	u64 used = head - load_acquire(s->m_tail);
+	if ( unlikely(used + depth + 1 > static_cast<u64> (s->m_mask) + 1) ) {
+		store_release(s->m_dropped, s->m_dropped + 1);
+		return;
+	}
+
+	s->m_words[head & s->m_mask] = depth;
+	for (u32 i = 0; likely(i < depth); i++)
+		s->m_words[(head + i + 1) & s->m_mask] = s->m_scratch[i];
+
+	store_release(s->m_head, head + depth + 1);
+}
+
+
+/**
+ * @brief
+ *	The aggregator thread routine. It drains the sample buffers of the
+ *	instrumented threads, every g_sampler_drain usec, until it is stopped
+ *
+ * @param[in] arg the sampler object
+ *
+ * @returns NULL
+ *
+ * @note
+ *	If the samples can't be counted, the error is reported and draining stops
+ */
+void* sampler::aggregator(void *arg)
+{
+	sampler *smp = static_cast<sampler*> (arg);
+
+	__D_ASSERT(smp != NULL);
+	while ( likely(!load_acquire(smp->m_stop)) ) {
+		try {
+			smp->collect();
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+			break;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+			break;
+		}
+
+		usleep(g_sampler_drain);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * @brief Delete the timer and retire the slot of an exiting thread
+ *
+ * @param[in] arg the slot of the thread
+ *
+ * @note
+ *	This is a pthread key destructor, it is executed by the exiting thread. The
+ *	slot is released by the aggregator thread, once its last samples are counted
+ */
+void sampler::thread_exit(void *arg)
+{
+	slot *s = static_cast<slot*> (arg);
+
+	__D_ASSERT(s != NULL);
+	if ( unlikely(s == NULL) )
+		return;
+
+	/* A signal still pending is ignored by the handler */
+	if ( likely(m_slot == s) )
+		m_slot = NULL;
+
+	util::lock();
+	if ( likely(s->m_armed) ) {
+		timer_delete(s->m_timer);
+		s->m_armed = false;
+	}
+
+	store_release(s->m_retired, true);
+	util::unlock();
+}
+
+
+/**
+ * @brief Install the SIGPROF handler and start the aggregator thread
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ *
+ * @attention
+ *	SIGPROF has a single handler, so only one sampler may run at a time. The
+ *	replaced action is restored when sampling stops
+ */
+sampler& sampler::start()
+{
+	if ( unlikely(m_running) )
+		return *this;
+
+	if ( unlikely(load_acquire(m_live)) )
+		throw exception("SIGPROF is already handled by another sampler");
+
+	struct sigaction act;
+	util::memset(&act, 0, sizeof(struct sigaction));
+	act.sa_sigaction = handler;
+	act.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&act.sa_mask);
+	if ( unlikely(sigaction(SIGPROF, &act, &m_action) != 0) )
+		throw exception("failed to install the SIGPROF handler (errno %d - %s)",
+										errno, strerror(errno));
+
+	store_release(m_stop, false);
+	i32 err = pthread_create(&m_aggregator, NULL, aggregator, this);
+	if ( unlikely(err != 0) ) {
+		sigaction(SIGPROF, &m_action, NULL);
+		throw exception("failed to create the sample aggregator thread "
+										"(errno %d - %s)", err, strerror(err));
+	}
+
+	store_release(m_live, true);
+	m_running = true;
+	return *this;
+}
+
+
+/**
+ * @brief Stop sampling and release the resources
+ *
+ * @returns *this
+ */
+sampler& sampler::destroy()
+{
+	stop();
+
+	/* The key is created before the aggregator buffer is allocated */
+	if ( likely(m_buffer != NULL) )
+		pthread_key_delete(m_key);
+
+	while (m_slots != NULL) {
+		slot *s = m_slots;
+		m_slots = s->m_next;
+		release(s);
+	}
+
+	delete[] m_buffer;
+	m_buffer = NULL;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Create the timer of a thread slot, that measures the CPU time of the current
+ *	thread and delivers a SIGPROF to it every sampling period
+ *
+ * @param[in] s the slot
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+sampler& sampler::arm(slot *s)
+{
+	sigevent sev;
+	util::memset(&sev, 0, sizeof(sigevent));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+	if ( unlikely(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &s->m_timer) != 0) )
+		throw exception("failed to create the sampling timer (errno %d - %s)",
+										errno, strerror(errno));
+
+	itimerspec its;
+	its.it_value.tv_sec = m_period / 1000000;
+	its.it_value.tv_nsec = (m_period % 1000000) * 1000;
+	its.it_interval = its.it_value;
+	if ( unlikely(timer_settime(s->m_timer, 0, &its, NULL) != 0) ) {
+		i32 err = errno;
+		timer_delete(s->m_timer);
+		throw exception("failed to arm the sampling timer (errno %d - %s)",
+										err, strerror(err));
+	}
+
+	s->m_armed = true;
+	return *this;
+}
+
+
+/**
+ * @brief Count the samples buffered in a thread slot
+ *
+ * @param[in] s the slot
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+sampler& sampler::drain(slot *s)
+{
+	u64 head = load_acquire(s->m_head);
+	u64 tail = s->m_tail;
+	while ( likely(tail < head) ) {
+		u32 depth = s->m_words[tail & s->m_mask];
+
+		__D_ASSERT(depth <= g_sample_depth);
+		for (u32 i = 0; likely(i < depth); i++)
+			m_buffer[i] = s->m_words[(tail + i + 1) & s->m_mask];
+
+		/* Free the buffer space before the (locking) sample count */
+		tail += depth + 1;
+		store_release(s->m_tail, tail);
+		m_proc->add_sample(m_buffer, depth);
+	}
+
+	u64 dropped = load_acquire(s->m_dropped);
+	m_dropped += dropped - s->m_reported;
+	s->m_reported = dropped;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Count the samples of the instrumented threads. The slots of the exited
+ *	threads are released
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The global lock is held only to access the slot list, not while the
+ *	samples are copied. Only one thread at a time (the aggregator thread, or
+ *	the stopping thread once the aggregator has exited) may collect
+ */
+sampler& sampler::collect()
+{
+	util::lock();
+	slot *s = m_slots;
+	util::unlock();
+
+	while ( likely(s != NULL) ) {
+		/* Check before draining, to keep the last samples of an exited thread */
+		bool retired = load_acquire(s->m_retired);
+		drain(s);
+
+		/* New slots are linked at the list head, the rest of the list is stable */
+		util::lock();
+		slot *next = s->m_next;
+		if ( unlikely(retired) ) {
+			slot **link = &m_slots;
+			while (*link != s)
+				link = &(*link)->m_next;
+
+			*link = next;
+		}
+
+		util::unlock();
+		if ( unlikely(retired) )
+			release(s);
+
+		s = next;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Release a thread slot
+ *
+ * @param[in] s the slot (unlinked)
+ *
+ * @returns *this
+ */
+sampler& sampler::release(slot *s)
+{
+	if ( unlikely(s->m_armed) )
+		timer_delete(s->m_timer);
+
+	delete[] s->m_words;
+	delete s;
+	return *this;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] proc the sampled process
+ *
+ * @param[in] period the sampling period (usec of thread CPU time)
+ *
+ * @param[in] sz
+ *	the sample buffer size of each thread (in words, a power of 2 larger than
+ *	g_sample_depth)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The SIGPROF handler is installed and the aggregator thread is started when
+ *	the first thread is attached
+ */
+sampler::sampler(process *proc, u32 period, u32 sz)
+try:
+m_proc(proc),
+m_slots(NULL),
+m_buffer(NULL),
+m_period(period),
+m_buffer_sz(sz),
+m_dropped(0),
+m_stop(false),
+m_running(false),
+m_failed(false),
+m_halted(false)
+{
+	if ( unlikely(proc == NULL) )
+		throw exception("invalid argument: proc (=%p)", proc);
+
+	if ( unlikely(period == 0) )
+		throw exception("invalid argument: period (=%d)", period);
+
+	if ( unlikely(sz <= g_sample_depth || (sz & (sz - 1)) != 0) )
+		throw exception("invalid sample buffer size (%d is not a power of 2 > %d)",
+										sz, g_sample_depth);
+
+	util::memset(&m_action, 0, sizeof(struct sigaction));
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+
+	m_buffer = new mem_addr_t[g_sample_depth];
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note The copy samples the same process, using its own slots and timers
+ */
+sampler::sampler(const sampler &src)
+try:
+m_proc(NULL),
+m_slots(NULL),
+m_buffer(NULL),
+m_period(0),
+m_buffer_sz(0),
+m_dropped(0),
+m_stop(false),
+m_running(false),
+m_failed(false),
+m_halted(false)
+{
+	util::memset(&m_action, 0, sizeof(struct sigaction));
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+
+	m_buffer = new mem_addr_t[g_sample_depth];
+	*this = src;
+}
+
+catch (...) {
+	destroy();
+}
+
+
+/**
+ * @brief Object destructor
+ *
+ * @attention
+ *	The slots are released, the instrumented threads must not be attached while
+ *	or after the object is destroyed
+ */
+sampler::~sampler()
+{
+	destroy();
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+inline sampler* sampler::clone() const
+{
+	return new sampler(*this);
+}
+
+
+/**
+ * @brief Get the sampling period
+ *
+ * @returns this->m_period (usec of thread CPU time)
+ */
+inline u32 sampler::period() const
+{
+	return m_period;
+}
+
+
+/**
+ * @brief Get the number of the dropped samples (as of the last collection)
+ *
+ * @returns this->m_dropped
+ */
+inline u64 sampler::dropped() const
+{
+	return m_dropped;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @note
+ *	Only the configuration of rval is copied. The timers and buffers of the
+ *	threads already attached keep their period and size
+ */
+sampler& sampler::operator=(const sampler &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	util::lock();
+	m_proc = rval.m_proc;
+	m_period = rval.m_period;
+	m_buffer_sz = rval.m_buffer_sz;
+	util::unlock();
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Attach the current thread, creating its sample buffer and timer. Upon the
+ *	first attached thread, the SIGPROF handler is installed and the aggregator
+ *	thread is started
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	An attached thread returns at once, without any locking. If sampling fails
+ *	to start, the error is reported once and no thread is sampled. If the timer
+ *	of a thread can't be created, the error is reported and the thread is not
+ *	sampled
+ */
+sampler& sampler::attach()
+{
+	slot *s = m_slot;
+	if ( likely(s != NULL && s->m_owner == this) )
+		return *this;
+
+	if ( unlikely(load_acquire(m_failed) || load_acquire(m_halted)) )
+		return *this;
+
+	s = new slot;
+	s->m_words = NULL;
+	try {
+		s->m_words = new mem_addr_t[m_buffer_sz];
+	}
+
+	catch (...) {
+		delete s;
+		throw;
+	}
+
+	s->m_mask = m_buffer_sz - 1;
+	s->m_head = s->m_tail = 0;
+	s->m_dropped = s->m_reported = 0;
+	s->m_owner = this;
+	s->m_armed = false;
+	s->m_retired = false;
+
+	/* The timer is armed locked, so it is either seen or never armed by stop */
+	util::lock();
+	if ( unlikely(!m_running && !m_failed && !m_halted) ) {
+		try {
+			start();
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+			store_release(m_failed, true);
+		}
+	}
+
+	if ( unlikely(m_failed || m_halted) ) {
+		util::unlock();
+		release(s);
+		return *this;
+	}
+
+	try {
+		arm(s);
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	s->m_next = m_slots;
+	m_slots = s;
+	util::unlock();
+
+	/* Delete the timer when the thread exits */
+	pthread_setspecific(m_key, s);
+	m_slot = s;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Stop sampling. The timers are deleted, the aggregator thread is stopped and
+ *	the buffered samples are counted
+ *
+ * @returns *this
+ *
+ * @note
+ *	Sampling can't be restarted. The replaced SIGPROF action is restored, or
+ *	SIGPROF is ignored if it had the default action, so that a signal still
+ *	pending does not terminate the process
+ */
+sampler& sampler::stop()
+{
+	util::lock();
+	bool running = m_running;
+	store_release(m_halted, true);
+	if ( likely(running) ) {
+		store_release(m_live, false);
+		for (slot *s = m_slots; s != NULL; s = s->m_next) {
+			if ( likely(s->m_armed) ) {
+				timer_delete(s->m_timer);
+				s->m_armed = false;
+			}
+		}
+	}
+
+	m_running = false;
+	util::unlock();
+
+	if ( unlikely(!running) )
+		return *this;
+
+	store_release(m_stop, true);
+	pthread_join(m_aggregator, NULL);
+
+	try {
+		collect();
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	struct sigaction act = m_action;
+	if ( likely(!(act.sa_flags & SA_SIGINFO) && act.sa_handler == SIG_DFL) )
+		act.sa_handler = SIG_IGN;
+
+	sigaction(SIGPROF, &act, NULL);
+	return *this;
+}
+
+}
+
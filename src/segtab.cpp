@@ -0,0 +1,245 @@
+#include "../include/segtab.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/segtab.cpp
+
+	@brief Class csdbg::segtab method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Object default constructor
+ */
+segtab::segtab():
+m_starts(NULL),
+m_ends(NULL),
+m_owners(NULL),
+m_size(0),
+m_capacity(0)
+{
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ */
+segtab::segtab(const segtab &src):
+m_starts(NULL),
+m_ends(NULL),
+m_owners(NULL),
+m_size(0),
+m_capacity(0)
+{
+	*this = src;
+}
+
+
+/**
+ * @brief Object destructor
+ */
+segtab::~segtab()
+{
+	delete[] m_starts;
+	delete[] m_ends;
+	delete[] m_owners;
+
+	m_starts = NULL;
+	m_ends = NULL;
+	m_owners = NULL;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ */
+inline segtab* segtab::clone() const
+{
+	return new segtab(*this);
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+segtab& segtab::operator=(const segtab &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	/* Allocate the new arrays before releasing the old ones */
+	u32 cap = rval.m_capacity;
+	mem_addr_t *starts = NULL, *ends = NULL;
+	const symtab **owners = NULL;
+	try {
+		starts = new mem_addr_t[cap];
+		ends = new mem_addr_t[cap];
+		owners = new const symtab*[cap];
+	}
+
+	catch (...) {
+		delete[] starts;
+		delete[] ends;
+		throw;
+	}
+
+	u32 sz = rval.m_size;
+	memcpy(starts, rval.m_starts, sz * sizeof(mem_addr_t));
+	memcpy(ends, rval.m_ends, sz * sizeof(mem_addr_t));
+	memcpy(owners, rval.m_owners, sz * sizeof(const symtab*));
+
+	delete[] m_starts;
+	delete[] m_ends;
+	delete[] m_owners;
+
+	m_starts = starts;
+	m_ends = ends;
+	m_owners = owners;
+	m_size = sz;
+	m_capacity = cap;
+	return *this;
+}
+
+
+/**
+ * @brief Get the segment count
+ *
+ * @returns this->m_size
+ */
+inline u32 segtab::size() const
+{
+	return m_size;
+}
+
+
+/**
+ * @brief Add a segment to the table
+ *
+ * @param[in] tbl the symbol table of the module that maps the segment
+ *
+ * @param[in] start the segment start address
+ *
+ * @param[in] end the segment end address (the first address past the segment)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+segtab& segtab::add(const symtab *tbl, mem_addr_t start, mem_addr_t end)
+{
+	if ( unlikely(tbl == NULL) )
+		throw exception("invalid argument: tbl (=%p)", tbl);
+
+	if ( unlikely(start >= end) )
+		throw exception("invalid segment range (%p - %p)", start, end);
+
+	/* Grow the arrays if required */
+	if ( unlikely(m_size == m_capacity) ) {
+		u32 cap = (m_capacity << 1) + g_memblock_sz;
+		segtab tmp;
+		tmp.m_starts = new mem_addr_t[cap];
+		tmp.m_ends = new mem_addr_t[cap];
+		tmp.m_owners = new const symtab*[cap];
+
+		memcpy(tmp.m_starts, m_starts, m_size * sizeof(mem_addr_t));
+		memcpy(tmp.m_ends, m_ends, m_size * sizeof(mem_addr_t));
+		memcpy(tmp.m_owners, m_owners, m_size * sizeof(const symtab*));
+
+		/* Swap the arrays, the old ones are released with tmp */
+		mem_addr_t *addrs = m_starts;
+		m_starts = tmp.m_starts;
+		tmp.m_starts = addrs;
+
+		addrs = m_ends;
+		m_ends = tmp.m_ends;
+		tmp.m_ends = addrs;
+
+		const symtab **owners = m_owners;
+		m_owners = tmp.m_owners;
+		tmp.m_owners = owners;
+		m_capacity = cap;
+	}
+
+	/* Insert the segment, keeping the table sorted */
+	u32 i = m_size;
+	while ( likely(i > 0 && m_starts[i - 1] > start) ) {
+		m_starts[i] = m_starts[i - 1];
+		m_ends[i] = m_ends[i - 1];
+		m_owners[i] = m_owners[i - 1];
+		i--;
+	}
+
+	m_starts[i] = start;
+	m_ends[i] = end;
+	m_owners[i] = tbl;
+	m_size++;
+	return *this;
+}
+
+
+/**
+ * @brief Replace a symbol table reference with another (e.g. with its copy)
+ *
+ * @param[in] from the replaced symbol table
+ *
+ * @param[in] to the new symbol table
+ *
+ * @returns *this
+ */
+segtab& segtab::rebind(const symtab *from, const symtab *to)
+{
+	for (u32 i = 0; likely(i < m_size); i++)
+		if ( unlikely(m_owners[i] == from) )
+			m_owners[i] = to;
+
+	return *this;
+}
+
+
+/**
+ * @brief Find the module that maps an address
+ *
+ * @param[in] addr the address
+ *
+ * @returns
+ *	the symbol table of the module that maps the address or NULL if addr is not
+ *	in any segment
+ */
+const symtab* segtab::lookup(mem_addr_t addr) const
+{
+	i32 lo = 0, hi = m_size - 1, i = -1;
+	while ( likely(lo <= hi) ) {
+		i32 mid = lo + (hi - lo) / 2;
+
+		if ( unlikely(m_starts[mid] <= addr) ) {
+			i = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+
+	if ( likely(i >= 0 && addr < m_ends[i]) )
+		return m_owners[i];
+
+	return NULL;
+}
+
+}
+
@@ -155,9 +155,33 @@ streambuf& streambuf::close()
  */
 streambuf& streambuf::flush()
 {
-	i32 offset = 0, sz = m_length;
+	streambuf::write(m_data, m_length);
+
+	/* Clear the buffer */
+	clear();
+	return *this;
+}
+
+
+/**
+ * @brief Write raw (binary) data to the stream, bypassing the buffer
+ *
+ * @param[in] data the data
+ *
+ * @param[in] sz the data size (bytes)
+ *
+ * @returns *this
+ *
+ * @throws i32 (errno)
+ *
+ * @note The buffered data is not flushed, the caller must flush it first
+ * @note Synchronous output is enforced (even if O_NONBLOCK is specified)
+ */
+streambuf& streambuf::write(const void *data, u32 sz)
+{
+	const i8 *ptr = static_cast<const i8*> (data);
 	while ( likely(sz > 0) ) {
-		i32 written = write(m_handle, m_data + offset, sz);
+		i32 written = ::write(m_handle, ptr, sz);
 		if ( unlikely(written < 0) )
 			switch (errno) {
 			case EINTR:
@@ -169,11 +193,9 @@ streambuf& streambuf::flush()
 			}
 
 		sz -= written;
-		offset += written;
+		ptr += written;
 	}
 
-	/* Clear the buffer */
-	clear();
 	return *this;
 }
 
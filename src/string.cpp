@@ -688,12 +688,12 @@ chain<string>* string::split(const string &exp, bool imatch, bool icase) const
 					throw exception("logic error in regular expression '%s'", exp.cstr());
 
 				word = new string("%.*s", bgn, m_data + offset);
-				tokens->add(word);
+				tokens->append(word);
 				word = NULL;
 
 				if ( unlikely(!imatch) ) {
 					word = new string("%.*s", end - bgn, m_data + offset + bgn);
-					tokens->add(word);
+					tokens->append(word);
 					word = NULL;
 				}
 
@@ -710,7 +710,7 @@ chain<string>* string::split(const string &exp, bool imatch, bool icase) const
 			 */
 			else if ( likely(offset <= len) ) {
 				word = new string(m_data + offset);
-				tokens->add(word);
+				tokens->append(word);
 				word = NULL;
 				break;
 			}
@@ -9,6 +9,136 @@
 
 namespace csdbg {
 
+/**
+ * @brief Swap two symbol table entries
+ *
+ * @param[in] i the offset of the first entry
+ *
+ * @param[in] j the offset of the second entry
+ *
+ * @returns *this
+ */
+symtab& symtab::swap(u32 i, u32 j)
+{
+	mem_addr_t addr = m_addrs[i];
+	m_addrs[i] = m_addrs[j];
+	m_addrs[j] = addr;
+
+	u32 tmp = m_sizes[i];
+	m_sizes[i] = m_sizes[j];
+	m_sizes[j] = tmp;
+
+	tmp = m_names[i];
+	m_names[i] = m_names[j];
+	m_names[j] = tmp;
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Sift an entry down a max heap, ordered by address and, on equal addresses,
+ *	by name offset (which increases with the load order)
+ *
+ * @param[in] i the offset of the entry
+ *
+ * @param[in] sz the heap size
+ *
+ * @returns *this
+ */
+symtab& symtab::sift(u32 i, u32 sz)
+{
+	while (true) {
+		u32 max = i, child = 2 * i + 1;
+
+		for (u32 j = child; likely(j < sz && j <= child + 1); j++)
+			if (m_addrs[j] > m_addrs[max] ||
+					(m_addrs[j] == m_addrs[max] && m_names[j] > m_names[max]))
+				max = j;
+
+		if ( unlikely(max == i) )
+			return *this;
+
+		swap(i, max);
+		i = max;
+	}
+}
+
+
+/**
+ * @brief
+ *	Sort the symbol table by function address and compute the function sizes.
+ *	Before sorting, m_sizes holds the distance of each function from the end of
+ *	its code section. Of multiple symbols with the same address, the first one
+ *	loaded is kept
+ *
+ * @returns *this
+ */
+symtab& symtab::sort()
+{
+	/* Heapsort */
+	for (i32 i = m_size / 2 - 1; likely(i >= 0); i--)
+		sift(i, m_size);
+
+	for (u32 i = m_size; likely(i > 1); i--) {
+		swap(0, i - 1);
+		sift(0, i - 1);
+	}
+
+	/* Discard duplicate addresses */
+	u32 cnt = 0;
+	for (u32 i = 0; likely(i < m_size); i++) {
+		if ( unlikely(cnt > 0 && m_addrs[cnt - 1] == m_addrs[i]) )
+			continue;
+
+		m_addrs[cnt] = m_addrs[i];
+		m_sizes[cnt] = m_sizes[i];
+		m_names[cnt] = m_names[i];
+		cnt++;
+	}
+
+	/*
+	 * A function extends up to the next function or to the end of its section,
+	 * whichever comes first
+	 */
+	m_size = cnt;
+	for (u32 i = 0; likely(i + 1 < cnt); i++) {
+		mem_addr_t dist = m_addrs[i + 1] - m_addrs[i];
+		if ( likely(dist < m_sizes[i]) )
+			m_sizes[i] = dist;
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Binary search the symbol table
+ *
+ * @param[in] addr the address
+ *
+ * @returns
+ *	the offset of the last function with address less than or equal to addr, or
+ *	-1 if there's no such function
+ */
+i32 symtab::find(mem_addr_t addr) const
+{
+	i32 lo = 0, hi = m_size - 1, retval = -1;
+	while ( likely(lo <= hi) ) {
+		i32 mid = lo + (hi - lo) / 2;
+
+		if ( unlikely(m_addrs[mid] <= addr) ) {
+			retval = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+
+	return retval;
+}
+
+
 /**
  * @brief Object constructor
  *
@@ -22,7 +152,13 @@ namespace csdbg {
 symtab::symtab(const i8 *path, mem_addr_t base):
 m_path(NULL),
 m_base(base),
-m_table(NULL)
+m_addrs(NULL),
+m_sizes(NULL),
+m_names(NULL),
+m_strings(NULL),
+m_traced(NULL),
+m_size(0),
+m_strings_sz(0)
 {
 	if ( unlikely(path == NULL) )
 		throw exception("invalid argument: path (=%p)", path);
@@ -33,7 +169,6 @@ m_table(NULL)
 	bfd *fd = NULL;
 	asymbol **tbl = NULL;
 	i8 *nm = NULL;
-	symbol *sym = NULL;
 
 	/* If an exception occurs, release resources and rethrow it */
 	try {
@@ -92,7 +227,11 @@ m_table(NULL)
 		}
 
 		/* Traverse the symbol table, discard non function symbols */
-		m_table = new chain<symbol>;
+		m_addrs = new mem_addr_t[cnt];
+		m_sizes = new u32[cnt];
+		m_names = new u32[cnt];
+
+		u32 pool_sz = 0;
 		for (i32 i = 0; likely(i < cnt); i++) {
 			const asymbol *cur = tbl[i];
 
@@ -112,41 +251,67 @@ m_table(NULL)
 			addr += bfd_get_section_vma(fd, cur->section);
 			addr += cur->value;
 
-			/* Demangle and store the symbol */
+			/* Demangle the symbol */
 			nm = abi::__cxa_demangle(cur->name, NULL, NULL, NULL);
-			if ( likely(nm != NULL) ) {
-				sym = new symbol(addr, nm);
-				delete[] nm;
-				nm = NULL;
+			const i8 *str = (nm != NULL) ? nm : cur->name;
+			u32 len = strlen(str) + 1;
+
+			/* Store the symbol name in the string pool, growing it if required */
+			if ( unlikely(m_strings_sz + len > pool_sz) ) {
+				pool_sz = (pool_sz << 1) + len + g_memblock_sz;
+				i8 *pool = new i8[pool_sz];
+				if ( likely(m_strings != NULL) )
+					memcpy(pool, m_strings, m_strings_sz);
+
+				delete[] m_strings;
+				m_strings = pool;
 			}
-			else
-				sym = new symbol(addr, cur->name);
 
-			m_table->add(sym);
-			sym = NULL;
+			memcpy(m_strings + m_strings_sz, str, len);
+			free(nm);
+			nm = NULL;
+
+			m_addrs[m_size] = addr;
+			m_sizes[m_size] = bfd_get_section_size(cur->section) - cur->value;
+			m_names[m_size] = m_strings_sz;
+			m_strings_sz += len;
+			m_size++;
 		}
 
+		sort();
 		delete[] tbl;
 		bfd_close(fd);
 
+		/* All the functions are traced, until filters are applied */
+		m_traced = new bool[m_size];
+		for (u32 i = 0; likely(i < m_size); i++)
+			m_traced[i] = true;
+
 #if CSDBG_DBG_LEVEL & CSDBG_DBGL_INFO
 		util::dbg_info("loaded the symbol table of '%s'", m_path);
 		util::dbg_info("  base address @ %p", m_base);
 		util::dbg_info("  number of symbols: %d", cnt);
-		util::dbg_info("  number of function symbols: %d", m_table->size());
+		util::dbg_info("  number of function symbols: %d", m_size);
 #endif
 	}
 
 	catch (...) {
 		delete[] m_path;
 		delete[] tbl;
-		delete[] nm;
+		free(nm);
 
-		delete m_table;
-		delete sym;
+		delete[] m_addrs;
+		delete[] m_sizes;
+		delete[] m_names;
+		delete[] m_strings;
+		delete[] m_traced;
 
 		m_path = NULL;
-		m_table = NULL;
+		m_addrs = NULL;
+		m_sizes = NULL;
+		m_names = NULL;
+		m_strings = NULL;
+		m_traced = NULL;
 
 		if ( likely(fd != NULL) )
 			bfd_close(fd);
@@ -167,16 +332,31 @@ symtab::symtab(const symtab &src)
 try:
 m_path(NULL),
 m_base(src.m_base),
-m_table(NULL)
+m_addrs(NULL),
+m_sizes(NULL),
+m_names(NULL),
+m_strings(NULL),
+m_traced(NULL),
+m_size(0),
+m_strings_sz(0)
 {
-	m_table = src.m_table->clone();
-	m_path = new i8[strlen(src.m_path) + 1];
-	strcpy(m_path, src.m_path);
+	*this = src;
 }
 
 catch (...) {
-	delete m_table;
-	m_table = NULL;
+	delete[] m_path;
+	delete[] m_addrs;
+	delete[] m_sizes;
+	delete[] m_names;
+	delete[] m_strings;
+	delete[] m_traced;
+
+	m_path = NULL;
+	m_addrs = NULL;
+	m_sizes = NULL;
+	m_names = NULL;
+	m_strings = NULL;
+	m_traced = NULL;
 }
 
 
@@ -186,9 +366,18 @@ catch (...) {
 symtab::~symtab()
 {
 	delete[] m_path;
-	delete m_table;
+	delete[] m_addrs;
+	delete[] m_sizes;
+	delete[] m_names;
+	delete[] m_strings;
+	delete[] m_traced;
+
 	m_path = NULL;
-	m_table = NULL;
+	m_addrs = NULL;
+	m_sizes = NULL;
+	m_names = NULL;
+	m_strings = NULL;
+	m_traced = NULL;
 }
 
 
@@ -242,16 +431,56 @@ symtab& symtab::operator=(const symtab &rval)
 		return *this;
 
 	u32 len = strlen(rval.m_path);
-	if (len > strlen(m_path)) {
+	if (m_path == NULL || len > strlen(m_path)) {
 		delete[] m_path;
 		m_path = NULL;
 		m_path = new i8[len + 1];
 	}
 
+	/* Allocate the new tables before releasing the old ones */
+	u32 sz = rval.m_size;
+	mem_addr_t *addrs = NULL;
+	u32 *sizes = NULL, *names = NULL;
+	i8 *strings = NULL;
+	bool *traced = NULL;
+	try {
+		addrs = new mem_addr_t[sz];
+		sizes = new u32[sz];
+		names = new u32[sz];
+		strings = new i8[rval.m_strings_sz];
+		traced = new bool[sz];
+	}
+
+	catch (...) {
+		delete[] addrs;
+		delete[] sizes;
+		delete[] names;
+		delete[] strings;
+		throw;
+	}
+
+	memcpy(addrs, rval.m_addrs, sz * sizeof(mem_addr_t));
+	memcpy(sizes, rval.m_sizes, sz * sizeof(u32));
+	memcpy(names, rval.m_names, sz * sizeof(u32));
+	memcpy(strings, rval.m_strings, rval.m_strings_sz);
+	memcpy(traced, rval.m_traced, sz * sizeof(bool));
+
+	delete[] m_addrs;
+	delete[] m_sizes;
+	delete[] m_names;
+	delete[] m_strings;
+	delete[] m_traced;
+
+	m_addrs = addrs;
+	m_sizes = sizes;
+	m_names = names;
+	m_strings = strings;
+	m_traced = traced;
+	m_size = sz;
+	m_strings_sz = rval.m_strings_sz;
+
 	strcpy(m_path, rval.m_path);
 	m_base = rval.m_base;
-	*m_table = *rval.m_table;
-
 	return *this;
 }
 
@@ -259,11 +488,11 @@ symtab& symtab::operator=(const symtab &rval)
 /**
  * @brief Get the number of symbols
  *
- * @returns this->m_table->size()
+ * @returns this->m_size
  */
 inline u32 symtab::size() const
 {
-	return m_table->size();
+	return m_size;
 }
 
 
@@ -280,13 +509,38 @@ inline u32 symtab::size() const
  */
 const i8* symtab::lookup(mem_addr_t addr) const
 {
-	for (u32 i = 0, sz = m_table->size(); likely(i < sz); i++) {
-		const symbol *sym = m_table->at(i);
-		if ( unlikely(sym->addr() == addr) )
-			return sym->name();
+	i32 i = find(addr);
+	if ( likely(i >= 0 && m_addrs[i] == addr) )
+		return m_strings + m_names[i];
+
+	/* The address was not resolved */
+	return NULL;
+}
+
+
+/**
+ * @brief Lookup an address to resolve the function symbol that contains it
+ *
+ * @param[in] addr the address (e.g. a return address or a program counter)
+ *
+ * @param[out] start the address of the function that contains addr
+ *
+ * @returns the demangled symbol or NULL if the address is unresolved
+ *
+ * @note
+ *	If demangling failed upon symbol table loading/parsing the decorated symbol
+ *	is returned
+ */
+const i8* symtab::lookup(mem_addr_t addr, mem_addr_t &start) const
+{
+	i32 i = find(addr);
+	if ( likely(i >= 0 && addr - m_addrs[i] < m_sizes[i]) ) {
+		start = m_addrs[i];
+		return m_strings + m_names[i];
 	}
 
 	/* The address was not resolved */
+	start = 0;
 	return NULL;
 }
 
@@ -304,6 +558,77 @@ inline bool symtab::exists(mem_addr_t addr) const
 }
 
 
+/**
+ * @brief Get the address range spanned by the function symbols
+ *
+ * @param[out] start the address of the first function
+ *
+ * @param[out] end the first address past the last function
+ *
+ * @returns false if the symbol table is empty, true otherwise
+ */
+bool symtab::bounds(mem_addr_t &start, mem_addr_t &end) const
+{
+	if ( unlikely(m_size == 0) ) {
+		start = end = 0;
+		return false;
+	}
+
+	start = m_addrs[0];
+	end = m_addrs[m_size - 1] + m_sizes[m_size - 1];
+	return true;
+}
+
+
+/**
+ * @brief Check if a function is traced
+ *
+ * @param[in] addr the function address
+ *
+ * @returns
+ *	false if the function is excluded by the filters last applied with
+ *	symtab::mark, true otherwise (even if the address is unresolved)
+ */
+bool symtab::traced(mem_addr_t addr) const
+{
+	i32 i = find(addr);
+	if ( likely(i >= 0 && m_addrs[i] == addr) )
+		return m_traced[i];
+
+	return true;
+}
+
+
+/**
+ * @brief
+ *	Apply a set of filters to the symbol table and store the verdict for each
+ *	function. The module filters are applied once, for the whole table, and the
+ *	symbol filters once for each function
+ *
+ * @param[in] pfunc
+ *	the filter callback. Its arguments are a module path or a symbol, a flag
+ *	that selects the symbol filters (true) or the module filters (false) and the
+ *	user data. It returns true if its first argument is filtered out
+ *
+ * @param[in] arg the user data passed to the callback
+ *
+ * @returns *this
+ */
+symtab& symtab::mark(bool (*pfunc)(const i8*, bool, void*), void *arg)
+{
+	__D_ASSERT(pfunc != NULL);
+	if ( unlikely(pfunc == NULL) )
+		return *this;
+
+	/* If the whole module is filtered out, no symbol filter is applied */
+	bool module = !pfunc(m_path, false, arg);
+	for (u32 i = 0; likely(i < m_size); i++)
+		m_traced[i] = module && !pfunc(m_strings + m_names[i], true, arg);
+
+	return *this;
+}
+
+
 /**
  * @brief Traverse the symbol table with a callback for each symbol
  *
@@ -311,9 +636,17 @@ inline bool symtab::exists(mem_addr_t addr) const
  *
  * @returns *this
  */
-inline symtab& symtab::foreach(void (*pfunc)(u32, symbol*)) const
+symtab& symtab::foreach(void (*pfunc)(u32, symbol*)) const
 {
-	m_table->foreach(pfunc);
+	__D_ASSERT(pfunc != NULL);
+	if ( unlikely(pfunc == NULL) )
+		return const_cast<symtab&> (*this);
+
+	for (u32 i = 0; likely(i < m_size); i++) {
+		symbol sym(m_addrs[i], m_strings + m_names[i]);
+		pfunc(i, &sym);
+	}
+
 	return const_cast<symtab&> (*this);
 }
 
@@ -1,4 +1,5 @@
 #include "../include/thread.hpp"
+#include "../include/util.hpp"
 
 /**
 	@file src/thread.cpp
@@ -8,6 +9,65 @@
 
 namespace csdbg {
 
+/**
+ * @brief
+ *	Double the capacity of the simulated call stack. The old frame array is
+ *	released under the global lock, to exclude concurrent readers (see
+ *	thread::snapshot)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+thread& thread::grow()
+{
+	u32 cap = m_capacity << 1;
+	if ( unlikely(cap == 0) )
+		cap = g_frames_sz;
+
+	frame *frames = new frame[cap];
+	frame *old = m_frames;
+	if ( likely(old != NULL) )
+		memcpy(frames, old, m_depth * sizeof(frame));
+
+	store_release(m_frames, frames);
+	m_capacity = cap;
+
+	util::lock();
+	delete[] old;
+	util::unlock();
+	return *this;
+}
+
+
+#ifdef CSDBG_WITH_PROFILER
+/**
+ * @brief
+ *	Account the time of the call just popped off the simulated call stack to
+ *	the function and to its caller
+ *
+ * @param[in] now the return timestamp (nsec)
+ *
+ * @returns *this
+ */
+thread& thread::account(u64 now)
+{
+	const frame &top = m_frames[m_depth];
+	u64 incl = (likely(now > top.start())) ? now - top.start() : 0;
+	u64 excl = (likely(incl > top.callees())) ? incl - top.callees() : 0;
+	m_profile->leave(top.entry(), incl, excl);
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree->charge(top.path(), excl);
+#endif
+
+	if ( likely(m_depth > 0) )
+		m_frames[m_depth - 1].charge(incl);
+
+	return *this;
+}
+#endif
+
+
 /**
  * @brief Object constructor
  *
@@ -19,15 +79,38 @@ thread::thread(const i8 *nm)
 try:
 m_name(NULL),
 m_handle(pthread_self()),
-m_stack(NULL),
-m_lag(0)
+m_frames(NULL),
+m_depth(0),
+m_capacity(0),
+m_lag(0),
+m_seq(0),
+m_epoch(0),
+m_hits(0)
+#ifdef CSDBG_WITH_PROFILER
+,m_profile(NULL)
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+,m_calltree(NULL)
+#endif
 {
+	util::memset(m_memo_addr, 0, sizeof(m_memo_addr));
+	util::memset(m_memo_name, 0, sizeof(m_memo_name));
+
 	if ( unlikely(nm != NULL) ) {
 		m_name = new i8[strlen(nm) + 1];
 		strcpy(m_name, nm);
 	}
 
-	m_stack = new stack<call>;
+	m_frames = new frame[g_frames_sz];
+	m_capacity = g_frames_sz;
+
+#ifdef CSDBG_WITH_PROFILER
+	m_profile = new profile;
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree = new calltree;
+#endif
 }
 
 catch (...) {
@@ -47,16 +130,42 @@ thread::thread(const thread &src)
 try:
 m_name(NULL),
 m_handle(src.m_handle),
-m_stack(NULL),
-m_lag(src.m_lag)
+m_frames(NULL),
+m_depth(0),
+m_capacity(0),
+m_lag(src.m_lag),
+m_seq(0),
+m_epoch(0),
+m_hits(0)
+#ifdef CSDBG_WITH_PROFILER
+,m_profile(NULL)
+#endif
+#ifdef CSDBG_WITH_FLAMEGRAPH
+,m_calltree(NULL)
+#endif
 {
+	util::memset(m_memo_addr, 0, sizeof(m_memo_addr));
+	util::memset(m_memo_name, 0, sizeof(m_memo_name));
+
 	const i8 *nm = src.m_name;
 	if ( unlikely(nm != NULL) ) {
 		m_name = new i8[strlen(nm) + 1];
 		strcpy(m_name, nm);
 	}
 
-	m_stack = src.m_stack->clone();
+	u32 cap = src.m_capacity;
+	m_frames = new frame[cap];
+	m_capacity = cap;
+	m_depth = src.m_depth;
+	memcpy(m_frames, src.m_frames, m_depth * sizeof(frame));
+
+#ifdef CSDBG_WITH_PROFILER
+	m_profile = src.m_profile->clone();
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree = src.m_calltree->clone();
+#endif
 }
 
 catch (...) {
@@ -71,9 +180,19 @@ catch (...) {
 thread::~thread()
 {
 	delete[] m_name;
-	delete m_stack;
+	delete[] m_frames;
 	m_name = NULL;
-	m_stack = NULL;
+	m_frames = NULL;
+
+#ifdef CSDBG_WITH_PROFILER
+	delete m_profile;
+	m_profile = NULL;
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	delete m_calltree;
+	m_calltree = NULL;
+#endif
 }
 
 
@@ -126,6 +245,66 @@ inline i32 thread::lag() const
 }
 
 
+/**
+ * @brief Get the registry epoch of the active read-side section
+ *
+ * @returns this->m_epoch (0 if the thread is not reading a shared registry)
+ *
+ * @see tracer::call_plugins
+ */
+inline u64 thread::epoch() const
+{
+	return load_acquire(m_epoch);
+}
+
+
+/**
+ * @brief Get the number of symbol lookups of the thread served by the cache
+ *
+ * @returns this->m_hits
+ *
+ * @see process::cache_hits
+ */
+inline u64 thread::cache_hits() const
+{
+	return load_acquire(m_hits);
+}
+
+
+#ifdef CSDBG_WITH_PROFILER
+/**
+ * @brief Get the function call statistics of the thread
+ *
+ * @returns this->m_profile
+ *
+ * @attention
+ *	The profile is modified by the thread without any locking, see
+ *	profile::merge to safely read the profile of a running thread
+ */
+inline const profile* thread::get_profile() const
+{
+	return m_profile;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+/**
+ * @brief Get the call path statistics of the thread
+ *
+ * @returns this->m_calltree
+ *
+ * @attention
+ *	The tree is modified by the thread without any locking, see calltree::merge
+ *	to safely read the tree of a running thread
+ */
+inline const calltree* thread::get_calltree() const
+{
+	return m_calltree;
+}
+#endif
+
+
 /**
  * @brief Set the thread name
  *
@@ -155,6 +334,59 @@ thread& thread::set_name(const i8 *nm)
 }
 
 
+/**
+ * @brief Enter or leave a read-side section of a shared registry
+ *
+ * @param[in] epoch the registry epoch read on entry, 0 on exit
+ *
+ * @returns *this
+ *
+ * @note
+ *	Objects retired from the registry at a later epoch than the one of any
+ *	active section are not released (see process::quiescent)
+ */
+inline thread& thread::set_epoch(u64 epoch)
+{
+	store_release(m_epoch, epoch);
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Rebind the object to the currently executing thread, releasing all the
+ *	thread specific data it held. Used to recycle the objects of exited threads
+ *
+ * @param[in] nm the new name (it can be NULL)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+thread& thread::reset(const i8 *nm)
+{
+	m_depth = 0;
+	m_handle = pthread_self();
+	m_lag = 0;
+	m_seq = 0;
+	m_epoch = 0;
+	m_hits = 0;
+
+	util::memset(m_memo_addr, 0, sizeof(m_memo_addr));
+	util::memset(m_memo_name, 0, sizeof(m_memo_name));
+
+#ifdef CSDBG_WITH_PROFILER
+	m_profile->clear();
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_calltree->clear();
+#endif
+
+	return set_name(nm);
+}
+
+
 /**
  * @brief Assignment operator
  *
@@ -169,10 +401,31 @@ thread& thread::operator=(const thread &rval)
 	if ( unlikely(this == &rval) )
 		return *this;
 
-	*m_stack = *rval.m_stack;
+	/* Copy the simulated call stack, growing the frame array if required */
+	u32 depth = rval.m_depth;
+	if ( unlikely(depth > m_capacity) ) {
+		frame *frames = new frame[rval.m_capacity];
+		delete[] m_frames;
+		m_frames = frames;
+		m_capacity = rval.m_capacity;
+	}
+
+	memcpy(m_frames, rval.m_frames, depth * sizeof(frame));
+	m_depth = depth;
 	m_handle = rval.m_handle;
 	m_lag = rval.m_lag;
 
+	util::memset(m_memo_addr, 0, sizeof(m_memo_addr));
+	util::memset(m_memo_name, 0, sizeof(m_memo_name));
+
+#ifdef CSDBG_WITH_PROFILER
+	*m_profile = *rval.m_profile;
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	*m_calltree = *rval.m_calltree;
+#endif
+
 	return set_name(rval.m_name);
 }
 
@@ -191,26 +444,29 @@ inline bool thread::is_current() const
 /**
  * @brief Get the size (call depth) of the simulated call stack
  *
- * @returns this->m_stack->size()
+ * @returns this->m_depth
  */
 inline u32 thread::call_depth() const
 {
-	return m_stack->size();
+	return m_depth;
 }
 
 
 /**
  * @brief Peek at the simulated call stack
  *
- * @param[in] i the offset
+ * @param[in] i the offset from the stack top
  *
  * @returns the i-th function call
  *
  * @throws csdbg::exception
  */
-inline const call* thread::backtrace(u32 i) const
+const frame* thread::backtrace(u32 i) const
 {
-	return m_stack->peek(i);
+	if ( unlikely(i >= m_depth) )
+		throw exception("offset out of stack bounds (%d >= %d)", i, m_depth);
+
+	return &m_frames[m_depth - i - 1];
 }
 
 
@@ -221,7 +477,9 @@ inline const call* thread::backtrace(u32 i) const
  *
  * @param[in] site the call site address
  *
- * @param[in] nm the function name
+ * @param[in] nm
+ *	the function name (NULL if the symbol is resolved when a trace is produced,
+ *	see CSDBG_WITH_LAZY_SYMBOLS)
  *
  * @returns *this
  *
@@ -239,38 +497,102 @@ thread& thread::called(mem_addr_t addr, mem_addr_t site, const i8 *nm)
 		return *this;
 	}
 
-	call *c = NULL;
-	try {
-		__D_ASSERT(nm != NULL);
-		c = new call(addr, site, nm);
-		m_stack->push(c);
-		return *this;
-	}
-
-	catch (...) {
-		delete c;
-		throw;
-	}
+	if ( unlikely(m_depth == m_capacity) )
+		grow();
+
+#ifdef CSDBG_WITH_PROFILER
+	u32 entry = m_profile->enter(addr, nm);
+#endif
+
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	u32 parent = (likely(m_depth > 0)) ? m_frames[m_depth - 1].path() : 0;
+	u32 path = m_calltree->child(parent, addr);
+#endif
+
+	/* Bracket the modification with an odd sequence number */
+#ifndef CSDBG_WITH_LAZY_SYMBOLS
+	__D_ASSERT(nm != NULL);
+#endif
+	store_release(m_seq, m_seq + 1);
+	fence_release();
+
+	m_frames[m_depth].set(addr, site, nm);
+#ifdef CSDBG_WITH_FLAMEGRAPH
+	m_frames[m_depth].set_path(path);
+#endif
+#ifdef CSDBG_WITH_PROFILER
+	/* Take the timestamp last, to leave the recording overhead out */
+	m_frames[m_depth].set_timing(entry, util::timestamp());
+#endif
+	m_depth++;
+	store_release(m_seq, m_seq + 1);
+	return *this;
 }
 
 
 /**
  * @brief Simulate a function return
  *
+ * @param[in] addr the function address
+ *
+ * @param[in] site the call site address
+ *
  * @returns *this
  */
-thread& thread::returned()
+thread& thread::returned(mem_addr_t addr, mem_addr_t site)
 {
+#ifdef CSDBG_WITH_PROFILER
+	/* Take the timestamp first, to leave the recording overhead out */
+	u64 now = util::timestamp();
+#endif
+
 	/*
 	 * If the function returned because an exception is propagating, unwinding the
 	 * stack, keep track of the call depth difference between the simulated and
 	 * the real call stack (the 'lag')
 	 */
-	if ( unlikely(std::uncaught_exception()) )
+	if ( unlikely(std::uncaught_exception()) ) {
 		m_lag++;
-	else
-		m_stack->pop();
+		return *this;
+	}
+
+	if ( unlikely(m_depth == 0) )
+		return *this;
 
+	/*
+	 * If an exception was caught but the simulated stack was not unwound (see
+	 * tracer::unwind), the calls it unwound are still on top of the stack. Calls
+	 * made from the catch block are pushed above them and return normally, but
+	 * when the function that caught the exception returns, the unwound calls are
+	 * popped off along with it
+	 */
+	u32 cnt = 1;
+	if ( unlikely(m_lag > 0) ) {
+		const frame &top = m_frames[m_depth - 1];
+		if ( likely(top.addr() != addr || top.site() != site) ) {
+			u32 lim = (static_cast<u32> (m_lag) < m_depth) ? m_lag : m_depth - 1;
+			for (u32 i = 1; likely(i <= lim); i++) {
+				const frame &f = m_frames[m_depth - i - 1];
+				if ( unlikely(f.addr() == addr && f.site() == site) ) {
+					cnt = i + 1;
+					break;
+				}
+			}
+		}
+	}
+
+	store_release(m_seq, m_seq + 1);
+	fence_release();
+
+	for (u32 i = 0; likely(i < cnt); i++) {
+		m_depth--;
+#ifdef CSDBG_WITH_PROFILER
+		account(now);
+#endif
+	}
+
+	m_lag -= static_cast<i32> (cnt - 1);
+	store_release(m_seq, m_seq + 1);
 	return *this;
 }
 
@@ -282,11 +604,168 @@ thread& thread::returned()
  */
 thread& thread::unwind()
 {
-	while ( likely(m_lag > 0) ) {
-		m_stack->pop();
-		m_lag--;
+	if ( likely(m_lag <= 0) )
+		return *this;
+
+	store_release(m_seq, m_seq + 1);
+	fence_release();
+
+	u32 lag = m_lag;
+#ifdef CSDBG_WITH_PROFILER
+	/* The calls unwound by an exception end now */
+	u64 now = util::timestamp();
+	for (u32 i = 0; likely(i < lag && m_depth > 0); i++) {
+		m_depth--;
+		account(now);
 	}
+#else
+	m_depth = (lag < m_depth) ? m_depth - lag : 0;
+#endif
+	m_lag = 0;
+	store_release(m_seq, m_seq + 1);
+	return *this;
+}
+
+
+/**
+ * @brief
+ *	Copy the simulated call stack. This method can be called from any thread,
+ *	the copy is consistent even if the stack is concurrently modified by the
+ *	thread it belongs to
+ *
+ * @param[out] dst the destination array (the stack bottom is copied first)
+ *
+ * @param[in] sz the destination array size
+ *
+ * @returns
+ *	the call depth of the copied stack. If it is greater than sz, only the sz
+ *	bottommost calls were copied
+ *
+ * @attention
+ *	The caller must hold the global lock (see util::lock), otherwise the frame
+ *	array may be released by the thread while it is copied. If a consistent
+ *	copy could not be obtained after csdbg::g_snapshot_retries attempts, the
+ *	last (possibly inconsistent) copy is returned
+ */
+u32 thread::snapshot(frame *dst, u32 sz) const
+{
+	__D_ASSERT(dst != NULL);
+	if ( unlikely(dst == NULL) )
+		return 0;
+
+	u32 retval = 0;
+	for (u32 i = 0; likely(i < g_snapshot_retries); i++) {
+		u32 seq = load_acquire(m_seq);
+		if ( unlikely(seq & 1) )
+			continue;
+
+		retval = load_acquire(m_depth);
+		const frame *frames = load_acquire(m_frames);
+		memcpy(dst, frames, ((retval < sz) ? retval : sz) * sizeof(frame));
+
+		/* If the stack was not modified while it was copied */
+		fence_acquire();
+		if ( likely(load_acquire(m_seq) == seq) )
+			return retval;
+	}
+
+	return retval;
+}
+
+
+#ifdef CSDBG_WITH_SAMPLER
+/**
+ * @brief
+ *	Copy the function addresses of the simulated call stack, from a signal
+ *	handler executed by the thread itself
+ *
+ * @param[out] dst the destination array (the stack bottom is copied first)
+ *
+ * @param[in] sz the destination array size
+ *
+ * @returns the number of copied addresses (at most sz, the bottommost calls)
+ *
+ * @note
+ *	This method is async-signal-safe. The interrupted thread can't modify the
+ *	stack while it is copied, but it may have been interrupted while recording
+ *	a call or a return, in which case the top frame is not copied
+ *
+ * @see csdbg::sampler
+ */
+u32 thread::sample(mem_addr_t *dst, u32 sz) const
+{
+	__D_ASSERT(dst != NULL);
+	u32 depth = load_acquire(m_depth);
+	const frame *frames = load_acquire(m_frames);
+	if ( unlikely((load_acquire(m_seq) & 1) && depth > 0) )
+		depth--;
+
+	if ( unlikely(depth > sz) )
+		depth = sz;
+
+	for (u32 i = 0; likely(i < depth); i++)
+		dst[i] = frames[i].addr();
+
+	return depth;
+}
+#endif
+
+
+/**
+ * @brief Lookup the memo of recently resolved symbols
+ *
+ * @param[in] addr the symbol address
+ *
+ * @returns the symbol name or NULL if the address is not memoized
+ *
+ * @note
+ *	The memo is thread local, it is accessed without any synchronization, to
+ *	avoid the global lookup cache on the instrumentation fast path
+ */
+inline const i8* thread::recall(mem_addr_t addr) const
+{
+	u32 i = (addr >> 4) & (g_memo_sz - 1);
+	if ( likely(m_memo_addr[i] == addr) )
+		return m_memo_name[i];
 
+	return NULL;
+}
+
+
+/**
+ * @brief Memoize a resolved symbol
+ *
+ * @param[in] addr the symbol address
+ *
+ * @param[in] nm the symbol name
+ *
+ * @returns *this
+ *
+ * @note
+ *	The name is not copied, it must remain valid for the lifetime of the object
+ *	(it is owned by the process namespace)
+ */
+inline thread& thread::memorize(mem_addr_t addr, const i8 *nm)
+{
+	u32 i = (addr >> 4) & (g_memo_sz - 1);
+	m_memo_addr[i] = addr;
+	m_memo_name[i] = nm;
+	return *this;
+}
+
+
+/**
+ * @brief Count a symbol lookup served by the lookup cache
+ *
+ * @returns *this
+ *
+ * @note
+ *	The counter is modified only by the thread it belongs to, with a plain
+ *	store, so counting a hit costs no read-modify-write on a shared cache line
+ */
+inline thread& thread::count_hit()
+{
+	store_release(m_hits, m_hits + 1);
 	return *this;
 }
 
@@ -298,9 +777,15 @@ thread& thread::unwind()
  *
  * @returns *this
  */
-inline thread& thread::foreach(void (*pfunc)(u32, call*)) const
+thread& thread::foreach(void (*pfunc)(u32, const frame*)) const
 {
-	m_stack->foreach(pfunc);
+	__D_ASSERT(pfunc != NULL);
+	if ( unlikely(pfunc == NULL) )
+		return const_cast<thread&> (*this);
+
+	for (u32 i = 0; likely(i < m_depth); i++)
+		pfunc(i, backtrace(i));
+
 	return const_cast<thread&> (*this);
 }
 
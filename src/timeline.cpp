@@ -0,0 +1,473 @@
+#include "../include/timeline.hpp"
+#include "../include/util.hpp"
+
+/**
+	@file src/timeline.cpp
+
+	@brief Class csdbg::timeline method implementation
+*/
+
+namespace csdbg {
+
+/**
+ * @brief Append a C-string to the stream buffer, escaped as a JSON string
+ *
+ * @param[in] str the C-string
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+timeline& timeline::escape(const i8 *str)
+{
+	__D_ASSERT(str != NULL);
+
+	/* Append the runs of plain characters at once */
+	const i8 *run = str;
+	for (; likely(*str != '\0'); str++) {
+		u8 ch = static_cast<u8> (*str);
+		if ( likely(ch >= ' ' && ch != '"' && ch != '\\') )
+			continue;
+
+		if ( likely(str > run) )
+			m_stream->append("%.*s", static_cast<i32> (str - run), run);
+
+		if (ch == '"' || ch == '\\')
+			m_stream->append("\\%c", ch);
+		else
+			m_stream->append("\\u%04x", ch);
+
+		run = str + 1;
+	}
+
+	if ( likely(str > run) )
+		m_stream->append("%.*s", static_cast<i32> (str - run), run);
+
+	return *this;
+}
+
+
+/**
+ * @brief Begin an event record, with the fields common to all event types
+ *
+ * @param[in] tid the thread id
+ *
+ * @param[in] time the event timestamp (nsec, see util::timestamp)
+ *
+ * @param[in] ph the event type
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+timeline& timeline::record(u64 tid, u64 time, const i8 *ph)
+{
+	u64 usec = (time > m_origin) ? time - m_origin : 0;
+	m_stream->append((m_events == 0) ? "[\n" : ",\n");
+	m_stream->append("{\"ph\":\"%s\",\"pid\":%u,\"tid\":%llu,\"ts\":%llu.%03llu",
+									 ph, m_pid, tid, usec / 1000, usec % 1000);
+
+	m_events++;
+	return *this;
+}
+
+
+/**
+ * @brief Write the name of a thread, if it was not written or has changed
+ *
+ * @param[in] tid the thread id
+ *
+ * @param[in] nm the thread name (NULL for an anonymous thread)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	Only a hash of the last written name of each thread is kept, the name may
+ *	be modified or released by its owner
+ */
+timeline& timeline::name_thread(u64 tid, const i8 *nm)
+{
+	u32 i = m_last;
+	if ( unlikely(i >= m_thread_cnt || m_threads[i] != tid) ) {
+		for (i = 0; likely(i < m_thread_cnt); i++)
+			if ( unlikely(m_threads[i] == tid) )
+				break;
+
+		/* A new thread, grow the arrays */
+		if ( unlikely(i == m_thread_cnt) ) {
+			u64 *threads = new u64[m_thread_cnt + 1];
+			u32 *names = NULL;
+			try {
+				names = new u32[m_thread_cnt + 1];
+			}
+
+			catch (...) {
+				delete[] threads;
+				throw;
+			}
+
+			if ( likely(m_thread_cnt > 0) ) {
+				memcpy(threads, m_threads, m_thread_cnt * sizeof(u64));
+				memcpy(names, m_names, m_thread_cnt * sizeof(u32));
+			}
+
+			delete[] m_threads;
+			delete[] m_names;
+			m_threads = threads;
+			m_names = names;
+			m_threads[i] = tid;
+			m_names[i] = 0;
+			m_thread_cnt++;
+		}
+
+		m_last = i;
+	}
+
+	/* FNV-1a hash of the name, 0 stands for no name */
+	u32 hash = 0;
+	if ( likely(nm != NULL) ) {
+		hash = 2166136261U;
+		for (const i8 *ch = nm; *ch != '\0'; ch++)
+			hash = (hash ^ static_cast<u8> (*ch)) * 16777619U;
+
+		hash |= (hash == 0);
+	}
+
+	if ( likely(hash == m_names[i]) )
+		return *this;
+
+	m_names[i] = hash;
+	if ( unlikely(nm == NULL) )
+		return *this;
+
+	record(tid, 0, "M");
+	m_stream->append(",\"name\":\"thread_name\",\"args\":{\"name\":\"");
+	escape(nm);
+	m_stream->append("\"}}");
+	return *this;
+}
+
+
+/**
+ * @brief Flush the stream buffer if it has grown beyond g_timeline_flush bytes
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+timeline& timeline::commit()
+{
+	if ( unlikely(m_stream->length() >= g_timeline_flush) )
+		m_stream->flush();
+
+	return *this;
+}
+
+
+/**
+ * @brief Object constructor
+ *
+ * @param[in] stream
+ *	the output stream, opened. The object takes its ownership, it is released
+ *	when the object is destroyed
+ *
+ * @param[in] origin
+ *	the timestamp (nsec, see util::timestamp) mapped to time 0, 0 for the
+ *	current time
+ *
+ * @param[in] pid the traced process id, 0 for the current process
+ *
+ * @throws csdbg::exception
+ */
+timeline::timeline(streambuf *stream, u64 origin, u32 pid):
+m_stream(stream),
+m_threads(NULL),
+m_names(NULL),
+m_thread_cnt(0),
+m_last(0),
+m_pid(pid),
+m_origin(origin),
+m_events(0),
+m_closed(false)
+{
+	if ( unlikely(stream == NULL) )
+		throw exception("invalid argument: stream (=%p)", stream);
+
+	if ( likely(origin == 0) )
+		m_origin = util::timestamp();
+
+	if ( likely(pid == 0) )
+		m_pid = getpid();
+}
+
+
+/**
+ * @brief Object copy constructor
+ *
+ * @param[in] src the source object
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+timeline::timeline(const timeline &src):
+m_stream(NULL),
+m_threads(NULL),
+m_names(NULL),
+m_thread_cnt(0),
+m_last(0),
+m_pid(0),
+m_origin(0),
+m_events(0),
+m_closed(false)
+{
+	*this = src;
+}
+
+
+/**
+ * @brief Object destructor
+ *
+ * @note The array is closed and the buffered events are flushed
+ */
+timeline::~timeline()
+{
+	try {
+		close();
+	}
+
+	catch (exception &x) {
+		std::cerr << x;
+	}
+
+	catch (std::exception &x) {
+		std::cerr << x;
+	}
+
+	delete m_stream;
+	delete[] m_threads;
+	delete[] m_names;
+	m_stream = NULL;
+	m_threads = NULL;
+	m_names = NULL;
+}
+
+
+/**
+ * @brief Object virtual copy constructor
+ *
+ * @returns the object copy (heap allocated)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+inline timeline* timeline::clone() const
+{
+	return new timeline(*this);
+}
+
+
+/**
+ * @brief Get the output stream
+ *
+ * @returns this->m_stream
+ */
+inline const streambuf* timeline::stream() const
+{
+	return m_stream;
+}
+
+
+/**
+ * @brief Get the number of the written events
+ *
+ * @returns this->m_events
+ */
+inline u64 timeline::event_count() const
+{
+	return m_events;
+}
+
+
+/**
+ * @brief Check if the event array is closed
+ *
+ * @returns this->m_closed
+ */
+inline bool timeline::is_closed() const
+{
+	return m_closed;
+}
+
+
+/**
+ * @brief Assignment operator
+ *
+ * @param[in] rval the assigned object
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The events buffered so far are written to the current stream, the following
+ *	ones to a duplicate of the stream of rval
+ */
+timeline& timeline::operator=(const timeline &rval)
+{
+	if ( unlikely(this == &rval) )
+		return *this;
+
+	streambuf *stream = rval.m_stream->clone();
+	u64 *threads = NULL;
+	u32 *names = NULL;
+	try {
+		threads = new u64[rval.m_thread_cnt];
+		names = new u32[rval.m_thread_cnt];
+	}
+
+	catch (...) {
+		delete stream;
+		delete[] threads;
+		throw;
+	}
+
+	if ( likely(m_stream != NULL) ) {
+		try {
+			m_stream->flush();
+		}
+
+		catch (...) {
+			delete stream;
+			delete[] threads;
+			delete[] names;
+			throw;
+		}
+	}
+
+	if ( likely(rval.m_thread_cnt > 0) ) {
+		memcpy(threads, rval.m_threads, rval.m_thread_cnt * sizeof(u64));
+		memcpy(names, rval.m_names, rval.m_thread_cnt * sizeof(u32));
+	}
+
+	delete m_stream;
+	delete[] m_threads;
+	delete[] m_names;
+	m_stream = stream;
+	m_threads = threads;
+	m_names = names;
+	m_thread_cnt = rval.m_thread_cnt;
+	m_last = rval.m_last;
+	m_pid = rval.m_pid;
+	m_origin = rval.m_origin;
+	m_events = rval.m_events;
+	m_closed = rval.m_closed;
+	return *this;
+}
+
+
+/**
+ * @brief Write a function call event ("B")
+ *
+ * @param[in] tid the thread id
+ *
+ * @param[in] thr the thread name (NULL for an anonymous thread)
+ *
+ * @param[in] fn the called function name
+ *
+ * @param[in] time the call timestamp (nsec, see util::timestamp)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @attention Class timeline is not thread safe
+ */
+timeline& timeline::enter(u64 tid, const i8 *thr, const i8 *fn, u64 time)
+{
+	if ( unlikely(m_closed) )
+		return *this;
+
+	if ( unlikely(fn == NULL) )
+		throw exception("invalid argument: fn (=%p)", fn);
+
+	name_thread(tid, thr);
+	record(tid, time, "B");
+	m_stream->append(",\"name\":\"");
+	escape(fn);
+	m_stream->append("\"}");
+	return commit();
+}
+
+
+/**
+ * @brief Write a function return event ("E")
+ *
+ * @param[in] tid the thread id
+ *
+ * @param[in] thr the thread name (NULL for an anonymous thread)
+ *
+ * @param[in] time the return timestamp (nsec, see util::timestamp)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note The event closes the last open call event of the thread
+ *
+ * @attention Class timeline is not thread safe
+ */
+timeline& timeline::leave(u64 tid, const i8 *thr, u64 time)
+{
+	if ( unlikely(m_closed) )
+		return *this;
+
+	name_thread(tid, thr);
+	record(tid, time, "E");
+	m_stream->append("}");
+	return commit();
+}
+
+
+/**
+ * @brief Write the buffered events to the stream
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ */
+timeline& timeline::flush()
+{
+	m_stream->flush();
+	return *this;
+}
+
+
+/**
+ * @brief Close the event array and write the buffered events to the stream
+ *
+ * @returns *this
+ *
+ * @throws csdbg::exception
+ *
+ * @note Any event written after the array is closed is ignored
+ */
+timeline& timeline::close()
+{
+	if ( unlikely(m_closed) )
+		return *this;
+
+	m_closed = true;
+	m_stream->append((m_events == 0) ? "[]\n" : "\n]\n");
+	return flush();
+}
+
+}
+
@@ -1,5 +1,10 @@
 #include "../include/tracer.hpp"
 #include "../include/util.hpp"
+#if defined CSDBG_WITH_STREAMBUF_FILE && \
+		(defined CSDBG_WITH_PROFILER || defined CSDBG_WITH_TIMELINE || \
+		 defined CSDBG_WITH_SAMPLER)
+#include "../include/filebuf.hpp"
+#endif
 
 /**
 	@file src/tracer.cpp
@@ -13,6 +18,18 @@ namespace csdbg {
 
 tracer *tracer::m_iface = NULL;
 
+#ifdef CSDBG_WITH_PLUGIN
+__thread modevent_t *tracer::m_events = NULL;
+
+__thread u32 tracer::m_events_cnt = 0;
+
+__thread tracer::context *tracer::m_contexts = NULL;
+
+__thread u32 tracer::m_contexts_sz = 0;
+
+__thread void *tracer::m_context = NULL;
+#endif
+
 
 /* Link the instrumentation functions with C-style linking */
 
@@ -32,89 +49,79 @@ extern "C" {
  * @param[in] call_site the address where the function was called
  *
  * @note If an exception occurs, the process exits
+ *
+ * @note
+ *	No lock is held while the plugins are called and the call is recorded. Once
+ *	the thread is registered and the function symbol is memoized, only thread
+ *	local data and the published plugin array are accessed
  */
 void __cyg_profile_func_enter(void *this_fn, void *call_site)
 {
 	__D_ASSERT(this_fn != NULL);
 	__D_ASSERT(call_site != NULL);
 
-	util::lock();
 	tracer *iface = tracer::interface();
 
 	__D_ASSERT(iface != NULL);
-	if ( unlikely(iface == NULL) ) {
-		util::unlock();
+	if ( unlikely(iface == NULL) )
 		return;
-	}
 
+	try {
 #ifdef CSDBG_WITH_PLUGIN
-	/* Call all plugin enter functions in the order they were registered */
-	for (u32 i = 0, sz = iface->plugin_count(); likely(i < sz); i++)
-		try {
-			iface->get_plugin(i)->begin(this_fn, call_site);
-		}
-
-		catch (exception &x) {
-			std::cerr << x;
-		}
-
-		catch (std::exception &x) {
-			std::cerr << x;
-		}
-
-		catch (...) {
-			util::header(std::cerr, "x");
-			std::cerr << "plugin " << std::dec << i << ": unidentified exception\r\n";
-		}
+		/* Call all plugin enter functions in the order they were registered */
+		iface->call_plugins(this_fn, call_site, true);
 #endif
 
-	try {
 		mem_addr_t addr = reinterpret_cast<mem_addr_t> (this_fn);
 		mem_addr_t site = reinterpret_cast<mem_addr_t> (call_site);
 		process *proc = iface->proc();
 
 #ifdef CSDBG_WITH_FILTER
-		mem_addr_t base = 0;
-		const i8 *path = proc->ilookup(addr, base);
-
-		/* Call all the module filters in the order they were registered */
-		if ( likely(path != NULL) )
-			for (u32 i = 0, sz = iface->filter_count(); likely(i < sz); i++) {
-				filter *filt = iface->get_filter(i);
-				if ( likely(filt->mode()) )
-					continue;
-
-				if ( unlikely(filt->apply(path)) ) {
-					util::unlock();
-					return;
-				}
-			}
+		/* Check the (cached) verdict of the registered filters for the function */
+		if ( unlikely(iface->filtered(addr)) )
+			return;
 #endif
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+		/* Append the call to the binary event trace of the thread */
+		iface->record_event(this_fn, call_site, true);
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+		/* Append the call to the exported timeline */
+		iface->export_event(this_fn, true);
+#endif
+
+#ifdef CSDBG_WITH_LAZY_SYMBOLS
 		/*
-		 * Lookup the process namespace to resolve the called function symbol. If it
-		 * gets resolved update the simulated call stack of the current thread
+		 * Record only the raw addresses, the symbol is resolved when a trace is
+		 * produced (see tracer::render)
 		 */
-		const i8 *nm = proc->lookup(addr);
+		proc->current_thread()->called(addr, site, NULL);
+#else
+		/*
+		 * Resolve the called function symbol, using the lookup memo of the current
+		 * thread or else the process namespace. If it gets resolved update the
+		 * simulated call stack of the current thread
+		 */
+		thread *thr = proc->current_thread();
+		const i8 *nm = thr->recall(addr);
+		if ( unlikely(nm == NULL) ) {
+			nm = proc->lookup(addr);
+			if ( likely(nm != NULL) )
+				thr->memorize(addr, nm);
+		}
+
 		if ( likely(nm != NULL) ) {
-#ifdef CSDBG_WITH_FILTER
-			/* Call all the symbol filters in the order they were registered */
-			for (u32 i = 0, sz = iface->filter_count(); likely(i < sz); i++) {
-				filter *filt = iface->get_filter(i);
-				if ( likely(!filt->mode()) )
-					continue;
-
-				if ( unlikely(filt->apply(nm)) ) {
-					util::unlock();
-					return;
-				}
-			}
+			thr->called(addr, site, nm);
+		}
 #endif
 
-			proc->current_thread()->called(addr, site, nm);
-		}
+#ifdef CSDBG_WITH_SAMPLER
+		/* Start sampling the thread, upon its first call */
+		iface->sample_thread();
+#endif
 
-		util::unlock();
 		return;
 	}
 
@@ -126,7 +133,6 @@ void __cyg_profile_func_enter(void *this_fn, void *call_site)
 		std::cerr << x;
 	}
 
-	util::unlock();
 	exit(EXIT_FAILURE);
 }
 
@@ -143,100 +149,81 @@ void __cyg_profile_func_enter(void *this_fn, void *call_site)
  * @param[in] call_site the address that the program counter will return to
  *
  * @note If an exception occurs, the process exits
+ *
+ * @note
+ *	No lock is held while the plugins are called and the return is recorded.
+ *	Once the thread is registered and the function symbol is memoized, only
+ *	thread local data and the published plugin array are accessed
  */
 void __cyg_profile_func_exit(void *this_fn, void *call_site)
 {
 	__D_ASSERT(this_fn != NULL);
 	__D_ASSERT(call_site != NULL);
 
-	util::lock();
 	tracer *iface = tracer::interface();
 
 	__D_ASSERT(iface != NULL);
-	if ( unlikely(iface == NULL) ) {
-		util::unlock();
+	if ( unlikely(iface == NULL) )
 		return;
-	}
 
+	try {
 #ifdef CSDBG_WITH_PLUGIN
-	/* Call all plugin exit functions in the reverse order they were registered */
-	for (i32 i = iface->plugin_count() - 1; likely(i >= 0); i--)
-		try {
-			iface->get_plugin(i)->end(this_fn, call_site);
-		}
-
-		catch (exception &x) {
-			std::cerr << x;
-		}
-
-		catch (std::exception &x) {
-			std::cerr << x;
-		}
-
-		catch (...) {
-			util::header(std::cerr, "x");
-			std::cerr << "plugin " << std::dec << i << ": unidentified exception\r\n";
-		}
+		/* Call all plugin exit functions in reverse registration order */
+		iface->call_plugins(this_fn, call_site, false);
 #endif
 
-	try {
 		mem_addr_t addr = reinterpret_cast<mem_addr_t> (this_fn);
+		mem_addr_t site = reinterpret_cast<mem_addr_t> (call_site);
 		process *proc = iface->proc();
 
 #ifdef CSDBG_WITH_FILTER
-		mem_addr_t base = 0;
-		const i8 *path = proc->ilookup(addr, base);
-
-		/* Call all the module filters in the order they were registered */
-		if ( likely(path != NULL) )
-			for (u32 i = 0, sz = iface->filter_count(); likely(i < sz); i++) {
-				filter *filt = iface->get_filter(i);
-				if ( likely(filt->mode()) )
-					continue;
-
-				if ( unlikely(filt->apply(path)) ) {
-					util::unlock();
-					return;
-				}
-			}
+		/* Check the (cached) verdict of the registered filters for the function */
+		if ( unlikely(iface->filtered(addr)) )
+			return;
+#endif
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+		/* Append the return to the binary event trace of the thread */
+		iface->record_event(this_fn, call_site, false);
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+		/* Append the return to the exported timeline */
+		iface->export_event(this_fn, false);
 #endif
 
+#ifdef CSDBG_WITH_LAZY_SYMBOLS
+		proc->current_thread()->returned(addr, site);
+#else
 		/*
-		 * Lookup the process namespace to resolve the returning function symbol. If
-		 * it gets resolved update the simulated call stack of the current thread
+		 * Resolve the returning function symbol, using the lookup memo of the
+		 * current thread or else the process namespace. If it gets resolved update
+		 * the simulated call stack of the current thread
 		 */
-		const i8 *nm = proc->lookup(addr);
-		if ( likely(nm != NULL) ) {
-#ifdef CSDBG_WITH_FILTER
-			/* Call all the symbol filters in the order they were registered */
-			for (u32 i = 0, sz = iface->filter_count(); likely(i < sz); i++) {
-				filter *filt = iface->get_filter(i);
-				if ( likely(!filt->mode()) )
-					continue;
-
-				if ( unlikely(filt->apply(nm)) ) {
-					util::unlock();
-					return;
-				}
-			}
-#endif
+		thread *thr = proc->current_thread();
+		const i8 *nm = thr->recall(addr);
+		if ( unlikely(nm == NULL) ) {
+			nm = proc->lookup(addr);
+			if ( likely(nm != NULL) )
+				thr->memorize(addr, nm);
+		}
 
-			proc->current_thread()->returned();
+		if ( likely(nm != NULL) ) {
+			thr->returned(addr, site);
 		}
+#endif
 
-		util::unlock();
 		return;
 	}
 
-	catch (exception x) {
+	catch (exception &x) {
 		std::cerr << x;
 	}
 
-	catch (std::exception x) {
+	catch (std::exception &x) {
 		std::cerr << x;
 	}
 
-	util::unlock();
 	exit(EXIT_FAILURE);
 }
 
@@ -258,12 +245,87 @@ void tracer::on_lib_load()
 	try {
 		m_iface = new tracer;
 
-		/* Load the symbol table of the executable */
-		const i8 *path = util::exec_path();
-		m_iface->m_proc->add_module(path, 0);
-		delete[] path;
+#ifdef CSDBG_WITH_EVENT_TRACE
+		/*
+		 * Record a binary event trace, if requested. The recorder is created before
+		 * the modules are loaded, to record the module load map
+		 */
+		const i8 *path = getenv(g_trace_env);
+		if ( unlikely(path != NULL) ) {
+			const i8 *drop = getenv(g_trace_drop_env);
+			bool oldest = (drop != NULL && strcmp(drop, "oldest") == 0);
+
+			try {
+				m_iface->m_recorder = new recorder(path, oldest);
+				util::dbg_info("recording event trace to '%s'", path);
+			}
+
+			catch (exception &x) {
+				std::cerr << x;
+			}
+		}
+#endif
+
+#ifdef CSDBG_WITH_CRASHDUMP
+		/*
+		 * Dump the simulated call stacks on a crash, if requested. The dumper is
+		 * created before the modules are loaded, to write the module load map
+		 */
+		const i8 *dump = getenv(g_crashdump_env);
+		if ( unlikely(dump != NULL) ) {
+			try {
+				m_iface->m_crashdump = new crashdump(m_iface->m_proc, dump);
+				util::dbg_info("crash dumps will be written to '%s'", dump);
+			}
+
+			catch (exception &x) {
+				std::cerr << x;
+			}
+		}
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+		/*
+		 * Export a Chrome trace event timeline, if requested. The events are
+		 * buffered like those of the binary trace (and dropped by the same policy)
+		 */
+		const i8 *json = getenv(g_timeline_env);
+		if ( unlikely(json != NULL) ) {
+			const i8 *drop = getenv(g_trace_drop_env);
+			bool oldest = (drop != NULL && strcmp(drop, "oldest") == 0);
+
+			try {
+				m_iface->m_exporter = new exporter(m_iface->m_proc, json, oldest);
+				util::dbg_info("exporting timeline to '%s'", json);
+			}
+
+			catch (exception &x) {
+				std::cerr << x;
+			}
+		}
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+		/* Sample the instrumented threads, if requested */
+		const i8 *period = getenv(g_sampler_env);
+		if ( unlikely(period != NULL) ) {
+			i64 val = strtol(period, NULL, 10);
+			u32 usec = g_sample_period;
+			if ( likely(val > 0 && val <= UINT_MAX) )
+				usec = val;
+
+			try {
+				m_iface->m_sampler = new sampler(m_iface->m_proc, usec);
+				util::dbg_info("sampling every %u usec of thread CPU time", usec);
+			}
+
+			catch (exception &x) {
+				std::cerr << x;
+			}
+		}
+#endif
 
-		/* Load the symbol tables of the selected DSO */
+		/* Load the symbol tables of the executable and the selected DSO */
 		chain<string> *libs = util::getenv(g_libs_env);
 		dl_iterate_phdr(on_dso_load, libs);
 		delete libs;
@@ -286,9 +348,82 @@ void tracer::on_lib_load()
 
 /**
  * @brief Library destructor
+ *
+ * @note
+ *	If the built-in profiler is enabled and the CSDBG_PROFILE shell variable is
+ *	set, the profile report (and the latency report, if the latency histograms
+ *	are enabled) is written to the file it names. Likewise, the folded stack
+ *	report (see tracer::flamegraph) is written to the file named by the
+ *	CSDBG_FLAMEGRAPH shell variable. The sampling profiler (if enabled) is
+ *	stopped first, so the report includes all the samples taken
  */
 void tracer::on_lib_unload()
 {
+#ifdef CSDBG_WITH_PLUGIN
+	/* Deliver the buffered events and release the contexts of this thread */
+	if ( likely(m_iface != NULL) )
+		m_iface->exit_thread();
+#endif
+
+#if defined CSDBG_WITH_PROFILER && defined CSDBG_WITH_STREAMBUF_FILE
+	const i8 *path = getenv(g_profile_env);
+	if ( unlikely(m_iface != NULL && path != NULL) ) {
+		try {
+			filebuf buf(path);
+			buf.open(O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			m_iface->report(buf);
+#ifdef CSDBG_WITH_HISTOGRAM
+			buf.append("\r\n");
+			m_iface->latencies(buf);
+#endif
+			buf.flush();
+			buf.close();
+			util::dbg_info("profile report written to '%s'", path);
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+		}
+	}
+#endif
+
+#ifdef CSDBG_WITH_SAMPLER
+	/* Count the buffered samples before they are reported */
+	if ( likely(m_iface != NULL && m_iface->m_sampler != NULL) )
+		m_iface->m_sampler->stop();
+#endif
+
+#if (defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER) && \
+		defined CSDBG_WITH_STREAMBUF_FILE
+	/* Report the samples, if any were taken, otherwise the exclusive time */
+	const i8 *folded = getenv(g_flamegraph_env);
+	if ( unlikely(m_iface != NULL && folded != NULL) ) {
+		try {
+			filebuf buf(folded);
+			buf.open(O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			m_iface->flamegraph(buf, true);
+			if ( likely(buf.length() == 0) )
+				m_iface->flamegraph(buf);
+
+			buf.flush();
+			buf.close();
+			util::dbg_info("folded stack report written to '%s'", folded);
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+		}
+	}
+#endif
+
 	delete m_iface;
 	m_iface = NULL;
 	util::dbg_info("libcsdbg.so.%d.%d finalized", g_major, g_minor);
@@ -297,9 +432,10 @@ void tracer::on_lib_unload()
 
 /**
  * @brief
- *	This is a dl_iterate_phdr (libdl) callback, called for each linked shared
- *	object. It loads the symbol table of the DSO (if it's not filtered out) to
- *	tracer::m_iface->m_proc
+ *	This is a dl_iterate_phdr (libdl) callback, called for the executable and
+ *	for each linked shared object. It loads the symbol table of the executable
+ *	and of each DSO (if it's not filtered out) to tracer::m_iface->m_proc and
+ *	indexes its loaded segments
  *
  * @param[in] dso
  *	a dl_phdr_info struct (libdl) that describes the shared object (file path,
@@ -326,22 +462,50 @@ i32 tracer::on_dso_load(dl_phdr_info *dso, size_t sz, void *arg)
 		if ( unlikely(dso == NULL) )
 			throw exception("invalid argument: dso (=%p)", dso);
 
+		/* If the DSO has no segments */
+		if ( unlikely(dso->dlpi_phnum == 0) )
+			throw exception("'%s' has 0 segments", dso->dlpi_name);
+
+		/*
+		 * The executable is reported with an undefined path, it is identified by
+		 * the address of its program headers. It is never filtered out
+		 */
+		mem_addr_t phdr = reinterpret_cast<mem_addr_t> (dso->dlpi_phdr);
+		if ( unlikely(phdr == getauxval(AT_PHDR)) ) {
+			const i8 *path = util::exec_path();
+			try {
+#ifdef CSDBG_WITH_EVENT_TRACE
+				map_module(path, dso);
+#endif
+				m_iface->m_proc->add_module(path, dso->dlpi_addr, dso);
+				delete[] path;
+				return 0;
+			}
+
+			catch (...) {
+				delete[] path;
+				throw;
+			}
+		}
+
 		/* If the DSO path is undefined */
 		string path(dso->dlpi_name);
 		if ( unlikely(path.length() == 0) )
 			throw exception("undefined DSO path");
 
-		/* If the DSO has no segments */
-		if ( unlikely(dso->dlpi_phnum == 0) )
-			throw exception("'%s' has 0 segments", path.cstr());
+#ifdef CSDBG_WITH_EVENT_TRACE
+		/* Filtered out DSO may still be instrumented, so they are always mapped */
+		map_module(path.cstr(), dso);
+#endif
 
 		/* Check if the DSO is filtered out */
 		bool found = false;
 		if ( likely(arg != NULL) ) {
 			chain<string> *filters = static_cast<chain<string>*> (arg);
 
-			for (u32 i = 0, sz = filters->size(); likely(i < sz); i++) {
-				string *filt = filters->at(i);
+			chain<string>::iterator it = filters->head();
+			for (; likely(it.valid()); it.next()) {
+				string *filt = it.data();
 				if ( unlikely(path.match(*filt)) ) {
 					found = true;
 					break;
@@ -356,9 +520,11 @@ i32 tracer::on_dso_load(dl_phdr_info *dso, size_t sz, void *arg)
 			return 0;
 		}
 
-		/* Load the DSO symbol table */
-		mem_addr_t base = dso->dlpi_addr + dso->dlpi_phdr[0].p_vaddr;
-		m_iface->m_proc->add_module(path.cstr(), base);
+		/*
+		 * Load the DSO symbol table. The symbol addresses are relocated by the
+		 * difference of the load address from the link address (dlpi_addr)
+		 */
+		m_iface->m_proc->add_module(path.cstr(), dso->dlpi_addr, dso);
 	}
 
 	catch (exception &x) {
@@ -373,6 +539,45 @@ i32 tracer::on_dso_load(dl_phdr_info *dso, size_t sz, void *arg)
 }
 
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+/**
+ * @brief
+ *	Add a loaded module (its path, load address and build id) to the module
+ *	load map of the binary event trace, if one is recorded, and of the crash
+ *	dump file, if crashes are dumped
+ *
+ * @param[in] path the module path
+ *
+ * @param[in] dso the module info (as reported by dl_iterate_phdr)
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+void tracer::map_module(const i8 *path, const dl_phdr_info *dso)
+{
+	recorder *rec = m_iface->m_recorder;
+#ifdef CSDBG_WITH_CRASHDUMP
+	crashdump *cd = m_iface->m_crashdump;
+	if ( likely(rec == NULL && cd == NULL) )
+		return;
+#else
+	if ( likely(rec == NULL) )
+		return;
+#endif
+
+	u8 id[g_build_id_sz];
+	u32 sz = util::build_id(dso, id, g_build_id_sz);
+	if ( likely(rec != NULL) )
+		rec->add_module(path, dso->dlpi_addr, id, sz);
+
+#ifdef CSDBG_WITH_CRASHDUMP
+	if ( likely(cd != NULL) )
+		cd->add_module(path, dso->dlpi_addr, id, sz);
+#endif
+}
+#endif
+
+
 /**
  * @brief
  *	Given an address in an objective code file, extract from the gdb-related
@@ -381,54 +586,25 @@ i32 tracer::on_dso_load(dl_phdr_info *dso, size_t sz, void *arg)
  *
  * @param[in,out] dst the destination string
  *
- * @param[in] path the path of the objective code file
- *
- * @param[in] addr the address
+ * @param[in] addr the address (e.g. a call site)
  *
  * @returns the first argument
  *
  * @note
- *	If the addr2line program fails to retreive the debug information, or if any
- *	other error or exception occurs, nothing is appended to the destination
- *	string
+ *	The debug information is resolved in-process, from the line number table of
+ *	the module that maps the address. If it is not available, or if any error or
+ *	exception occurs, nothing is appended to the destination string
  *
- * @see man addr2line
+ * @see process::addr2line
  * @see man g++ (-g family options)
  */
-string& tracer::addr2line(string &dst, const i8 *path, mem_addr_t addr)
+string& tracer::addr2line(string &dst, mem_addr_t addr) const
 {
-	__D_ASSERT(path != NULL);
-	if ( unlikely(path == NULL) )
-		return dst;
-
-	FILE *pipe = NULL;
 	try {
-		/* Command to be executed by the child process */
-		string cmd("addr2line -se %s 0x%x", path, addr);
-
-		/* Open a readonly pipe to the child process */
-		pipe = popen(cmd.cstr(), "r");
-		if ( unlikely(pipe == NULL) )
-			throw exception(
-				"failed to open pipe for command '%s' (errno %d - %s)",
-				cmd.cstr(),
-				errno,
-				strerror(errno)
-			);
-
-		/* Read a line of output from the pipe to a buffer */
-		string buf;
-		i8 ch = fgetc(pipe);
-		while ( likely(ch != '\n' && ch != EOF) ) {
-			buf.append(ch);
-			ch = fgetc(pipe);
-		}
-
-		if ( unlikely(ferror(pipe) != 0) )
-			throw exception("failed to read pipe for command '%s'", cmd.cstr());
-
-		if ( likely(buf.cmp("??:0") != 0) )
-			dst.append(" (%s)", buf.cstr());
+		u32 line = 0;
+		const i8 *file = m_proc->addr2line(addr, line);
+		if ( likely(file != NULL) )
+			dst.append(" (%s:%d)", file, line);
 	}
 
 	catch (exception &x) {
@@ -439,9 +615,6 @@ string& tracer::addr2line(string &dst, const i8 *path, mem_addr_t addr)
 		util::dbg_error("in tracer::%s(): %s", __FUNCTION__, x.what());
 	}
 
-	if ( likely(pipe != NULL) )
-		pclose(pipe);
-
 	return dst;
 }
 
@@ -456,19 +629,49 @@ try:
 m_proc(NULL)
 #ifdef CSDBG_WITH_PLUGIN
 ,m_plugins(NULL)
+,m_active(NULL)
+,m_active_sz(0)
+,m_retired(NULL)
+,m_epoch(1)
 #endif
 #ifdef CSDBG_WITH_FILTER
 ,m_filters(NULL)
+,m_modmatch(NULL)
+,m_symmatch(NULL)
+,m_verdicts(NULL)
+,m_generation(0)
+,m_filters_sz(0)
+#endif
+#ifdef CSDBG_WITH_EVENT_TRACE
+,m_recorder(NULL)
+#endif
+#ifdef CSDBG_WITH_TIMELINE
+,m_exporter(NULL)
+#endif
+#ifdef CSDBG_WITH_SAMPLER
+,m_sampler(NULL)
+#endif
+#ifdef CSDBG_WITH_CRASHDUMP
+,m_crashdump(NULL)
 #endif
 {
 #ifdef CSDBG_WITH_PLUGIN
 	m_plugins = new chain<plugin>;
+	m_active = snapshot();
 #endif
 #ifdef CSDBG_WITH_FILTER
 	m_filters = new chain<filter>;
+	m_verdicts = new cache<u32>;
 #endif
 
 	m_proc = new process;
+
+#ifdef CSDBG_WITH_PLUGIN
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+#endif
 }
 
 catch (...) {
@@ -488,19 +691,50 @@ try:
 m_proc(NULL)
 #ifdef CSDBG_WITH_PLUGIN
 ,m_plugins(NULL)
+,m_active(NULL)
+,m_active_sz(0)
+,m_retired(NULL)
+,m_epoch(1)
 #endif
 #ifdef CSDBG_WITH_FILTER
 ,m_filters(NULL)
+,m_modmatch(NULL)
+,m_symmatch(NULL)
+,m_verdicts(NULL)
+,m_generation(0)
+,m_filters_sz(0)
+#endif
+#ifdef CSDBG_WITH_EVENT_TRACE
+,m_recorder(NULL)
+#endif
+#ifdef CSDBG_WITH_TIMELINE
+,m_exporter(NULL)
+#endif
+#ifdef CSDBG_WITH_SAMPLER
+,m_sampler(NULL)
+#endif
+#ifdef CSDBG_WITH_CRASHDUMP
+,m_crashdump(NULL)
 #endif
 {
 #ifdef CSDBG_WITH_PLUGIN
 	m_plugins = src.m_plugins->clone();
+	m_active = snapshot();
+	m_active_sz = m_active->m_size + m_active->m_batches_sz;
 #endif
 #ifdef CSDBG_WITH_FILTER
 	m_filters = new chain<filter>;
+	m_verdicts = new cache<u32>;
 #endif
 
 	m_proc = src.m_proc->clone();
+
+#ifdef CSDBG_WITH_PLUGIN
+	i32 err = pthread_key_create(&m_key, thread_exit);
+	if ( unlikely(err != 0) )
+		throw exception("failed to create pthread key (errno %d - %s)",
+										err, strerror(err));
+#endif
 }
 
 catch (...) {
@@ -513,6 +747,10 @@ catch (...) {
  */
 tracer::~tracer()
 {
+#ifdef CSDBG_WITH_PLUGIN
+	pthread_key_delete(m_key);
+#endif
+
 	destroy();
 }
 
@@ -545,7 +783,26 @@ tracer& tracer::operator=(const tracer &rval)
 		return *this;
 
 #ifdef CSDBG_WITH_PLUGIN
-	*m_plugins = *rval.m_plugins;
+	/*
+	 * The replaced plugins may still be in use by the instrumentation functions,
+	 * they are released with the replaced plugin array
+	 */
+	util::lock();
+	chain<plugin> *plugins = m_plugins;
+	try {
+		m_plugins = rval.m_plugins->clone();
+		publish(snapshot(), plugins);
+		util::unlock();
+	}
+
+	catch (...) {
+		if ( likely(m_plugins != plugins) )
+			delete m_plugins;
+
+		m_plugins = plugins;
+		util::unlock();
+		throw;
+	}
 #endif
 
 	*m_proc = *rval.m_proc;
@@ -560,13 +817,54 @@ tracer& tracer::operator=(const tracer &rval)
  */
 tracer& tracer::destroy()
 {
+#ifdef CSDBG_WITH_CRASHDUMP
+	/* Restore the replaced signal actions first */
+	delete m_crashdump;
+	m_crashdump = NULL;
+#endif
+#ifdef CSDBG_WITH_SAMPLER
+	/* Count the samples left in the thread buffers */
+	delete m_sampler;
+	m_sampler = NULL;
+#endif
+#ifdef CSDBG_WITH_EVENT_TRACE
+	/* Write the events left in the thread rings */
+	delete m_recorder;
+	m_recorder = NULL;
+#endif
+#ifdef CSDBG_WITH_TIMELINE
+	/* Format the events left in the thread rings */
+	delete m_exporter;
+	m_exporter = NULL;
+#endif
 #ifdef CSDBG_WITH_PLUGIN
+	/* No instrumentation function can be using the plugins anymore */
+	while (m_retired != NULL) {
+		plugin_set *set = m_retired;
+		m_retired = set->m_next;
+		release(set);
+	}
+
+	if ( likely(m_active != NULL) ) {
+		delete[] m_active->m_plugins;
+		delete[] m_active->m_batches;
+		delete m_active;
+	}
+
 	delete m_plugins;
+	m_active = NULL;
+	m_active_sz = 0;
 	m_plugins = NULL;
 #endif
 #ifdef CSDBG_WITH_FILTER
+	delete m_modmatch;
+	delete m_symmatch;
 	delete m_filters;
+	delete m_verdicts;
+	m_modmatch = NULL;
+	m_symmatch = NULL;
 	m_filters = NULL;
+	m_verdicts = NULL;
 #endif
 
 	delete m_proc;
@@ -576,28 +874,89 @@ tracer& tracer::destroy()
 
 
 /**
- * @brief Stream insertion operator for csdbg::tracer objects
+ * @brief Append the function calls of a simulated call stack copy to a string
  *
- * @param[in] lval the output stream
+ * @param[in] dst the destination string
  *
- * @param[in] rval the object to output
+ * @param[in] frames the frames of the stack copy (the stack bottom first)
  *
- * @returns its first argument
+ * @param[in] i
+ *	the offset of the first frame to render (the previous frames are used only
+ *	as callers)
+ *
+ * @param[in] sz the frame count
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	With CSDBG_WITH_LAZY_SYMBOLS, the frames record only raw addresses. They are
+ *	resolved here in a single batch lookup, and the unresolved frames are
+ *	dropped, as they would not have been recorded if the symbols were resolved
+ *	upon each call
  */
-std::ostream& operator<<(std::ostream &lval, tracer &rval)
+const tracer& tracer::render(string &dst, frame *frames, u32 i, u32 sz) const
 {
-	util::lock();
-	try {
-		string buf;
-		rval.trace(buf);
-		lval << buf;
+#ifdef CSDBG_WITH_LAZY_SYMBOLS
+	m_proc->lookup(frames, sz);
 
-		util::unlock();
-		return lval;
-	}
+	u32 cnt = 0, skip = 0;
+	for (u32 j = 0; likely(j < sz); j++) {
+		if ( unlikely(frames[j].name() == NULL) ) {
+			if ( likely(j < i) )
+				skip++;
 
-	catch (exception &x) {
-		lval << x;
+			continue;
+		}
+
+		frames[cnt++] = frames[j];
+	}
+
+	i -= skip;
+	sz = cnt;
+#endif
+
+	/* For each function call */
+	for (; likely(i < sz); i++) {
+		const frame *cur = &frames[i];
+		dst.append("  at %s", cur->name());
+
+		/* Append addr2line debug information (the call site is in the caller) */
+		if ( likely(i > 0) )
+			addr2line(dst, cur->site());
+
+		dst.append("\r\n");
+	}
+
+	return *this;
+}
+
+
+/**
+ * @brief Stream insertion operator for csdbg::tracer objects
+ *
+ * @param[in] lval the output stream
+ *
+ * @param[in] rval the object to output
+ *
+ * @returns its first argument
+ */
+std::ostream& operator<<(std::ostream &lval, tracer &rval)
+{
+	util::lock();
+	try {
+		string buf;
+		rval.trace(buf);
+		lval << buf;
+
+		util::unlock();
+		return lval;
+	}
+
+	catch (exception &x) {
+		lval << x;
 	}
 
 	catch (std::exception &x) {
@@ -657,41 +1016,38 @@ tracer* tracer::interface()
  */
 tracer& tracer::trace(string &dst)
 {
+	frame *frames = NULL;
+
 	/* If an exception occurs, unwind, unlock and rethrow it */
 	try {
 		util::lock();
 		thread *thr = m_proc->current_thread();
 
+		/* Only the calls unwinded by the exception (the 'lag') are traced */
+		u32 depth = thr->call_depth(), first = 0;
+		i32 lag = thr->lag() + 1;
+		if ( likely(lag < static_cast<i32> (depth)) )
+			first = (lag > 0) ? depth - lag : depth;
+
+		frames = new frame[depth];
+		thr->snapshot(frames, depth);
+
 		const i8 *nm = thr->name();
 		if ( likely(nm == NULL) )
 			nm = "anonymous";
 		dst.append("at %s thread (0x%lx) {\r\n", nm, thr->handle());
 
-		/* For each function call */
-		for (i32 i = thr->lag(); likely(i >= 0); i--) {
-			const call *cur = thr->backtrace(i);
-			dst.append("  at %s", cur->name());
-
-			/* Append addr2line debug information */
-			u32 prev = i + 1;
-			if ( likely (prev < thr->call_depth()) ) {
-				const call *caller = thr->backtrace(prev);
-				mem_addr_t base = 0;
-
-				const i8 *path = m_proc->ilookup(caller->addr(), base);
-				addr2line(dst, path, cur->site() - base);
-			}
-
-			dst.append("\r\n");
-		}
-
+		render(dst, frames, first, depth);
 		dst.append("}\r\n");
+
+		delete[] frames;
 		thr->unwind();
 		util::unlock();
 		return *this;
 	}
 
 	catch (...) {
+		delete[] frames;
 		unwind();
 		util::unlock();
 		throw;
@@ -715,6 +1071,8 @@ tracer& tracer::trace(string &dst)
  */
 tracer& tracer::trace(string &dst, pthread_t id) const
 {
+	frame *frames = NULL;
+
 	/* If an exception occurs, unlock and rethrow it */
 	try {
 		util::lock();
@@ -724,35 +1082,36 @@ tracer& tracer::trace(string &dst, pthread_t id) const
 			return const_cast<tracer&> (*this);
 		}
 
+		/*
+		 * Copy the simulated call stack, the thread may modify it concurrently. If
+		 * it grew beyond the copy buffer, retry with a larger one
+		 */
+		u32 depth = thr->call_depth(), sz;
+		do {
+			delete[] frames;
+			frames = NULL;
+
+			sz = depth + 32;
+			frames = new frame[sz];
+			depth = thr->snapshot(frames, sz);
+		}
+		while ( unlikely(depth > sz) );
+
 		const i8 *nm = thr->name();
 		if ( likely(nm == NULL) )
 			nm = "anonymous";
 		dst.append("at %s thread (0x%lx) {\r\n", nm, thr->handle());
 
-		/* For each function call */
-		for (i32 i = thr->call_depth() - 1; likely(i >= 0); i--) {
-			const call *cur = thr->backtrace(i);
-			dst.append("  at %s", cur->name());
-
-			/* Append addr2line debug information */
-			u32 prev = i + 1;
-			if ( likely (prev < thr->call_depth()) ) {
-				const call *caller = thr->backtrace(prev);
-				mem_addr_t base = 0;
-
-				const i8 *path = m_proc->ilookup(caller->addr(), base);
-				addr2line(dst, path, cur->site() - base);
-			}
-
-			dst.append("\r\n");
-		}
-
+		render(dst, frames, 0, depth);
 		dst.append("}\r\n");
+
+		delete[] frames;
 		util::unlock();
 		return const_cast<tracer&> (*this);
 	}
 
 	catch (...) {
+		delete[] frames;
 		util::unlock();
 		throw;
 	}
@@ -828,6 +1187,152 @@ tracer& tracer::dump(string &dst) const
 
 
 #ifdef CSDBG_WITH_PLUGIN
+/**
+ * @brief Release a retired plugin array and the plugins released with it
+ *
+ * @param[in] set the plugin array
+ */
+void tracer::release(plugin_set *set)
+{
+	if ( unlikely(set == NULL) )
+		return;
+
+	delete[] set->m_plugins;
+	delete[] set->m_batches;
+	delete set->m_released;
+	delete set;
+}
+
+
+/**
+ * @brief
+ *	Deliver the events buffered by an exiting thread to the batched plugins and
+ *	release its plugin data
+ *
+ * @param[in] arg the tracer object that the thread called the plugins of
+ *
+ * @note
+ *	This is a pthread key destructor, it is executed by the exiting thread
+ */
+void tracer::thread_exit(void *arg)
+{
+	tracer *iface = static_cast<tracer*> (arg);
+
+	__D_ASSERT(iface != NULL);
+	if ( likely(iface != NULL) )
+		iface->exit_thread();
+}
+
+
+/**
+ * @brief Create a plugin array from the registered plugins
+ *
+ * @param[in] skip the registration index of a plugin to leave out (or -1)
+ *
+ * @returns the plugin array (heap allocated)
+ *
+ * @throws std::bad_alloc
+ *
+ * @note The caller must hold the global lock
+ */
+tracer::plugin_set* tracer::snapshot(i32 skip) const
+{
+	plugin_set *retval = new plugin_set;
+	retval->m_plugins = NULL;
+	retval->m_size = 0;
+	retval->m_batches = NULL;
+	retval->m_batches_sz = 0;
+	retval->m_epoch = 0;
+	retval->m_released = NULL;
+	retval->m_next = NULL;
+
+	try {
+		retval->m_plugins = new const plugin*[m_plugins->size()];
+		retval->m_batches = new const plugin*[m_plugins->size()];
+	}
+
+	catch (...) {
+		delete[] retval->m_plugins;
+		delete retval;
+		throw;
+	}
+
+	/* The batched plugins are kept apart, they are fed from the event buffers */
+	chain<plugin>::iterator it = m_plugins->head();
+	for (; likely(it.valid()); it.next()) {
+		if ( unlikely(static_cast<i32> (it.index()) == skip) )
+			continue;
+
+		const plugin *plg = it.data();
+		if ( unlikely(plg->batched()) )
+			retval->m_batches[retval->m_batches_sz++] = plg;
+		else
+			retval->m_plugins[retval->m_size++] = plg;
+	}
+
+	return retval;
+}
+
+
+/**
+ * @brief
+ *	Publish a plugin array to the instrumentation functions. The replaced array
+ *	is retired and released when no thread can be using it anymore
+ *
+ * @param[in] set the new plugin array
+ *
+ * @param[in] released
+ *	plugins that are no longer registered, to be released with the replaced
+ *	array (it can be NULL)
+ *
+ * @returns *this
+ *
+ * @note The caller must hold the global lock
+ */
+tracer& tracer::publish(plugin_set *set, chain<plugin> *released)
+{
+	plugin_set *old = m_active;
+	store_release(m_active, set);
+	store_release(m_active_sz, set->m_size + set->m_batches_sz);
+
+	/* The threads that start calling plugins from now on see the new array */
+	store_release(m_epoch, m_epoch + 1);
+	fence_full();
+
+	old->m_epoch = m_epoch;
+	old->m_released = released;
+	old->m_next = m_retired;
+	m_retired = old;
+	return reclaim();
+}
+
+
+/**
+ * @brief
+ *	Release the retired plugin arrays (and the plugins released with them) that
+ *	no thread can be using anymore
+ *
+ * @returns *this
+ *
+ * @note The caller must hold the global lock
+ */
+tracer& tracer::reclaim()
+{
+	plugin_set **prev = &m_retired;
+	while (*prev != NULL) {
+		plugin_set *set = *prev;
+		if ( likely(m_proc->quiescent(set->m_epoch)) ) {
+			*prev = set->m_next;
+			release(set);
+		}
+		else
+			prev = &set->m_next;
+	}
+
+	return *this;
+}
+
+
 /**
  * @brief Get the number of registered plugins
  *
@@ -846,23 +1351,35 @@ inline u32 tracer::plugin_count() const
  *
  * @param[in] scope the full scope of the plugin callbacks
  *
+ * @param[in] ctxsz the size of the per-thread plugin context (0 for none)
+ *
  * @returns the new plugin
  *
  * @throws std::bad_alloc
  * @throws csdbg::exception
  */
-const plugin* tracer::add_plugin(const i8 *path, const i8 *scope)
+const plugin* tracer::add_plugin(const i8 *path, const i8 *scope, u32 ctxsz)
 {
 	plugin *retval = NULL;
+	bool added = false;
 	try {
 		util::lock();
-		retval = new plugin(path, scope);
+		retval = new plugin(path, scope, ctxsz);
+		if ( unlikely(ctxsz > 0) )
+			retval->set_slot(alloc_slot());
+
 		m_plugins->add(retval);
+		added = true;
+
+		publish(snapshot());
 		util::unlock();
 		return retval;
 	}
 
 	catch (...) {
+		if ( unlikely(added) )
+			m_plugins->detach(m_plugins->size() - 1);
+
 		delete retval;
 		util::unlock();
 		throw;
@@ -877,22 +1394,41 @@ const plugin* tracer::add_plugin(const i8 *path, const i8 *scope)
  *
  * @param[in] end the instrumentation ending callback
  *
+ * @param[in] batch
+ *	the batched instrumentation callback (it can be NULL). If set, bgn and end
+ *	are not used
+ *
+ * @param[in] ctxsz the size of the per-thread plugin context (0 for none)
+ *
+ * @param[in] exit the thread exit callback (it can be NULL)
+ *
  * @returns the new plugin
  *
  * @throws std::bad_alloc
  */
-const plugin* tracer::add_plugin(modsym_t bgn, modsym_t end)
+const plugin* tracer::add_plugin(modsym_t bgn, modsym_t end, modsym_t batch,
+																 u32 ctxsz, modsym_t exit)
 {
 	plugin *retval = NULL;
+	bool added = false;
 	try {
 		util::lock();
-		retval = new plugin(bgn, end);
+		retval = new plugin(bgn, end, batch, ctxsz, exit);
+		if ( unlikely(ctxsz > 0) )
+			retval->set_slot(alloc_slot());
+
 		m_plugins->add(retval);
+		added = true;
+
+		publish(snapshot());
 		util::unlock();
 		return retval;
 	}
 
 	catch (...) {
+		if ( unlikely(added) )
+			m_plugins->detach(m_plugins->size() - 1);
+
 		delete retval;
 		util::unlock();
 		throw;
@@ -906,6 +1442,8 @@ const plugin* tracer::add_plugin(modsym_t bgn, modsym_t end)
  * @param[in] path the path of the module file
  *
  * @returns *this
+ *
+ * @throws std::bad_alloc
  */
 tracer& tracer::remove_plugin(const i8 *path)
 {
@@ -913,22 +1451,31 @@ tracer& tracer::remove_plugin(const i8 *path)
 	if ( unlikely(path == NULL) )
 		return *this;
 
-	util::lock();
-	for (u32 i = 0, sz = m_plugins->size(); likely(i < sz); i++) {
-		const plugin *plg = m_plugins->at(i);
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+		chain<plugin>::iterator it = m_plugins->head();
+		for (; likely(it.valid()); it.next()) {
+			const plugin *plg = it.data();
 
-		/* If this is an inline plugin */
-		if ( unlikely(plg->path() == NULL) )
-			continue;
+			/* If this is an inline plugin */
+			if ( unlikely(plg->path() == NULL) )
+				continue;
 
-		if ( unlikely(strcmp(plg->path(), path) == 0) ) {
-			m_plugins->remove(i);
-			break;
+			if ( unlikely(strcmp(plg->path(), path) == 0) ) {
+				remove_plugin(it.index());
+				break;
+			}
 		}
+
+		util::unlock();
+		return *this;
 	}
 
-	util::unlock();
-	return *this;
+	catch (...) {
+		util::unlock();
+		throw;
+	}
 }
 
 
@@ -939,18 +1486,38 @@ tracer& tracer::remove_plugin(const i8 *path)
  *
  * @returns *this
  *
+ * @throws std::bad_alloc
  * @throws csdbg::exception
  */
 tracer& tracer::remove_plugin(u32 i)
 {
+	chain<plugin> *released = NULL;
+	plugin_set *set = NULL;
 	try {
 		util::lock();
-		m_plugins->remove(i);
+
+		/*
+		 * The plugin may still be in use by the instrumentation functions, it is
+		 * released with the replaced plugin array
+		 */
+		released = new chain<plugin>;
+		set = snapshot(i);
+		released->append(m_plugins->at(i));
+		m_plugins->detach(i);
+
+		publish(set, released);
 		util::unlock();
 		return *this;
 	}
 
 	catch (...) {
+		if ( likely(set != NULL) ) {
+			delete[] set->m_plugins;
+			delete[] set->m_batches;
+			delete set;
+		}
+
+		delete released;
 		util::unlock();
 		throw;
 	}
@@ -971,8 +1538,9 @@ const plugin* tracer::get_plugin(const i8 *path) const
 		return NULL;
 
 	util::lock();
-	for (u32 i = 0, sz = m_plugins->size(); likely(i < sz); i++) {
-		const plugin *plg = m_plugins->at(i);
+	chain<plugin>::iterator it = m_plugins->head();
+	for (; likely(it.valid()); it.next()) {
+		const plugin *plg = it.data();
 
 		/* If this is an inline plugin */
 		if ( unlikely(plg->path() == NULL) )
@@ -1012,69 +1580,500 @@ const plugin* tracer::get_plugin(u32 i) const
 		throw;
 	}
 }
-#endif
-
-
-#ifdef CSDBG_WITH_FILTER
-/**
- * @brief Get the number of registered filters
- *
- * @returns this->m_plugins->size()
- */
-inline u32 tracer::filter_count() const
-{
-	return m_filters->size();
-}
 
 
 /**
- * @brief Register a filter
+ * @brief Call the instrumentation callbacks of all the registered plugins
  *
- * @param[in] expr the filter expression
+ * @param[in] fn the address of the called (or returning) function
  *
- * @param[in] icase true to ignore case on filtering, false otherwise
+ * @param[in] site the call site (or the return address)
  *
- * @param[in] mode true to create a symbol filter, false to filter modules
+ * @param[in] mode
+ *	true to call the starting callbacks in registration order, false to call
+ *	the ending callbacks in reverse order
  *
- * @returns the new filter
+ * @returns *this
  *
  * @throws std::bad_alloc
- * @throws csdbg::exception
+ *
+ * @note
+ *	No lock is held. The published plugin array is immutable and the current
+ *	thread records the registry epoch it read, so the array (and the plugins in
+ *	it) can't be released while it is traversed. An exception thrown by a
+ *	plugin is reported and the next plugin is called
+ *
+ * @note
+ *	If batched plugins are registered, the event is appended to the event
+ *	buffer of the current thread and the buffer is delivered to them once it is
+ *	full (or flushed). Buffered events are delivered to the batched plugins
+ *	registered at that time
+ *
+ * @note
+ *	If no plugin is registered, the method returns at once, without entering a
+ *	read-side section of the registry
  */
-filter* tracer::add_filter(const i8 *expr, bool icase, bool mode)
+tracer& tracer::call_plugins(void *fn, void *site, bool mode)
 {
-	filter *retval = NULL;
-	try {
-		retval = new filter(expr, icase, mode);
-		m_filters->add(retval);
-		return retval;
+	if ( likely(load_acquire(m_active_sz) == 0) )
+		return *this;
+
+	thread *thr = m_proc->current_thread();
+
+	/* Plugins may call instrumented functions, only the outer call is recorded */
+	u64 prev = thr->epoch();
+	if ( likely(prev == 0) ) {
+		thr->set_epoch(load_acquire(m_epoch));
+		fence_full();
 	}
 
-	catch (...) {
-		delete retval;
-		throw;
+	const plugin_set *set = load_acquire(m_active);
+	if ( unlikely(set->m_batches_sz > 0) ) {
+		if ( unlikely(m_events == NULL) ) {
+			m_events = new modevent_t[g_events_sz];
+			pthread_setspecific(m_key, this);
+		}
+
+		modevent_t &ev = m_events[m_events_cnt++];
+		ev.time = util::timestamp();
+		ev.fn = fn;
+		ev.site = site;
+		ev.type = (mode) ? g_event_call : g_event_return;
+		if ( unlikely(m_events_cnt == g_events_sz) )
+			drain(set);
+	}
+
+	u32 i = 0, sz = set->m_size;
+	while ( likely(i < sz) ) {
+		try {
+			for (; likely(i < sz); i++) {
+				const plugin *plg = set->m_plugins[(mode) ? i : sz - i - 1];
+				m_context = (plg->context_size() > 0) ? bind(plg) : NULL;
+
+				if ( likely(mode) )
+					plg->begin(fn, site);
+				else
+					plg->end(fn, site);
+			}
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+			i++;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+			i++;
+		}
+
+		catch (...) {
+			u32 idx = (mode) ? i : sz - i - 1;
+			util::header(std::cerr, "x");
+			std::cerr << "plugin " << std::dec << idx;
+			std::cerr << ": unidentified exception\r\n";
+			i++;
+		}
 	}
+
+	thr->set_epoch(prev);
+	return *this;
 }
 
 
 /**
- * @brief Unregister a filter
+ * @brief
+ *	Deliver the events buffered by the current thread to the batched plugins of
+ *	a plugin array (in registration order) and empty the buffer
  *
- * @param[in] i the filter registration index
+ * @param[in] set the plugin array
  *
  * @returns *this
  *
- * @throws csdbg::exception
+ * @note
+ *	The caller must ensure that the plugin array can't be released. If it has
+ *	no batched plugins, the events are discarded. An exception thrown by a
+ *	plugin is reported and the next plugin is called
+ *
+ * @note
+ *	The events of the instrumented functions called by the plugins themselves
+ *	are buffered for the next delivery
  */
-inline tracer& tracer::remove_filter(u32 i)
+tracer& tracer::drain(const plugin_set *set)
 {
-	m_filters->remove(i);
+	u32 cnt = m_events_cnt;
+	if ( unlikely(cnt == 0) )
+		return *this;
+
+	/*
+	 * Detach the buffer while the plugins are called. The instrumented functions
+	 * they call record their events to a new buffer, so the delivered events are
+	 * neither overwritten nor redelivered
+	 */
+	modevent_t *events = m_events;
+	m_events = NULL;
+	m_events_cnt = 0;
+
+	u32 i = 0, sz = set->m_batches_sz;
+	while ( likely(i < sz) ) {
+		try {
+			for (; likely(i < sz); i++) {
+				const plugin *plg = set->m_batches[i];
+				m_context = (plg->context_size() > 0) ? bind(plg) : NULL;
+				plg->batch(events, cnt);
+			}
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+			i++;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+			i++;
+		}
+
+		catch (...) {
+			util::header(std::cerr, "x");
+			std::cerr << "batched plugin " << std::dec << i;
+			std::cerr << ": unidentified exception\r\n";
+			i++;
+		}
+	}
+
+	/* Reuse the buffer, unless events were recorded to a new one meanwhile */
+	if ( likely(m_events == NULL) )
+		m_events = events;
+	else
+		delete[] events;
+
 	return *this;
 }
 
 
 /**
- * @brief Get a registered filter
+ * @brief
+ *	Deliver the events buffered by the current thread to the registered batched
+ *	plugins
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	Each thread flushes its buffer when it exits, but buffered events of threads
+ *	still running when the process exits are lost
+ */
+tracer& tracer::flush_plugins()
+{
+	if ( likely(m_events_cnt == 0) )
+		return *this;
+
+	thread *thr = m_proc->current_thread();
+	u64 prev = thr->epoch();
+	if ( likely(prev == 0) ) {
+		thr->set_epoch(load_acquire(m_epoch));
+		fence_full();
+	}
+
+	drain(load_acquire(m_active));
+	thr->set_epoch(prev);
+	return *this;
+}
+
+
+/**
+ * @brief Get the per-thread context of the plugin being called
+ *
+ * @returns
+ *	the context of the current thread, or NULL if the plugin has no per-thread
+ *	context or no plugin callback is running
+ *
+ * @note
+ *	This method is meant to be called by the plugin callbacks. No lock is held,
+ *	the context is accessed only by the current thread
+ */
+void* tracer::plugin_context()
+{
+	return m_context;
+}
+
+
+/**
+ * @brief Find a per-thread context slot not used by any registered plugin
+ *
+ * @returns the lowest free slot index
+ *
+ * @note The caller must hold the global lock
+ */
+u32 tracer::alloc_slot() const
+{
+	u32 retval = 0;
+	bool used = true;
+	while (used) {
+		used = false;
+		chain<plugin>::iterator it = m_plugins->head();
+		for (; likely(it.valid()); it.next()) {
+			const plugin *plg = it.data();
+			if ( unlikely(plg->context_size() > 0 && plg->slot() == retval) ) {
+				used = true;
+				retval++;
+				break;
+			}
+		}
+	}
+
+	return retval;
+}
+
+
+/**
+ * @brief
+ *	Get the per-thread context of a plugin for the current thread. The context
+ *	is allocated (zero filled) on first use
+ *
+ * @param[in] plg the plugin
+ *
+ * @returns the context
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	No lock is held, the contexts are thread local. A slot still holding the
+ *	context of a plugin that is no longer registered is reused, the stale
+ *	context is released without notifying the plugin
+ */
+void* tracer::bind(const plugin *plg)
+{
+	u32 slot = plg->slot();
+	if ( unlikely(slot >= m_contexts_sz) ) {
+		u32 sz = slot + 1;
+		context *contexts = new context[sz];
+		memset(contexts, 0, sz * sizeof(context));
+		if ( likely(m_contexts != NULL) )
+			memcpy(contexts, m_contexts, m_contexts_sz * sizeof(context));
+
+		delete[] m_contexts;
+		m_contexts = contexts;
+		m_contexts_sz = sz;
+		pthread_setspecific(m_key, this);
+	}
+
+	context &ctx = m_contexts[slot];
+	if ( unlikely(ctx.m_owner != plg->id()) ) {
+		u8 *data = new u8[plg->context_size()];
+		memset(data, 0, plg->context_size());
+		delete[] ctx.m_data;
+		ctx.m_data = data;
+		ctx.m_owner = plg->id();
+	}
+
+	return ctx.m_data;
+}
+
+
+/**
+ * @brief
+ *	Deliver the events buffered by the current thread to the batched plugins,
+ *	pass each plugin context of the thread to the thread exit callback of its
+ *	plugin and release the buffer and the contexts
+ *
+ * @returns *this
+ *
+ * @note
+ *	The global lock is held while the plugins are called, so the plugin array
+ *	can't be released. An exception thrown by a plugin is reported and the next
+ *	plugin is called
+ */
+tracer& tracer::exit_thread()
+{
+	util::lock();
+	const plugin_set *set = m_active;
+	drain(set);
+
+	u32 sz = set->m_size + set->m_batches_sz;
+	for (u32 i = 0; likely(i < sz); i++) {
+		const plugin *plg = (i < set->m_size) ? set->m_plugins[i] :
+																						set->m_batches[i - set->m_size];
+
+		u32 slot = plg->slot();
+		if ( likely(plg->context_size() == 0 || slot >= m_contexts_sz) )
+			continue;
+
+		if ( unlikely(m_contexts[slot].m_owner != plg->id()) )
+			continue;
+
+		try {
+			m_context = m_contexts[slot].m_data;
+			plg->thread_exit(m_context);
+		}
+
+		catch (exception &x) {
+			std::cerr << x;
+		}
+
+		catch (std::exception &x) {
+			std::cerr << x;
+		}
+
+		catch (...) {
+			util::header(std::cerr, "x");
+			std::cerr << "plugin " << std::dec << i << ": unidentified exception\r\n";
+		}
+	}
+
+	for (u32 i = 0; likely(i < m_contexts_sz); i++)
+		delete[] m_contexts[i].m_data;
+
+	delete[] m_contexts;
+	delete[] m_events;
+	m_contexts = NULL;
+	m_contexts_sz = 0;
+	m_context = NULL;
+	m_events = NULL;
+	m_events_cnt = 0;
+	util::unlock();
+	return *this;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_FILTER
+/**
+ * @brief Get the number of registered filters
+ *
+ * @returns this->m_plugins->size()
+ */
+inline u32 tracer::filter_count() const
+{
+	return m_filters->size();
+}
+
+
+/**
+ * @brief Register a filter
+ *
+ * @param[in] expr the filter expression
+ *
+ * @param[in] icase true to ignore case on filtering, false otherwise
+ *
+ * @param[in] mode true to create a symbol filter, false to filter modules
+ *
+ * @returns the new filter
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The filter can't be modified after it is registered, as the filter set is
+ *	compiled and applied to the loaded symbols only upon registration. To change
+ *	a filter, unregister it and register a new one
+ */
+const filter* tracer::add_filter(const i8 *expr, bool icase, bool mode)
+{
+	filter *retval = NULL;
+	bool added = false;
+	try {
+		util::lock();
+		retval = new filter(expr, icase, mode);
+		m_filters->append(retval);
+		added = true;
+
+		/*
+		 * Recompile the filter matchers, update the function trace flags and
+		 * invalidate the cached verdicts
+		 */
+		compile_filters();
+		m_proc->mark(apply_filters, this);
+		store_release(m_generation, m_generation + 1);
+		store_release(m_filters_sz, m_filters->size());
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		/*
+		 * Restore the function trace flags of the remaining filters. If recompiling
+		 * fails too, the filters are applied one by one
+		 */
+		if ( unlikely(added) ) {
+			m_filters->detach(m_filters->size() - 1);
+			try {
+				compile_filters();
+			}
+
+			catch (...) {
+			}
+
+			try {
+				m_proc->mark(apply_filters, this);
+			}
+
+			catch (...) {
+			}
+
+			store_release(m_generation, m_generation + 1);
+			store_release(m_filters_sz, m_filters->size());
+		}
+
+		delete retval;
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Unregister a filter
+ *
+ * @param[in] i the filter registration index
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ */
+tracer& tracer::remove_filter(u32 i)
+{
+	try {
+		util::lock();
+		m_filters->remove(i);
+
+		/*
+		 * Recompile the filter matchers, update the function trace flags and
+		 * invalidate the cached verdicts
+		 */
+		compile_filters();
+		m_proc->mark(apply_filters, this);
+		store_release(m_generation, m_generation + 1);
+		store_release(m_filters_sz, m_filters->size());
+		util::unlock();
+		return *this;
+	}
+
+	catch (...) {
+		/*
+		 * The filter set may have changed, restore the function trace flags of the
+		 * remaining filters and invalidate the cached verdicts
+		 */
+		try {
+			m_proc->mark(apply_filters, this);
+		}
+
+		catch (...) {
+		}
+
+		store_release(m_generation, m_generation + 1);
+		store_release(m_filters_sz, m_filters->size());
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief Get a registered filter
  *
  * @param[in] i the filter registration index
  *
@@ -1082,9 +2081,453 @@ inline tracer& tracer::remove_filter(u32 i)
  *
  * @throws csdbg::exception
  */
-inline filter* tracer::get_filter(u32 i) const
+const filter* tracer::get_filter(u32 i) const
 {
-	return m_filters->at(i);
+	try {
+		util::lock();
+		const filter *retval = m_filters->at(i);
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+
+
+/**
+ * @brief
+ *	Compile the registered filters of each type to a combined matcher. If the
+ *	compilation fails, the filters are applied one by one
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note The caller must hold the global lock
+ */
+tracer& tracer::compile_filters()
+{
+	delete m_modmatch;
+	delete m_symmatch;
+	m_modmatch = NULL;
+	m_symmatch = NULL;
+
+	m_modmatch = new matcher(m_filters, false);
+	m_symmatch = new matcher(m_filters, true);
+	return *this;
+}
+
+
+/**
+ * @brief Apply all the registered filters of a type, in registration order
+ *
+ * @param[in] nm a module path or a symbol
+ *
+ * @param[in] mode true to apply the symbol filters, false for module filters
+ *
+ * @returns true if nm is filtered out, false otherwise
+ *
+ * @note
+ *	All the filters of a type are checked in a single pass of their combined
+ *	matcher (see csdbg::matcher). The global lock is held, so the matchers can
+ *	not be recompiled concurrently
+ */
+bool tracer::apply_filters(const i8 *nm, bool mode) const
+{
+	util::lock();
+	const matcher *match = (mode) ? m_symmatch : m_modmatch;
+	if ( likely(match != NULL) ) {
+		bool retval = (match->match(nm) >= 0);
+		util::unlock();
+		return retval;
+	}
+
+	/* If the filters are not compiled, apply them one by one */
+	chain<filter>::iterator it = m_filters->head();
+	for (; likely(it.valid()); it.next()) {
+		filter *filt = it.data();
+		if (filt->mode() != mode)
+			continue;
+
+		if ( unlikely(filt->apply(nm)) ) {
+			util::unlock();
+			return true;
+		}
+	}
+
+	util::unlock();
+	return false;
+}
+
+
+/**
+ * @brief
+ *	Apply all the registered filters of a type to a module path or a symbol.
+ *	This is the filter callback passed to process::mark
+ *
+ * @param[in] nm a module path or a symbol
+ *
+ * @param[in] mode true to apply the symbol filters, false for module filters
+ *
+ * @param[in] arg the tracer object
+ *
+ * @returns true if nm is filtered out, false otherwise
+ */
+bool tracer::apply_filters(const i8 *nm, bool mode, void *arg)
+{
+	const tracer *self = static_cast<const tracer*> (arg);
+
+	__D_ASSERT(self != NULL);
+	if ( unlikely(self == NULL) )
+		return false;
+
+	return self->apply_filters(nm, mode);
+}
+
+
+/**
+ * @brief Check if the registered filters exclude a function from the trace
+ *
+ * @param[in] addr the function address
+ *
+ * @returns true if the function is filtered out, false otherwise
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	The filters are applied to all the loaded symbols whenever a filter is
+ *	registered or unregistered, and the verdict is stored next to each symbol,
+ *	so no filter expression is matched here. The verdict for each function is
+ *	also cached, tagged with the generation of the filter set, so after the
+ *	first call it costs a single lock-free cache probe. Changing the filter set
+ *	starts a new generation, invalidating all the cached verdicts. If no filter
+ *	is registered, the cache is not probed at all
+ */
+bool tracer::filtered(mem_addr_t addr)
+{
+	if ( likely(load_acquire(m_filters_sz) == 0) )
+		return false;
+
+	u32 gen = load_acquire(m_generation), verdict;
+	if ( likely(m_verdicts->lookup(addr, verdict) && (verdict >> 1) == gen) )
+		return verdict & 1;
+
+	/* If an exception occurs, unlock and rethrow it */
+	try {
+		util::lock();
+
+		/* The cache writers are serialized with the global lock */
+		bool retval = !m_proc->traced(addr);
+		m_verdicts->add(addr, (gen << 1) | static_cast<u32> (retval));
+		util::unlock();
+		return retval;
+	}
+
+	catch (...) {
+		util::unlock();
+		throw;
+	}
+}
+#endif
+
+
+#if defined CSDBG_WITH_PROFILER || defined CSDBG_WITH_SAMPLER
+/**
+ * @brief Resolve the name of a profiled function (profile::resolve callback)
+ *
+ * @param[in] addr the function address
+ *
+ * @param[in] arg the process that the function belongs to
+ *
+ * @returns the function name or NULL if the address was not resolved
+ *
+ * @throws std::bad_alloc
+ */
+const i8* tracer::symbol_name(mem_addr_t addr, void *arg)
+{
+	return static_cast<process*> (arg)->lookup(addr);
+}
+#endif
+
+
+#ifdef CSDBG_WITH_PROFILER
+/**
+ * @brief
+ *	Produce a report of the function call statistics of all the instrumented
+ *	threads (running and exited), sorted by exclusive time
+ *
+ * @param[out] dst the destination string (or stream)
+ *
+ * @param[in] max the maximum number of reported functions (0 for all)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+const tracer& tracer::report(string &dst, u32 max) const
+{
+	profile *prof = m_proc->collect_profile();
+	try {
+		prof->resolve(symbol_name, m_proc);
+		prof->sort();
+		prof->report(dst, max);
+
+		delete prof;
+		return *this;
+	}
+
+	catch (...) {
+		delete prof;
+		throw;
+	}
+}
+#endif
+
+
+#ifdef CSDBG_WITH_HISTOGRAM
+/**
+ * @brief
+ *	Get a latency percentile of an instrumented function, over all the
+ *	instrumented threads (running and exited)
+ *
+ * @param[in] addr the function address
+ *
+ * @param[in] p the percentile (0 to 100, e.g 99.9)
+ *
+ * @returns
+ *	the latency (nsec) that p percent of the calls did not exceed or 0 if the
+ *	function was never called
+ *
+ * @throws std::bad_alloc
+ */
+u64 tracer::percentile(mem_addr_t addr, f64 p) const
+{
+	profile *prof = m_proc->collect_profile();
+	i32 i = prof->find(addr);
+	u64 retval = (likely(i >= 0)) ? prof->percentile(i, p) : 0;
+
+	delete prof;
+	return retval;
+}
+
+
+/**
+ * @brief
+ *	Get a latency percentile of an instrumented function, over all the
+ *	instrumented threads (running and exited)
+ *
+ * @param[in] nm the function name (as reported in the stack traces)
+ *
+ * @param[in] p the percentile (0 to 100, e.g 99.9)
+ *
+ * @returns
+ *	the latency (nsec) that p percent of the calls did not exceed or 0 if the
+ *	function was never called
+ *
+ * @throws std::bad_alloc
+ */
+u64 tracer::percentile(const i8 *nm, f64 p) const
+{
+	profile *prof = m_proc->collect_profile();
+	try {
+		prof->resolve(symbol_name, m_proc);
+		i32 i = prof->find(nm);
+		u64 retval = (likely(i >= 0)) ? prof->percentile(i, p) : 0;
+
+		delete prof;
+		return retval;
+	}
+
+	catch (...) {
+		delete prof;
+		throw;
+	}
+}
+
+
+/**
+ * @brief
+ *	Produce a latency report (percentiles) of all the instrumented threads
+ *	(running and exited), sorted by 99th percentile latency
+ *
+ * @param[out] dst the destination string (or stream)
+ *
+ * @param[in] max the maximum number of reported functions (0 for all)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ */
+const tracer& tracer::latencies(string &dst, u32 max) const
+{
+	profile *prof = m_proc->collect_profile();
+	try {
+		prof->resolve(symbol_name, m_proc);
+		prof->sort(true);
+		prof->latencies(dst, max);
+
+		delete prof;
+		return *this;
+	}
+
+	catch (...) {
+		delete prof;
+		throw;
+	}
+}
+#endif
+
+
+#if defined CSDBG_WITH_FLAMEGRAPH || defined CSDBG_WITH_SAMPLER
+/**
+ * @brief
+ *	Produce a folded stack report (the flame graph tools input) of all the
+ *	instrumented threads (running and exited)
+ *
+ * @param[out] dst the destination string (or stream)
+ *
+ * @param[in] sampled
+ *	true to report the call stack samples taken with tracer::sample (the path
+ *	weights are sample counts), false to report the exact exclusive time spent
+ *	in each call path (the path weights are in nsec)
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @see calltree::fold
+ */
+const tracer& tracer::flamegraph(string &dst, bool sampled) const
+{
+	calltree *tree = m_proc->collect_calltree(sampled);
+	try {
+		tree->fold(dst, symbol_name, m_proc);
+
+		delete tree;
+		return *this;
+	}
+
+	catch (...) {
+		delete tree;
+		throw;
+	}
+}
+
+
+/**
+ * @brief
+ *	Take a sample of the simulated call stack of each instrumented thread, to
+ *	be reported with tracer::flamegraph
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	Call it periodically (e.g from a timer thread) to profile the instrumented
+ *	threads statistically. An hour of sampling takes only as much memory as the
+ *	number of distinct call paths requires
+ */
+tracer& tracer::sample()
+{
+	m_proc->sample();
+	return *this;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_SAMPLER
+/**
+ * @brief
+ *	Attach the current thread to the sampling profiler (if it is enabled with
+ *	the CSDBG_SAMPLER shell variable), to sample its simulated call stack every
+ *	sampling period of its CPU time
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ *
+ * @note
+ *	The instrumentation functions call it upon each function call, an attached
+ *	thread returns at once, without any locking
+ *
+ * @see csdbg::sampler
+ */
+tracer& tracer::sample_thread()
+{
+	if ( likely(m_sampler != NULL) )
+		m_sampler->attach();
+
+	return *this;
+}
+#endif
+
+
+#ifdef CSDBG_WITH_EVENT_TRACE
+/**
+ * @brief Append an instrumentation event to the binary event trace
+ *
+ * @param[in] this_fn the address of the called (or returning) function
+ *
+ * @param[in] call_site the call site (or the return address)
+ *
+ * @param[in] entered true for a function call, false for a function return
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	If no event trace is recorded (the CSDBG_TRACE shell variable was not set
+ *	when the library was loaded), this method does nothing
+ */
+tracer& tracer::record_event(void *this_fn, void *call_site, bool entered)
+{
+	if ( likely(m_recorder == NULL) )
+		return *this;
+
+	m_recorder->record(reinterpret_cast<mem_addr_t> (this_fn),
+										 reinterpret_cast<mem_addr_t> (call_site),
+										 (entered) ? g_event_call : g_event_return);
+
+	return *this;
+}
+#endif
+
+#ifdef CSDBG_WITH_TIMELINE
+/**
+ * @brief Append an instrumentation event to the exported timeline
+ *
+ * @param[in] this_fn the address of the called (or returning) function
+ *
+ * @param[in] entered true for a function call, false for a function return
+ *
+ * @returns *this
+ *
+ * @throws std::bad_alloc
+ * @throws csdbg::exception
+ *
+ * @note
+ *	If no timeline is exported (the CSDBG_TIMELINE shell variable was not set
+ *	when the library was loaded), this method does nothing. No lock is held,
+ *	the event is appended to the ring of the current thread and it is formatted
+ *	by the writer thread of the exporter
+ */
+tracer& tracer::export_event(void *this_fn, bool entered)
+{
+	if ( likely(m_exporter == NULL) )
+		return *this;
+
+	m_exporter->record(reinterpret_cast<mem_addr_t> (this_fn), 0,
+										 (entered) ? g_event_call : g_event_return);
+
+	return *this;
 }
 #endif
 }
@@ -46,6 +46,50 @@ void util::on_lib_unload()
 }
 
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+/**
+ * @brief Find the GNU build id in the contents of an ELF note segment
+ *
+ * @param[in] notes the segment contents
+ *
+ * @param[in] sz the segment size
+ *
+ * @param[out] dst the build id buffer
+ *
+ * @param[in] max the buffer size
+ *
+ * @returns the build id size, 0 if it is not found (or doesn't fit in dst)
+ */
+u32 util::note_build_id(const u8 *notes, u32 sz, u8 *dst, u32 max)
+{
+	/* Each note is a header, followed by its name and descriptor (aligned) */
+	u32 offset = 0;
+	while ( likely(offset + sizeof(ElfW(Nhdr)) <= sz) ) {
+		const ElfW(Nhdr) *note;
+		note = reinterpret_cast<const ElfW(Nhdr)*> (notes + offset);
+
+		u32 name = offset + sizeof(ElfW(Nhdr));
+		u32 desc = name + ((note->n_namesz + 3) & ~3U);
+		offset = desc + ((note->n_descsz + 3) & ~3U);
+		if ( unlikely(offset > sz || offset < desc) )
+			break;
+
+		if (note->n_type != NT_GNU_BUILD_ID || note->n_namesz != 4 ||
+				memcmp(notes + name, "GNU", 4) != 0)
+			continue;
+
+		if ( unlikely(note->n_descsz > max) )
+			return 0;
+
+		memcpy(dst, notes + desc, note->n_descsz);
+		return note->n_descsz;
+	}
+
+	return 0;
+}
+#endif
+
+
 /**
  * @brief Get the library version numbers
  *
@@ -150,7 +194,7 @@ chain<string>* util::getenv(const i8 *var)
 
 			/* New token */
 			else if ( likely(token->length() > 0) ) {
-				retval->add(token);
+				retval->append(token);
 				token = NULL;
 				token = new string;
 			}
@@ -158,7 +202,7 @@ chain<string>* util::getenv(const i8 *var)
 
 		/* Final token */
 		if ( likely(token->length() > 0) )
-			retval->add(token);
+			retval->append(token);
 		else
 			delete token;
 
@@ -215,8 +259,9 @@ void util::init(i32 &argc, i8 **argv)
 		if ( unlikely(m_config->size() > 0) )
 			util::dbg_info("libcsdbg runtime configuration:");
 
-		for (u32 i = 0, sz = m_config->size(); likely(i < sz); i++)
-			util::dbg_info("  arg %d: --csdbg-(%s)", i, m_config->at(i)->cstr());
+		chain<string>::iterator it = m_config->head();
+		for (; likely(it.valid()); it.next())
+			util::dbg_info("  arg %d: --csdbg-(%s)", it.index(), it.data()->cstr());
 #endif
 
 		return;
@@ -409,6 +454,19 @@ void util::unlock()
 }
 
 
+/**
+ * @brief Get a monotonic timestamp
+ *
+ * @returns the time elapsed since an unspecified starting point (nsec)
+ */
+u64 util::timestamp()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<u64> (ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+
 /**
  * @brief Check if a file is a regular one
  *
@@ -473,6 +531,100 @@ bool util::is_writable(const fileinfo_t &inf)
 }
 
 
+#ifdef CSDBG_WITH_EVENT_TRACE
+/**
+ * @brief Get the GNU build id of a loaded module
+ *
+ * @param[in] dso the module info (as reported by dl_iterate_phdr)
+ *
+ * @param[out] dst the build id buffer
+ *
+ * @param[in] max the buffer size
+ *
+ * @returns the build id size, 0 if the module has none
+ *
+ * @note The note segments are read from the process memory
+ */
+u32 util::build_id(const dl_phdr_info *dso, u8 *dst, u32 max)
+{
+	__D_ASSERT(dso != NULL && dst != NULL);
+	for (u32 i = 0; i < dso->dlpi_phnum; i++) {
+		const ElfW(Phdr) &seg = dso->dlpi_phdr[i];
+		if (seg.p_type != PT_NOTE)
+			continue;
+
+		const u8 *notes;
+		notes = reinterpret_cast<const u8*> (dso->dlpi_addr + seg.p_vaddr);
+
+		u32 sz = note_build_id(notes, seg.p_memsz, dst, max);
+		if (sz > 0)
+			return sz;
+	}
+
+	return 0;
+}
+
+
+/**
+ * @brief Get the GNU build id of an ELF file
+ *
+ * @param[in] path the file path
+ *
+ * @param[out] dst the build id buffer
+ *
+ * @param[in] max the buffer size
+ *
+ * @returns the build id size, 0 if the file has none (or it isn't readable)
+ *
+ * @note Only files of the native ELF class are examined
+ */
+u32 util::build_id(const i8 *path, u8 *dst, u32 max)
+{
+	__D_ASSERT(path != NULL && dst != NULL);
+	i32 fd = open(path, O_RDONLY);
+	if ( unlikely(fd < 0) )
+		return 0;
+
+	ElfW(Ehdr) hdr;
+	u8 cls = (sizeof(ElfW(Addr)) == 8) ? ELFCLASS64 : ELFCLASS32;
+	bool valid = pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+							 memcmp(hdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+							 hdr.e_ident[EI_CLASS] == cls;
+
+	u32 retval = 0;
+	u8 *notes = NULL;
+	try {
+		for (u32 i = 0; valid && retval == 0 && i < hdr.e_phnum; i++) {
+			ElfW(Phdr) seg;
+			off_t offset = hdr.e_phoff + i * sizeof(seg);
+			if ( unlikely(pread(fd, &seg, sizeof(seg), offset) != sizeof(seg)) )
+				break;
+
+			/* Skip the other segments and any insanely large note segment */
+			if (seg.p_type != PT_NOTE || seg.p_filesz > USHRT_MAX)
+				continue;
+
+			notes = new u8[seg.p_filesz];
+			if ( likely(pread(fd, notes, seg.p_filesz, seg.p_offset) ==
+					static_cast<ssize_t> (seg.p_filesz)) )
+				retval = note_build_id(notes, seg.p_filesz, dst, max);
+
+			delete[] notes;
+			notes = NULL;
+		}
+	}
+
+	catch (std::bad_alloc &x) {
+		delete[] notes;
+		retval = 0;
+	}
+
+	close(fd);
+	return retval;
+}
+#endif
+
+
 /**
  * @brief
  *	Compute the size of a printf-style format string expanded with the values of